@@ -743,6 +743,7 @@ static uint32_t kvm_dirty_ring_reap_one(KVMState *s, CPUState *cpu)
         count++;
     }
     cpu->kvm_fetch_index = fetch;
+    cpu->dirty_pages += count;
 
     return count;
 }
@@ -3090,6 +3091,11 @@ int kvm_device_access(int fd, int group, uint64_t attr,
     return err;
 }
 
+bool kvm_dirty_ring_enabled(void)
+{
+    return kvm_state && kvm_state->kvm_dirty_ring_size;
+}
+
 bool kvm_has_sync_mmu(void)
 {
     return kvm_state->sync_mmu;
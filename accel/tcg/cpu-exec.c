@@ -994,7 +994,6 @@ void tcg_exec_realizefn(CPUState *cpu, Error **errp)
         tcg_target_initialized = true;
     }
     tlb_init(cpu);
-    qemu_plugin_vcpu_init_hook(cpu);
 
 #ifndef CONFIG_USER_ONLY
     tcg_iommu_init_notifier_list(cpu);
@@ -19,4 +19,49 @@ void QEMU_NORETURN cpu_io_recompile(CPUState *cpu, uintptr_t retaddr);
 void page_init(void);
 void tb_htable_init(void);
 
+/*
+ * Number of executions after which a TB is retranslated as a trace,
+ * 0 to disable traces.  Set by the "trace-threshold" accelerator property.
+ */
+extern uint32_t tb_trace_threshold;
+
+typedef struct TBTraceStats {
+    /* TBs that reached tb_trace_threshold */
+    size_t hot;
+    /* traces translated */
+    size_t traces;
+    /* guest instructions translated as part of a trace */
+    size_t insns;
+    /* branches followed by the traces */
+    size_t follows;
+    /* side exits generated for conditional branches that were followed */
+    size_t side_exits;
+} TBTraceStats;
+
+extern TBTraceStats tb_trace_stats;
+
+/*
+ * Return a countdown of the executions of @tb, initialized to
+ * tb_trace_threshold, or NULL if the executions of @tb are not counted.
+ */
+int32_t *tb_hot_count_alloc(const TranslationBlock *tb);
+
+#ifdef CONFIG_USER_ONLY
+/*
+ * Emit the ops of @tb from the persistent translation cache, in place of
+ * the front end.  Returns false if the cache has no valid entry for @tb.
+ */
+bool tb_cache_restore(TranslationBlock *tb, int max_insns);
+/* Add the ops just emitted by the front end for @tb to the cache */
+void tb_cache_save(const TranslationBlock *tb);
+#else
+static inline bool tb_cache_restore(TranslationBlock *tb, int max_insns)
+{
+    return false;
+}
+static inline void tb_cache_save(const TranslationBlock *tb)
+{
+}
+#endif
+
 #endif /* ACCEL_TCG_INTERNAL_H */
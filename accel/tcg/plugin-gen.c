@@ -41,6 +41,12 @@
  * optimization to avoid generating redundant operations. For instance, for the
  * second and all subsequent callbacks of an event, we do not need to reload the
  * CPU's index into a TCG temp, since the first callback did it already.
+ *
+ * Inline operations and conditional callbacks work on a uint64_t in the
+ * running vCPU's entry of a scoreboard. Its address is computed at run-time
+ * from CPUState.cpu_index and from the scoreboard's data pointer, which is
+ * loaded rather than embedded so that scoreboards can grow without having
+ * to flush the code cache.
  */
 #include "qemu/osdep.h"
 #include "tcg/tcg.h"
@@ -74,6 +80,7 @@ enum plugin_gen_from {
 enum plugin_gen_cb {
     PLUGIN_GEN_CB_UDATA,
     PLUGIN_GEN_CB_INLINE,
+    PLUGIN_GEN_CB_COND,
     PLUGIN_GEN_CB_MEM,
     PLUGIN_GEN_ENABLE_MEM_HELPER,
     PLUGIN_GEN_DISABLE_MEM_HELPER,
@@ -125,20 +132,63 @@ static void gen_empty_udata_cb(void)
 }
 
 /*
- * For now we only support addi_i64.
- * When we support more ops, we can generate one empty inline cb for each.
+ * Compute the address of the running vCPU's scoreboard entry, i.e.
+ * score->data->data + cpu_index * element_size. The element size and the
+ * address of score->data->data are filled in later. Inline ops on a global
+ * pointer only keep the constant.
+ */
+static TCGv_ptr gen_empty_plugin_u64_ptr(void)
+{
+    TCGv_i32 cpu_index = tcg_temp_new_i32();
+    TCGv_ptr cpu_index_as_ptr = tcg_temp_new_ptr();
+    TCGv_ptr ptr;
+
+    tcg_gen_ld_i32(cpu_index, cpu_env,
+                   -offsetof(ArchCPU, env) + offsetof(CPUState, cpu_index));
+    /* second operand will be replaced by an immediate value */
+    tcg_gen_mul_i32(cpu_index, cpu_index, cpu_index);
+    tcg_gen_ext_i32_ptr(cpu_index_as_ptr, cpu_index);
+
+    ptr = tcg_const_ptr(NULL); /* overwritten later */
+    tcg_gen_ld_ptr(ptr, ptr, 0);
+    tcg_gen_add_ptr(ptr, ptr, cpu_index_as_ptr);
+
+    tcg_temp_free_ptr(cpu_index_as_ptr);
+    tcg_temp_free_i32(cpu_index);
+    return ptr;
+}
+
+/*
+ * Both inline ops share this template: a store only copies the
+ * address computation and the st_i64.
  */
 static void gen_empty_inline_cb(void)
 {
+    TCGv_ptr ptr = gen_empty_plugin_u64_ptr();
     TCGv_i64 val = tcg_temp_new_i64();
-    TCGv_ptr ptr = tcg_const_ptr(NULL); /* overwritten later */
 
     tcg_gen_ld_i64(val, ptr, 0);
-    /* pass an immediate != 0 so that it doesn't get optimized away */
-    tcg_gen_addi_i64(val, val, 0xdeadface);
+    /* second operand will be replaced by an immediate value */
+    tcg_gen_add_i64(val, val, val);
     tcg_gen_st_i64(val, ptr, 0);
+    tcg_temp_free_i64(val);
     tcg_temp_free_ptr(ptr);
+}
+
+static void gen_empty_cond_cb(void)
+{
+    TCGv_ptr ptr = gen_empty_plugin_u64_ptr();
+    TCGv_i64 val = tcg_temp_new_i64();
+    TCGLabel *after_cb = gen_new_label();
+
+    tcg_gen_ld_i64(val, ptr, 0);
+    /* condition and second operand will be replaced later */
+    tcg_gen_brcond_i64(TCG_COND_EQ, val, val, after_cb);
     tcg_temp_free_i64(val);
+    tcg_temp_free_ptr(ptr);
+
+    gen_empty_udata_cb();
+    gen_set_label(after_cb);
 }
 
 static void gen_empty_mem_cb(TCGv addr, uint32_t info)
@@ -196,6 +246,8 @@ static void plugin_gen_empty_callback(enum plugin_gen_from from)
     case PLUGIN_GEN_FROM_TB:
         gen_wrapped(from, PLUGIN_GEN_CB_UDATA, gen_empty_udata_cb);
         gen_wrapped(from, PLUGIN_GEN_CB_INLINE, gen_empty_inline_cb);
+        /* after the inline ops, so that conditions see their updates */
+        gen_wrapped(from, PLUGIN_GEN_CB_COND, gen_empty_cond_cb);
         break;
     default:
         g_assert_not_reached();
@@ -277,6 +329,13 @@ static TCGOp *copy_op(TCGOp **begin_op, TCGOp *op, TCGOpcode opc)
     return op;
 }
 
+/* move past an op of the empty callback that we do not need */
+static void skip_op(TCGOp **begin_op, TCGOpcode opc)
+{
+    *begin_op = QTAILQ_NEXT(*begin_op, link);
+    tcg_debug_assert(*begin_op && (*begin_op)->opc == opc);
+}
+
 static TCGOp *copy_extu_i32_i64(TCGOp **begin_op, TCGOp *op)
 {
     if (TCG_TARGET_REG_BITS == 32) {
@@ -330,29 +389,144 @@ static TCGOp *copy_extu_tl_i64(TCGOp **begin_op, TCGOp *op)
     return op;
 }
 
-static TCGOp *copy_ld_i64(TCGOp **begin_op, TCGOp *op)
+static TCGOp *copy_ld_i64(TCGOp **begin_op, TCGOp *op, intptr_t offset)
 {
     if (TCG_TARGET_REG_BITS == 32) {
         /* 2x ld_i32 */
         op = copy_op(begin_op, op, INDEX_op_ld_i32);
+        op->args[2] += offset;
         op = copy_op(begin_op, op, INDEX_op_ld_i32);
+        op->args[2] += offset;
     } else {
         /* ld_i64 */
         op = copy_op(begin_op, op, INDEX_op_ld_i64);
+        op->args[2] += offset;
     }
     return op;
 }
 
-static TCGOp *copy_st_i64(TCGOp **begin_op, TCGOp *op)
+static void skip_ld_i64(TCGOp **begin_op)
+{
+    if (TCG_TARGET_REG_BITS == 32) {
+        /* 2x ld_i32 */
+        skip_op(begin_op, INDEX_op_ld_i32);
+        skip_op(begin_op, INDEX_op_ld_i32);
+    } else {
+        /* ld_i64 */
+        skip_op(begin_op, INDEX_op_ld_i64);
+    }
+}
+
+static TCGOp *copy_st_i64(TCGOp **begin_op, TCGOp *op, intptr_t offset)
 {
     if (TCG_TARGET_REG_BITS == 32) {
         /* 2x st_i32 */
         op = copy_op(begin_op, op, INDEX_op_st_i32);
+        op->args[2] += offset;
+        op = copy_op(begin_op, op, INDEX_op_st_i32);
+        op->args[2] += offset;
+    } else {
+        /* st_i64 */
+        op = copy_op(begin_op, op, INDEX_op_st_i64);
+        op->args[2] += offset;
+    }
+    return op;
+}
+
+/* as copy_st_i64, but store @v instead of the value computed in the temp */
+static TCGOp *copy_st_imm_i64(TCGOp **begin_op, TCGOp *op, intptr_t offset,
+                              uint64_t v)
+{
+    if (TCG_TARGET_REG_BITS == 32) {
+        /* 2x st_i32, the first one at the lower address */
+#ifdef HOST_WORDS_BIGENDIAN
+        uint32_t lo_addr = v >> 32, hi_addr = v;
+#else
+        uint32_t lo_addr = v, hi_addr = v >> 32;
+#endif
+        op = copy_op(begin_op, op, INDEX_op_st_i32);
+        op->args[0] = tcgv_i32_arg(tcg_constant_i32(lo_addr));
+        op->args[2] += offset;
         op = copy_op(begin_op, op, INDEX_op_st_i32);
+        op->args[0] = tcgv_i32_arg(tcg_constant_i32(hi_addr));
+        op->args[2] += offset;
     } else {
         /* st_i64 */
         op = copy_op(begin_op, op, INDEX_op_st_i64);
+        op->args[0] = tcgv_i64_arg(tcg_constant_i64(v));
+        op->args[2] += offset;
+    }
+    return op;
+}
+
+static TCGOp *copy_mul_i32(TCGOp **begin_op, TCGOp *op, uint32_t v)
+{
+    op = copy_op(begin_op, op, INDEX_op_mul_i32);
+    op->args[2] = tcgv_i32_arg(tcg_constant_i32(v));
+    return op;
+}
+
+static TCGOp *copy_ext_i32_ptr(TCGOp **begin_op, TCGOp *op)
+{
+    if (UINTPTR_MAX == UINT32_MAX) {
+        /* mov_i32 */
+        op = copy_op(begin_op, op, INDEX_op_mov_i32);
+    } else {
+        /* ext_i32_i64 */
+        op = copy_op(begin_op, op, INDEX_op_ext_i32_i64);
+    }
+    return op;
+}
+
+static TCGOp *copy_ld_ptr(TCGOp **begin_op, TCGOp *op)
+{
+    if (UINTPTR_MAX == UINT32_MAX) {
+        /* ld_i32 */
+        op = copy_op(begin_op, op, INDEX_op_ld_i32);
+    } else {
+        /* ld_i64 */
+        op = copy_op(begin_op, op, INDEX_op_ld_i64);
+    }
+    return op;
+}
+
+static TCGOp *copy_add_ptr(TCGOp **begin_op, TCGOp *op)
+{
+    if (UINTPTR_MAX == UINT32_MAX) {
+        /* add_i32 */
+        op = copy_op(begin_op, op, INDEX_op_add_i32);
+    } else {
+        /* add_i64 */
+        op = copy_op(begin_op, op, INDEX_op_add_i64);
+    }
+    return op;
+}
+
+static TCGOp *copy_brcondi_i64(TCGOp **begin_op, TCGOp *op, TCGCond cond,
+                               uint64_t v, TCGLabel *l)
+{
+    if (TCG_TARGET_REG_BITS == 32) {
+        /* brcond2_i32 */
+        op = copy_op(begin_op, op, INDEX_op_brcond2_i32);
+        op->args[2] = tcgv_i32_arg(tcg_constant_i32(v));
+        op->args[3] = tcgv_i32_arg(tcg_constant_i32(v >> 32));
+        op->args[4] = cond;
+        op->args[5] = label_arg(l);
+    } else {
+        /* brcond_i64 */
+        op = copy_op(begin_op, op, INDEX_op_brcond_i64);
+        op->args[1] = tcgv_i64_arg(tcg_constant_i64(v));
+        op->args[2] = cond;
+        op->args[3] = label_arg(l);
     }
+    l->refs++;
+    return op;
+}
+
+static TCGOp *copy_set_label(TCGOp **begin_op, TCGOp *op, TCGLabel *l)
+{
+    op = copy_op(begin_op, op, INDEX_op_set_label);
+    op->args[0] = label_arg(l);
     return op;
 }
 
@@ -371,6 +545,56 @@ static TCGOp *copy_add_i64(TCGOp **begin_op, TCGOp *op, uint64_t v)
     return op;
 }
 
+static void skip_add_i64(TCGOp **begin_op)
+{
+    if (TCG_TARGET_REG_BITS == 32) {
+        skip_op(begin_op, INDEX_op_add2_i32);
+    } else {
+        skip_op(begin_op, INDEX_op_add_i64);
+    }
+}
+
+/*
+ * Copy the computation of the address of @entry for the running vCPU.
+ * Without a scoreboard, the address is the global pointer @ptr.
+ */
+static TCGOp *copy_plugin_u64_ptr(TCGOp **begin_op, TCGOp *op,
+                                  qemu_plugin_u64 entry, void *ptr)
+{
+    GArray *data;
+
+    if (!entry.score) {
+        skip_op(begin_op, INDEX_op_ld_i32);
+        skip_op(begin_op, INDEX_op_mul_i32);
+        skip_op(begin_op, UINTPTR_MAX == UINT32_MAX ?
+                          INDEX_op_mov_i32 : INDEX_op_ext_i32_i64);
+        op = copy_const_ptr(begin_op, op, ptr);
+        skip_op(begin_op, UINTPTR_MAX == UINT32_MAX ?
+                          INDEX_op_ld_i32 : INDEX_op_ld_i64);
+        skip_op(begin_op, UINTPTR_MAX == UINT32_MAX ?
+                          INDEX_op_add_i32 : INDEX_op_add_i64);
+        return op;
+    }
+
+    data = entry.score->data;
+
+    /* ld_i32 cpu_index */
+    op = copy_op(begin_op, op, INDEX_op_ld_i32);
+
+    /* cpu_index * element size, as a pointer-sized offset */
+    op = copy_mul_i32(begin_op, op, g_array_get_element_size(data));
+    op = copy_ext_i32_ptr(begin_op, op);
+
+    /* load the current address of the scoreboard's entries */
+    op = copy_const_ptr(begin_op, op, &data->data);
+    op = copy_ld_ptr(begin_op, op);
+
+    /* add_ptr */
+    op = copy_add_ptr(begin_op, op);
+
+    return op;
+}
+
 static TCGOp *copy_st_ptr(TCGOp **begin_op, TCGOp *op)
 {
     if (UINTPTR_MAX == UINT32_MAX) {
@@ -422,42 +646,109 @@ static TCGOp *copy_call(TCGOp **begin_op, TCGOp *op, void *empty_func,
  * empty callbacks. This will assert very quickly in a debug build as
  * we assert the ops we are replacing are the correct ones.
  */
-static TCGOp *append_udata_cb(const struct qemu_plugin_dyn_cb *cb,
-                              TCGOp *begin_op, TCGOp *op, int *cb_idx)
+static TCGOp *copy_udata_cb(const struct qemu_plugin_dyn_cb *cb,
+                            TCGOp **begin_op, TCGOp *op, int *cb_idx)
 {
     /* const_ptr */
-    op = copy_const_ptr(&begin_op, op, cb->userp);
+    op = copy_const_ptr(begin_op, op, cb->userp);
 
     /* copy the ld_i32, but note that we only have to copy it once */
-    begin_op = QTAILQ_NEXT(begin_op, link);
-    tcg_debug_assert(begin_op && begin_op->opc == INDEX_op_ld_i32);
+    *begin_op = QTAILQ_NEXT(*begin_op, link);
+    tcg_debug_assert(*begin_op && (*begin_op)->opc == INDEX_op_ld_i32);
     if (*cb_idx == -1) {
         op = tcg_op_insert_after(tcg_ctx, op, INDEX_op_ld_i32);
-        memcpy(op->args, begin_op->args, sizeof(op->args));
+        memcpy(op->args, (*begin_op)->args, sizeof(op->args));
     }
 
     /* call */
-    op = copy_call(&begin_op, op, HELPER(plugin_vcpu_udata_cb),
+    op = copy_call(begin_op, op, HELPER(plugin_vcpu_udata_cb),
                    cb->f.vcpu_udata, cb_idx);
 
     return op;
 }
 
+static TCGOp *append_udata_cb(const struct qemu_plugin_dyn_cb *cb,
+                              TCGOp *begin_op, TCGOp *op, int *cb_idx)
+{
+    return copy_udata_cb(cb, &begin_op, op, cb_idx);
+}
+
 static TCGOp *append_inline_cb(const struct qemu_plugin_dyn_cb *cb,
                                TCGOp *begin_op, TCGOp *op,
                                int *unused)
 {
-    /* const_ptr */
-    op = copy_const_ptr(&begin_op, op, cb->userp);
+    qemu_plugin_u64 entry = cb->inline_insn.entry;
+
+    op = copy_plugin_u64_ptr(&begin_op, op, entry, cb->userp);
+
+    switch (cb->inline_insn.op) {
+    case QEMU_PLUGIN_INLINE_ADD_U64:
+        /* ld_i64 */
+        op = copy_ld_i64(&begin_op, op, entry.offset);
+
+        /* add_i64 */
+        op = copy_add_i64(&begin_op, op, cb->inline_insn.imm);
+
+        /* st_i64 */
+        op = copy_st_i64(&begin_op, op, entry.offset);
+        break;
+    case QEMU_PLUGIN_INLINE_STORE_U64:
+        skip_ld_i64(&begin_op);
+        skip_add_i64(&begin_op);
+
+        /* st_i64 of the immediate */
+        op = copy_st_imm_i64(&begin_op, op, entry.offset,
+                             cb->inline_insn.imm);
+        break;
+    default:
+        g_assert_not_reached();
+    }
+
+    return op;
+}
+
+static TCGCond plugin_cond_to_tcgcond(enum qemu_plugin_cond cond)
+{
+    switch (cond) {
+    case QEMU_PLUGIN_COND_EQ:
+        return TCG_COND_EQ;
+    case QEMU_PLUGIN_COND_NE:
+        return TCG_COND_NE;
+    case QEMU_PLUGIN_COND_LT:
+        return TCG_COND_LTU;
+    case QEMU_PLUGIN_COND_LE:
+        return TCG_COND_LEU;
+    case QEMU_PLUGIN_COND_GT:
+        return TCG_COND_GTU;
+    case QEMU_PLUGIN_COND_GE:
+        return TCG_COND_GEU;
+    default:
+        /* ALWAYS and NEVER are dealt with at registration time */
+        g_assert_not_reached();
+    }
+}
+
+static TCGOp *append_cond_cb(const struct qemu_plugin_dyn_cb *cb,
+                             TCGOp *begin_op, TCGOp *op, int *cb_idx)
+{
+    TCGCond cond = plugin_cond_to_tcgcond(cb->cond.cond);
+    TCGLabel *after_cb = gen_new_label();
+    /* temps are not preserved across the branch, so always reload cpu_index */
+    int call_idx = -1;
+
+    op = copy_plugin_u64_ptr(&begin_op, op, cb->cond.entry, NULL);
 
     /* ld_i64 */
-    op = copy_ld_i64(&begin_op, op);
+    op = copy_ld_i64(&begin_op, op, cb->cond.entry.offset);
 
-    /* add_i64 */
-    op = copy_add_i64(&begin_op, op, cb->inline_insn.imm);
+    /* skip the call unless the condition holds */
+    op = copy_brcondi_i64(&begin_op, op, tcg_invert_cond(cond),
+                          cb->cond.imm, after_cb);
 
-    /* st_i64 */
-    op = copy_st_i64(&begin_op, op);
+    op = copy_udata_cb(cb, &begin_op, op, &call_idx);
+
+    /* set_label */
+    op = copy_set_label(&begin_op, op, after_cb);
 
     return op;
 }
@@ -512,6 +803,18 @@ static bool op_rw(const TCGOp *op, const struct qemu_plugin_dyn_cb *cb)
     return !!(cb->rw & (w + 1));
 }
 
+/* regular callbacks are split between the udata and the cond templates */
+static bool op_cond_always(const TCGOp *op,
+                           const struct qemu_plugin_dyn_cb *cb)
+{
+    return cb->cond.cond == QEMU_PLUGIN_COND_ALWAYS;
+}
+
+static bool op_cond(const TCGOp *op, const struct qemu_plugin_dyn_cb *cb)
+{
+    return cb->cond.cond != QEMU_PLUGIN_COND_ALWAYS;
+}
+
 static void inject_cb_type(const GArray *cbs, TCGOp *begin_op,
                            inject_fn inject, op_ok_fn ok)
 {
@@ -544,7 +847,13 @@ static void inject_cb_type(const GArray *cbs, TCGOp *begin_op,
 static void
 inject_udata_cb(const GArray *cbs, TCGOp *begin_op)
 {
-    inject_cb_type(cbs, begin_op, append_udata_cb, op_ok);
+    inject_cb_type(cbs, begin_op, append_udata_cb, op_cond_always);
+}
+
+static void
+inject_cond_cb(const GArray *cbs, TCGOp *begin_op)
+{
+    inject_cb_type(cbs, begin_op, append_cond_cb, op_cond);
 }
 
 static void
@@ -660,6 +969,12 @@ static void plugin_gen_tb_inline(const struct qemu_plugin_tb *ptb,
     inject_inline_cb(ptb->cbs[PLUGIN_CB_INLINE], begin_op, op_ok);
 }
 
+static void plugin_gen_tb_cond(const struct qemu_plugin_tb *ptb,
+                               TCGOp *begin_op)
+{
+    inject_cond_cb(ptb->cbs[PLUGIN_CB_REGULAR], begin_op);
+}
+
 static void plugin_gen_insn_udata(const struct qemu_plugin_tb *ptb,
                                   TCGOp *begin_op, int insn_idx)
 {
@@ -676,6 +991,13 @@ static void plugin_gen_insn_inline(const struct qemu_plugin_tb *ptb,
                      begin_op, op_ok);
 }
 
+static void plugin_gen_insn_cond(const struct qemu_plugin_tb *ptb,
+                                 TCGOp *begin_op, int insn_idx)
+{
+    struct qemu_plugin_insn *insn = g_ptr_array_index(ptb->insns, insn_idx);
+    inject_cond_cb(insn->cbs[PLUGIN_CB_INSN][PLUGIN_CB_REGULAR], begin_op);
+}
+
 static void plugin_gen_mem_regular(const struct qemu_plugin_tb *ptb,
                                    TCGOp *begin_op, int insn_idx)
 {
@@ -722,6 +1044,9 @@ static void plugin_inject_cb(const struct qemu_plugin_tb *ptb, TCGOp *begin_op,
         case PLUGIN_GEN_CB_INLINE:
             plugin_gen_tb_inline(ptb, begin_op);
             return;
+        case PLUGIN_GEN_CB_COND:
+            plugin_gen_tb_cond(ptb, begin_op);
+            return;
         default:
             g_assert_not_reached();
         }
@@ -733,6 +1058,9 @@ static void plugin_inject_cb(const struct qemu_plugin_tb *ptb, TCGOp *begin_op,
         case PLUGIN_GEN_CB_INLINE:
             plugin_gen_insn_inline(ptb, begin_op, insn_idx);
             return;
+        case PLUGIN_GEN_CB_COND:
+            plugin_gen_insn_cond(ptb, begin_op, insn_idx);
+            return;
         case PLUGIN_GEN_ENABLE_MEM_HELPER:
             plugin_gen_enable_mem_helper(ptb, begin_op, insn_idx);
             return;
@@ -798,6 +1126,9 @@ static void pr_ops(void)
             case PLUGIN_GEN_CB_INLINE:
                 type = "inline";
                 break;
+            case PLUGIN_GEN_CB_COND:
+                type = "cond";
+                break;
             case PLUGIN_GEN_CB_MEM:
                 type = "mem";
                 break;
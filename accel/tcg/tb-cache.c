@@ -0,0 +1,440 @@
+/*
+ * Persistent translation cache for user mode emulation
+ *
+ * The ops emitted by the front end for the TBs of executable file
+ * mappings are saved, per mapped file, in a cache directory.  Later runs
+ * that map the same file restore them instead of running the front end.
+ *
+ * Saved ops contain absolute guest addresses, so an entry is only used
+ * by a TB with the same pc, flags and cflags, and only if the guest code
+ * it was translated from is unchanged.  A cache file is discarded when
+ * the mapped file or the QEMU binary changes.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/error-report.h"
+#include "qemu/xxhash.h"
+#include "exec/exec-all.h"
+#include "exec/cpu_ldst.h"
+#include "exec/tb-cache.h"
+#include "tcg/tcg.h"
+#include "internal.h"
+
+#define TB_CACHE_MAGIC "QEMUTBC2"
+
+typedef struct TBCacheIdentity {
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t size;
+    uint64_t mtime_sec;
+    uint64_t mtime_nsec;
+} TBCacheIdentity;
+
+typedef struct TBCacheHeader {
+    char magic[8];
+    /* the QEMU binary that wrote the file */
+    TBCacheIdentity exe;
+    /* the mapped file */
+    TBCacheIdentity file;
+    uint32_t nb_entries;
+    uint32_t reserved;
+} TBCacheHeader;
+
+typedef struct TBCacheKey {
+    uint64_t pc;
+    uint64_t cs_base;
+    uint32_t flags;
+    uint32_t cflags;
+    uint32_t trace_vcpu_dstate;
+    /* a trace spans several blocks, see translator_trace_follow() */
+    uint32_t trace;
+} TBCacheKey;
+
+/* Same layout in memory and in the cache files */
+typedef struct TBCacheEntry {
+    TBCacheKey key;
+    /* guest code bytes */
+    uint16_t size;
+    uint16_t icount;
+    /* bytes of ops saved by tcg_ir_save() */
+    uint32_t ir_len;
+    /* the guest code, followed by the ops */
+    uint8_t data[];
+} TBCacheEntry;
+
+typedef struct TBCacheFile {
+    char *path;
+    TBCacheIdentity id;
+    GHashTable *entries;
+    /* entries were added since the file was read */
+    bool dirty;
+} TBCacheFile;
+
+typedef struct TBCacheMap {
+    target_ulong start;
+    target_ulong end;
+    TBCacheFile *file;
+} TBCacheMap;
+
+/* Protected by mmap_lock */
+static struct {
+    char *dir;
+    char *config;
+    TBCacheIdentity exe;
+    /* cache file path -> TBCacheFile */
+    GHashTable *files;
+    GArray *maps;
+    GByteArray *buf;
+    bool stats;
+
+    /* translations in a cached mapping */
+    uint64_t lookups;
+    /* translations restored from the cache */
+    uint64_t hits;
+    /* entries not used because the guest code changed */
+    uint64_t stale;
+    /* entries added */
+    uint64_t saved;
+} tb_cache;
+
+static guint tb_cache_key_hash(gconstpointer p)
+{
+    const TBCacheKey *k = p;
+
+    return qemu_xxhash7(k->pc, k->cs_base, k->flags, k->cflags,
+                        k->trace_vcpu_dstate ^ k->trace);
+}
+
+static gboolean tb_cache_key_equal(gconstpointer a, gconstpointer b)
+{
+    return !memcmp(a, b, sizeof(TBCacheKey));
+}
+
+static void tb_cache_key_init(TBCacheKey *k, const TranslationBlock *tb)
+{
+    memset(k, 0, sizeof(*k));
+    k->pc = tb->pc;
+    k->cs_base = tb->cs_base;
+    k->flags = tb->flags;
+    k->cflags = tb->cflags;
+    k->trace_vcpu_dstate = tb->trace_vcpu_dstate;
+    k->trace = tb->trace;
+}
+
+static size_t tb_cache_entry_len(const TBCacheEntry *e)
+{
+    return sizeof(*e) + e->size + e->ir_len;
+}
+
+static void tb_cache_identity(TBCacheIdentity *id, const struct stat *st)
+{
+    memset(id, 0, sizeof(*id));
+    id->dev = st->st_dev;
+    id->ino = st->st_ino;
+    id->size = st->st_size;
+    id->mtime_sec = st->st_mtim.tv_sec;
+    id->mtime_nsec = st->st_mtim.tv_nsec;
+}
+
+/*
+ * Add the entries of the cache file at @path to @entries, unless they
+ * were written by another QEMU binary or for another version of the
+ * mapped file.  Entries already in @entries are kept.
+ */
+static void tb_cache_read(const char *path, const TBCacheIdentity *id,
+                          GHashTable *entries)
+{
+    g_autofree gchar *contents = NULL;
+    const TBCacheHeader *hdr;
+    gsize len, pos;
+    uint32_t i;
+
+    if (!g_file_get_contents(path, &contents, &len, NULL)) {
+        return;
+    }
+
+    hdr = (const TBCacheHeader *)contents;
+    if (len < sizeof(*hdr) ||
+        memcmp(hdr->magic, TB_CACHE_MAGIC, sizeof(hdr->magic)) ||
+        memcmp(&hdr->exe, &tb_cache.exe, sizeof(hdr->exe)) ||
+        memcmp(&hdr->file, id, sizeof(hdr->file))) {
+        return;
+    }
+
+    pos = sizeof(*hdr);
+    for (i = 0; i < hdr->nb_entries; i++) {
+        TBCacheEntry e;
+
+        if (len - pos < sizeof(e)) {
+            break;
+        }
+        memcpy(&e, contents + pos, sizeof(e));
+        if (len - pos < tb_cache_entry_len(&e)) {
+            break;
+        }
+        if (!g_hash_table_contains(entries, &e.key)) {
+            TBCacheEntry *n = g_memdup(contents + pos, tb_cache_entry_len(&e));
+
+            g_hash_table_insert(entries, &n->key, n);
+        }
+        pos += tb_cache_entry_len(&e);
+    }
+}
+
+static void tb_cache_write(TBCacheFile *file)
+{
+    g_autoptr(GByteArray) out = g_byte_array_new();
+    TBCacheHeader hdr = {};
+    GHashTableIter iter;
+    TBCacheEntry *e;
+
+    /* Keep what other processes added since the file was read */
+    tb_cache_read(file->path, &file->id, file->entries);
+
+    memcpy(hdr.magic, TB_CACHE_MAGIC, sizeof(hdr.magic));
+    hdr.exe = tb_cache.exe;
+    hdr.file = file->id;
+    hdr.nb_entries = g_hash_table_size(file->entries);
+    g_byte_array_append(out, (uint8_t *)&hdr, sizeof(hdr));
+
+    g_hash_table_iter_init(&iter, file->entries);
+    while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&e)) {
+        g_byte_array_append(out, (uint8_t *)e, tb_cache_entry_len(e));
+    }
+
+    /* written to a temporary file and renamed */
+    g_file_set_contents(file->path, (gchar *)out->data, out->len, NULL);
+    file->dirty = false;
+}
+
+static TBCacheMap *tb_cache_find_map(target_ulong pc)
+{
+    guint i;
+
+    for (i = 0; i < tb_cache.maps->len; i++) {
+        TBCacheMap *m = &g_array_index(tb_cache.maps, TBCacheMap, i);
+
+        if (pc >= m->start && pc < m->end) {
+            return m;
+        }
+    }
+    return NULL;
+}
+
+void tb_cache_init(const char *dir, const char *config)
+{
+    struct stat st;
+
+    if (g_mkdir_with_parents(dir, 0700) < 0) {
+        warn_report("tb cache: cannot create %s: %s", dir, strerror(errno));
+        return;
+    }
+    if (stat("/proc/self/exe", &st) < 0) {
+        warn_report("tb cache: cannot identify the QEMU binary: %s",
+                    strerror(errno));
+        return;
+    }
+
+    tb_cache.dir = g_strdup(dir);
+    tb_cache.config = g_strdup(config ? config : "");
+    tb_cache_identity(&tb_cache.exe, &st);
+    tb_cache.files = g_hash_table_new(g_str_hash, g_str_equal);
+    tb_cache.maps = g_array_new(false, false, sizeof(TBCacheMap));
+    tb_cache.buf = g_byte_array_new();
+}
+
+void tb_cache_enable_stats(void)
+{
+    tb_cache.stats = true;
+}
+
+void tb_cache_map(target_ulong start, target_ulong len, int fd)
+{
+    g_autofree char *fd_path = NULL;
+    g_autofree char *src = NULL;
+    g_autofree char *name = NULL;
+    g_autofree char *digest = NULL;
+    g_autofree char *path = NULL;
+    TBCacheIdentity id;
+    TBCacheFile *file;
+    TBCacheMap m;
+    struct stat st;
+
+    if (!tb_cache.dir) {
+        return;
+    }
+    tb_cache_unmap(start, len);
+
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+        return;
+    }
+    fd_path = g_strdup_printf("/proc/self/fd/%d", fd);
+    src = g_file_read_link(fd_path, NULL);
+    if (!src) {
+        return;
+    }
+    tb_cache_identity(&id, &st);
+
+    /* The same file translated for another target or CPU is another file */
+    name = g_strdup_printf("%s\n%s\n%s", TARGET_NAME, tb_cache.config, src);
+    digest = g_compute_checksum_for_string(G_CHECKSUM_SHA256, name, -1);
+    path = g_strdup_printf("%s/%s.tbc", tb_cache.dir, digest);
+
+    file = g_hash_table_lookup(tb_cache.files, path);
+    if (!file) {
+        file = g_new0(TBCacheFile, 1);
+        file->path = g_steal_pointer(&path);
+        file->id = id;
+        file->entries = g_hash_table_new_full(tb_cache_key_hash,
+                                              tb_cache_key_equal,
+                                              NULL, g_free);
+        tb_cache_read(file->path, &file->id, file->entries);
+        g_hash_table_insert(tb_cache.files, file->path, file);
+    } else if (memcmp(&file->id, &id, sizeof(id))) {
+        /* the file was replaced while we were running */
+        file->id = id;
+        g_hash_table_remove_all(file->entries);
+        file->dirty = true;
+    }
+
+    m.start = start;
+    m.end = start + len;
+    m.file = file;
+    g_array_append_val(tb_cache.maps, m);
+}
+
+void tb_cache_unmap(target_ulong start, target_ulong len)
+{
+    target_ulong end = start + len;
+    guint i = 0;
+
+    if (!tb_cache.dir) {
+        return;
+    }
+
+    while (i < tb_cache.maps->len) {
+        TBCacheMap *m = &g_array_index(tb_cache.maps, TBCacheMap, i);
+
+        if (m->end <= start || m->start >= end) {
+            i++;
+        } else if (m->start >= start && m->end > end) {
+            m->start = end;
+            i++;
+        } else if (m->start < start && m->end <= end) {
+            m->end = start;
+            i++;
+        } else {
+            /* covered, or split in two: drop it */
+            g_array_remove_index_fast(tb_cache.maps, i);
+        }
+    }
+}
+
+bool tb_cache_restore(TranslationBlock *tb, int max_insns)
+{
+    TBCacheMap *m;
+    TBCacheEntry *e;
+    TBCacheKey key;
+
+    if (!tb_cache.dir) {
+        return false;
+    }
+    m = tb_cache_find_map(tb->pc);
+    if (!m) {
+        return false;
+    }
+    tb_cache.lookups++;
+
+    tb_cache_key_init(&key, tb);
+    e = g_hash_table_lookup(m->file->entries, &key);
+    if (!e || e->icount > max_insns) {
+        return false;
+    }
+
+    if (page_check_range(tb->pc, e->size, PAGE_EXEC) < 0 ||
+        memcmp(g2h_untagged(tb->pc), e->data, e->size)) {
+        tb_cache.stale++;
+        return false;
+    }
+    if (!tcg_ir_restore(tcg_ctx, tb, e->data + e->size, e->ir_len)) {
+        tb_cache.stale++;
+        tcg_func_start(tcg_ctx);
+        return false;
+    }
+
+    tb->size = e->size;
+    tb->icount = e->icount;
+    tb_cache.hits++;
+    return true;
+}
+
+void tb_cache_save(const TranslationBlock *tb)
+{
+    TBCacheMap *m;
+    TBCacheEntry *e;
+
+    if (!tb_cache.dir) {
+        return;
+    }
+    m = tb_cache_find_map(tb->pc);
+    if (!m || tb->pc + tb->size > m->end) {
+        return;
+    }
+
+    g_byte_array_set_size(tb_cache.buf, 0);
+    if (!tcg_ir_save(tcg_ctx, tb, tb_cache.buf)) {
+        return;
+    }
+
+    e = g_malloc(sizeof(*e) + tb->size + tb_cache.buf->len);
+    tb_cache_key_init(&e->key, tb);
+    e->size = tb->size;
+    e->icount = tb->icount;
+    e->ir_len = tb_cache.buf->len;
+    memcpy(e->data, g2h_untagged(tb->pc), tb->size);
+    memcpy(e->data + tb->size, tb_cache.buf->data, tb_cache.buf->len);
+
+    g_hash_table_replace(m->file->entries, &e->key, e);
+    m->file->dirty = true;
+    tb_cache.saved++;
+}
+
+void tb_cache_flush(void)
+{
+    GHashTableIter iter;
+    TBCacheFile *file;
+
+    if (!tb_cache.dir) {
+        return;
+    }
+
+    mmap_lock();
+    g_hash_table_iter_init(&iter, tb_cache.files);
+    while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&file)) {
+        if (file->dirty) {
+            tb_cache_write(file);
+        }
+    }
+    mmap_unlock();
+}
+
+void tb_cache_exit(void)
+{
+    if (!tb_cache.dir) {
+        return;
+    }
+
+    tb_cache_flush();
+
+    if (tb_cache.stats) {
+        fprintf(stderr, "qemu: tb cache: %" PRIu64 " lookups, %" PRIu64
+                " hits (%.1f%%), %" PRIu64 " stale, %" PRIu64 " saved\n",
+                tb_cache.lookups, tb_cache.hits,
+                tb_cache.lookups ? 100.0 * tb_cache.hits / tb_cache.lookups
+                                 : 0.0,
+                tb_cache.stale, tb_cache.saved);
+    }
+}
@@ -35,6 +35,14 @@ struct TBContext {
     /* statistics */
     unsigned tb_flush_count;
     unsigned tb_phys_invalidate_count;
+    unsigned tb_region_evict_count;
+    /* TBs invalidated by region evictions */
+    size_t tb_region_evict_tbs;
+    /* time spent invalidating the TBs of evicted regions, in us */
+    size_t tb_region_evict_us;
+    /* time from tb_flush() until the flush is done, in ns */
+    int64_t tb_flush_pause_ns;
+    int64_t tb_flush_pause_max_ns;
 };
 
 extern TBContext tb_ctx;
@@ -24,6 +24,7 @@
 #include "trace.h"
 #include "disas/disas.h"
 #include "exec/exec-all.h"
+#include "exec/helper-proto.h"
 #include "tcg/tcg.h"
 #if defined(CONFIG_USER_ONLY)
 #include "qemu.h"
@@ -220,6 +221,47 @@ static void *l1_map[V_L1_MAX_SIZE];
 
 TBContext tb_ctx;
 
+uint32_t tb_trace_threshold;
+TBTraceStats tb_trace_stats;
+
+/*
+ * Hot TBs waiting to be retranslated as traces.  A TB that reaches
+ * tb_trace_threshold is invalidated and its key added here; the next
+ * tb_gen_code() for the same key takes it out and builds a trace.
+ */
+typedef struct TBHotKey {
+    tb_page_addr_t phys_pc;
+    target_ulong pc;
+    target_ulong cs_base;
+    uint32_t flags;
+    uint32_t cflags;
+    uint32_t trace_vcpu_dstate;
+} TBHotKey;
+
+static struct {
+    QemuMutex lock;
+    GHashTable *keys;
+} tb_hot_set;
+
+/*
+ * Execution countdowns of the TBs that count them, see tb_hot_count_alloc().
+ * They live apart from the TBs, which share cache lines and pages with the
+ * generated code, so that counting does not write next to code that other
+ * vCPUs execute.  A TB gives its slot back when it is invalidated, which
+ * includes the eviction of its region; tb_flush() releases all of them.
+ * Once all slots are in use new TBs are not counted.
+ */
+#define TB_HOT_COUNTS (64 * 1024)
+
+static struct {
+    QemuSpin lock;
+    int32_t *counts;
+    /* stack of released slots, used before the ones never handed out */
+    uint32_t *free;
+    unsigned int nfree;
+    unsigned int used;
+} tb_hot_slots;
+
 static void page_table_config_init(void)
 {
     uint32_t v_l1_bits;
@@ -899,11 +941,159 @@ static bool tb_cmp(const void *ap, const void *bp)
         a->page_addr[1] == b->page_addr[1];
 }
 
+static guint tb_hot_key_hash(gconstpointer p)
+{
+    const TBHotKey *k = p;
+
+    return tb_hash_func(k->phys_pc, k->pc, k->flags, k->cflags,
+                        k->trace_vcpu_dstate);
+}
+
+static gboolean tb_hot_key_equal(gconstpointer a, gconstpointer b)
+{
+    return !memcmp(a, b, sizeof(TBHotKey));
+}
+
+static void tb_hot_set_init(void)
+{
+    qemu_mutex_init(&tb_hot_set.lock);
+    tb_hot_set.keys = g_hash_table_new_full(tb_hot_key_hash, tb_hot_key_equal,
+                                            g_free, NULL);
+    qemu_spin_init(&tb_hot_slots.lock);
+    if (tb_trace_threshold) {
+        tb_hot_slots.counts = g_new0(int32_t, TB_HOT_COUNTS);
+        tb_hot_slots.free = g_new(uint32_t, TB_HOT_COUNTS);
+    }
+}
+
+/*
+ * Only count the executions of TBs that would be translated the same
+ * way again; io_recompile and single-step TBs are short lived.
+ */
+static bool tb_hot_countable(uint32_t cflags)
+{
+    return tb_trace_threshold &&
+           !(cflags & (CF_SINGLE_STEP | CF_LAST_IO | CF_MEMI_ONLY |
+                       CF_USE_ICOUNT));
+}
+
+int32_t *tb_hot_count_alloc(const TranslationBlock *tb)
+{
+    unsigned int i;
+
+    if (tb->trace || !tb_hot_countable(tb_cflags(tb))) {
+        return NULL;
+    }
+
+    qemu_spin_lock(&tb_hot_slots.lock);
+    if (tb_hot_slots.nfree) {
+        i = tb_hot_slots.free[--tb_hot_slots.nfree];
+    } else if (tb_hot_slots.used < TB_HOT_COUNTS) {
+        i = tb_hot_slots.used++;
+    } else {
+        qemu_spin_unlock(&tb_hot_slots.lock);
+        return NULL;
+    }
+    qemu_spin_unlock(&tb_hot_slots.lock);
+
+    qatomic_set(&tb_hot_slots.counts[i], tb_trace_threshold);
+    return &tb_hot_slots.counts[i];
+}
+
+/*
+ * Called once @tb can't be found any more.  A vCPU may still be running
+ * it and step the count of the slot's next owner, which can only make
+ * that TB hot a few executions early.
+ */
+static void tb_hot_count_free(TranslationBlock *tb)
+{
+    if (!tb->hot_count) {
+        return;
+    }
+
+    qemu_spin_lock(&tb_hot_slots.lock);
+    tb_hot_slots.free[tb_hot_slots.nfree++] = tb->hot_count -
+                                              tb_hot_slots.counts;
+    qemu_spin_unlock(&tb_hot_slots.lock);
+    tb->hot_count = NULL;
+}
+
+static void tb_hot_key_init(TBHotKey *k, tb_page_addr_t phys_pc,
+                            target_ulong pc, target_ulong cs_base,
+                            uint32_t flags, uint32_t cflags,
+                            uint32_t trace_vcpu_dstate)
+{
+    /* zero the padding, keys are compared with memcmp */
+    memset(k, 0, sizeof(*k));
+    k->phys_pc = phys_pc;
+    k->pc = pc;
+    k->cs_base = cs_base;
+    k->flags = flags;
+    k->cflags = cflags;
+    k->trace_vcpu_dstate = trace_vcpu_dstate;
+}
+
+/* Returns true if the TB for this key should be translated as a trace */
+static bool tb_hot_set_take(TBHotKey *k)
+{
+    bool found;
+
+    qemu_mutex_lock(&tb_hot_set.lock);
+    found = g_hash_table_remove(tb_hot_set.keys, k);
+    qemu_mutex_unlock(&tb_hot_set.lock);
+
+    return found;
+}
+
+static void tb_hot_set_reset(void)
+{
+    qemu_mutex_lock(&tb_hot_set.lock);
+    g_hash_table_remove_all(tb_hot_set.keys);
+    qemu_mutex_unlock(&tb_hot_set.lock);
+
+    /* Called with all vCPUs stopped, no TB uses its count any more */
+    qemu_spin_lock(&tb_hot_slots.lock);
+    tb_hot_slots.nfree = 0;
+    tb_hot_slots.used = 0;
+    qemu_spin_unlock(&tb_hot_slots.lock);
+}
+
+/*
+ * Called by the TB when its hot_count reaches 0.  The TB keeps
+ * running, but it can't be found any more and the next lookup of its
+ * pc retranslates it as a trace.
+ */
+void HELPER(tb_hot)(CPUArchState *env, void *ptr)
+{
+    TranslationBlock *tb = ptr;
+    TBHotKey *k;
+
+    if (tb_cflags(tb) & CF_INVALID) {
+        return;
+    }
+
+    k = g_new(TBHotKey, 1);
+    tb_hot_key_init(k, tb->page_addr[0] + (tb->pc & ~TARGET_PAGE_MASK),
+                    tb->pc, tb->cs_base, tb->flags, tb_cflags(tb),
+                    tb->trace_vcpu_dstate);
+
+    qemu_mutex_lock(&tb_hot_set.lock);
+    g_hash_table_add(tb_hot_set.keys, k);
+    qemu_mutex_unlock(&tb_hot_set.lock);
+
+    mmap_lock();
+    tb_phys_invalidate(tb, -1);
+    mmap_unlock();
+
+    qatomic_inc(&tb_trace_stats.hot);
+}
+
 void tb_htable_init(void)
 {
     unsigned int mode = QHT_MODE_AUTO_RESIZE;
 
     qht_init(&tb_ctx.htable, tb_cmp, CODE_GEN_HTABLE_SIZE, mode);
+    tb_hot_set_init();
 }
 
 /* call with @p->lock held */
@@ -961,16 +1151,24 @@ static gboolean tb_host_size_iter(gpointer key, gpointer value, gpointer data)
     return false;
 }
 
+typedef struct TBFlushRequest {
+    unsigned tb_flush_count;
+    /* get_clock() when tb_flush was called */
+    int64_t time;
+} TBFlushRequest;
+
 /* flush all the translation blocks */
-static void do_tb_flush(CPUState *cpu, run_on_cpu_data tb_flush_count)
+static void do_tb_flush(CPUState *cpu, run_on_cpu_data data)
 {
+    TBFlushRequest *req = data.host_ptr;
     bool did_flush = false;
+    int64_t pause;
 
     mmap_lock();
     /* If it is already been done on request of another CPU,
      * just retry.
      */
-    if (tb_ctx.tb_flush_count != tb_flush_count.host_int) {
+    if (tb_ctx.tb_flush_count != req->tb_flush_count) {
         goto done;
     }
     did_flush = true;
@@ -990,33 +1188,138 @@ static void do_tb_flush(CPUState *cpu, run_on_cpu_data tb_flush_count)
 
     qht_reset_size(&tb_ctx.htable, CODE_GEN_HTABLE_SIZE);
     page_flush_tb();
+    tb_hot_set_reset();
 
     tcg_region_reset_all();
     /* XXX: flush processor icache at this point if cache flush is
        expensive */
     qatomic_mb_set(&tb_ctx.tb_flush_count, tb_ctx.tb_flush_count + 1);
 
+    /* Only updated here, with all the vCPUs stopped */
+    pause = get_clock() - req->time;
+    tb_ctx.tb_flush_pause_ns += pause;
+    tb_ctx.tb_flush_pause_max_ns = MAX(tb_ctx.tb_flush_pause_max_ns, pause);
+
 done:
     mmap_unlock();
     if (did_flush) {
         qemu_plugin_flush_cb();
     }
+    g_free(req);
 }
 
 void tb_flush(CPUState *cpu)
 {
     if (tcg_enabled()) {
-        unsigned tb_flush_count = qatomic_mb_read(&tb_ctx.tb_flush_count);
+        TBFlushRequest *req = g_new(TBFlushRequest, 1);
 
+        req->tb_flush_count = qatomic_mb_read(&tb_ctx.tb_flush_count);
+        req->time = get_clock();
         if (cpu_in_exclusive_context(cpu)) {
-            do_tb_flush(cpu, RUN_ON_CPU_HOST_INT(tb_flush_count));
+            do_tb_flush(cpu, RUN_ON_CPU_HOST_PTR(req));
         } else {
-            async_safe_run_on_cpu(cpu, do_tb_flush,
-                                  RUN_ON_CPU_HOST_INT(tb_flush_count));
+            async_safe_run_on_cpu(cpu, do_tb_flush, RUN_ON_CPU_HOST_PTR(req));
         }
     }
 }
 
+typedef struct TBRegionEviction {
+    size_t region;
+    /* code buffer generation, from tcg_region_evict_begin() */
+    unsigned int gen;
+    /* vCPUs yet to leave cpu_exec, plus one for the evicting vCPU */
+    int pending;
+} TBRegionEviction;
+
+static gboolean tb_region_evict_iter(gpointer key, gpointer value,
+                                     gpointer data)
+{
+    g_ptr_array_add(data, value);
+    return false;
+}
+
+static void tb_region_evict_put(TBRegionEviction *ev)
+{
+    CPUState *cpu;
+    unsigned int h;
+
+    if (qatomic_fetch_dec(&ev->pending) != 1) {
+        return;
+    }
+
+    /*
+     * Every vCPU has left cpu_exec since the TBs of the region were
+     * invalidated, so none of them is running those TBs or can find them
+     * again.  A vCPU may still have put one of them in its jump cache
+     * right before the invalidation; drop those before the memory is
+     * reused, along with the one-shot TBs that are not in the region tree.
+     */
+    CPU_FOREACH(cpu) {
+        for (h = 0; h < TB_JMP_CACHE_SIZE; h++) {
+            TranslationBlock *tb = qatomic_read(&cpu->tb_jmp_cache[h]);
+
+            if (tb && ((tb_cflags(tb) & CF_INVALID) ||
+                       tb->page_addr[0] == -1)) {
+                qatomic_cmpxchg(&cpu->tb_jmp_cache[h], tb, NULL);
+            }
+        }
+    }
+
+    tcg_region_evict_end(ev->region, ev->gen);
+    g_free(ev);
+}
+
+static void do_tb_region_evict_done(CPUState *cpu, run_on_cpu_data data)
+{
+    tb_region_evict_put(data.host_ptr);
+}
+
+/*
+ * Reclaim the oldest full region of the code buffer if the free ones
+ * are running low, so that tb_flush() is seldom needed.  The other vCPUs
+ * keep running; each of them only has to leave cpu_exec once before the
+ * region can be reused.
+ *
+ * Called with mmap_lock held in user-mode.
+ */
+static void tb_region_evict(void)
+{
+    g_autoptr(GPtrArray) tbs = NULL;
+    TBRegionEviction *ev;
+    unsigned int gen;
+    ssize_t region;
+    CPUState *cpu;
+    int64_t start;
+    guint i;
+
+    region = tcg_region_evict_begin(&gen);
+    if (region < 0) {
+        return;
+    }
+
+    start = get_clock();
+    tbs = g_ptr_array_new();
+    tcg_region_tb_foreach(region, tb_region_evict_iter, tbs);
+    for (i = 0; i < tbs->len; i++) {
+        tb_phys_invalidate(g_ptr_array_index(tbs, i), -1);
+    }
+
+    ev = g_new(TBRegionEviction, 1);
+    ev->region = region;
+    ev->gen = gen;
+    ev->pending = 1;
+    CPU_FOREACH(cpu) {
+        qatomic_inc(&ev->pending);
+        async_run_on_cpu(cpu, do_tb_region_evict_done,
+                         RUN_ON_CPU_HOST_PTR(ev));
+    }
+    tb_region_evict_put(ev);
+
+    qatomic_inc(&tb_ctx.tb_region_evict_count);
+    qatomic_add(&tb_ctx.tb_region_evict_tbs, tbs->len);
+    qatomic_add(&tb_ctx.tb_region_evict_us, (get_clock() - start) / SCALE_US);
+}
+
 /*
  * Formerly ifdef DEBUG_TB_CHECK. These debug functions are user-mode-only,
  * so in order to prevent bit rot we compile them unconditionally in user-mode,
@@ -1191,6 +1494,7 @@ static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
     if (!qht_remove(&tb_ctx.htable, tb, h)) {
         return;
     }
+    tb_hot_count_free(tb);
 
     /* remove the TB from the page list */
     if (rm_from_page_list) {
@@ -1410,7 +1714,9 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     tb_page_addr_t phys_pc, phys_page2;
     target_ulong virt_page2;
     tcg_insn_unit *gen_code_buf;
+    void *region_buf;
     int gen_code_size, search_size, max_insns;
+    bool trace = false;
 #ifdef CONFIG_PROFILER
     TCGProfile *prof = &tcg_ctx->prof;
     int64_t ti;
@@ -1432,7 +1738,17 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     }
     QEMU_BUILD_BUG_ON(CF_COUNT_MASK + 1 != TCG_MAX_INSNS);
 
+    /* phys_pc == -1 implies CF_LAST_IO, so such TBs are not counted */
+    if (tb_hot_countable(cflags)) {
+        TBHotKey k;
+
+        tb_hot_key_init(&k, phys_pc, pc, cs_base, flags, cflags,
+                        *cpu->trace_dstate);
+        trace = tb_hot_set_take(&k);
+    }
+
  buffer_overflow:
+    region_buf = tcg_ctx->code_gen_buffer;
     tb = tcg_tb_alloc(tcg_ctx);
     if (unlikely(!tb)) {
         /* flush must be done */
@@ -1442,6 +1758,10 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
         cpu->exception_index = EXCP_INTERRUPT;
         cpu_loop_exit(cpu);
     }
+    if (tcg_ctx->code_gen_buffer != region_buf) {
+        /* We moved to a new region, fewer of them are left free */
+        tb_region_evict();
+    }
 
     gen_code_buf = tcg_ctx->code_gen_ptr;
     tb->tc.ptr = tcg_splitwx_to_rx(gen_code_buf);
@@ -1450,6 +1770,8 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     tb->flags = flags;
     tb->cflags = cflags;
     tb->trace_vcpu_dstate = *cpu->trace_dstate;
+    tb->hot_count = NULL;
+    tb->trace = trace;
     tcg_ctx->tb_cflags = cflags;
  tb_overflow:
 
@@ -1467,7 +1789,10 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     tcg_func_start(tcg_ctx);
 
     tcg_ctx->cpu = env_cpu(env);
-    gen_intermediate_code(cpu, tb, max_insns);
+    if (!tb_cache_restore(tb, max_insns)) {
+        gen_intermediate_code(cpu, tb, max_insns);
+        tb_cache_save(tb);
+    }
     assert(tb->size != 0);
     tcg_ctx->cpu = NULL;
     max_insns = tb->icount;
@@ -1510,6 +1835,7 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
             qemu_log_mask(CPU_LOG_TB_OP | CPU_LOG_TB_OP_OPT,
                           "Restarting code generation for "
                           "code_gen_buffer overflow\n");
+            tb_hot_count_free(tb);
             goto buffer_overflow;
 
         case -2:
@@ -1536,10 +1862,17 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     }
     search_size = encode_search(tb, (void *)gen_code_buf + gen_code_size);
     if (unlikely(search_size < 0)) {
+        tb_hot_count_free(tb);
         goto buffer_overflow;
     }
     tb->tc.size = gen_code_size;
 
+    if (tb->trace) {
+        trace_translate_trace(tb, tb->pc, tb->icount);
+        qatomic_inc(&tb_trace_stats.traces);
+        qatomic_add(&tb_trace_stats.insns, tb->icount);
+    }
+
 #ifdef CONFIG_PROFILER
     qatomic_set(&prof->code_time, prof->code_time + profile_getclock() - ti);
     qatomic_set(&prof->code_in_len, prof->code_in_len + tb->size);
@@ -1672,6 +2005,7 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
         orig_aligned -= ROUND_UP(sizeof(*tb), qemu_icache_linesize);
         qatomic_set(&tcg_ctx->code_gen_ptr, (void *)orig_aligned);
         tcg_tb_remove(tb);
+        tb_hot_count_free(tb);
         return existing_tb;
     }
     return tb;
@@ -2089,6 +2423,8 @@ void dump_exec_info(void)
     struct tb_tree_stats tst = {};
     struct qht_stats hst;
     size_t nb_tbs, flush_full, flush_part, flush_elide;
+    size_t jmp_hits = 0, jmp_misses = 0;
+    CPUState *cpu;
 
     tcg_tb_foreach(tb_tree_stats_iter, &tst);
     nb_tbs = tst.nb_tbs;
@@ -2125,6 +2461,40 @@ void dump_exec_info(void)
                 qatomic_read(&tb_ctx.tb_flush_count));
     qemu_printf("TB invalidate count %u\n",
                 qatomic_read(&tb_ctx.tb_phys_invalidate_count));
+    if (tb_ctx.tb_flush_count) {
+        qemu_printf("TB flush pause      avg %" PRId64 " us max %" PRId64
+                    " us\n",
+                    tb_ctx.tb_flush_pause_ns / tb_ctx.tb_flush_count /
+                    SCALE_US,
+                    tb_ctx.tb_flush_pause_max_ns / SCALE_US);
+    }
+    qemu_printf("region evict count  %u (%zu TBs, %zu us)\n",
+                qatomic_read(&tb_ctx.tb_region_evict_count),
+                qatomic_read(&tb_ctx.tb_region_evict_tbs),
+                qatomic_read(&tb_ctx.tb_region_evict_us));
+    CPU_FOREACH(cpu) {
+        jmp_hits += qatomic_read(&cpu->tb_jmp_inline_hits);
+        jmp_misses += qatomic_read(&cpu->tb_jmp_inline_misses);
+    }
+    qemu_printf("inline TB lookups   %zu (%zu%% hit)\n",
+                jmp_hits + jmp_misses,
+                jmp_hits + jmp_misses ?
+                (jmp_hits * 100) / (jmp_hits + jmp_misses) : 0);
+
+    if (tb_trace_threshold) {
+        size_t traces = qatomic_read(&tb_trace_stats.traces);
+
+        qemu_printf("\nTraces (threshold %u):\n", tb_trace_threshold);
+        qemu_printf("hot TB count        %zu\n",
+                    qatomic_read(&tb_trace_stats.hot));
+        qemu_printf("trace count         %zu\n", traces);
+        qemu_printf("trace avg insns     %zu\n",
+                    traces ? qatomic_read(&tb_trace_stats.insns) / traces : 0);
+        qemu_printf("followed branches   %zu\n",
+                    qatomic_read(&tb_trace_stats.follows));
+        qemu_printf("side exits          %zu\n",
+                    qatomic_read(&tb_trace_stats.side_exits));
+    }
 
     tlb_flush_counts(&flush_full, &flush_part, &flush_elide);
     qemu_printf("TLB full flushes    %zu\n", flush_full);
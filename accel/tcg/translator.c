@@ -17,6 +17,15 @@
 #include "exec/translator.h"
 #include "exec/plugin-gen.h"
 #include "sysemu/replay.h"
+#include "internal.h"
+#include "tb-hash.h"
+
+/* Bound the number of blocks merged into one trace */
+#define TRACE_MAX_FOLLOWS 8
+
+/* Offset of a CPUState field from cpu_env */
+#define CPU_ENV_OFFSET(field) \
+    (offsetof(ArchCPU, parent_obj.field) - offsetof(ArchCPU, env))
 
 /* Pairs with tcg_clear_temp_count.
    To be called by #TranslatorOps.{translate_insn,tb_stop} if
@@ -42,6 +51,166 @@ bool translator_use_goto_tb(DisasContextBase *db, target_ulong dest)
     return ((db->pc_first ^ dest) & TARGET_PAGE_MASK) == 0;
 }
 
+bool translator_trace_follow(DisasContextBase *db, target_ulong dest)
+{
+    if (!db->tb->trace || db->trace_follows >= TRACE_MAX_FOLLOWS) {
+        return false;
+    }
+    if (dest < db->pc_first ||
+        ((db->pc_first ^ dest) & TARGET_PAGE_MASK) != 0) {
+        return false;
+    }
+
+    db->pc_max = MAX(db->pc_max, db->pc_next);
+    db->trace_follows++;
+    return true;
+}
+
+/*
+ * Count the executions of the TB; when the countdown reaches 0 the TB
+ * is invalidated and retranslated as a trace by its next lookup.
+ * The decrement is not atomic, so with MTTCG the vCPUs that run the TB
+ * together can step over 0: test for <= 0, HELPER(tb_hot) ignores the
+ * calls after the first one.
+ */
+static void gen_tb_hot_count(const TranslationBlock *tb)
+{
+    TCGv_ptr ptr = tcg_const_ptr(tb->hot_count);
+    TCGv_i32 count = tcg_temp_new_i32();
+    TCGLabel *skip = gen_new_label();
+
+    tcg_gen_ld_i32(count, ptr, 0);
+    tcg_gen_subi_i32(count, count, 1);
+    tcg_gen_st_i32(count, ptr, 0);
+    tcg_gen_brcondi_i32(TCG_COND_GT, count, 0, skip);
+    tcg_temp_free_ptr(ptr);
+    tcg_temp_free_i32(count);
+
+    /* temps don't survive the branch */
+    ptr = tcg_const_ptr(tb);
+    gen_helper_tb_hot(cpu_env, ptr);
+    tcg_temp_free_ptr(ptr);
+    gen_set_label(skip);
+}
+
+/* Compute the byte offset of the tb_jmp_cache slot for @pc into @ret */
+static void gen_tb_jmp_cache_offset(TCGv ret, TCGv pc)
+{
+    /* Must match tb_jmp_cache_hash_func() */
+#ifdef CONFIG_SOFTMMU
+    TCGv tmp = tcg_temp_new();
+
+    tcg_gen_shri_tl(tmp, pc, TARGET_PAGE_BITS - TB_JMP_PAGE_BITS);
+    tcg_gen_xor_tl(tmp, tmp, pc);
+    tcg_gen_shri_tl(ret, tmp, TARGET_PAGE_BITS - TB_JMP_PAGE_BITS);
+    tcg_gen_andi_tl(ret, ret, TB_JMP_PAGE_MASK);
+    tcg_gen_andi_tl(tmp, tmp, TB_JMP_ADDR_MASK);
+    tcg_gen_or_tl(ret, ret, tmp);
+    tcg_temp_free(tmp);
+#else
+    tcg_gen_shri_tl(ret, pc, TB_JMP_CACHE_BITS);
+    tcg_gen_xor_tl(ret, ret, pc);
+    tcg_gen_andi_tl(ret, ret, TB_JMP_CACHE_SIZE - 1);
+#endif
+    tcg_gen_muli_tl(ret, ret, sizeof(TranslationBlock *));
+}
+
+static void gen_inc_cpu_counter(intptr_t offset)
+{
+    TCGv_ptr count = tcg_temp_new_ptr();
+
+    tcg_gen_ld_ptr(count, cpu_env, offset);
+    tcg_gen_addi_ptr(count, count, 1);
+    tcg_gen_st_ptr(count, cpu_env, offset);
+    tcg_temp_free_ptr(count);
+}
+
+void translator_lookup_and_goto_ptr(DisasContextBase *db, TCGv pc)
+{
+    const TranslationBlock *tb = db->tb;
+    TCGLabel *miss;
+    TCGv_ptr next, slot;
+    TCGv pc_local, t;
+    TCGv_i32 t32, cflags;
+
+    /*
+     * Leave the lookup to the helper when it must see every TB
+     * (-d exec, -d nochain); gdb single-step sets CF_NO_GOTO_PTR.
+     */
+    if ((tb_cflags(tb) & CF_NO_GOTO_PTR) ||
+        qemu_loglevel_mask(CPU_LOG_EXEC | CPU_LOG_TB_NOCHAIN)) {
+        tcg_gen_lookup_and_goto_ptr();
+        return;
+    }
+
+    plugin_gen_disable_mem_helpers();
+
+    miss = gen_new_label();
+    pc_local = tcg_temp_local_new();
+    next = tcg_temp_local_new_ptr();
+    slot = tcg_temp_new_ptr();
+    t = tcg_temp_new();
+
+    tcg_gen_mov_tl(pc_local, pc);
+    gen_tb_jmp_cache_offset(t, pc);
+#if TARGET_LONG_BITS == 32
+    tcg_gen_ext_i32_ptr(slot, t);
+#else
+    tcg_gen_trunc_i64_ptr(slot, t);
+#endif
+    tcg_gen_add_ptr(slot, slot, cpu_env);
+    tcg_gen_ld_ptr(next, slot, CPU_ENV_OFFSET(tb_jmp_cache));
+    tcg_temp_free_ptr(slot);
+    tcg_temp_free(t);
+
+    /*
+     * Same checks as tb_lookup().  cs_base, flags and trace_vcpu_dstate
+     * are those of the current TB, as guaranteed by the caller.
+     */
+    tcg_gen_brcondi_ptr(TCG_COND_EQ, next, 0, miss);
+
+    t = tcg_temp_new();
+    tcg_gen_ld_tl(t, next, offsetof(TranslationBlock, pc));
+    tcg_gen_brcond_tl(TCG_COND_NE, t, pc_local, miss);
+    tcg_temp_free(t);
+
+    t = tcg_temp_new();
+    tcg_gen_ld_tl(t, next, offsetof(TranslationBlock, cs_base));
+    tcg_gen_brcondi_tl(TCG_COND_NE, t, tb->cs_base, miss);
+    tcg_temp_free(t);
+
+    t32 = tcg_temp_new_i32();
+    tcg_gen_ld_i32(t32, next, offsetof(TranslationBlock, flags));
+    tcg_gen_brcondi_i32(TCG_COND_NE, t32, tb->flags, miss);
+    tcg_temp_free_i32(t32);
+
+    t32 = tcg_temp_new_i32();
+    tcg_gen_ld_i32(t32, next, offsetof(TranslationBlock, trace_vcpu_dstate));
+    tcg_gen_brcondi_i32(TCG_COND_NE, t32, tb->trace_vcpu_dstate, miss);
+    tcg_temp_free_i32(t32);
+
+    /* A stale TB has CF_INVALID set and never matches tcg_cflags */
+    t32 = tcg_temp_new_i32();
+    cflags = tcg_temp_new_i32();
+    tcg_gen_ld_i32(t32, next, offsetof(TranslationBlock, cflags));
+    tcg_gen_ld_i32(cflags, cpu_env, CPU_ENV_OFFSET(tcg_cflags));
+    tcg_gen_brcond_i32(TCG_COND_NE, t32, cflags, miss);
+    tcg_temp_free_i32(cflags);
+    tcg_temp_free_i32(t32);
+
+    gen_inc_cpu_counter(CPU_ENV_OFFSET(tb_jmp_inline_hits));
+    tcg_gen_ld_ptr(next, next, offsetof(TranslationBlock, tc.ptr));
+    tcg_gen_op1i(INDEX_op_goto_ptr, tcgv_ptr_arg(next));
+
+    gen_set_label(miss);
+    gen_inc_cpu_counter(CPU_ENV_OFFSET(tb_jmp_inline_misses));
+    gen_helper_lookup_tb_ptr(next, cpu_env);
+    tcg_gen_op1i(INDEX_op_goto_ptr, tcgv_ptr_arg(next));
+
+    tcg_temp_free_ptr(next);
+    tcg_temp_free(pc_local);
+}
+
 void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
                      CPUState *cpu, TranslationBlock *tb, int max_insns)
 {
@@ -56,6 +225,9 @@ void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
     db->num_insns = 0;
     db->max_insns = max_insns;
     db->singlestep_enabled = cflags & CF_SINGLE_STEP;
+    db->pc_max = db->pc_first;
+    db->trace_follows = 0;
+    db->trace_side_exits = 0;
 
     ops->init_disas_context(db, cpu);
     tcg_debug_assert(db->is_jmp == DISAS_NEXT);  /* no early exit */
@@ -70,6 +242,20 @@ void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
 
     plugin_enabled = plugin_gen_tb_start(cpu, tb, cflags & CF_MEMI_ONLY);
 
+    /*
+     * Only targets that follow branches in traces count executions, and
+     * plugins expect to see every execution of the TBs they instrument.
+     */
+    if (ops->trace_follow && !plugin_enabled) {
+        /* keep the slot when retranslating with fewer insns */
+        if (!tb->hot_count) {
+            tb->hot_count = tb_hot_count_alloc(tb);
+        }
+        if (tb->hot_count) {
+            gen_tb_hot_count(tb);
+        }
+    }
+
     while (true) {
         db->num_insns++;
         ops->insn_start(db, cpu);
@@ -112,6 +298,13 @@ void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
             db->is_jmp = DISAS_TOO_MANY;
             break;
         }
+
+        /* A trace that followed a branch must not leave its page.  */
+        if (db->trace_follows &&
+            ((db->pc_first ^ db->pc_next) & TARGET_PAGE_MASK) != 0) {
+            db->is_jmp = DISAS_TOO_MANY;
+            break;
+        }
     }
 
     /* Emit code to exit the TB, as indicated by db->is_jmp.  */
@@ -123,9 +316,14 @@ void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
     }
 
     /* The disas_log hook may use these values rather than recompute.  */
-    tb->size = db->pc_next - db->pc_first;
+    tb->size = MAX(db->pc_max, db->pc_next) - db->pc_first;
     tb->icount = db->num_insns;
 
+    if (db->trace_follows) {
+        qatomic_add(&tb_trace_stats.follows, db->trace_follows);
+        qatomic_add(&tb_trace_stats.side_exits, db->trace_side_exits);
+    }
+
 #ifdef DEBUG_DISAS
     if (qemu_loglevel_mask(CPU_LOG_TB_IN_ASM)
         && qemu_log_in_addr_range(db->pc_first)) {
@@ -12,16 +12,37 @@
 #include <liburing.h>
 #include "qemu-common.h"
 #include "block/aio.h"
+#include "block/aio-wait.h"
 #include "qemu/queue.h"
 #include "block/block.h"
 #include "block/raw-aio.h"
 #include "qemu/coroutine.h"
+#include "qemu/error-report.h"
+#include "qemu/units.h"
+#include "qemu/bitmap.h"
 #include "qapi/error.h"
+#include "exec/ramlist.h"
 #include "trace.h"
 
 /* io_uring ring size */
 #define MAX_ENTRIES 128
 
+/* Number of slots in the registered file table */
+#define MAX_FIXED_FILES 64
+
+/* Number of slots in the registered buffer table */
+#define MAX_FIXED_BUFFERS 1024
+
+/* The kernel refuses to register buffers larger than this */
+#define MAX_FIXED_BUFFER_SIZE (1 * GiB)
+
+/* A chunk of guest RAM registered in slot @index of the buffer table */
+typedef struct LuringFixedBuffer {
+    uintptr_t start;
+    size_t len;
+    unsigned int index;
+} LuringFixedBuffer;
+
 typedef struct LuringAIOCB {
     Coroutine *co;
     struct io_uring_sqe sqeq;
@@ -56,6 +77,26 @@ typedef struct LuringState {
 
     /* I/O completion processing.  Only runs in I/O thread.  */
     QEMUBH *completion_bh;
+
+    /*
+     * Registered file table.  fixed_fds[i] is the fd registered in slot i,
+     * or -1 if the slot is free.  Protected by AioContext lock.
+     */
+    bool fixed_files;
+    int fixed_fds[MAX_FIXED_FILES];
+
+    /*
+     * Guest RAM registered as fixed buffers.  The buffer table is registered
+     * empty; the RAM blocks reported by ram_notifier are split into chunks
+     * of at most 1 GiB, each updated into a free slot, so that a RAM block
+     * change only touches the slots of that block.  fixed_bufs holds the
+     * LuringFixedBuffers sorted by address, used_buf_slots the slots in use.
+     * Only modified in the AioContext of the ring, or before it is attached.
+     */
+    bool fixed_buffers;
+    RAMBlockNotifier ram_notifier;
+    GArray *fixed_bufs;
+    unsigned long *used_buf_slots;
 } LuringState;
 
 /**
@@ -102,7 +143,9 @@ static void luring_resubmit_short_read(LuringState *s, LuringAIOCB *luringcb,
     qemu_iovec_concat(resubmit_qiov, luringcb->qiov, luringcb->total_read,
                       remaining);
 
-    /* Update sqe */
+    /* Update sqe, a fixed buffer read is resubmitted as a plain readv */
+    luringcb->sqeq.opcode = IORING_OP_READV;
+    luringcb->sqeq.buf_index = 0;
     luringcb->sqeq.off = nread;
     luringcb->sqeq.addr = (__u64)(uintptr_t)luringcb->resubmit_qiov.iov;
     luringcb->sqeq.len = luringcb->resubmit_qiov.niov;
@@ -326,6 +369,287 @@ void luring_io_unplug(BlockDriverState *bs, LuringState *s)
     }
 }
 
+static int luring_fixed_file_index(LuringState *s, int fd)
+{
+    int i;
+
+    for (i = 0; s->fixed_files && i < MAX_FIXED_FILES; i++) {
+        if (s->fixed_fds[i] == fd) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * luring_register_fd:
+ * @s: AIO state
+ * @fd: file descriptor that requests will be submitted for
+ *
+ * Add @fd to the registered file table so that requests for it do not need a
+ * file table lookup in the kernel.  This is only an optimization: if the table
+ * is full or registration fails, requests for @fd are submitted as usual.
+ *
+ * The caller must call luring_unregister_fd() before closing @fd.
+ */
+void luring_register_fd(LuringState *s, int fd)
+{
+    int i, ret;
+
+    if (!s->fixed_files || luring_fixed_file_index(s, fd) >= 0) {
+        return;
+    }
+
+    for (i = 0; i < MAX_FIXED_FILES; i++) {
+        if (s->fixed_fds[i] == -1) {
+            ret = io_uring_register_files_update(&s->ring, i, &fd, 1);
+            trace_luring_register_fd(s, fd, i, ret);
+            if (ret == 1) {
+                s->fixed_fds[i] = fd;
+            }
+            return;
+        }
+    }
+}
+
+void luring_unregister_fd(LuringState *s, int fd)
+{
+    int i = luring_fixed_file_index(s, fd);
+    int unused = -1;
+
+    if (i < 0) {
+        return;
+    }
+
+    /*
+     * The kernel keeps a reference to the file until the slot is cleared, so
+     * the slot must not be reused for anything else if this fails.
+     */
+    if (io_uring_register_files_update(&s->ring, i, &unused, 1) == 1) {
+        s->fixed_fds[i] = -1;
+    } else {
+        s->fixed_fds[i] = -2;
+    }
+    trace_luring_unregister_fd(s, fd, i);
+}
+
+/* Index in s->fixed_bufs of the first buffer that starts after @start */
+static unsigned int luring_fixed_buffer_search(LuringState *s, uintptr_t start)
+{
+    unsigned int lo = 0, hi = s->fixed_bufs->len;
+
+    while (lo < hi) {
+        unsigned int mid = lo + (hi - lo) / 2;
+
+        if (g_array_index(s->fixed_bufs, LuringFixedBuffer, mid).start <=
+            start) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/*
+ * Return the slot of the fixed buffer that holds all of @qiov, or -1.
+ * READ_FIXED and WRITE_FIXED take a single buffer, so this only works if
+ * the elements of @qiov follow each other in memory.
+ */
+static int luring_fixed_buffer_index(LuringState *s, QEMUIOVector *qiov)
+{
+    LuringFixedBuffer *buf;
+    uintptr_t start, end;
+    unsigned int i;
+
+    if (!s->fixed_buffers || !s->fixed_bufs->len || !qiov->niov) {
+        return -1;
+    }
+
+    start = (uintptr_t)qiov->iov[0].iov_base;
+    end = start + qiov->iov[0].iov_len;
+    for (i = 1; i < qiov->niov; i++) {
+        if ((uintptr_t)qiov->iov[i].iov_base != end) {
+            return -1;
+        }
+        end += qiov->iov[i].iov_len;
+    }
+
+    i = luring_fixed_buffer_search(s, start);
+    if (i == 0) {
+        return -1;
+    }
+    buf = &g_array_index(s->fixed_bufs, LuringFixedBuffer, i - 1);
+    if (end > buf->start + buf->len) {
+        return -1;
+    }
+    return buf->index;
+}
+
+static int luring_update_buffer_slot(LuringState *s, unsigned int index,
+                                     void *base, size_t len)
+{
+    struct iovec iov = { .iov_base = base, .iov_len = len };
+    int ret;
+
+    ret = io_uring_register_buffers_update_tag(&s->ring, index, &iov, NULL, 1);
+    trace_luring_update_buffer(s, index, base, len, ret);
+    return ret;
+}
+
+static void luring_add_fixed_buffers(LuringState *s, void *host, size_t size)
+{
+    size_t offset;
+
+    for (offset = 0; offset < size; offset += MAX_FIXED_BUFFER_SIZE) {
+        LuringFixedBuffer buf = {
+            .start = (uintptr_t)host + offset,
+            .len = MIN(size - offset, MAX_FIXED_BUFFER_SIZE),
+        };
+        int ret;
+
+        buf.index = find_first_zero_bit(s->used_buf_slots, MAX_FIXED_BUFFERS);
+        if (buf.index == MAX_FIXED_BUFFERS) {
+            warn_report_once("io_uring: no free fixed buffer slot, "
+                             "not all of guest RAM is registered");
+            return;
+        }
+
+        /* The pages are pinned until the slot is updated again */
+        ret = luring_update_buffer_slot(s, buf.index, (void *)buf.start,
+                                        buf.len);
+        if (ret < 0) {
+            warn_report("io_uring: failed to register guest RAM as fixed "
+                        "buffer (%s), check RLIMIT_MEMLOCK", strerror(-ret));
+            return;
+        }
+
+        set_bit(buf.index, s->used_buf_slots);
+        g_array_insert_val(s->fixed_bufs,
+                           luring_fixed_buffer_search(s, buf.start), buf);
+    }
+}
+
+/*
+ * In-flight requests keep their buffer registered in the kernel until they
+ * complete, so slots can be cleared while they still use them.
+ */
+static void luring_remove_fixed_buffers(LuringState *s, void *host,
+                                        size_t size)
+{
+    uintptr_t start = (uintptr_t)host;
+    unsigned int i = 0;
+
+    while (i < s->fixed_bufs->len) {
+        LuringFixedBuffer *buf = &g_array_index(s->fixed_bufs,
+                                                LuringFixedBuffer, i);
+
+        if (buf->start < start || buf->start >= start + size) {
+            i++;
+            continue;
+        }
+
+        /* The slot must not be reused if the kernel still holds the pages */
+        if (luring_update_buffer_slot(s, buf->index, NULL, 0) == 1) {
+            clear_bit(buf->index, s->used_buf_slots);
+        }
+        g_array_remove_index(s->fixed_bufs, i);
+    }
+}
+
+typedef struct LuringRAMBlockUpdate {
+    LuringState *s;
+    void *host;
+    size_t old_size;
+    size_t new_size;
+} LuringRAMBlockUpdate;
+
+static void luring_update_fixed_buffers_bh(void *opaque)
+{
+    LuringRAMBlockUpdate *update = opaque;
+
+    if (update->old_size) {
+        luring_remove_fixed_buffers(update->s, update->host, update->old_size);
+    }
+    if (update->new_size) {
+        luring_add_fixed_buffers(update->s, update->host, update->new_size);
+    }
+}
+
+/* Context: QEMU global mutex held */
+static void luring_ram_block_changed(LuringState *s, void *host,
+                                     size_t old_size, size_t new_size)
+{
+    LuringRAMBlockUpdate update = {
+        .s = s,
+        .host = host,
+        .old_size = old_size,
+        .new_size = new_size,
+    };
+
+    if (!s->fixed_buffers) {
+        return;
+    }
+
+    if (s->aio_context) {
+        aio_context_acquire(s->aio_context);
+        aio_wait_bh_oneshot(s->aio_context, luring_update_fixed_buffers_bh,
+                            &update);
+        aio_context_release(s->aio_context);
+    } else {
+        luring_update_fixed_buffers_bh(&update);
+    }
+}
+
+static void luring_ram_block_added(RAMBlockNotifier *n, void *host,
+                                   size_t size, size_t max_size)
+{
+    LuringState *s = container_of(n, LuringState, ram_notifier);
+
+    luring_ram_block_changed(s, host, 0, size);
+}
+
+static void luring_ram_block_removed(RAMBlockNotifier *n, void *host,
+                                     size_t size, size_t max_size)
+{
+    LuringState *s = container_of(n, LuringState, ram_notifier);
+
+    luring_ram_block_changed(s, host, size, 0);
+}
+
+static void luring_ram_block_resized(RAMBlockNotifier *n, void *host,
+                                     size_t old_size, size_t new_size)
+{
+    LuringState *s = container_of(n, LuringState, ram_notifier);
+
+    luring_ram_block_changed(s, host, old_size, new_size);
+}
+
+/*
+ * Register an empty buffer table, RAM blocks are added to it as they are
+ * reported.  Failing that, requests are submitted without fixed buffers.
+ */
+static bool luring_init_fixed_buffers(LuringState *s)
+{
+#ifdef CONFIG_LINUX_IO_URING_BUFFERS_UPDATE
+    g_autofree struct iovec *iovs = g_new0(struct iovec, MAX_FIXED_BUFFERS);
+    int ret;
+
+    ret = io_uring_register_buffers_tags(&s->ring, iovs, NULL,
+                                         MAX_FIXED_BUFFERS);
+    trace_luring_register_buffers(s, MAX_FIXED_BUFFERS, ret);
+    if (ret < 0) {
+        warn_report("io_uring: cannot register fixed buffers (%s), "
+                    "Linux 5.13 or newer is needed", strerror(-ret));
+        return false;
+    }
+    return true;
+#else
+    warn_report("io_uring: fixed buffers need liburing 2.1 or newer");
+    return false;
+#endif
+}
+
 /**
  * luring_do_submit:
  * @fd: file descriptor for I/O
@@ -341,16 +665,32 @@ static int luring_do_submit(int fd, LuringAIOCB *luringcb, LuringState *s,
                             uint64_t offset, int type)
 {
     int ret;
+    int buf_index = -1;
+    int file_index = luring_fixed_file_index(s, fd);
     struct io_uring_sqe *sqes = &luringcb->sqeq;
 
+    if (type == QEMU_AIO_WRITE || type == QEMU_AIO_READ) {
+        buf_index = luring_fixed_buffer_index(s, luringcb->qiov);
+    }
+
     switch (type) {
     case QEMU_AIO_WRITE:
-        io_uring_prep_writev(sqes, fd, luringcb->qiov->iov,
-                             luringcb->qiov->niov, offset);
+        if (buf_index >= 0) {
+            io_uring_prep_write_fixed(sqes, fd, luringcb->qiov->iov[0].iov_base,
+                                      luringcb->qiov->size, offset, buf_index);
+        } else {
+            io_uring_prep_writev(sqes, fd, luringcb->qiov->iov,
+                                 luringcb->qiov->niov, offset);
+        }
         break;
     case QEMU_AIO_READ:
-        io_uring_prep_readv(sqes, fd, luringcb->qiov->iov,
-                            luringcb->qiov->niov, offset);
+        if (buf_index >= 0) {
+            io_uring_prep_read_fixed(sqes, fd, luringcb->qiov->iov[0].iov_base,
+                                     luringcb->qiov->size, offset, buf_index);
+        } else {
+            io_uring_prep_readv(sqes, fd, luringcb->qiov->iov,
+                                luringcb->qiov->niov, offset);
+        }
         break;
     case QEMU_AIO_FLUSH:
         io_uring_prep_fsync(sqes, fd, IORING_FSYNC_DATASYNC);
@@ -360,6 +700,10 @@ static int luring_do_submit(int fd, LuringAIOCB *luringcb, LuringState *s,
                         __func__, type);
         abort();
     }
+    if (file_index >= 0) {
+        sqes->fd = file_index;
+        sqes->flags |= IOSQE_FIXED_FILE;
+    }
     io_uring_sqe_set_data(sqes, luringcb);
 
     QSIMPLEQ_INSERT_TAIL(&s->io_q.submit_queue, luringcb, next);
@@ -416,28 +760,53 @@ void luring_attach_aio_context(LuringState *s, AioContext *new_context)
                        qemu_luring_completion_cb, NULL, qemu_luring_poll_cb, s);
 }
 
-LuringState *luring_init(Error **errp)
+LuringState *luring_init(bool sqpoll, bool fixed_buffers, Error **errp)
 {
     int rc;
+    int i;
     LuringState *s = g_new0(LuringState, 1);
     struct io_uring *ring = &s->ring;
 
     trace_luring_init_state(s, sizeof(*s));
 
-    rc = io_uring_queue_init(MAX_ENTRIES, ring, 0);
+    rc = io_uring_queue_init(MAX_ENTRIES, ring,
+                             sqpoll ? IORING_SETUP_SQPOLL : 0);
     if (rc < 0) {
-        error_setg_errno(errp, errno, "failed to init linux io_uring ring");
+        error_setg_errno(errp, -rc, "failed to init linux io_uring ring%s",
+                         sqpoll ? " in SQPOLL mode" : "");
         g_free(s);
         return NULL;
     }
 
     ioq_init(&s->io_q);
+
+    /* Start with an empty, sparse file table; fds are added on demand */
+    for (i = 0; i < MAX_FIXED_FILES; i++) {
+        s->fixed_fds[i] = -1;
+    }
+    s->fixed_files = io_uring_register_files(ring, s->fixed_fds,
+                                             MAX_FIXED_FILES) == 0;
+
+    if (fixed_buffers && luring_init_fixed_buffers(s)) {
+        s->fixed_buffers = true;
+        s->fixed_bufs = g_array_new(false, false, sizeof(LuringFixedBuffer));
+        s->used_buf_slots = bitmap_new(MAX_FIXED_BUFFERS);
+        s->ram_notifier.ram_block_added = luring_ram_block_added;
+        s->ram_notifier.ram_block_removed = luring_ram_block_removed;
+        s->ram_notifier.ram_block_resized = luring_ram_block_resized;
+        ram_block_notifier_add(&s->ram_notifier);
+    }
     return s;
 
 }
 
 void luring_cleanup(LuringState *s)
 {
+    if (s->fixed_buffers) {
+        ram_block_notifier_remove(&s->ram_notifier);
+        g_array_free(s->fixed_bufs, true);
+        g_free(s->used_buf_slots);
+    }
     io_uring_queue_exit(&s->ring);
     trace_luring_cleanup_state(s);
     g_free(s);
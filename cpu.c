@@ -274,6 +274,14 @@ int cpu_breakpoint_insert(CPUState *cpu, vaddr pc, int flags,
         *breakpoint = bp;
     }
 
+    /*
+     * Translated indirect branches may probe tb_jmp_cache inline and
+     * skip helper_lookup_tb_ptr, where breakpoints are checked.  Drop
+     * the cached TBs so that the next lookups take the breakpoint into
+     * account.
+     */
+    cpu_tb_jmp_cache_clear(cpu);
+
     trace_breakpoint_insert(cpu->cpu_index, pc, flags);
     return 0;
 }
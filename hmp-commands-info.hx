@@ -686,6 +686,21 @@ SRST
     Show iothread's identifiers.
 ERST
 
+    {
+        .name       = "coroutine-pool",
+        .args_type  = "",
+        .params     = "",
+        .help       = "show coroutine pool statistics",
+        .cmd        = hmp_info_coroutine_pool,
+        .flags      = "p",
+    },
+
+SRST
+  ``info coroutine-pool``
+    Show how many coroutines were allocated, freed and had their stack
+    trimmed by the coroutine pool.
+ERST
+
     {
         .name       = "rocker",
         .args_type  = "name:s",
@@ -1730,16 +1730,18 @@ ERST
     },
 
 SRST
-``calc_dirty_rate`` *second*
+``calc_dirty_rate`` [-r] *second*
   Start a round of dirty rate measurement with the period specified in *second*.
+  With ``-r``, the rate of each vCPU is measured with the KVM dirty ring
+  instead of sampling pages.
   The result of the dirty rate measurement may be observed with ``info
   dirty_rate`` command.
 ERST
 
     {
         .name       = "calc_dirty_rate",
-        .args_type  = "second:l,sample_pages_per_GB:l?",
-        .params     = "second [sample_pages_per_GB]",
+        .args_type  = "dirty_ring:-r,second:l,sample_pages_per_GB:l?",
+        .params     = "[-r] second [sample_pages_per_GB]",
         .help       = "start a round of guest dirty rate measurement",
         .cmd        = hmp_calc_dirty_rate,
     },
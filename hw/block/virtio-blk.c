@@ -72,21 +72,57 @@ static void virtio_blk_free_request(VirtIOBlockReq *req)
     g_free(req);
 }
 
-static void virtio_blk_req_complete(VirtIOBlockReq *req, unsigned char status)
+static void virtio_blk_req_set_status(VirtIOBlockReq *req, unsigned char status)
 {
-    VirtIOBlock *s = req->dev;
-    VirtIODevice *vdev = VIRTIO_DEVICE(s);
-
-    trace_virtio_blk_req_complete(vdev, req, status);
+    trace_virtio_blk_req_complete(VIRTIO_DEVICE(req->dev), req, status);
 
     stb_p(&req->in->status, status);
     iov_discard_undo(&req->inhdr_undo);
     iov_discard_undo(&req->outhdr_undo);
-    virtqueue_push(req->vq, &req->elem, req->in_len);
+}
+
+static void virtio_blk_notify_vq(VirtIOBlock *s, VirtQueue *vq)
+{
     if (s->dataplane_started && !s->dataplane_disabled) {
-        virtio_blk_data_plane_notify(s->dataplane, req->vq);
+        virtio_blk_data_plane_notify(s->dataplane, vq);
     } else {
-        virtio_notify(vdev, req->vq);
+        virtio_notify(VIRTIO_DEVICE(s), vq);
+    }
+}
+
+static void virtio_blk_req_complete(VirtIOBlockReq *req, unsigned char status)
+{
+    virtio_blk_req_set_status(req, status);
+    virtqueue_push(req->vq, &req->elem, req->in_len);
+    virtio_blk_notify_vq(req->dev, req->vq);
+}
+
+/*
+ * Successfully complete requests from the same virtqueue with a single
+ * used index update and notification, then free them.
+ */
+static void virtio_blk_req_complete_batch(VirtIOBlockReq **reqs,
+                                          unsigned int count)
+{
+    VirtIOBlock *s = reqs[0]->dev;
+    VirtQueue *vq = reqs[0]->vq;
+    VirtQueueElement *elems[VIRTIO_BLK_MAX_MERGE_REQS];
+    unsigned int lens[VIRTIO_BLK_MAX_MERGE_REQS];
+    unsigned int i;
+
+    assert(count <= VIRTIO_BLK_MAX_MERGE_REQS);
+    for (i = 0; i < count; i++) {
+        assert(reqs[i]->vq == vq);
+        virtio_blk_req_set_status(reqs[i], VIRTIO_BLK_S_OK);
+        elems[i] = &reqs[i]->elem;
+        lens[i] = reqs[i]->in_len;
+    }
+    virtqueue_push_batch(vq, elems, lens, count);
+    virtio_blk_notify_vq(s, vq);
+
+    for (i = 0; i < count; i++) {
+        block_acct_done(blk_get_stats(s->blk), &reqs[i]->acct);
+        virtio_blk_free_request(reqs[i]);
     }
 }
 
@@ -119,6 +155,8 @@ static void virtio_blk_rw_complete(void *opaque, int ret)
     VirtIOBlockReq *next = opaque;
     VirtIOBlock *s = next->dev;
     VirtIODevice *vdev = VIRTIO_DEVICE(s);
+    VirtIOBlockReq *done[VIRTIO_BLK_MAX_MERGE_REQS];
+    unsigned int num_done = 0;
 
     aio_context_acquire(blk_get_aio_context(s->conf.conf.blk));
     while (next) {
@@ -149,9 +187,19 @@ static void virtio_blk_rw_complete(void *opaque, int ret)
             }
         }
 
-        virtio_blk_req_complete(req, VIRTIO_BLK_S_OK);
-        block_acct_done(blk_get_stats(s->blk), &req->acct);
-        virtio_blk_free_request(req);
+        /*
+         * Requests restarted after an error may come from different
+         * virtqueues, so batch only consecutive requests of one queue.
+         */
+        if (num_done && (done[0]->vq != req->vq ||
+                         num_done == ARRAY_SIZE(done))) {
+            virtio_blk_req_complete_batch(done, num_done);
+            num_done = 0;
+        }
+        done[num_done++] = req;
+    }
+    if (num_done) {
+        virtio_blk_req_complete_batch(done, num_done);
     }
     aio_context_release(blk_get_aio_context(s->conf.conf.blk));
 }
@@ -253,14 +301,18 @@ out:
 
 #endif
 
-static VirtIOBlockReq *virtio_blk_get_request(VirtIOBlock *s, VirtQueue *vq)
+static unsigned int virtio_blk_get_requests(VirtIOBlock *s, VirtQueue *vq,
+                                            VirtIOBlockReq **reqs,
+                                            unsigned int max)
 {
-    VirtIOBlockReq *req = virtqueue_pop(vq, sizeof(VirtIOBlockReq));
+    unsigned int i, count;
 
-    if (req) {
-        virtio_blk_init_request(s, vq, req);
+    count = virtqueue_pop_batch(vq, sizeof(VirtIOBlockReq), (void **)reqs,
+                                max);
+    for (i = 0; i < count; i++) {
+        virtio_blk_init_request(s, vq, reqs[i]);
     }
-    return req;
+    return count;
 }
 
 static int virtio_blk_handle_scsi_req(VirtIOBlockReq *req)
@@ -769,7 +821,8 @@ static int virtio_blk_handle_request(VirtIOBlockReq *req, MultiReqBuffer *mrb)
 
 bool virtio_blk_handle_vq(VirtIOBlock *s, VirtQueue *vq)
 {
-    VirtIOBlockReq *req;
+    VirtIOBlockReq *reqs[VIRTIO_BLK_POP_BATCH];
+    unsigned int i, j, count;
     MultiReqBuffer mrb = {};
     bool suppress_notifications = virtio_queue_get_notification(vq);
     bool progress = false;
@@ -782,11 +835,22 @@ bool virtio_blk_handle_vq(VirtIOBlock *s, VirtQueue *vq)
             virtio_queue_set_notification(vq, 0);
         }
 
-        while ((req = virtio_blk_get_request(s, vq))) {
+        while ((count = virtio_blk_get_requests(s, vq, reqs,
+                                                ARRAY_SIZE(reqs)))) {
             progress = true;
-            if (virtio_blk_handle_request(req, &mrb)) {
-                virtqueue_detach_element(req->vq, &req->elem, 0);
-                virtio_blk_free_request(req);
+            for (i = 0; i < count; i++) {
+                if (virtio_blk_handle_request(reqs[i], &mrb)) {
+                    break;
+                }
+            }
+            if (i < count) {
+                /* The device is broken; give back what was not handled */
+                for (j = count - 1; j > i; j--) {
+                    virtqueue_unpop(vq, &reqs[j]->elem, 0);
+                    virtio_blk_free_request(reqs[j]);
+                }
+                virtqueue_detach_element(vq, &reqs[i]->elem, 0);
+                virtio_blk_free_request(reqs[i]);
                 break;
             }
         }
@@ -1232,6 +1296,12 @@ static void virtio_blk_device_realize(DeviceState *dev, Error **errp)
         return;
     }
 
+    /*
+     * Size the coroutine pool for half of the requests that can be in flight,
+     * so that deep queues do not allocate coroutine stacks on the hot path.
+     */
+    qemu_coroutine_inc_pool_size(conf->num_queues * conf->queue_size / 2);
+
     s->change = qemu_add_vm_change_state_handler(virtio_blk_dma_restart_cb, s);
     blk_set_dev_ops(s->blk, &virtio_block_ops, s);
     blk_set_guest_block_size(s->blk, s->conf.conf.logical_block_size);
@@ -1253,6 +1323,7 @@ static void virtio_blk_device_unrealize(DeviceState *dev)
 
     blk_drain(s->blk);
     del_boot_device_lchs(dev, "/disk@0,0");
+    qemu_coroutine_dec_pool_size(conf->num_queues * conf->queue_size / 2);
     virtio_blk_data_plane_destroy(s->dataplane);
     s->dataplane = NULL;
     for (i = 0; i < conf->num_queues; i++) {
@@ -213,6 +213,14 @@ static void cpu_common_realizefn(DeviceState *dev, Error **errp)
 
     /* NOTE: latest generic point where the cpu is fully realized */
     trace_init_vcpu(cpu);
+
+    /*
+     * Plugin initialization is queued as work on the vCPU, so it must wait
+     * until the vCPU thread exists (see qemu_init_vcpu).
+     */
+    if (tcg_enabled()) {
+        qemu_plugin_vcpu_init_hook(cpu);
+    }
 }
 
 static void cpu_common_unrealizefn(DeviceState *dev)
@@ -220,6 +220,7 @@ static const uint32_t nvme_cse_acs[256] = {
     [NVME_ADM_CMD_GET_FEATURES]     = NVME_CMD_EFF_CSUPP,
     [NVME_ADM_CMD_ASYNC_EV_REQ]     = NVME_CMD_EFF_CSUPP,
     [NVME_ADM_CMD_NS_ATTACHMENT]    = NVME_CMD_EFF_CSUPP | NVME_CMD_EFF_NIC,
+    [NVME_ADM_CMD_DBBUF_CONFIG]     = NVME_CMD_EFF_CSUPP,
     [NVME_ADM_CMD_FORMAT_NVM]       = NVME_CMD_EFF_CSUPP | NVME_CMD_EFF_LBCC,
 };
 
@@ -1265,19 +1266,154 @@ static inline void nvme_blk_write(BlockBackend *blk, int64_t offset,
     }
 }
 
+/*
+ * Shadow doorbells and EventIdx entries are little endian dwords in guest
+ * memory, laid out like the doorbell registers with a stride of 4 bytes (see
+ * nvme_dbbuf_config()).
+ */
+static uint32_t nvme_dbbuf_read(NvmeCtrl *n, uint64_t addr)
+{
+    uint32_t val = 0;
+
+    pci_dma_read(&n->parent_obj, addr, &val, sizeof(val));
+
+    return le32_to_cpu(val);
+}
+
+static void nvme_dbbuf_write(NvmeCtrl *n, uint64_t addr, uint32_t val)
+{
+    val = cpu_to_le32(val);
+
+    pci_dma_write(&n->parent_obj, addr, &val, sizeof(val));
+}
+
+static void nvme_update_cq_head(NvmeCtrl *n, NvmeCQueue *cq, uint16_t head)
+{
+    bool start_sqs = nvme_cq_full(cq);
+
+    cq->head = head;
+    if (start_sqs) {
+        NvmeSQueue *sq;
+        QTAILQ_FOREACH(sq, &cq->sq_list, entry) {
+            timer_mod(sq->timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + 500);
+        }
+        timer_mod(cq->timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + 500);
+    }
+
+    if (cq->tail == cq->head) {
+        if (cq->irq_enabled) {
+            n->cq_pending--;
+        }
+
+        nvme_irq_deassert(n, cq);
+    }
+}
+
+/*
+ * Pick up a head the host has written to the shadow doorbell without ringing
+ * the MMIO doorbell. Returns true if the head moved.
+ */
+static bool nvme_dbbuf_update_cq_head(NvmeCQueue *cq)
+{
+    uint32_t head;
+
+    if (!cq->db_addr) {
+        return false;
+    }
+
+    head = nvme_dbbuf_read(cq->ctrl, cq->db_addr);
+    if (head >= cq->size || head == cq->head) {
+        return false;
+    }
+
+    cq->db_avoided++;
+    cq->db_shadow = true;
+    nvme_update_cq_head(cq->ctrl, cq, head);
+
+    return true;
+}
+
+static bool nvme_dbbuf_update_sq_tail(NvmeSQueue *sq)
+{
+    uint32_t tail;
+
+    if (!sq->db_addr) {
+        return false;
+    }
+
+    tail = nvme_dbbuf_read(sq->ctrl, sq->db_addr);
+    if (tail >= sq->size || tail == sq->tail) {
+        return false;
+    }
+
+    sq->db_avoided++;
+    sq->db_shadow = true;
+    sq->tail = tail;
+
+    return true;
+}
+
+/*
+ * The host only rings a doorbell when the new value passes the EventIdx, so
+ * an EventIdx one behind the current value suppresses the doorbell and an
+ * EventIdx equal to it requests one.
+ *
+ * After a submission queue has been processed, ask for a doorbell on the next
+ * submission; entries the host adds before that are picked up from the shadow
+ * tail without one. Check the shadow once more to close the race with a host
+ * that updated it before seeing the new EventIdx.
+ */
+static void nvme_dbbuf_update_sq_eventidx(NvmeSQueue *sq)
+{
+    NvmeCtrl *n = sq->ctrl;
+
+    nvme_dbbuf_write(n, sq->ei_addr, sq->tail);
+    smp_mb();
+
+    if (nvme_dbbuf_update_sq_tail(sq)) {
+        timer_mod(sq->timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + 500);
+    }
+}
+
+/*
+ * Completion queue head doorbells are only needed to deassert a pin-based
+ * interrupt or to make room in a full queue; otherwise the shadow head is
+ * polled whenever completions are posted.
+ */
+static void nvme_dbbuf_update_cq_eventidx(NvmeCQueue *cq)
+{
+    NvmeCtrl *n = cq->ctrl;
+
+    if (msix_enabled(&n->parent_obj) &&
+        !(nvme_cq_full(cq) && !QTAILQ_EMPTY(&cq->req_list))) {
+        nvme_dbbuf_write(n, cq->ei_addr, (cq->head + cq->size - 1) % cq->size);
+        return;
+    }
+
+    nvme_dbbuf_write(n, cq->ei_addr, cq->head);
+    smp_mb();
+
+    if (nvme_dbbuf_update_cq_head(cq) && !QTAILQ_EMPTY(&cq->req_list)) {
+        timer_mod(cq->timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + 500);
+    }
+}
+
 static void nvme_post_cqes(void *opaque)
 {
     NvmeCQueue *cq = opaque;
     NvmeCtrl *n = cq->ctrl;
     NvmeRequest *req, *next;
-    bool pending = cq->head != cq->tail;
+    bool pending;
     int ret;
 
+    nvme_dbbuf_update_cq_head(cq);
+    pending = cq->head != cq->tail;
+
     QTAILQ_FOREACH_SAFE(req, &cq->req_list, entry, next) {
         NvmeSQueue *sq;
         hwaddr addr;
 
-        if (nvme_cq_full(cq)) {
+        if (nvme_cq_full(cq) && !nvme_dbbuf_update_cq_head(cq)) {
             break;
         }
 
@@ -1306,6 +1442,10 @@ static void nvme_post_cqes(void *opaque)
 
         nvme_irq_assert(n, cq);
     }
+
+    if (cq->ei_addr) {
+        nvme_dbbuf_update_cq_eventidx(cq);
+    }
 }
 
 static void nvme_enqueue_req_completion(NvmeCQueue *cq, NvmeRequest *req)
@@ -3925,6 +4065,10 @@ static uint16_t nvme_io_cmd(NvmeCtrl *n, NvmeRequest *req)
 
 static void nvme_free_sq(NvmeSQueue *sq, NvmeCtrl *n)
 {
+    if (sq->db_addr) {
+        trace_pci_nvme_dbbuf_sq_stats(sq->sqid, sq->db_writes, sq->db_avoided);
+    }
+
     n->sq[sq->sqid] = NULL;
     timer_free(sq->timer);
     g_free(sq->io_req);
@@ -3974,6 +4118,17 @@ static uint16_t nvme_del_sq(NvmeCtrl *n, NvmeRequest *req)
     return NVME_SUCCESS;
 }
 
+static void nvme_dbbuf_init_sq(NvmeSQueue *sq)
+{
+    NvmeCtrl *n = sq->ctrl;
+
+    sq->db_addr = n->dbbuf_dbs + (sq->sqid << 3);
+    sq->ei_addr = n->dbbuf_eis + (sq->sqid << 3);
+
+    nvme_dbbuf_write(n, sq->db_addr, sq->tail);
+    nvme_dbbuf_write(n, sq->ei_addr, sq->tail);
+}
+
 static void nvme_init_sq(NvmeSQueue *sq, NvmeCtrl *n, uint64_t dma_addr,
                          uint16_t sqid, uint16_t cqid, uint16_t size)
 {
@@ -3986,6 +4141,9 @@ static void nvme_init_sq(NvmeSQueue *sq, NvmeCtrl *n, uint64_t dma_addr,
     sq->size = size;
     sq->cqid = cqid;
     sq->head = sq->tail = 0;
+    sq->db_addr = sq->ei_addr = 0;
+    sq->db_writes = sq->db_avoided = 0;
+    sq->db_shadow = false;
     sq->io_req = g_new0(NvmeRequest, sq->size);
 
     QTAILQ_INIT(&sq->req_list);
@@ -3996,6 +4154,10 @@ static void nvme_init_sq(NvmeSQueue *sq, NvmeCtrl *n, uint64_t dma_addr,
     }
     sq->timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, nvme_process_sq, sq);
 
+    if (sqid && n->dbbuf_enabled) {
+        nvme_dbbuf_init_sq(sq);
+    }
+
     assert(n->cq[cqid]);
     cq = n->cq[cqid];
     QTAILQ_INSERT_TAIL(&(cq->sq_list), sq, entry);
@@ -4293,6 +4455,10 @@ static uint16_t nvme_get_log(NvmeCtrl *n, NvmeRequest *req)
 
 static void nvme_free_cq(NvmeCQueue *cq, NvmeCtrl *n)
 {
+    if (cq->db_addr) {
+        trace_pci_nvme_dbbuf_cq_stats(cq->cqid, cq->db_writes, cq->db_avoided);
+    }
+
     n->cq[cq->cqid] = NULL;
     timer_free(cq->timer);
     if (msix_enabled(&n->parent_obj)) {
@@ -4330,6 +4496,17 @@ static uint16_t nvme_del_cq(NvmeCtrl *n, NvmeRequest *req)
     return NVME_SUCCESS;
 }
 
+static void nvme_dbbuf_init_cq(NvmeCQueue *cq)
+{
+    NvmeCtrl *n = cq->ctrl;
+
+    cq->db_addr = n->dbbuf_dbs + (cq->cqid << 3) + (1 << 2);
+    cq->ei_addr = n->dbbuf_eis + (cq->cqid << 3) + (1 << 2);
+
+    nvme_dbbuf_write(n, cq->db_addr, cq->head);
+    nvme_dbbuf_write(n, cq->ei_addr, cq->head);
+}
+
 static void nvme_init_cq(NvmeCQueue *cq, NvmeCtrl *n, uint64_t dma_addr,
                          uint16_t cqid, uint16_t vector, uint16_t size,
                          uint16_t irq_enabled)
@@ -4348,10 +4525,17 @@ static void nvme_init_cq(NvmeCQueue *cq, NvmeCtrl *n, uint64_t dma_addr,
     cq->irq_enabled = irq_enabled;
     cq->vector = vector;
     cq->head = cq->tail = 0;
+    cq->db_addr = cq->ei_addr = 0;
+    cq->db_writes = cq->db_avoided = 0;
+    cq->db_shadow = false;
     QTAILQ_INIT(&cq->req_list);
     QTAILQ_INIT(&cq->sq_list);
     n->cq[cqid] = cq;
     cq->timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, nvme_post_cqes, cq);
+
+    if (cqid && n->dbbuf_enabled) {
+        nvme_dbbuf_init_cq(cq);
+    }
 }
 
 static uint16_t nvme_create_cq(NvmeCtrl *n, NvmeRequest *req)
@@ -5451,6 +5635,42 @@ out:
     return status;
 }
 
+/*
+ * Doorbell Buffer Config: PRP1 points to the shadow doorbell buffer the host
+ * updates instead of ringing the doorbell registers and PRP2 to the EventIdx
+ * buffer through which the controller tells the host when it still wants
+ * the MMIO doorbell written. Both are a single page laid out like the
+ * doorbell registers. The admin queue keeps using the doorbell registers.
+ */
+static uint16_t nvme_dbbuf_config(NvmeCtrl *n, const NvmeRequest *req)
+{
+    uint64_t dbs_addr = le64_to_cpu(req->cmd.dptr.prp1);
+    uint64_t eis_addr = le64_to_cpu(req->cmd.dptr.prp2);
+    int i;
+
+    if (dbs_addr & (n->page_size - 1) || eis_addr & (n->page_size - 1)) {
+        return NVME_INVALID_FIELD | NVME_DNR;
+    }
+
+    trace_pci_nvme_dbbuf_config(dbs_addr, eis_addr);
+
+    n->dbbuf_dbs = dbs_addr;
+    n->dbbuf_eis = eis_addr;
+    n->dbbuf_enabled = true;
+
+    for (i = 1; i < n->params.max_ioqpairs + 1; i++) {
+        if (n->cq[i]) {
+            nvme_dbbuf_init_cq(n->cq[i]);
+        }
+
+        if (n->sq[i]) {
+            nvme_dbbuf_init_sq(n->sq[i]);
+        }
+    }
+
+    return NVME_SUCCESS;
+}
+
 static uint16_t nvme_admin_cmd(NvmeCtrl *n, NvmeRequest *req)
 {
     trace_pci_nvme_admin_cmd(nvme_cid(req), nvme_sqid(req), req->cmd.opcode,
@@ -5489,6 +5709,8 @@ static uint16_t nvme_admin_cmd(NvmeCtrl *n, NvmeRequest *req)
         return nvme_aer(n, req);
     case NVME_ADM_CMD_NS_ATTACHMENT:
         return nvme_ns_attachment(n, req);
+    case NVME_ADM_CMD_DBBUF_CONFIG:
+        return nvme_dbbuf_config(n, req);
     case NVME_ADM_CMD_FORMAT_NVM:
         return nvme_format(n, req);
     default:
@@ -5509,6 +5731,8 @@ static void nvme_process_sq(void *opaque)
     NvmeCmd cmd;
     NvmeRequest *req;
 
+    nvme_dbbuf_update_sq_tail(sq);
+
     while (!(nvme_sq_empty(sq) || QTAILQ_EMPTY(&sq->req_list))) {
         addr = sq->dma_addr + sq->head * n->sqe_size;
         if (nvme_addr_read(n, addr, (void *)&cmd, sizeof(cmd))) {
@@ -5532,6 +5756,14 @@ static void nvme_process_sq(void *opaque)
             req->status = status;
             nvme_enqueue_req_completion(cq, req);
         }
+
+        if (nvme_sq_empty(sq)) {
+            nvme_dbbuf_update_sq_tail(sq);
+        }
+    }
+
+    if (sq->ei_addr) {
+        nvme_dbbuf_update_sq_eventidx(sq);
     }
 }
 
@@ -5569,6 +5801,10 @@ static void nvme_ctrl_reset(NvmeCtrl *n)
     n->aer_queued = 0;
     n->outstanding_aers = 0;
     n->qs_created = false;
+
+    n->dbbuf_enabled = false;
+    n->dbbuf_dbs = 0;
+    n->dbbuf_eis = 0;
 }
 
 static void nvme_ctrl_shutdown(NvmeCtrl *n)
@@ -6033,7 +6269,6 @@ static void nvme_process_db(NvmeCtrl *n, hwaddr addr, int val)
         /* Completion queue doorbell write */
 
         uint16_t new_head = val & 0xffff;
-        int start_sqs;
         NvmeCQueue *cq;
 
         qid = (addr - (0x1000 + (1 << 2))) >> 3;
@@ -6084,23 +6319,22 @@ static void nvme_process_db(NvmeCtrl *n, hwaddr addr, int val)
 
         trace_pci_nvme_mmio_doorbell_cq(cq->cqid, new_head);
 
-        start_sqs = nvme_cq_full(cq) ? 1 : 0;
-        cq->head = new_head;
-        if (start_sqs) {
-            NvmeSQueue *sq;
-            QTAILQ_FOREACH(sq, &cq->sq_list, entry) {
-                timer_mod(sq->timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + 500);
-            }
-            timer_mod(cq->timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + 500);
-        }
+        cq->db_writes++;
 
-        if (cq->tail == cq->head) {
-            if (cq->irq_enabled) {
-                n->cq_pending--;
+        /*
+         * The head may already have been picked up from the shadow doorbell;
+         * the doorbell write was not avoided after all.
+         */
+        if (cq->db_addr && new_head == cq->head) {
+            if (cq->db_shadow) {
+                cq->db_avoided--;
+                cq->db_shadow = false;
             }
-
-            nvme_irq_deassert(n, cq);
+            return;
         }
+
+        cq->db_shadow = false;
+        nvme_update_cq_head(n, cq, new_head);
     } else {
         /* Submission queue doorbell write */
 
@@ -6142,6 +6376,11 @@ static void nvme_process_db(NvmeCtrl *n, hwaddr addr, int val)
 
         trace_pci_nvme_mmio_doorbell_sq(sq->sqid, new_tail);
 
+        sq->db_writes++;
+        if (sq->db_shadow && new_tail == sq->tail) {
+            sq->db_avoided--;
+        }
+        sq->db_shadow = false;
         sq->tail = new_tail;
         timer_mod(sq->timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + 500);
     }
@@ -6420,7 +6659,8 @@ static void nvme_init_ctrl(NvmeCtrl *n, PCIDevice *pci_dev)
 
     id->mdts = n->params.mdts;
     id->ver = cpu_to_le32(NVME_SPEC_VER);
-    id->oacs = cpu_to_le16(NVME_OACS_NS_MGMT | NVME_OACS_FORMAT);
+    id->oacs = cpu_to_le16(NVME_OACS_NS_MGMT | NVME_OACS_FORMAT |
+                           NVME_OACS_DBBUF);
     id->cntrltype = 0x1;
 
     /*
@@ -6656,6 +6896,71 @@ static void nvme_set_smart_warning(Object *obj, Visitor *v, const char *name,
     }
 }
 
+static bool nvme_visit_dbbuf_stats(Visitor *v, NvmeSQueue *sq,
+                                   NvmeCQueue *cq, Error **errp)
+{
+    uint16_t qid = sq->sqid;
+    bool ok = false;
+
+    if (!visit_start_struct(v, NULL, NULL, 0, errp)) {
+        return false;
+    }
+    if (!visit_type_uint16(v, "qid", &qid, errp)) {
+        goto out_end;
+    }
+    if (!visit_type_uint64(v, "sq-doorbells", &sq->db_writes, errp)) {
+        goto out_end;
+    }
+    if (!visit_type_uint64(v, "sq-exits-avoided", &sq->db_avoided, errp)) {
+        goto out_end;
+    }
+    if (cq) {
+        if (!visit_type_uint64(v, "cq-doorbells", &cq->db_writes, errp)) {
+            goto out_end;
+        }
+        if (!visit_type_uint64(v, "cq-exits-avoided", &cq->db_avoided,
+                               errp)) {
+            goto out_end;
+        }
+    }
+    ok = visit_check_struct(v, errp);
+out_end:
+    visit_end_struct(v, NULL);
+    return ok;
+}
+
+/*
+ * Per I/O queue doorbell counters: doorbell register writes, and queue
+ * updates picked up from the shadow doorbell buffer that the host never
+ * wrote to the doorbell register.
+ */
+static void nvme_get_dbbuf_stats(Object *obj, Visitor *v, const char *name,
+                                 void *opaque, Error **errp)
+{
+    NvmeCtrl *n = NVME(obj);
+    int i;
+
+    if (!visit_start_list(v, name, NULL, 0, errp)) {
+        return;
+    }
+
+    for (i = 1; n->sq && i < n->params.max_ioqpairs + 1; i++) {
+        NvmeSQueue *sq = n->sq[i];
+
+        if (!sq) {
+            continue;
+        }
+
+        if (!nvme_visit_dbbuf_stats(v, sq, n->cq[sq->cqid], errp)) {
+            goto out_end;
+        }
+    }
+
+    visit_check_list(v, errp);
+out_end:
+    visit_end_list(v, NULL);
+}
+
 static const VMStateDescription nvme_vmstate = {
     .name = "nvme",
     .unmigratable = 1,
@@ -6688,6 +6993,9 @@ static void nvme_instance_init(Object *obj)
     object_property_add(obj, "smart_critical_warning", "uint8",
                         nvme_get_smart_warning,
                         nvme_set_smart_warning, NULL, NULL);
+
+    object_property_add(obj, "x-dbbuf-stats", "list",
+                        nvme_get_dbbuf_stats, NULL, NULL, NULL);
 }
 
 static const TypeInfo nvme_info = {
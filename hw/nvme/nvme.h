@@ -320,6 +320,7 @@ static inline const char *nvme_adm_opc_str(uint8_t opc)
     case NVME_ADM_CMD_GET_FEATURES:     return "NVME_ADM_CMD_GET_FEATURES";
     case NVME_ADM_CMD_ASYNC_EV_REQ:     return "NVME_ADM_CMD_ASYNC_EV_REQ";
     case NVME_ADM_CMD_NS_ATTACHMENT:    return "NVME_ADM_CMD_NS_ATTACHMENT";
+    case NVME_ADM_CMD_DBBUF_CONFIG:     return "NVME_ADM_CMD_DBBUF_CONFIG";
     case NVME_ADM_CMD_FORMAT_NVM:       return "NVME_ADM_CMD_FORMAT_NVM";
     default:                            return "NVME_ADM_CMD_UNKNOWN";
     }
@@ -351,6 +352,11 @@ typedef struct NvmeSQueue {
     uint32_t    tail;
     uint32_t    size;
     uint64_t    dma_addr;
+    uint64_t    db_addr;    /* shadow doorbell, 0 if not in use */
+    uint64_t    ei_addr;    /* EventIdx */
+    uint64_t    db_writes;  /* tail doorbell MMIO writes */
+    uint64_t    db_avoided; /* shadow tails not followed by an MMIO write */
+    bool        db_shadow;  /* tail was last set from the shadow doorbell */
     QEMUTimer   *timer;
     NvmeRequest *io_req;
     QTAILQ_HEAD(, NvmeRequest) req_list;
@@ -368,6 +374,11 @@ typedef struct NvmeCQueue {
     uint32_t    vector;
     uint32_t    size;
     uint64_t    dma_addr;
+    uint64_t    db_addr;    /* shadow doorbell, 0 if not in use */
+    uint64_t    ei_addr;    /* EventIdx */
+    uint64_t    db_writes;  /* head doorbell MMIO writes */
+    uint64_t    db_avoided; /* shadow heads not followed by an MMIO write */
+    bool        db_shadow;  /* head was last set from the shadow doorbell */
     QEMUTimer   *timer;
     QTAILQ_HEAD(, NvmeSQueue) sq_list;
     QTAILQ_HEAD(, NvmeRequest) req_list;
@@ -419,6 +430,11 @@ typedef struct NvmeCtrl {
     uint16_t    temperature;
     uint8_t     smart_critical_warning;
 
+    /* Doorbell Buffer Config, see nvme_dbbuf_config() */
+    bool        dbbuf_enabled;
+    uint64_t    dbbuf_dbs;
+    uint64_t    dbbuf_eis;
+
     struct {
         MemoryRegion mem;
         uint8_t      *buf;
@@ -20,6 +20,7 @@
 #include "qemu/coroutine.h"
 #include "qemu/queue.h"
 #include "qemu/event_notifier.h"
+#include "qemu/stats64.h"
 #include "qemu/thread.h"
 #include "qemu/timer.h"
 
@@ -182,13 +183,23 @@ struct AioContext {
      * positives are possible, i.e. "notified" could be set even though the
      * EventNotifier is clear.
      *
-     * Note that event_notifier_set *cannot* be optimized the same way.  For
-     * more information on the problem that would result, see "#ifdef BUG2"
-     * in the docs/aio_notify_accept.promela formal model.
+     * aio_notify skips event_notifier_set if "notified" was already set.
+     * This is only correct because the event loop never blocks while
+     * "notified" is set; without that check, see "#ifdef BUG2" in the
+     * docs/spin/aio_notify_accept.promela formal model for the problem that
+     * would result.
      */
     bool notified;
     EventNotifier notifier;
 
+    /*
+     * Number of aio_notify calls that set the EventNotifier, and of those that
+     * were coalesced with an earlier notification that the event loop had not
+     * yet accepted.
+     */
+    Stat64 notify_events;
+    Stat64 notify_coalesced;
+
     QSLIST_HEAD(, Coroutine) scheduled_coroutines;
     QEMUBH *co_schedule_bh;
 
@@ -235,6 +246,10 @@ struct AioContext {
     /* AIO engine parameters */
     int64_t aio_max_batch;  /* maximum number of requests in a batch */
 
+    /* io_uring parameters, applied when the io_uring ring is created */
+    bool uring_sqpoll;          /* use a kernel submission queue thread */
+    bool uring_fixed_buffers;   /* register guest RAM as fixed buffers */
+
     /*
      * List of handlers participating in userspace polling.  Protected by
      * ctx->list_lock.  Iterated and modified mostly by the event loop thread
@@ -767,4 +782,17 @@ void aio_context_set_poll_params(AioContext *ctx, int64_t max_ns,
 void aio_context_set_aio_params(AioContext *ctx, int64_t max_batch,
                                 Error **errp);
 
+/**
+ * aio_context_set_io_uring_params:
+ * @ctx: the aio context
+ * @sqpoll: let a kernel thread poll the submission queue
+ * @fixed_buffers: register guest RAM with the ring so that reads and writes
+ *                 from guest memory do not need to pin pages
+ *
+ * The parameters only take effect when the io_uring ring of @ctx is created,
+ * i.e. before the first block device using aio=io_uring is attached to it.
+ */
+void aio_context_set_io_uring_params(AioContext *ctx, bool sqpoll,
+                                     bool fixed_buffers, Error **errp);
+
 #endif
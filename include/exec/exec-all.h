@@ -517,6 +517,14 @@ struct TranslationBlock {
     uint16_t size;
     uint16_t icount;
 
+    /*
+     * Executions left before the TB is retranslated as a trace, or NULL if
+     * the TB does not count them.  Decremented by the generated code.
+     */
+    int32_t *hot_count;
+    /* the TB was translated as a trace, see translator_trace_follow() */
+    bool trace;
+
     struct tb_tc tc;
 
     /* first and second physical page containing code. The lower bit
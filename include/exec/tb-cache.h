@@ -0,0 +1,63 @@
+/*
+ * Persistent translation cache for user mode emulation
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef EXEC_TB_CACHE_H
+#define EXEC_TB_CACHE_H
+
+#include "exec/cpu-defs.h"
+
+/**
+ * tb_cache_init:
+ * @dir: directory holding the cache files, created if needed
+ * @config: anything besides the guest code that changes the translation,
+ *          e.g. the CPU model and its properties
+ *
+ * Enable the cache.  The ops emitted for the TBs of file backed
+ * executable mappings are saved to one cache file per mapped file,
+ * and used instead of the front end by later runs.
+ */
+void tb_cache_init(const char *dir, const char *config);
+
+/**
+ * tb_cache_map:
+ * @start: guest address of the mapping
+ * @len: length of the mapping
+ * @fd: file descriptor of the mapped file
+ *
+ * Called with mmap_lock held when an executable file mapping is created.
+ * Loads the cache file of the mapped file, unless the file changed since
+ * the cache file was written.
+ */
+void tb_cache_map(target_ulong start, target_ulong len, int fd);
+
+/**
+ * tb_cache_unmap:
+ * @start: guest address of the range
+ * @len: length of the range
+ *
+ * Called with mmap_lock held when a range of guest memory is unmapped.
+ */
+void tb_cache_unmap(target_ulong start, target_ulong len);
+
+/**
+ * tb_cache_flush:
+ *
+ * Write the cache files that gained entries, e.g. before execve().
+ */
+void tb_cache_flush(void);
+
+/**
+ * tb_cache_exit:
+ *
+ * Write the cache files and report the hit rate if requested with
+ * tb_cache_enable_stats().
+ */
+void tb_cache_exit(void);
+
+void tb_cache_enable_stats(void);
+
+#endif
@@ -63,6 +63,11 @@ typedef enum DisasJumpType {
  * @num_insns: Number of translated instructions (including current).
  * @max_insns: Maximum number of instructions to be translated in this TB.
  * @singlestep_enabled: "Hardware" single stepping enabled.
+ * @pc_max: End of the highest guest instruction translated before the last
+ *          branch followed by translator_trace_follow().
+ * @trace_follows: Number of branches followed by translator_trace_follow().
+ * @trace_side_exits: Number of side exits generated by the target for the
+ *                    branches it followed.
  *
  * Architecture-agnostic disassembly context.
  */
@@ -74,6 +79,9 @@ typedef struct DisasContextBase {
     int num_insns;
     int max_insns;
     bool singlestep_enabled;
+    target_ulong pc_max;
+    int trace_follows;
+    int trace_side_exits;
 } DisasContextBase;
 
 /**
@@ -107,6 +115,8 @@ typedef struct TranslatorOps {
     void (*translate_insn)(DisasContextBase *db, CPUState *cpu);
     void (*tb_stop)(DisasContextBase *db, CPUState *cpu);
     void (*disas_log)(const DisasContextBase *db, CPUState *cpu);
+    /* The target calls translator_trace_follow(), see trace-threshold */
+    bool trace_follow;
 } TranslatorOps;
 
 /**
@@ -144,6 +154,36 @@ void translator_loop_temp_check(DisasContextBase *db);
  */
 bool translator_use_goto_tb(DisasContextBase *db, target_ulong dest);
 
+/**
+ * translator_trace_follow
+ * @db: Disassembly context
+ * @dest: guest pc the translation would continue at
+ *
+ * Return true if the translation of a trace may follow a branch and
+ * continue at @dest instead of ending the TB.  The caller then sets
+ * db->pc_next to @dest; any path that leaves the trace must be ended
+ * with a side exit.  Traces stay within the page of their first
+ * instruction and never go back before it, so that the TB is still
+ * invalidated by writes to the code it contains.
+ *
+ * Targets whose instructions can cross a page must check it themselves.
+ */
+bool translator_trace_follow(DisasContextBase *db, target_ulong dest);
+
+/**
+ * translator_lookup_and_goto_ptr
+ * @db: Disassembly context
+ * @pc: guest pc of the next TB
+ *
+ * Like tcg_gen_lookup_and_goto_ptr(), but probe the vCPU's tb_jmp_cache
+ * inline and call helper_lookup_tb_ptr only on a miss.  The caller
+ * guarantees that the cs_base and flags computed by
+ * cpu_get_tb_cpu_state() at this point are those of db->tb, i.e. that
+ * only the pc changed since the start of the TB.  Hits and misses are
+ * counted per vCPU and reported by "info jit".
+ */
+void translator_lookup_and_goto_ptr(DisasContextBase *db, TCGv pc);
+
 /*
  * Translator Load Functions
  *
@@ -301,6 +301,8 @@ struct qemu_work_item;
  *    ring is enabled.
  * @kvm_fetch_index: Keeps the index that we last fetched from the per-vCPU
  *    dirty ring structure.
+ * @dirty_pages: Number of pages collected from the KVM dirty ring of this
+ *    CPU since it was created.
  *
  * State of one CPU core or thread.
  */
@@ -353,6 +355,9 @@ struct CPUState {
 
     /* Accessed in parallel; all accesses must be atomic */
     TranslationBlock *tb_jmp_cache[TB_JMP_CACHE_SIZE];
+    /* Indirect branches resolved by the inline tb_jmp_cache probe */
+    size_t tb_jmp_inline_hits;
+    size_t tb_jmp_inline_misses;
 
     struct GDBRegisterState *gdb_regs;
     int gdb_num_regs;
@@ -378,6 +383,7 @@ struct CPUState {
     struct kvm_run *kvm_run;
     struct kvm_dirty_gfn *kvm_dirty_gfns;
     uint32_t kvm_fetch_index;
+    uint64_t dirty_pages;
 
     /* Used for events with 'vcpu' and *without* the 'disabled' properties */
     DECLARE_BITMAP(trace_dstate_delayed, CPU_TRACE_DSTATE_MAX_EVENTS);
@@ -406,6 +412,8 @@ struct CPUState {
      * autoconverge
      */
     bool throttle_thread_scheduled;
+    /* Throttle percentage of this vCPU alone, see cpu_throttle_set_vcpu() */
+    int throttle_percentage;
 
     bool ignore_memory_transaction_failures;
 
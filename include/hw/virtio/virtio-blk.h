@@ -84,6 +84,9 @@ typedef struct VirtIOBlockReq {
 
 #define VIRTIO_BLK_MAX_MERGE_REQS 32
 
+/* Maximum number of requests popped from a virtqueue at once */
+#define VIRTIO_BLK_POP_BATCH 32
+
 typedef struct MultiReqBuffer {
     VirtIOBlockReq *reqs[VIRTIO_BLK_MAX_MERGE_REQS];
     unsigned int num_reqs;
@@ -35,6 +35,9 @@ OBJECT_DECLARE_SIMPLE_TYPE(VirtIONet, VIRTIO_NET)
  * and latency. */
 #define TX_BURST 256
 
+/* Maximum number of TX packets popped and completed together */
+#define VIRTIO_NET_TX_BATCH 64
+
 typedef struct virtio_net_conf
 {
     uint32_t txtimer;
@@ -47,6 +47,9 @@ struct QIOChannelSocket {
     socklen_t localAddrLen;
     struct sockaddr_storage remoteAddr;
     socklen_t remoteAddrLen;
+    /* MSG_ZEROCOPY sendmsg() calls, and how many of them have completed */
+    ssize_t zero_copy_queued;
+    ssize_t zero_copy_sent;
 };
 
 
@@ -26,8 +26,22 @@
 
 
 typedef struct NetPacket NetPacket;
+typedef struct NetPacketBuf NetPacketBuf;
 typedef struct NetQueue NetQueue;
 
+/*
+ * Describes a packet while it is passed on to other net clients.  Any
+ * queue that appends the same data before qemu_net_packet_scope_end()
+ * shares one reference counted copy of it.
+ */
+typedef struct NetPacketScope {
+    const struct iovec *iov;
+    int iovcnt;
+    NetPacketBuf *buf;
+    bool owned;
+    struct NetPacketScope *outer;
+} NetPacketScope;
+
 typedef void (NetPacketSent) (NetClientState *sender, ssize_t ret);
 
 #define QEMU_NET_PACKET_FLAG_NONE  0
@@ -44,6 +58,20 @@ typedef ssize_t (NetQueueDeliverFunc)(NetClientState *sender,
                                       int iovcnt,
                                       void *opaque);
 
+NetPacketBuf *qemu_net_packet_buf_new(size_t size);
+NetPacketBuf *qemu_net_packet_buf_from_iov(const struct iovec *iov,
+                                           int iovcnt);
+uint8_t *qemu_net_packet_buf_data(NetPacketBuf *buf);
+size_t qemu_net_packet_buf_size(NetPacketBuf *buf);
+void qemu_net_packet_buf_ref(NetPacketBuf *buf);
+void qemu_net_packet_buf_unref(NetPacketBuf *buf);
+
+/* @buf, if not NULL, already holds the data of @iov */
+void qemu_net_packet_scope_begin(NetPacketScope *scope,
+                                 const struct iovec *iov, int iovcnt,
+                                 NetPacketBuf *buf);
+void qemu_net_packet_scope_end(NetPacketScope *scope);
+
 NetQueue *qemu_new_net_queue(NetQueueDeliverFunc *deliver, void *opaque);
 
 void qemu_net_queue_append_iov(NetQueue *queue,
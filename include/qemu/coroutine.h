@@ -108,6 +108,35 @@ Coroutine *coroutine_fn qemu_coroutine_self(void);
  */
 bool qemu_in_coroutine(void);
 
+/**
+ * Increase or decrease the number of coroutines that are kept in the pool
+ * for reuse
+ *
+ * Devices that can have many requests in flight at the same time should
+ * grow the pool by their queue depth, so that creating a coroutine for each
+ * request does not need to allocate a new stack.  Decreasing the pool size
+ * frees the pooled coroutines beyond the new size and releases the stack
+ * memory of the remaining ones.
+ */
+void qemu_coroutine_inc_pool_size(unsigned int additional_pool_size);
+void qemu_coroutine_dec_pool_size(unsigned int removing_pool_size);
+
+typedef struct CoroutinePoolStats {
+    /* Target number of coroutines kept in each pool */
+    unsigned int batch_size;
+    /* Coroutines created because the pools were empty */
+    uint64_t allocated;
+    /* Terminated coroutines freed because the pools were full */
+    uint64_t freed;
+    /* Idle coroutines whose stack memory was released */
+    uint64_t trimmed;
+} CoroutinePoolStats;
+
+/**
+ * Get statistics about the coroutine pool
+ */
+void qemu_coroutine_get_pool_stats(CoroutinePoolStats *stats);
+
 /**
  * Return true if the coroutine is currently entered
  *
@@ -71,6 +71,13 @@ struct Coroutine {
 
 Coroutine *qemu_coroutine_new(void);
 void qemu_coroutine_delete(Coroutine *co);
+
+/*
+ * Release the memory of the unused part of the stack of a terminated
+ * coroutine back to the operating system.  The coroutine can still be
+ * reused afterwards.
+ */
+void qemu_coroutine_trim(Coroutine *co);
 CoroutineAction qemu_coroutine_switch(Coroutine *from, Coroutine *to,
                                       CoroutineAction action);
 
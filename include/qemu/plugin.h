@@ -71,6 +71,16 @@ enum plugin_dyn_cb_subtype {
     PLUGIN_N_CB_SUBTYPES,
 };
 
+/*
+ * One entry per vCPU, indexed by cpu_index. Translated code reads @data
+ * on each access, so the array can be reallocated while all vCPUs are
+ * stopped.
+ */
+struct qemu_plugin_scoreboard {
+    GArray *data;
+    QLIST_ENTRY(qemu_plugin_scoreboard) entry;
+};
+
 /*
  * A dynamic callback has an insertion point that is determined at run-time.
  * Usually the insertion point is somewhere in the code cache; think for
@@ -84,10 +94,18 @@ struct qemu_plugin_dyn_cb {
     enum qemu_plugin_mem_rw rw;
     /* fields specific to each dyn_cb type go here */
     union {
+        /* a NULL @entry.score means the op applies to the global @userp */
         struct {
             enum qemu_plugin_op op;
+            qemu_plugin_u64 entry;
             uint64_t imm;
         } inline_insn;
+        /* regular callbacks are only made if (@entry @cond @imm) holds */
+        struct {
+            enum qemu_plugin_cond cond;
+            qemu_plugin_u64 entry;
+            uint64_t imm;
+        } cond;
     };
 };
 
@@ -42,6 +42,26 @@ void cpu_throttle_init(void);
  */
 void cpu_throttle_set(int new_throttle_pct);
 
+/**
+ * cpu_throttle_set_vcpu:
+ * @cpu: The vCPU to throttle
+ * @new_throttle_pct: Percent of sleep time. Valid range is 1 to 99, or 0
+ * to stop throttling this vCPU.
+ *
+ * Throttles a single vcpu, like cpu_throttle_set() does for all of them.
+ * When both are in effect, the vcpu sleeps for the larger percentage.
+ * The caller must hold the BQL.
+ */
+void cpu_throttle_set_vcpu(CPUState *cpu, int new_throttle_pct);
+
+/**
+ * cpu_throttle_get_vcpu:
+ * @cpu: The vCPU
+ *
+ * Returns: the throttle percentage set with cpu_throttle_set_vcpu(), or 0.
+ */
+int cpu_throttle_get_vcpu(CPUState *cpu);
+
 /**
  * cpu_throttle_stop:
  *
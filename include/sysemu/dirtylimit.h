@@ -0,0 +1,48 @@
+/*
+ * Per-vCPU dirty page rate limit
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef QEMU_DIRTYLIMIT_H
+#define QEMU_DIRTYLIMIT_H
+
+/**
+ * dirtylimit_set_vcpu:
+ * @cpu_index: index of the vCPU
+ * @quota: dirty page rate limit in MB/s, 0 to remove the limit
+ *
+ * Limit how fast a vCPU can dirty memory.  The dirty rate of every
+ * limited vCPU is measured each second with the KVM dirty ring, and
+ * the vCPUs above their quota are throttled with cpu_throttle_set_vcpu().
+ * The others run at full speed.
+ *
+ * The caller must hold the BQL and check kvm_dirty_ring_enabled().
+ */
+void dirtylimit_set_vcpu(int cpu_index, uint64_t quota);
+
+/**
+ * dirtylimit_set_all:
+ * @quota: dirty page rate limit in MB/s, 0 to remove the limits
+ *
+ * Like dirtylimit_set_vcpu(), for every vCPU.
+ */
+void dirtylimit_set_all(uint64_t quota);
+
+/**
+ * dirtylimit_in_service:
+ *
+ * Returns: true if the dirty page rate of any vCPU is limited.
+ */
+bool dirtylimit_in_service(void);
+
+/**
+ * dirtylimit_vcpu_index_valid:
+ * @cpu_index: index of the vCPU
+ *
+ * Returns: true if @cpu_index is the index of an existing vCPU.
+ */
+bool dirtylimit_vcpu_index_valid(int cpu_index);
+
+#endif
@@ -40,6 +40,8 @@ struct IOThread {
 
     /* AioContext AIO engine parameters */
     int64_t aio_max_batch;
+    bool aio_uring_sqpoll;
+    bool aio_uring_fixed_buffers;
 };
 typedef struct IOThread IOThread;
 
@@ -547,4 +547,13 @@ bool kvm_cpu_check_are_resettable(void);
 
 bool kvm_arch_cpu_check_are_resettable(void);
 
+/**
+ * kvm_dirty_ring_enabled - return whether KVM tracks dirty pages with
+ * per-vCPU dirty rings
+ *
+ * Returns: true if the dirty ring is in use, which also means that
+ *          #CPUState.dirty_pages is counted
+ */
+bool kvm_dirty_ring_enabled(void);
+
 #endif
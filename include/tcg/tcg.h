@@ -592,6 +592,9 @@ struct TCGContext {
 
     TCGLabel *exitreq_label;
 
+    /* A host pointer was loaded as a constant, see tcg_ir_save() */
+    bool ir_host_ptr;
+
 #ifdef CONFIG_PLUGIN
     /*
      * We keep one plugin_tb struct per TCGContext. Note that on every TB
@@ -807,6 +810,10 @@ void tcg_pool_reset(TCGContext *s);
 TranslationBlock *tcg_tb_alloc(TCGContext *s);
 
 void tcg_region_reset_all(void);
+ssize_t tcg_region_evict_begin(unsigned int *gen);
+void tcg_region_evict_end(size_t region_idx, unsigned int gen);
+void tcg_region_tb_foreach(size_t region_idx, GTraverseFunc func,
+                           gpointer user_data);
 
 size_t tcg_code_size(void);
 size_t tcg_code_capacity(void);
@@ -1008,6 +1015,33 @@ bool tcg_op_supported(TCGOpcode op);
 void tcg_gen_callN(void *func, TCGTemp *ret, int nargs, TCGTemp **args);
 
 TCGOp *tcg_emit_op(TCGOpcode opc);
+
+/**
+ * tcg_ir_save:
+ * @s: TCG context
+ * @tb: the TB being translated
+ * @buf: buffer the ops are appended to
+ *
+ * Save the ops emitted for @tb by the front end, before tcg_gen_code()
+ * runs.  They can only be restored by the same QEMU binary, with the
+ * same globals.  Returns false if the ops can't be saved, e.g. because
+ * they refer to host addresses.
+ */
+bool tcg_ir_save(TCGContext *s, const TranslationBlock *tb, GByteArray *buf);
+
+/**
+ * tcg_ir_restore:
+ * @s: TCG context, right after tcg_func_start()
+ * @tb: the TB being translated
+ * @data: ops saved by tcg_ir_save()
+ * @len: size of @data
+ *
+ * Emit the ops saved by tcg_ir_save() in place of the front end.
+ * Returns false if @data is not valid; @s must then be reset with
+ * tcg_func_start().
+ */
+bool tcg_ir_restore(TCGContext *s, const TranslationBlock *tb,
+                    const void *data, size_t len);
 void tcg_op_remove(TCGContext *s, TCGOp *op);
 TCGOp *tcg_op_insert_before(TCGContext *s, TCGOp *op, TCGOpcode opc);
 TCGOp *tcg_op_insert_after(TCGContext *s, TCGOp *op, TCGOpcode opc);
@@ -1054,12 +1088,20 @@ static inline TCGv_i64 tcg_constant_i64(int64_t val)
 TCGv_vec tcg_constant_vec(TCGType type, unsigned vece, int64_t val);
 TCGv_vec tcg_constant_vec_matching(TCGv_vec match, unsigned vece, int64_t val);
 
+/*
+ * Pointer constants are usually host addresses, which differ from one
+ * run to the next: the IR of the TB can't be saved.
+ */
 #if UINTPTR_MAX == UINT32_MAX
-# define tcg_const_ptr(x)        ((TCGv_ptr)tcg_const_i32((intptr_t)(x)))
-# define tcg_const_local_ptr(x)  ((TCGv_ptr)tcg_const_local_i32((intptr_t)(x)))
+# define tcg_const_ptr(x)        (tcg_ctx->ir_host_ptr = true, \
+                                  (TCGv_ptr)tcg_const_i32((intptr_t)(x)))
+# define tcg_const_local_ptr(x)  (tcg_ctx->ir_host_ptr = true, \
+                                  (TCGv_ptr)tcg_const_local_i32((intptr_t)(x)))
 #else
-# define tcg_const_ptr(x)        ((TCGv_ptr)tcg_const_i64((intptr_t)(x)))
-# define tcg_const_local_ptr(x)  ((TCGv_ptr)tcg_const_local_i64((intptr_t)(x)))
+# define tcg_const_ptr(x)        (tcg_ctx->ir_host_ptr = true, \
+                                  (TCGv_ptr)tcg_const_i64((intptr_t)(x)))
+# define tcg_const_local_ptr(x)  (tcg_ctx->ir_host_ptr = true, \
+                                  (TCGv_ptr)tcg_const_local_i64((intptr_t)(x)))
 #endif
 
 TCGLabel *gen_new_label(void);
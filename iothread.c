@@ -168,6 +168,14 @@ static void iothread_set_aio_context_params(IOThread *iothread, Error **errp)
     aio_context_set_aio_params(iothread->ctx,
                                iothread->aio_max_batch,
                                errp);
+    if (*errp) {
+        return;
+    }
+
+    aio_context_set_io_uring_params(iothread->ctx,
+                                    iothread->aio_uring_sqpoll,
+                                    iothread->aio_uring_fixed_buffers,
+                                    errp);
 }
 
 static void iothread_complete(UserCreatable *obj, Error **errp)
@@ -311,6 +319,50 @@ static void iothread_set_aio_param(Object *obj, Visitor *v,
     }
 }
 
+static bool iothread_get_aio_uring_sqpoll(Object *obj, Error **errp)
+{
+    return IOTHREAD(obj)->aio_uring_sqpoll;
+}
+
+static void iothread_set_aio_uring_sqpoll(Object *obj, bool value,
+                                          Error **errp)
+{
+    ERRP_GUARD();
+    IOThread *iothread = IOTHREAD(obj);
+
+    if (iothread->ctx) {
+        aio_context_set_io_uring_params(iothread->ctx, value,
+                                        iothread->aio_uring_fixed_buffers,
+                                        errp);
+        if (*errp) {
+            return;
+        }
+    }
+    iothread->aio_uring_sqpoll = value;
+}
+
+static bool iothread_get_aio_uring_fixed_buffers(Object *obj, Error **errp)
+{
+    return IOTHREAD(obj)->aio_uring_fixed_buffers;
+}
+
+static void iothread_set_aio_uring_fixed_buffers(Object *obj, bool value,
+                                                 Error **errp)
+{
+    ERRP_GUARD();
+    IOThread *iothread = IOTHREAD(obj);
+
+    if (iothread->ctx) {
+        aio_context_set_io_uring_params(iothread->ctx,
+                                        iothread->aio_uring_sqpoll, value,
+                                        errp);
+        if (*errp) {
+            return;
+        }
+    }
+    iothread->aio_uring_fixed_buffers = value;
+}
+
 static void iothread_class_init(ObjectClass *klass, void *class_data)
 {
     UserCreatableClass *ucc = USER_CREATABLE_CLASS(klass);
@@ -332,6 +384,12 @@ static void iothread_class_init(ObjectClass *klass, void *class_data)
                               iothread_get_aio_param,
                               iothread_set_aio_param,
                               NULL, &aio_max_batch_info);
+    object_class_property_add_bool(klass, "aio-uring-sqpoll",
+                                   iothread_get_aio_uring_sqpoll,
+                                   iothread_set_aio_uring_sqpoll);
+    object_class_property_add_bool(klass, "aio-uring-fixed-buffers",
+                                   iothread_get_aio_uring_fixed_buffers,
+                                   iothread_set_aio_uring_fixed_buffers);
 }
 
 static const TypeInfo iothread_info = {
@@ -382,6 +440,8 @@ static int query_one_iothread(Object *object, void *opaque)
     info->poll_grow = iothread->poll_grow;
     info->poll_shrink = iothread->poll_shrink;
     info->aio_max_batch = iothread->aio_max_batch;
+    info->notify_events = stat64_get(&iothread->ctx->notify_events);
+    info->notify_coalesced = stat64_get(&iothread->ctx->notify_coalesced);
 
     QAPI_LIST_APPEND(*tail, info);
     return 0;
@@ -17,6 +17,7 @@
  *  along with this program; if not, see <http://www.gnu.org/licenses/>.
  */
 #include "qemu/osdep.h"
+#include "exec/tb-cache.h"
 #include "qemu.h"
 #ifdef CONFIG_GPROF
 #include <sys/gmon.h>
@@ -36,4 +37,5 @@ void preexit_cleanup(CPUArchState *env, int code)
 #endif
         gdb_exit(code);
         qemu_plugin_user_exit();
+        tb_cache_exit();
 }
@@ -39,6 +39,7 @@
 #include "qemu/module.h"
 #include "qemu/plugin.h"
 #include "exec/exec-all.h"
+#include "exec/tb-cache.h"
 #include "tcg/tcg.h"
 #include "qemu/timer.h"
 #include "qemu/envlist.h"
@@ -64,6 +65,7 @@ static envlist_t *envlist;
 static const char *cpu_model;
 static const char *cpu_type;
 static const char *seed_optarg;
+static const char *tb_cache_dir;
 unsigned long mmap_min_addr;
 uintptr_t guest_base;
 bool have_guest_base;
@@ -382,6 +384,16 @@ static void handle_arg_strace(const char *arg)
     enable_strace = true;
 }
 
+static void handle_arg_tb_cache(const char *arg)
+{
+    tb_cache_dir = arg;
+}
+
+static void handle_arg_tb_cache_stats(const char *arg)
+{
+    tb_cache_enable_stats();
+}
+
 static void handle_arg_version(const char *arg)
 {
     printf("qemu-" TARGET_NAME " version " QEMU_FULL_VERSION
@@ -461,6 +473,10 @@ static const struct qemu_argument arg_table[] = {
      "",           "Seed for pseudo-random number generator"},
     {"trace",      "QEMU_TRACE",       true,  handle_arg_trace,
      "",           "[[enable=]<pattern>][,events=<file>][,file=<file>]"},
+    {"tb-cache",   "QEMU_TB_CACHE",    true,  handle_arg_tb_cache,
+     "dir",        "keep translated code of executables in 'dir'"},
+    {"tb-cache-stats", "QEMU_TB_CACHE_STATS", false, handle_arg_tb_cache_stats,
+     "",           "report the translation cache hit rate at exit"},
 #ifdef CONFIG_PLUGIN
     {"plugin",     "QEMU_PLUGIN",      true,  handle_arg_plugin,
      "",           "[file=]<file>[,arg=<string>]"},
@@ -733,6 +749,14 @@ int main(int argc, char **argv, char **envp)
     cpu_reset(cpu);
     thread_cpu = cpu;
 
+    if (tb_cache_dir) {
+        if (QTAILQ_EMPTY(&plugins)) {
+            tb_cache_init(tb_cache_dir, cpu_model);
+        } else {
+            warn_report("translation cache disabled by plugins");
+        }
+    }
+
     /*
      * Reserving too much vm space via mmap can run into problems
      * with rlimits, oom due to page table creation, etc.  We will
@@ -19,6 +19,7 @@
 #include "qemu/osdep.h"
 #include "trace.h"
 #include "exec/log.h"
+#include "exec/tb-cache.h"
 #include "qemu.h"
 
 static pthread_mutex_t mmap_mutex = PTHREAD_MUTEX_INITIALIZER;
@@ -631,6 +632,11 @@ abi_long target_mmap(abi_ulong start, abi_ulong len, int target_prot,
         log_page_dump(__func__);
     }
     tb_invalidate_phys_range(start, start + len);
+    if ((target_prot & PROT_EXEC) && !(flags & MAP_ANONYMOUS)) {
+        tb_cache_map(start, len, fd);
+    } else {
+        tb_cache_unmap(start, len);
+    }
     mmap_unlock();
     return start;
 fail:
@@ -735,6 +741,7 @@ int target_munmap(abi_ulong start, abi_ulong len)
     if (ret == 0) {
         page_set_flags(start, start + len, 0);
         tb_invalidate_phys_range(start, start + len);
+        tb_cache_unmap(start, len);
     }
     mmap_unlock();
     return ret;
@@ -133,6 +133,7 @@
 #include "qapi/error.h"
 #include "fd-trans.h"
 #include "tcg/tcg.h"
+#include "exec/tb-cache.h"
 
 #ifndef CLONE_IO
 #define CLONE_IO                0x80000000      /* Clone io context */
@@ -8421,6 +8422,7 @@ static abi_long do_syscall1(void *cpu_env, int num, abi_long arg1,
              * before the execve completes and makes it the other
              * program's problem.
              */
+            tb_cache_flush();
             ret = get_errno(safe_execve(p, argp, envp));
             unlock_user(p, arg1, 0);
 
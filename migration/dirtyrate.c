@@ -15,7 +15,10 @@
 #include "qapi/error.h"
 #include "cpu.h"
 #include "exec/ramblock.h"
+#include "exec/memory.h"
 #include "qemu/rcu_queue.h"
+#include "qemu/main-loop.h"
+#include "sysemu/kvm.h"
 #include "qapi/qapi-commands-migration.h"
 #include "ram.h"
 #include "trace.h"
@@ -72,32 +75,47 @@ static struct DirtyRateInfo *query_dirty_rate_info(void)
 {
     int64_t dirty_rate = DirtyStat.dirty_rate;
     struct DirtyRateInfo *info = g_malloc0(sizeof(DirtyRateInfo));
+    DirtyRateVcpuList **tail = &info->vcpu_dirty_rate;
+    int i;
 
     if (qatomic_read(&CalculatingState) == DIRTY_RATE_STATUS_MEASURED) {
         info->has_dirty_rate = true;
         info->dirty_rate = dirty_rate;
+
+        for (i = 0; i < DirtyStat.nvcpu; i++) {
+            DirtyRateVcpu *rate = g_new(DirtyRateVcpu, 1);
+
+            *rate = DirtyStat.rates[i];
+            QAPI_LIST_APPEND(tail, rate);
+        }
+        info->has_vcpu_dirty_rate = DirtyStat.rates != NULL;
     }
 
     info->status = CalculatingState;
     info->start_time = DirtyStat.start_time;
     info->calc_time = DirtyStat.calc_time;
     info->sample_pages = DirtyStat.sample_pages;
+    info->mode = DirtyStat.mode;
 
     trace_query_dirty_rate_info(DirtyRateStatus_str(CalculatingState));
 
     return info;
 }
 
-static void init_dirtyrate_stat(int64_t start_time, int64_t calc_time,
-                                uint64_t sample_pages)
+static void init_dirtyrate_stat(int64_t start_time,
+                                struct DirtyRateConfig config)
 {
     DirtyStat.total_dirty_samples = 0;
     DirtyStat.total_sample_count = 0;
     DirtyStat.total_block_mem_MB = 0;
     DirtyStat.dirty_rate = -1;
     DirtyStat.start_time = start_time;
-    DirtyStat.calc_time = calc_time;
-    DirtyStat.sample_pages = sample_pages;
+    DirtyStat.calc_time = config.sample_period_seconds;
+    DirtyStat.sample_pages = config.sample_pages_per_gigabytes;
+    DirtyStat.mode = config.mode;
+    DirtyStat.nvcpu = 0;
+    g_free(DirtyStat.rates);
+    DirtyStat.rates = NULL;
 }
 
 static void update_dirtyrate_stat(struct RamblockDirtyInfo *info)
@@ -334,7 +352,105 @@ static bool compare_page_hash_info(struct RamblockDirtyInfo *info,
     return true;
 }
 
-static void calculate_dirtyrate(struct DirtyRateConfig config)
+/* Convert @dirty_pages written during @msec into MB/s */
+static int64_t do_calculate_dirtyrate(uint64_t dirty_pages, int64_t msec)
+{
+    return (dirty_pages * TARGET_PAGE_SIZE * 1000 / msec) >> 20;
+}
+
+/*
+ * Snapshot the dirty ring counter of every vCPU; must be called with the
+ * BQL held, after memory_global_dirty_log_sync() collected the rings.
+ * Returns false if vCPUs were plugged or unplugged since the start.
+ */
+static bool record_dirtypages(struct DirtyPageRecord *records, int nvcpu,
+                              bool start)
+{
+    CPUState *cpu;
+    int i = 0;
+
+    CPU_FOREACH(cpu) {
+        if (i == nvcpu) {
+            return false;
+        }
+        if (start) {
+            records[i].id = cpu->cpu_index;
+            records[i].start_pages = cpu->dirty_pages;
+        } else {
+            if (records[i].id != cpu->cpu_index) {
+                return false;
+            }
+            records[i].end_pages = cpu->dirty_pages;
+        }
+        i++;
+    }
+
+    return i == nvcpu;
+}
+
+static void calculate_dirtyrate_dirty_ring(struct DirtyRateConfig config)
+{
+    struct DirtyPageRecord *records;
+    CPUState *cpu;
+    uint64_t total_pages = 0;
+    int64_t initial_time;
+    int64_t msec;
+    int nvcpu = 0;
+    bool ok;
+    int i;
+
+    rcu_register_thread();
+    qemu_mutex_lock_iothread();
+    CPU_FOREACH(cpu) {
+        nvcpu++;
+    }
+    records = g_new0(struct DirtyPageRecord, nvcpu);
+
+    memory_global_dirty_log_start(GLOBAL_DIRTY_DIRTY_RATE);
+    /*
+     * Whatever the rings hold now was dirtied before the period started;
+     * collect it so that it is not counted.
+     */
+    memory_global_dirty_log_sync();
+    initial_time = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
+    record_dirtypages(records, nvcpu, true);
+    qemu_mutex_unlock_iothread();
+
+    msec = config.sample_period_seconds * 1000;
+    msec = set_sample_page_period(msec, initial_time);
+    DirtyStat.start_time = initial_time / 1000;
+    DirtyStat.calc_time = msec / 1000;
+
+    qemu_mutex_lock_iothread();
+    memory_global_dirty_log_sync();
+    ok = record_dirtypages(records, nvcpu, false);
+    memory_global_dirty_log_stop(GLOBAL_DIRTY_DIRTY_RATE);
+    qemu_mutex_unlock_iothread();
+
+    if (!ok) {
+        trace_dirtyrate_vcpu_changed(nvcpu);
+        goto out;
+    }
+
+    DirtyStat.rates = g_new0(DirtyRateVcpu, nvcpu);
+    for (i = 0; i < nvcpu; i++) {
+        uint64_t pages = records[i].end_pages - records[i].start_pages;
+
+        DirtyStat.rates[i].id = records[i].id;
+        DirtyStat.rates[i].dirty_rate = do_calculate_dirtyrate(pages, msec);
+        total_pages += pages;
+        trace_dirtyrate_do_calculate_vcpu(records[i].id,
+                                          DirtyStat.rates[i].dirty_rate);
+    }
+    DirtyStat.nvcpu = nvcpu;
+    DirtyStat.dirty_rate = do_calculate_dirtyrate(total_pages, msec);
+
+out:
+    g_free(records);
+    rcu_unregister_thread();
+}
+
+static void calculate_dirtyrate_sample_vm(struct DirtyRateConfig config)
 {
     struct RamblockDirtyInfo *block_dinfo = NULL;
     int block_count = 0;
@@ -372,8 +488,6 @@ void *get_dirtyrate_thread(void *arg)
     struct DirtyRateConfig config = *(struct DirtyRateConfig *)arg;
     int ret;
     int64_t start_time;
-    int64_t calc_time;
-    uint64_t sample_pages;
 
     ret = dirtyrate_set_state(&CalculatingState, DIRTY_RATE_STATUS_UNSTARTED,
                               DIRTY_RATE_STATUS_MEASURING);
@@ -383,11 +497,13 @@ void *get_dirtyrate_thread(void *arg)
     }
 
     start_time = qemu_clock_get_ms(QEMU_CLOCK_REALTIME) / 1000;
-    calc_time = config.sample_period_seconds;
-    sample_pages = config.sample_pages_per_gigabytes;
-    init_dirtyrate_stat(start_time, calc_time, sample_pages);
+    init_dirtyrate_stat(start_time, config);
 
-    calculate_dirtyrate(config);
+    if (config.mode == DIRTY_RATE_MEASURE_MODE_DIRTY_RING) {
+        calculate_dirtyrate_dirty_ring(config);
+    } else {
+        calculate_dirtyrate_sample_vm(config);
+    }
 
     ret = dirtyrate_set_state(&CalculatingState, DIRTY_RATE_STATUS_MEASURING,
                               DIRTY_RATE_STATUS_MEASURED);
@@ -398,7 +514,8 @@ void *get_dirtyrate_thread(void *arg)
 }
 
 void qmp_calc_dirty_rate(int64_t calc_time, bool has_sample_pages,
-                         int64_t sample_pages, Error **errp)
+                         int64_t sample_pages, bool has_mode,
+                         DirtyRateMeasureMode mode, Error **errp)
 {
     static struct DirtyRateConfig config;
     QemuThread thread;
@@ -419,7 +536,22 @@ void qmp_calc_dirty_rate(int64_t calc_time, bool has_sample_pages,
         return;
     }
 
-    if (has_sample_pages) {
+    if (!has_mode) {
+        mode = DIRTY_RATE_MEASURE_MODE_PAGE_SAMPLING;
+    }
+
+    if (mode == DIRTY_RATE_MEASURE_MODE_DIRTY_RING) {
+        if (has_sample_pages) {
+            error_setg(errp, "sample-pages can't be used in dirty-ring mode.");
+            return;
+        }
+        if (!kvm_dirty_ring_enabled()) {
+            error_setg(errp, "dirty-ring mode needs the KVM dirty ring, "
+                             "see the dirty-ring-size property of kvm.");
+            return;
+        }
+        sample_pages = 0;
+    } else if (has_sample_pages) {
         if (!is_sample_pages_valid(sample_pages)) {
             error_setg(errp, "sample-pages is out of range[%d, %d].",
                             MIN_SAMPLE_PAGE_COUNT,
@@ -442,6 +574,7 @@ void qmp_calc_dirty_rate(int64_t calc_time, bool has_sample_pages,
 
     config.sample_period_seconds = calc_time;
     config.sample_pages_per_gigabytes = sample_pages;
+    config.mode = mode;
     qemu_thread_create(&thread, "get_dirtyrate", get_dirtyrate_thread,
                        (void *)&config, QEMU_THREAD_DETACHED);
 }
@@ -457,6 +590,8 @@ void hmp_info_dirty_rate(Monitor *mon, const QDict *qdict)
 
     monitor_printf(mon, "Status: %s\n",
                    DirtyRateStatus_str(info->status));
+    monitor_printf(mon, "Mode: %s\n",
+                   DirtyRateMeasureMode_str(info->mode));
     monitor_printf(mon, "Start Time: %"PRIi64" (ms)\n",
                    info->start_time);
     monitor_printf(mon, "Sample Pages: %"PRIu64" (per GB)\n",
@@ -469,7 +604,16 @@ void hmp_info_dirty_rate(Monitor *mon, const QDict *qdict)
     } else {
         monitor_printf(mon, "(not ready)\n");
     }
-    g_free(info);
+    if (info->has_vcpu_dirty_rate) {
+        DirtyRateVcpuList *rate;
+
+        for (rate = info->vcpu_dirty_rate; rate; rate = rate->next) {
+            monitor_printf(mon, "vcpu[%"PRIi64"], Dirty rate: %"PRIi64
+                           " (MB/s)\n", rate->value->id,
+                           rate->value->dirty_rate);
+        }
+    }
+    qapi_free_DirtyRateInfo(info);
 }
 
 void hmp_calc_dirty_rate(Monitor *mon, const QDict *qdict)
@@ -477,6 +621,7 @@ void hmp_calc_dirty_rate(Monitor *mon, const QDict *qdict)
     int64_t sec = qdict_get_try_int(qdict, "second", 0);
     int64_t sample_pages = qdict_get_try_int(qdict, "sample_pages_per_GB", -1);
     bool has_sample_pages = (sample_pages != -1);
+    bool dirty_ring = qdict_get_try_bool(qdict, "dirty_ring", false);
     Error *err = NULL;
 
     if (!sec) {
@@ -484,7 +629,10 @@ void hmp_calc_dirty_rate(Monitor *mon, const QDict *qdict)
         return;
     }
 
-    qmp_calc_dirty_rate(sec, has_sample_pages, sample_pages, &err);
+    qmp_calc_dirty_rate(sec, has_sample_pages, sample_pages, true,
+                        dirty_ring ? DIRTY_RATE_MEASURE_MODE_DIRTY_RING :
+                                     DIRTY_RATE_MEASURE_MODE_PAGE_SAMPLING,
+                        &err);
     if (err) {
         hmp_handle_error(mon, err);
         return;
@@ -0,0 +1,305 @@
+/*
+ * Multifd lz4 compression implementation
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include <lz4.h>
+#include "qemu/rcu.h"
+#include "exec/target_page.h"
+#include "qapi/error.h"
+#include "migration.h"
+#include "trace.h"
+#include "multifd.h"
+
+/*
+ * Each channel is one lz4 stream: the tail of the previous packet sent
+ * on the channel is used as dictionary for the next one.  Channels are
+ * independent, and packets of a channel are received in the order they
+ * were sent, so both sides always agree on the dictionary.
+ *
+ * lz4 references the dictionary in place instead of keeping a copy of
+ * it, so the pages are first copied into a private buffer; the guest
+ * can change them while they are being compressed.
+ */
+
+/* lz4 can't use a dictionary bigger than this */
+#define LZ4_DICT_SIZE (64 * 1024)
+
+/* 1 is lz4 default, bigger values trade compression ratio for speed */
+#define MULTIFD_LZ4_ACCELERATION 1
+
+struct lz4_data {
+    /* stream for compression */
+    LZ4_stream_t *stream;
+    /* stream for decompression */
+    LZ4_streamDecode_t *stream_decode;
+    /* uncompressed pages of the current packet */
+    uint8_t *buf;
+    /* tail of the previous packet */
+    uint8_t *dict;
+    /* compressed buffer */
+    uint8_t *zbuff;
+    /* size of compressed buffer */
+    uint32_t zbuff_len;
+};
+
+static struct lz4_data *lz4_data_new(void)
+{
+    uint32_t page_count = MULTIFD_PACKET_SIZE / qemu_target_page_size();
+    uint32_t buf_len = page_count * qemu_target_page_size();
+    struct lz4_data *z = g_new0(struct lz4_data, 1);
+
+    z->buf = g_try_malloc(buf_len);
+    z->dict = g_try_malloc(LZ4_DICT_SIZE);
+    /* We will never have more than page_count pages */
+    z->zbuff_len = LZ4_compressBound(buf_len);
+    z->zbuff = g_try_malloc(z->zbuff_len);
+    if (!z->buf || !z->dict || !z->zbuff) {
+        g_free(z->buf);
+        g_free(z->dict);
+        g_free(z->zbuff);
+        g_free(z);
+        return NULL;
+    }
+    return z;
+}
+
+static void lz4_data_free(struct lz4_data *z)
+{
+    g_free(z->buf);
+    g_free(z->dict);
+    g_free(z->zbuff);
+    g_free(z);
+}
+
+/* Multifd lz4 compression */
+
+/**
+ * lz4_send_setup: setup send side
+ *
+ * Setup each channel with lz4 compression.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int lz4_send_setup(MultiFDSendParams *p, Error **errp)
+{
+    struct lz4_data *z = lz4_data_new();
+
+    if (!z) {
+        error_setg(errp, "multifd %d: out of memory for lz4 buffers", p->id);
+        return -1;
+    }
+    z->stream = LZ4_createStream();
+    if (!z->stream) {
+        lz4_data_free(z);
+        error_setg(errp, "multifd %d: lz4 createStream failed", p->id);
+        return -1;
+    }
+    p->data = z;
+    return 0;
+}
+
+/**
+ * lz4_send_cleanup: cleanup send side
+ *
+ * Close the channel and return memory.
+ *
+ * @p: Params for the channel that we are using
+ */
+static void lz4_send_cleanup(MultiFDSendParams *p, Error **errp)
+{
+    struct lz4_data *z = p->data;
+
+    LZ4_freeStream(z->stream);
+    lz4_data_free(z);
+    p->data = NULL;
+}
+
+/**
+ * lz4_send_prepare: prepare date to be able to send
+ *
+ * Create a compressed buffer with all the pages that we are going to
+ * send.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @used: number of pages used
+ */
+static int lz4_send_prepare(MultiFDSendParams *p, uint32_t used, Error **errp)
+{
+    struct iovec *iov = p->pages->iov;
+    struct lz4_data *z = p->data;
+    uint32_t in_size = 0;
+    int ret;
+    uint32_t i;
+
+    for (i = 0; i < used; i++) {
+        memcpy(z->buf + in_size, iov[i].iov_base, iov[i].iov_len);
+        in_size += iov[i].iov_len;
+    }
+
+    ret = LZ4_compress_fast_continue(z->stream, (char *)z->buf,
+                                     (char *)z->zbuff, in_size, z->zbuff_len,
+                                     MULTIFD_LZ4_ACCELERATION);
+    if (ret <= 0) {
+        error_setg(errp, "multifd %d: lz4 compression failed", p->id);
+        return -1;
+    }
+    /* z->buf is overwritten by the next packet, keep the dictionary */
+    LZ4_saveDict(z->stream, (char *)z->dict, LZ4_DICT_SIZE);
+
+    p->next_packet_size = ret;
+    p->flags |= MULTIFD_FLAG_LZ4;
+
+    return 0;
+}
+
+/**
+ * lz4_send_write: do the actual write of the data
+ *
+ * Do the actual write of the comprresed buffer.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @used: number of pages used
+ * @errp: pointer to an error
+ */
+static int lz4_send_write(MultiFDSendParams *p, uint32_t used, Error **errp)
+{
+    struct lz4_data *z = p->data;
+
+    return qio_channel_write_all(p->c, (void *)z->zbuff, p->next_packet_size,
+                                 errp);
+}
+
+/**
+ * lz4_recv_setup: setup receive side
+ *
+ * Create the compressed channel and buffer.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int lz4_recv_setup(MultiFDRecvParams *p, Error **errp)
+{
+    struct lz4_data *z = lz4_data_new();
+
+    if (!z) {
+        error_setg(errp, "multifd %d: out of memory for lz4 buffers", p->id);
+        return -1;
+    }
+    z->stream_decode = LZ4_createStreamDecode();
+    if (!z->stream_decode) {
+        lz4_data_free(z);
+        error_setg(errp, "multifd %d: lz4 createStreamDecode failed", p->id);
+        return -1;
+    }
+    p->data = z;
+    return 0;
+}
+
+/**
+ * lz4_recv_cleanup: cleanup receive side
+ *
+ * Close the channel and return memory.
+ *
+ * @p: Params for the channel that we are using
+ */
+static void lz4_recv_cleanup(MultiFDRecvParams *p)
+{
+    struct lz4_data *z = p->data;
+
+    LZ4_freeStreamDecode(z->stream_decode);
+    lz4_data_free(z);
+    p->data = NULL;
+}
+
+/**
+ * lz4_recv_pages: read the data from the channel into actual pages
+ *
+ * Read the compressed buffer, and uncompress it into the actual
+ * pages.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @used: number of pages used
+ * @errp: pointer to an error
+ */
+static int lz4_recv_pages(MultiFDRecvParams *p, uint32_t used, Error **errp)
+{
+    uint32_t in_size = p->next_packet_size;
+    uint32_t expected_size = used * qemu_target_page_size();
+    uint32_t flags = p->flags & MULTIFD_FLAG_COMPRESSION_MASK;
+    struct lz4_data *z = p->data;
+    uint32_t dict_size;
+    uint32_t pos = 0;
+    int ret;
+    int i;
+
+    if (flags != MULTIFD_FLAG_LZ4) {
+        error_setg(errp, "multifd %d: flags received %x flags expected %x",
+                   p->id, flags, MULTIFD_FLAG_LZ4);
+        return -1;
+    }
+    if (in_size > z->zbuff_len) {
+        error_setg(errp, "multifd %d: packet size received %d maximum is %d",
+                   p->id, in_size, z->zbuff_len);
+        return -1;
+    }
+    ret = qio_channel_read_all(p->c, (void *)z->zbuff, in_size, errp);
+
+    if (ret != 0) {
+        return ret;
+    }
+
+    ret = LZ4_decompress_safe_continue(z->stream_decode, (char *)z->zbuff,
+                                       (char *)z->buf, in_size,
+                                       expected_size);
+    if (ret != expected_size) {
+        error_setg(errp, "multifd %d: packet size received %d size expected %d",
+                   p->id, ret, expected_size);
+        return -1;
+    }
+
+    for (i = 0; i < used; i++) {
+        struct iovec *iov = &p->pages->iov[i];
+
+        memcpy(iov->iov_base, z->buf + pos, iov->iov_len);
+        pos += iov->iov_len;
+    }
+
+    /* Same dictionary that lz4_send_prepare() kept on the source */
+    dict_size = MIN(expected_size, LZ4_DICT_SIZE);
+    memcpy(z->dict, z->buf + expected_size - dict_size, dict_size);
+    LZ4_setStreamDecode(z->stream_decode, (char *)z->dict, dict_size);
+
+    return 0;
+}
+
+static MultiFDMethods multifd_lz4_ops = {
+    .send_setup = lz4_send_setup,
+    .send_cleanup = lz4_send_cleanup,
+    .send_prepare = lz4_send_prepare,
+    .send_write = lz4_send_write,
+    .recv_setup = lz4_recv_setup,
+    .recv_cleanup = lz4_recv_cleanup,
+    .recv_pages = lz4_recv_pages
+};
+
+static void multifd_lz4_register(void)
+{
+    multifd_register_ops(MULTIFD_COMPRESSION_LZ4, &multifd_lz4_ops);
+}
+
+migration_init(multifd_lz4_register);
@@ -12,6 +12,8 @@
 
 #include "qemu/osdep.h"
 #include "qemu/rcu.h"
+#include "qemu/bitmap.h"
+#include "qemu/cutils.h"
 #include "exec/target_page.h"
 #include "sysemu/sysemu.h"
 #include "exec/ramblock.h"
@@ -95,7 +97,8 @@ static int nocomp_send_prepare(MultiFDSendParams *p, uint32_t used,
 /**
  * nocomp_send_write: do the actual write of the data
  *
- * For no compression we just have to write the data.
+ * For no compression we just have to write the data.  With zero copy
+ * the pages go straight from guest memory to the network card.
  *
  * Returns 0 for success or -1 for error
  *
@@ -105,7 +108,8 @@ static int nocomp_send_prepare(MultiFDSendParams *p, uint32_t used,
  */
 static int nocomp_send_write(MultiFDSendParams *p, uint32_t used, Error **errp)
 {
-    return qio_channel_writev_all(p->c, p->pages->iov, used, errp);
+    return qio_channel_writev_full_all(p->c, p->pages->iov, used, NULL, 0,
+                                       p->write_flags, errp);
 }
 
 /**
@@ -239,6 +243,16 @@ static int multifd_recv_initial_packet(QIOChannel *c, Error **errp)
     return msg.id;
 }
 
+static uint32_t multifd_packet_len(uint32_t page_count, bool zero_page)
+{
+    uint32_t len = sizeof(MultiFDPacket_t) + sizeof(uint64_t) * page_count;
+
+    if (zero_page) {
+        len += MULTIFD_ZERO_BITMAP_SIZE(page_count);
+    }
+    return len;
+}
+
 static MultiFDPages_t *multifd_pages_init(size_t size)
 {
     MultiFDPages_t *pages = g_new0(MultiFDPages_t, 1);
@@ -246,6 +260,7 @@ static MultiFDPages_t *multifd_pages_init(size_t size)
     pages->allocated = size;
     pages->iov = g_new0(struct iovec, size);
     pages->offset = g_new0(ram_addr_t, size);
+    pages->zero_bitmap = bitmap_new(size);
 
     return pages;
 }
@@ -260,6 +275,9 @@ static void multifd_pages_clear(MultiFDPages_t *pages)
     pages->iov = NULL;
     g_free(pages->offset);
     pages->offset = NULL;
+    pages->zero_num = 0;
+    g_free(pages->zero_bitmap);
+    pages->zero_bitmap = NULL;
     g_free(pages);
 }
 
@@ -284,6 +302,20 @@ static void multifd_send_fill_packet(MultiFDSendParams *p)
 
         packet->offset[i] = cpu_to_be64(temp);
     }
+
+    if (p->flags & MULTIFD_FLAG_ZERO_PAGE) {
+        uint64_t *bitmap = &packet->offset[p->pages->allocated];
+
+        memset(bitmap, 0, MULTIFD_ZERO_BITMAP_SIZE(p->pages->allocated));
+        for (i = 0; i < p->pages->used; i++) {
+            if (test_bit(i, p->pages->zero_bitmap)) {
+                bitmap[i / 64] |= 1ULL << (i % 64);
+            }
+        }
+        for (i = 0; i < DIV_ROUND_UP(p->pages->used, 64); i++) {
+            bitmap[i] = cpu_to_be64(bitmap[i]);
+        }
+    }
 }
 
 static int multifd_recv_unfill_packet(MultiFDRecvParams *p, Error **errp)
@@ -339,8 +371,24 @@ static int multifd_recv_unfill_packet(MultiFDRecvParams *p, Error **errp)
         return -1;
     }
 
+    if (p->flags & MULTIFD_FLAG_ZERO_PAGE) {
+        if (!migrate_multifd_zero_page()) {
+            error_setg(errp, "multifd: received zero page bitmap but "
+                       "multifd-zero-page is not enabled");
+            return -1;
+        }
+        /* The bitmap must fit in the packet that we have just read */
+        if (packet->pages_alloc > pages_max) {
+            error_setg(errp, "multifd: received packet with zero page "
+                       "bitmap and %d pages, maximum is %d",
+                       packet->pages_alloc, pages_max);
+            return -1;
+        }
+    }
+
     p->next_packet_size = be32_to_cpu(packet->next_packet_size);
     p->packet_num = be64_to_cpu(packet->packet_num);
+    p->pages->zero_num = 0;
 
     if (p->pages->used == 0) {
         return 0;
@@ -355,8 +403,21 @@ static int multifd_recv_unfill_packet(MultiFDRecvParams *p, Error **errp)
         return -1;
     }
 
+    bitmap_zero(p->pages->zero_bitmap, p->pages->used);
+    if (p->flags & MULTIFD_FLAG_ZERO_PAGE) {
+        uint64_t *bitmap = &packet->offset[packet->pages_alloc];
+
+        for (i = 0; i < p->pages->used; i++) {
+            if (be64_to_cpu(bitmap[i / 64]) & (1ULL << (i % 64))) {
+                set_bit(i, p->pages->zero_bitmap);
+            }
+        }
+    }
+
+    p->pages->block = block;
     for (i = 0; i < p->pages->used; i++) {
         uint64_t offset = be64_to_cpu(packet->offset[i]);
+        uint32_t normal = i - p->pages->zero_num;
 
         if (offset > (block->used_length - qemu_target_page_size())) {
             error_setg(errp, "multifd: offset too long %" PRIu64
@@ -364,8 +425,13 @@ static int multifd_recv_unfill_packet(MultiFDRecvParams *p, Error **errp)
                        offset, block->used_length);
             return -1;
         }
-        p->pages->iov[i].iov_base = block->host + offset;
-        p->pages->iov[i].iov_len = qemu_target_page_size();
+        p->pages->offset[i] = offset;
+        if (test_bit(i, p->pages->zero_bitmap)) {
+            p->pages->zero_num++;
+            continue;
+        }
+        p->pages->iov[normal].iov_base = block->host + offset;
+        p->pages->iov[normal].iov_len = qemu_target_page_size();
     }
 
     return 0;
@@ -385,6 +451,8 @@ struct {
      * We will use atomic operations.  Only valid values are 0 and 1.
      */
     int exiting;
+    /* zero pages are detected by the channels */
+    bool zero_page;
     /* multifd ops */
     MultiFDMethods *ops;
 } *multifd_send_state;
@@ -407,6 +475,33 @@ struct {
  * false.
  */
 
+/*
+ * multifd_send_account: account the work done by a channel
+ *
+ * Page data is only accounted once the channel has written it, because
+ * with multifd-zero-page the main thread doesn't know how many of the
+ * queued pages are going to be sent as data.
+ *
+ * Returns the number of bytes to account for the channel.  Must be
+ * called from the migration thread with p->mutex held.
+ *
+ * @p: Params for the channel
+ */
+static uint64_t multifd_send_account(MultiFDSendParams *p)
+{
+    uint64_t bytes = p->bytes_pending;
+
+    /* these pages were counted as normal when they were queued */
+    ram_counters.duplicate += p->zero_pending;
+    ram_counters.normal -= p->zero_pending;
+    ram_counters.dirty_sync_missed_zero_copy += p->zero_copy_missed_pending;
+    p->bytes_pending = 0;
+    p->zero_pending = 0;
+    p->zero_copy_missed_pending = 0;
+
+    return bytes;
+}
+
 static int multifd_send_pages(QEMUFile *f)
 {
     int i;
@@ -448,8 +543,7 @@ static int multifd_send_pages(QEMUFile *f)
     p->packet_num = multifd_send_state->packet_num++;
     multifd_send_state->pages = p->pages;
     p->pages = pages;
-    transferred = ((uint64_t) pages->used) * qemu_target_page_size()
-                + p->packet_len;
+    transferred = multifd_send_account(p) + p->packet_len;
     qemu_file_update_transfer(f, transferred);
     ram_counters.multifd_bytes += transferred;
     ram_counters.transferred += transferred;
@@ -612,13 +706,51 @@ void multifd_send_sync_main(QEMUFile *f)
     }
     for (i = 0; i < migrate_multifd_channels(); i++) {
         MultiFDSendParams *p = &multifd_send_state->params[i];
+        uint64_t transferred;
 
         trace_multifd_send_sync_main_wait(p->id);
         qemu_sem_wait(&p->sem_sync);
+
+        /* The channel is idle now, account everything that it has sent */
+        qemu_mutex_lock(&p->mutex);
+        transferred = multifd_send_account(p);
+        qemu_file_update_transfer(f, transferred);
+        ram_counters.multifd_bytes += transferred;
+        ram_counters.transferred += transferred;
+        qemu_mutex_unlock(&p->mutex);
     }
     trace_multifd_send_sync_main(multifd_send_state->packet_num);
 }
 
+/*
+ * multifd_send_zero_page_detect: find the zero pages of a packet
+ *
+ * Zero pages are marked in pages->zero_bitmap and removed from
+ * pages->iov, so that the compression methods only see the pages
+ * whose data has to be sent.
+ *
+ * @p: Params for the channel that we are using
+ */
+static void multifd_send_zero_page_detect(MultiFDSendParams *p)
+{
+    MultiFDPages_t *pages = p->pages;
+    size_t page_size = qemu_target_page_size();
+    uint32_t normal = 0;
+    uint32_t i;
+
+    bitmap_zero(pages->zero_bitmap, pages->used);
+    pages->zero_num = 0;
+
+    for (i = 0; i < pages->used; i++) {
+        if (buffer_is_zero(pages->iov[i].iov_base, page_size)) {
+            set_bit(i, pages->zero_bitmap);
+            pages->zero_num++;
+            continue;
+        }
+        pages->iov[normal++] = pages->iov[i];
+    }
+}
+
 static void *multifd_send_thread(void *opaque)
 {
     MultiFDSendParams *p = opaque;
@@ -629,6 +761,14 @@ static void *multifd_send_thread(void *opaque)
     trace_multifd_send_thread_start(p->id);
     rcu_register_thread();
 
+    if ((p->write_flags & QIO_CHANNEL_WRITE_FLAG_ZERO_COPY) &&
+        !qio_channel_has_feature(p->c, QIO_CHANNEL_FEATURE_WRITE_ZERO_COPY)) {
+        error_setg(&local_err, "multifd %d: zero copy is not supported "
+                   "by the host", p->id);
+        ret = -1;
+        goto out;
+    }
+
     if (multifd_send_initial_packet(p, &local_err) < 0) {
         ret = -1;
         goto out;
@@ -646,26 +786,38 @@ static void *multifd_send_thread(void *opaque)
 
         if (p->pending_job) {
             uint32_t used = p->pages->used;
+            uint32_t normal = used;
+            uint32_t zero = 0;
+            bool zero_copy_missed = false;
             uint64_t packet_num = p->packet_num;
-            flags = p->flags;
 
-            if (used) {
-                ret = multifd_send_state->ops->send_prepare(p, used,
+            p->next_packet_size = 0;
+            if (used && multifd_send_state->zero_page) {
+                multifd_send_zero_page_detect(p);
+                zero = p->pages->zero_num;
+                normal = used - zero;
+                p->flags |= MULTIFD_FLAG_ZERO_PAGE;
+            }
+            if (normal) {
+                ret = multifd_send_state->ops->send_prepare(p, normal,
                                                             &local_err);
                 if (ret != 0) {
                     qemu_mutex_unlock(&p->mutex);
                     break;
                 }
             }
+            flags = p->flags;
             multifd_send_fill_packet(p);
             p->flags = 0;
             p->num_packets++;
             p->num_pages += used;
+            p->num_zero_pages += zero;
             p->pages->used = 0;
+            p->pages->zero_num = 0;
             p->pages->block = NULL;
             qemu_mutex_unlock(&p->mutex);
 
-            trace_multifd_send(p->id, packet_num, used, flags,
+            trace_multifd_send(p->id, packet_num, used, zero, flags,
                                p->next_packet_size);
 
             ret = qio_channel_write_all(p->c, (void *)p->packet,
@@ -674,14 +826,35 @@ static void *multifd_send_thread(void *opaque)
                 break;
             }
 
-            if (used) {
-                ret = multifd_send_state->ops->send_write(p, used, &local_err);
+            if (normal) {
+                ret = multifd_send_state->ops->send_write(p, normal,
+                                                          &local_err);
                 if (ret != 0) {
                     break;
                 }
             }
 
+            /*
+             * Guest pages sent with zero copy are read by the kernel
+             * asynchronously.  Wait for all of them at the end of each
+             * dirty bitmap pass, so that a page can't still be in flight
+             * when a newer copy of it is sent on another channel.
+             */
+            if ((flags & MULTIFD_FLAG_SYNC) &&
+                (p->write_flags & QIO_CHANNEL_WRITE_FLAG_ZERO_COPY)) {
+                int flushed = qio_channel_flush(p->c, &local_err);
+
+                if (flushed < 0) {
+                    ret = -1;
+                    break;
+                }
+                zero_copy_missed = flushed == 1;
+            }
+
             qemu_mutex_lock(&p->mutex);
+            p->bytes_pending += (uint64_t)normal * qemu_target_page_size();
+            p->zero_pending += zero;
+            p->zero_copy_missed_pending += zero_copy_missed;
             p->pending_job--;
             qemu_mutex_unlock(&p->mutex);
 
@@ -719,7 +892,8 @@ out:
     qemu_mutex_unlock(&p->mutex);
 
     rcu_unregister_thread();
-    trace_multifd_send_thread_end(p->id, p->num_packets, p->num_pages);
+    trace_multifd_send_thread_end(p->id, p->num_packets, p->num_pages,
+                                  p->num_zero_pages);
 
     return NULL;
 }
@@ -882,6 +1056,7 @@ int multifd_save_setup(Error **errp)
     qemu_sem_init(&multifd_send_state->channels_ready, 0);
     qatomic_set(&multifd_send_state->exiting, 0);
     multifd_send_state->ops = multifd_ops[migrate_multifd_compression()];
+    multifd_send_state->zero_page = migrate_multifd_zero_page();
 
     for (i = 0; i < thread_count; i++) {
         MultiFDSendParams *p = &multifd_send_state->params[i];
@@ -893,8 +1068,10 @@ int multifd_save_setup(Error **errp)
         p->pending_job = 0;
         p->id = i;
         p->pages = multifd_pages_init(page_count);
-        p->packet_len = sizeof(MultiFDPacket_t)
-                      + sizeof(uint64_t) * page_count;
+        p->packet_len = multifd_packet_len(page_count,
+                                           multifd_send_state->zero_page);
+        p->write_flags = migrate_use_zero_copy_send() ?
+                         QIO_CHANNEL_WRITE_FLAG_ZERO_COPY : 0;
         p->packet = g_malloc0(p->packet_len);
         p->packet->magic = cpu_to_be32(MULTIFD_MAGIC);
         p->packet->version = cpu_to_be32(MULTIFD_VERSION);
@@ -1040,6 +1217,31 @@ void multifd_recv_sync_main(void)
     trace_multifd_recv_sync_main(multifd_recv_state->packet_num);
 }
 
+/*
+ * multifd_recv_zero_pages: clear the pages that the source found zero
+ *
+ * Pages that are already zero are left alone, so that they don't get
+ * allocated on the destination just to be written with zeroes.
+ *
+ * @p: Params for the channel that we are using
+ */
+static void multifd_recv_zero_pages(MultiFDRecvParams *p)
+{
+    MultiFDPages_t *pages = p->pages;
+    size_t page_size = qemu_target_page_size();
+    unsigned long i;
+
+    for (i = find_first_bit(pages->zero_bitmap, pages->used);
+         i < pages->used;
+         i = find_next_bit(pages->zero_bitmap, pages->used, i + 1)) {
+        void *page = pages->block->host + pages->offset[i];
+
+        if (!buffer_is_zero(page, page_size)) {
+            memset(page, 0, page_size);
+        }
+    }
+}
+
 static void *multifd_recv_thread(void *opaque)
 {
     MultiFDRecvParams *p = opaque;
@@ -1051,6 +1253,7 @@ static void *multifd_recv_thread(void *opaque)
 
     while (true) {
         uint32_t used;
+        uint32_t zero;
         uint32_t flags;
 
         if (p->quit) {
@@ -1074,17 +1277,24 @@ static void *multifd_recv_thread(void *opaque)
         }
 
         used = p->pages->used;
+        zero = p->pages->zero_num;
         flags = p->flags;
         /* recv methods don't know how to handle the SYNC flag */
         p->flags &= ~MULTIFD_FLAG_SYNC;
-        trace_multifd_recv(p->id, p->packet_num, used, flags,
+        trace_multifd_recv(p->id, p->packet_num, used, zero, flags,
                            p->next_packet_size);
         p->num_packets++;
         p->num_pages += used;
+        p->num_zero_pages += zero;
         qemu_mutex_unlock(&p->mutex);
 
-        if (used) {
-            ret = multifd_recv_state->ops->recv_pages(p, used, &local_err);
+        if (zero) {
+            multifd_recv_zero_pages(p);
+        }
+
+        if (used > zero) {
+            ret = multifd_recv_state->ops->recv_pages(p, used - zero,
+                                                      &local_err);
             if (ret != 0) {
                 break;
             }
@@ -1105,7 +1315,8 @@ static void *multifd_recv_thread(void *opaque)
     qemu_mutex_unlock(&p->mutex);
 
     rcu_unregister_thread();
-    trace_multifd_recv_thread_end(p->id, p->num_packets, p->num_pages);
+    trace_multifd_recv_thread_end(p->id, p->num_packets, p->num_pages,
+                                  p->num_zero_pages);
 
     return NULL;
 }
@@ -1134,8 +1345,8 @@ int multifd_load_setup(Error **errp)
         p->quit = false;
         p->id = i;
         p->pages = multifd_pages_init(page_count);
-        p->packet_len = sizeof(MultiFDPacket_t)
-                      + sizeof(uint64_t) * page_count;
+        p->packet_len = multifd_packet_len(page_count,
+                                           migrate_multifd_zero_page());
         p->packet = g_malloc0(p->packet_len);
         p->name = g_strdup_printf("multifdrecv_%d", i);
     }
@@ -32,6 +32,10 @@ int multifd_queue_page(QEMUFile *f, RAMBlock *block, ram_addr_t offset);
 #define MULTIFD_FLAG_NOCOMP (0 << 1)
 #define MULTIFD_FLAG_ZLIB (1 << 1)
 #define MULTIFD_FLAG_ZSTD (2 << 1)
+#define MULTIFD_FLAG_LZ4 (3 << 1)
+
+/* The packet carries a bitmap of zero pages after the offsets */
+#define MULTIFD_FLAG_ZERO_PAGE (1 << 4)
 
 /* This value needs to be a multiple of qemu_target_page_size() */
 #define MULTIFD_PACKET_SIZE (512 * 1024)
@@ -48,9 +52,19 @@ typedef struct {
     uint64_t packet_num;
     uint64_t unused[4];    /* Reserved for future use */
     char ramblock[256];
+    /*
+     * pages_alloc offsets.  With MULTIFD_FLAG_ZERO_PAGE they are followed
+     * by a bitmap of pages_alloc bits, stored as big endian 64 bit words,
+     * where a set bit means that the page at that offset is all zeroes
+     * and its data is not part of the packet.
+     */
     uint64_t offset[];
 } __attribute__((packed)) MultiFDPacket_t;
 
+/* size in bytes of the zero page bitmap for a packet of @pages pages */
+#define MULTIFD_ZERO_BITMAP_SIZE(pages) \
+    (DIV_ROUND_UP(pages, 64) * sizeof(uint64_t))
+
 typedef struct {
     /* number of used pages */
     uint32_t used;
@@ -62,6 +76,10 @@ typedef struct {
     ram_addr_t *offset;
     /* pointer to each page */
     struct iovec *iov;
+    /* number of pages in zero_bitmap */
+    uint32_t zero_num;
+    /* zero pages, indexed like offset; they have no entry in iov */
+    unsigned long *zero_bitmap;
     RAMBlock *block;
 } MultiFDPages_t;
 
@@ -104,6 +122,15 @@ typedef struct {
     uint64_t num_packets;
     /* pages sent through this channel */
     uint64_t num_pages;
+    /* zero pages found by this channel, and so not sent as data */
+    uint64_t num_zero_pages;
+    /* page data written and zero pages found since the main thread's last look */
+    uint64_t bytes_pending;
+    uint64_t zero_pending;
+    /* syncs where the kernel had to copy pages sent with zero copy */
+    uint64_t zero_copy_missed_pending;
+    /* flags for writing the pages (QIO_CHANNEL_WRITE_FLAG_*) */
+    int write_flags;
     /* syncs main thread and channels */
     QemuSemaphore sem_sync;
     /* used for compression methods */
@@ -143,6 +170,8 @@ typedef struct {
     uint64_t num_packets;
     /* pages sent through this channel */
     uint64_t num_pages;
+    /* zero pages received through this channel */
+    uint64_t num_zero_pages;
     /* syncs main thread and channels */
     QemuSemaphore sem_sync;
     /* used for de-compression methods */
@@ -284,6 +284,12 @@ void hmp_info_migrate(Monitor *mon, const QDict *qdict)
                        info->ram->multifd_bytes >> 10);
         monitor_printf(mon, "pages-per-second: %" PRIu64 "\n",
                        info->ram->pages_per_second);
+        if (info->ram->dirty_sync_missed_zero_copy) {
+            monitor_printf(mon,
+                           "Zero-copy-send fallbacks happened: %" PRIu64
+                           " times\n",
+                           info->ram->dirty_sync_missed_zero_copy);
+        }
 
         if (info->ram->dirty_pages_rate) {
             monitor_printf(mon, "dirty pages rate: %" PRIu64 " pages\n",
@@ -487,6 +493,10 @@ void hmp_info_migrate_parameters(Monitor *mon, const QDict *qdict)
         monitor_printf(mon, "%s: '%s'\n",
             MigrationParameter_str(MIGRATION_PARAMETER_TLS_AUTHZ),
             params->tls_authz);
+        assert(params->has_vcpu_dirty_limit);
+        monitor_printf(mon, "%s: %" PRIu64 " MB/s\n",
+            MigrationParameter_str(MIGRATION_PARAMETER_VCPU_DIRTY_LIMIT),
+            params->vcpu_dirty_limit);
 
         if (params->has_block_bitmap_mapping) {
             const BitmapMigrationNodeAliasList *bmnal;
@@ -1399,6 +1409,10 @@ void hmp_migrate_set_parameter(Monitor *mon, const QDict *qdict)
         error_setg(&err, "The block-bitmap-mapping parameter can only be set "
                    "through QMP");
         break;
+    case MIGRATION_PARAMETER_VCPU_DIRTY_LIMIT:
+        p->has_vcpu_dirty_limit = true;
+        visit_type_uint64(v, param, &p->vcpu_dirty_limit, &err);
+        break;
     default:
         assert(0);
     }
@@ -1895,11 +1909,27 @@ void hmp_info_iothreads(Monitor *mon, const QDict *qdict)
         monitor_printf(mon, "  poll-shrink=%" PRId64 "\n", value->poll_shrink);
         monitor_printf(mon, "  aio-max-batch=%" PRId64 "\n",
                        value->aio_max_batch);
+        monitor_printf(mon, "  notify-events=%" PRId64 "\n",
+                       value->notify_events);
+        monitor_printf(mon, "  notify-coalesced=%" PRId64 "\n",
+                       value->notify_coalesced);
     }
 
     qapi_free_IOThreadInfoList(info_list);
 }
 
+void hmp_info_coroutine_pool(Monitor *mon, const QDict *qdict)
+{
+    CoroutinePoolInfo *info = qmp_query_coroutine_pool(NULL);
+
+    monitor_printf(mon, "batch-size=%" PRId64 "\n", info->batch_size);
+    monitor_printf(mon, "allocated=%" PRId64 "\n", info->allocated);
+    monitor_printf(mon, "freed=%" PRId64 "\n", info->freed);
+    monitor_printf(mon, "trimmed=%" PRId64 "\n", info->trimmed);
+
+    qapi_free_CoroutinePoolInfo(info);
+}
+
 void hmp_rocker(Monitor *mon, const QDict *qdict)
 {
     const char *name = qdict_get_str(qdict, "name");
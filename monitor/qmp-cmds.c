@@ -17,6 +17,7 @@
 #include "qemu-common.h"
 #include "qemu/cutils.h"
 #include "qemu/option.h"
+#include "qemu/coroutine.h"
 #include "monitor/monitor.h"
 #include "sysemu/sysemu.h"
 #include "qemu/config-file.h"
@@ -53,6 +54,20 @@ NameInfo *qmp_query_name(Error **errp)
     return info;
 }
 
+CoroutinePoolInfo *qmp_query_coroutine_pool(Error **errp)
+{
+    CoroutinePoolInfo *info = g_malloc0(sizeof(*info));
+    CoroutinePoolStats stats;
+
+    qemu_coroutine_get_pool_stats(&stats);
+    info->batch_size = stats.batch_size;
+    info->allocated = stats.allocated;
+    info->freed = stats.freed;
+    info->trimmed = stats.trimmed;
+
+    return info;
+}
+
 KvmInfo *qmp_query_kvm(Error **errp)
 {
     KvmInfo *info = g_malloc0(sizeof(*info));
@@ -712,7 +712,7 @@ ssize_t qemu_send_packet_raw(NetClientState *nc, const uint8_t *buf, int size)
 static ssize_t nc_sendv_compat(NetClientState *nc, const struct iovec *iov,
                                int iovcnt, unsigned flags)
 {
-    uint8_t *buf = NULL;
+    NetPacketBuf *buf = NULL;
     uint8_t *buffer;
     size_t offset;
     ssize_t ret;
@@ -725,9 +725,8 @@ static ssize_t nc_sendv_compat(NetClientState *nc, const struct iovec *iov,
         if (offset > NET_BUFSIZE) {
             return -1;
         }
-        buf = g_malloc(offset);
-        buffer = buf;
-        offset = iov_to_buf(iov, iovcnt, 0, buf, offset);
+        buf = qemu_net_packet_buf_from_iov(iov, iovcnt);
+        buffer = qemu_net_packet_buf_data(buf);
     }
 
     if (flags & QEMU_NET_PACKET_FLAG_RAW && nc->info->receive_raw) {
@@ -736,7 +735,9 @@ static ssize_t nc_sendv_compat(NetClientState *nc, const struct iovec *iov,
         ret = nc->info->receive(nc, buffer, offset);
     }
 
-    g_free(buf);
+    if (buf) {
+        qemu_net_packet_buf_unref(buf);
+    }
     return ret;
 }
 
@@ -988,6 +989,9 @@ static int (* const net_client_init_fun[NET_CLIENT_DRIVER__MAX])(
 #ifdef CONFIG_NETMAP
         [NET_CLIENT_DRIVER_NETMAP]    = net_init_netmap,
 #endif
+#ifdef CONFIG_AF_XDP
+        [NET_CLIENT_DRIVER_AF_XDP]    = net_init_af_xdp,
+#endif
 #ifdef CONFIG_NET_BRIDGE
         [NET_CLIENT_DRIVER_BRIDGE]    = net_init_bridge,
 #endif
@@ -1081,6 +1085,9 @@ void show_netdevs(void)
 #ifdef CONFIG_NETMAP
         "netmap",
 #endif
+#ifdef CONFIG_AF_XDP
+        "af-xdp",
+#endif
 #ifdef CONFIG_POSIX
         "vhost-user",
 #endif
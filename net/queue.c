@@ -23,7 +23,11 @@
 
 #include "qemu/osdep.h"
 #include "net/queue.h"
+#include "qemu/atomic.h"
+#include "qemu/iov.h"
+#include "qemu/notify.h"
 #include "qemu/queue.h"
+#include "qemu/thread.h"
 #include "net/net.h"
 
 /* The delivery handler may only return zero if it will call
@@ -40,13 +44,37 @@
  * unbounded queueing.
  */
 
+/*
+ * The data of a queued packet is kept in a reference counted
+ * NetPacketBuf.  Buffers and queue entries are recycled through
+ * per-thread free lists, so that a backpressured peer does not cause a
+ * malloc/free pair for every packet.
+ *
+ * While a packet is passed on, e.g. by qemu_net_queue_flush(), a hub or
+ * a filter, it is described by a NetPacketScope.  Appending the same
+ * data to another queue inside the scope takes a reference to the
+ * packet's buffer instead of copying the data.
+ */
+
+struct NetPacketBuf {
+    int refcnt;
+    int8_t pool;            /* index in net_packet_buf_pool_size, or -1 */
+    size_t size;
+    QSLIST_ENTRY(NetPacketBuf) next;
+    uint8_t data[];
+};
+
 struct NetPacket {
-    QTAILQ_ENTRY(NetPacket) entry;
+    union {
+        QTAILQ_ENTRY(NetPacket) entry;
+        QSLIST_ENTRY(NetPacket) free_next;
+    };
     NetClientState *sender;
     unsigned flags;
     int size;
     NetPacketSent *sent_cb;
-    uint8_t data[];
+    NetPacketBuf *buf;
+    uint8_t *data;          /* within buf->data */
 };
 
 struct NetQueue {
@@ -60,6 +88,231 @@ struct NetQueue {
     unsigned delivering : 1;
 };
 
+/* Buffer sizes: an MTU sized frame, and anything up to NET_BUFSIZE */
+#define NET_PACKET_BUF_POOLS 2
+static const size_t net_packet_buf_pool_size[NET_PACKET_BUF_POOLS] = {
+    2048, NET_BUFSIZE
+};
+
+/* Number of free buffers of each size, and of queue entries, per thread */
+static const unsigned net_packet_buf_pool_max[NET_PACKET_BUF_POOLS] = {
+    1024, 32
+};
+#define NET_PACKET_POOL_MAX 1024
+
+typedef struct NetPacketPool {
+    QSLIST_HEAD(, NetPacketBuf) bufs[NET_PACKET_BUF_POOLS];
+    unsigned nbufs[NET_PACKET_BUF_POOLS];
+    QSLIST_HEAD(, NetPacket) packets;
+    unsigned npackets;
+    Notifier cleanup_notifier;
+} NetPacketPool;
+
+static __thread NetPacketPool net_packet_pool;
+static __thread NetPacketScope *net_packet_scope;
+
+static void net_packet_pool_cleanup(Notifier *n, void *value)
+{
+    NetPacketPool *pool = &net_packet_pool;
+    NetPacketBuf *buf;
+    NetPacket *packet;
+    int i;
+
+    for (i = 0; i < NET_PACKET_BUF_POOLS; i++) {
+        while ((buf = QSLIST_FIRST(&pool->bufs[i]))) {
+            QSLIST_REMOVE_HEAD(&pool->bufs[i], next);
+            g_free(buf);
+        }
+        pool->nbufs[i] = 0;
+    }
+    while ((packet = QSLIST_FIRST(&pool->packets))) {
+        QSLIST_REMOVE_HEAD(&pool->packets, free_next);
+        g_free(packet);
+    }
+    pool->npackets = 0;
+}
+
+static void net_packet_pool_init(NetPacketPool *pool)
+{
+    if (!pool->cleanup_notifier.notify) {
+        pool->cleanup_notifier.notify = net_packet_pool_cleanup;
+        qemu_thread_atexit_add(&pool->cleanup_notifier);
+    }
+}
+
+NetPacketBuf *qemu_net_packet_buf_new(size_t size)
+{
+    NetPacketPool *pool = &net_packet_pool;
+    NetPacketBuf *buf = NULL;
+    int i;
+
+    for (i = 0; i < NET_PACKET_BUF_POOLS; i++) {
+        if (size <= net_packet_buf_pool_size[i] - sizeof(NetPacketBuf)) {
+            break;
+        }
+    }
+
+    if (i < NET_PACKET_BUF_POOLS) {
+        buf = QSLIST_FIRST(&pool->bufs[i]);
+        if (buf) {
+            QSLIST_REMOVE_HEAD(&pool->bufs[i], next);
+            pool->nbufs[i]--;
+        } else {
+            buf = g_malloc(net_packet_buf_pool_size[i]);
+        }
+        buf->pool = i;
+    } else {
+        buf = g_malloc(sizeof(NetPacketBuf) + size);
+        buf->pool = -1;
+    }
+
+    buf->refcnt = 1;
+    buf->size = size;
+    return buf;
+}
+
+NetPacketBuf *qemu_net_packet_buf_from_iov(const struct iovec *iov,
+                                           int iovcnt)
+{
+    size_t size = iov_size(iov, iovcnt);
+    NetPacketBuf *buf = qemu_net_packet_buf_new(size);
+
+    iov_to_buf(iov, iovcnt, 0, buf->data, size);
+    return buf;
+}
+
+uint8_t *qemu_net_packet_buf_data(NetPacketBuf *buf)
+{
+    return buf->data;
+}
+
+size_t qemu_net_packet_buf_size(NetPacketBuf *buf)
+{
+    return buf->size;
+}
+
+void qemu_net_packet_buf_ref(NetPacketBuf *buf)
+{
+    qatomic_inc(&buf->refcnt);
+}
+
+void qemu_net_packet_buf_unref(NetPacketBuf *buf)
+{
+    NetPacketPool *pool = &net_packet_pool;
+
+    if (qatomic_fetch_dec(&buf->refcnt) != 1) {
+        return;
+    }
+
+    if (buf->pool >= 0 &&
+        pool->nbufs[buf->pool] < net_packet_buf_pool_max[buf->pool]) {
+        net_packet_pool_init(pool);
+        QSLIST_INSERT_HEAD(&pool->bufs[buf->pool], buf, next);
+        pool->nbufs[buf->pool]++;
+        return;
+    }
+    g_free(buf);
+}
+
+void qemu_net_packet_scope_begin(NetPacketScope *scope,
+                                 const struct iovec *iov, int iovcnt,
+                                 NetPacketBuf *buf)
+{
+    scope->iov = iov;
+    scope->iovcnt = iovcnt;
+    scope->buf = buf;
+    scope->owned = false;
+    scope->outer = net_packet_scope;
+    net_packet_scope = scope;
+}
+
+void qemu_net_packet_scope_end(NetPacketScope *scope)
+{
+    assert(net_packet_scope == scope);
+    net_packet_scope = scope->outer;
+    if (scope->owned) {
+        qemu_net_packet_buf_unref(scope->buf);
+    }
+}
+
+/*
+ * Look for a buffer that already holds the data in @iov: either the
+ * buffer of a scope, if the data lies within it, or the data that a
+ * scope describes, copied to a buffer once for all the queues.
+ * Returns a new reference and, in *@data, where the data starts.
+ */
+static NetPacketBuf *net_packet_scope_lookup(const struct iovec *iov,
+                                             int iovcnt, uint8_t **data)
+{
+    NetPacketScope *scope;
+    int i;
+
+    for (scope = net_packet_scope; scope; scope = scope->outer) {
+        if (scope->buf && iovcnt == 1) {
+            uint8_t *base = iov[0].iov_base;
+            uint8_t *start = scope->buf->data;
+            uint8_t *end = start + scope->buf->size;
+
+            if (base >= start && base <= end &&
+                iov[0].iov_len <= end - base) {
+                *data = base;
+                qemu_net_packet_buf_ref(scope->buf);
+                return scope->buf;
+            }
+        }
+
+        if (scope->iovcnt != iovcnt) {
+            continue;
+        }
+        for (i = 0; i < iovcnt; i++) {
+            if (scope->iov[i].iov_base != iov[i].iov_base ||
+                scope->iov[i].iov_len != iov[i].iov_len) {
+                break;
+            }
+        }
+        if (i < iovcnt) {
+            continue;
+        }
+
+        if (!scope->buf) {
+            scope->buf = qemu_net_packet_buf_from_iov(iov, iovcnt);
+            scope->owned = true;
+        }
+        *data = scope->buf->data;
+        qemu_net_packet_buf_ref(scope->buf);
+        return scope->buf;
+    }
+
+    return NULL;
+}
+
+static NetPacket *net_packet_new(void)
+{
+    NetPacketPool *pool = &net_packet_pool;
+    NetPacket *packet = QSLIST_FIRST(&pool->packets);
+
+    if (packet) {
+        QSLIST_REMOVE_HEAD(&pool->packets, free_next);
+        pool->npackets--;
+        return packet;
+    }
+    return g_new(NetPacket, 1);
+}
+
+static void net_packet_free(NetPacket *packet)
+{
+    NetPacketPool *pool = &net_packet_pool;
+
+    qemu_net_packet_buf_unref(packet->buf);
+    if (pool->npackets < NET_PACKET_POOL_MAX) {
+        net_packet_pool_init(pool);
+        QSLIST_INSERT_HEAD(&pool->packets, packet, free_next);
+        pool->npackets++;
+        return;
+    }
+    g_free(packet);
+}
+
 NetQueue *qemu_new_net_queue(NetQueueDeliverFunc *deliver, void *opaque)
 {
     NetQueue *queue;
@@ -84,35 +337,12 @@ void qemu_del_net_queue(NetQueue *queue)
 
     QTAILQ_FOREACH_SAFE(packet, &queue->packets, entry, next) {
         QTAILQ_REMOVE(&queue->packets, packet, entry);
-        g_free(packet);
+        net_packet_free(packet);
     }
 
     g_free(queue);
 }
 
-static void qemu_net_queue_append(NetQueue *queue,
-                                  NetClientState *sender,
-                                  unsigned flags,
-                                  const uint8_t *buf,
-                                  size_t size,
-                                  NetPacketSent *sent_cb)
-{
-    NetPacket *packet;
-
-    if (queue->nq_count >= queue->nq_maxlen && !sent_cb) {
-        return; /* drop if queue full and no callback */
-    }
-    packet = g_malloc(sizeof(NetPacket) + size);
-    packet->sender = sender;
-    packet->flags = flags;
-    packet->size = size;
-    packet->sent_cb = sent_cb;
-    memcpy(packet->data, buf, size);
-
-    queue->nq_count++;
-    QTAILQ_INSERT_TAIL(&queue->packets, packet, entry);
-}
-
 void qemu_net_queue_append_iov(NetQueue *queue,
                                NetClientState *sender,
                                unsigned flags,
@@ -121,33 +351,41 @@ void qemu_net_queue_append_iov(NetQueue *queue,
                                NetPacketSent *sent_cb)
 {
     NetPacket *packet;
-    size_t max_len = 0;
-    int i;
 
     if (queue->nq_count >= queue->nq_maxlen && !sent_cb) {
         return; /* drop if queue full and no callback */
     }
-    for (i = 0; i < iovcnt; i++) {
-        max_len += iov[i].iov_len;
-    }
 
-    packet = g_malloc(sizeof(NetPacket) + max_len);
+    packet = net_packet_new();
     packet->sender = sender;
     packet->sent_cb = sent_cb;
     packet->flags = flags;
-    packet->size = 0;
-
-    for (i = 0; i < iovcnt; i++) {
-        size_t len = iov[i].iov_len;
-
-        memcpy(packet->data + packet->size, iov[i].iov_base, len);
-        packet->size += len;
+    packet->size = iov_size(iov, iovcnt);
+    packet->buf = net_packet_scope_lookup(iov, iovcnt, &packet->data);
+    if (!packet->buf) {
+        packet->buf = qemu_net_packet_buf_from_iov(iov, iovcnt);
+        packet->data = packet->buf->data;
     }
 
     queue->nq_count++;
     QTAILQ_INSERT_TAIL(&queue->packets, packet, entry);
 }
 
+static void qemu_net_queue_append(NetQueue *queue,
+                                  NetClientState *sender,
+                                  unsigned flags,
+                                  const uint8_t *buf,
+                                  size_t size,
+                                  NetPacketSent *sent_cb)
+{
+    struct iovec iov = {
+        .iov_base = (void *)buf,
+        .iov_len = size
+    };
+
+    qemu_net_queue_append_iov(queue, sender, flags, &iov, 1, sent_cb);
+}
+
 static ssize_t qemu_net_queue_deliver(NetQueue *queue,
                                       NetClientState *sender,
                                       unsigned flags,
@@ -265,7 +503,7 @@ void qemu_net_queue_purge(NetQueue *queue, NetClientState *from)
             if (packet->sent_cb) {
                 packet->sent_cb(packet->sender, 0);
             }
-            g_free(packet);
+            net_packet_free(packet);
         }
     }
 }
@@ -276,18 +514,23 @@ bool qemu_net_queue_flush(NetQueue *queue)
         return false;
 
     while (!QTAILQ_EMPTY(&queue->packets)) {
+        NetPacketScope scope;
         NetPacket *packet;
+        struct iovec iov;
         int ret;
 
         packet = QTAILQ_FIRST(&queue->packets);
         QTAILQ_REMOVE(&queue->packets, packet, entry);
         queue->nq_count--;
 
-        ret = qemu_net_queue_deliver(queue,
-                                     packet->sender,
-                                     packet->flags,
-                                     packet->data,
-                                     packet->size);
+        iov.iov_base = packet->data;
+        iov.iov_len = packet->size;
+
+        /* Whoever queues the packet again shares its buffer */
+        qemu_net_packet_scope_begin(&scope, &iov, 1, packet->buf);
+        ret = qemu_net_queue_deliver_iov(queue, packet->sender,
+                                         packet->flags, &iov, 1);
+        qemu_net_packet_scope_end(&scope);
         if (ret == 0) {
             queue->nq_count++;
             QTAILQ_INSERT_HEAD(&queue->packets, packet, entry);
@@ -298,7 +541,7 @@ bool qemu_net_queue_flush(NetQueue *queue)
             packet->sent_cb(packet->sender, ret);
         }
 
-        g_free(packet);
+        net_packet_free(packet);
     }
     return true;
 }
@@ -48,6 +48,14 @@
 
 #include "net/vhost_net.h"
 
+#ifdef CONFIG_LINUX_IO_URING
+#include <liburing.h>
+#include "qemu/event_notifier.h"
+#include "qemu/iov.h"
+
+typedef struct TapUring TapUring;
+#endif
+
 typedef struct TAPState {
     NetClientState nc;
     int fd;
@@ -62,6 +70,9 @@ typedef struct TAPState {
     VHostNetState *vhost_net;
     unsigned host_vnet_hdr_len;
     Notifier exit;
+#ifdef CONFIG_LINUX_IO_URING
+    TapUring *uring;
+#endif
 } TAPState;
 
 static void launch_script(const char *setup_script, const char *ifname,
@@ -69,6 +80,373 @@ static void launch_script(const char *setup_script, const char *ifname,
 
 static void tap_send(void *opaque);
 static void tap_writable(void *opaque);
+static void tap_send_completed(NetClientState *nc, ssize_t len);
+static void tap_read_poll(TAPState *s, bool enable);
+static void tap_write_poll(TAPState *s, bool enable);
+static void tap_update_fd_handler(TAPState *s);
+
+#ifdef CONFIG_LINUX_IO_URING
+/*
+ * With io-uring=on, packets are read from and written to the tap device
+ * through an io_uring instead of one read() or writev() per packet.  The fd
+ * stays O_NONBLOCK, so a request never waits for a packet in the kernel: it
+ * completes, or fails with -EAGAIN, as soon as it is issued.
+ *
+ * - When the fd becomes readable, tap_send() queues a batch of reads and
+ *   submits them with one io_uring_enter().  The batch grows while every
+ *   read returns a packet and shrinks when most of them come back empty,
+ *   so a trickle of packets does not pay for many failed reads.
+ *
+ * - Outgoing packets are copied into one of TAP_URING_TX_BUFS buffers and
+ *   the writes are submitted together from a bottom half.  While all
+ *   buffers are in flight, or while writes that found the device full wait
+ *   to be retried, tap_write_packet() returns 0 so that the net queue holds
+ *   the packet.
+ *
+ * Requests that the kernel completes asynchronously are reaped by a handler
+ * on an eventfd registered with the ring.
+ */
+#define TAP_URING_RX_BUFS       32
+#define TAP_URING_RX_MIN_BATCH  2
+#define TAP_URING_TX_BUFS       32
+#define TAP_URING_TX            0x10000 /* user_data flag for writes */
+
+enum {
+    TAP_URING_RX_FREE,
+    TAP_URING_RX_INFLIGHT,
+    TAP_URING_RX_READY,
+};
+
+struct TapUring {
+    TAPState *tap;
+    struct io_uring ring;
+    EventNotifier notifier;
+    QEMUBH *submit_bh;
+    unsigned inflight;      /* submitted or queued, not completed */
+
+    uint8_t (*rx_buf)[NET_BUFSIZE];
+    uint8_t rx_state[TAP_URING_RX_BUFS];
+    int rx_len[TAP_URING_RX_BUFS];
+    /* FIFO of buffers in TAP_URING_RX_READY state, in completion order */
+    unsigned rx_ready[TAP_URING_RX_BUFS];
+    unsigned rx_ready_head;
+    unsigned rx_ready_count;
+    unsigned rx_batch;      /* reads queued when the fd is readable */
+    unsigned rx_empty;      /* reads that found no packet */
+
+    uint8_t (*tx_buf)[NET_BUFSIZE];
+    size_t tx_len[TAP_URING_TX_BUFS];
+    unsigned tx_free[TAP_URING_TX_BUFS];
+    unsigned tx_nfree;
+    /* Writes that failed with -EAGAIN, resubmitted when the fd is writable */
+    unsigned tx_retry[TAP_URING_TX_BUFS];
+    unsigned tx_nretry;
+    bool tx_blocked;
+};
+
+/* Account for completed requests, without calling into the peer */
+static void tap_uring_reap(TAPState *s)
+{
+    TapUring *u = s->uring;
+    struct io_uring_cqe *cqe;
+
+    while (io_uring_peek_cqe(&u->ring, &cqe) == 0) {
+        unsigned tag = (uintptr_t)io_uring_cqe_get_data(cqe);
+        unsigned idx = tag & ~TAP_URING_TX;
+
+        if (tag & TAP_URING_TX) {
+            if (cqe->res == -EAGAIN) {
+                u->tx_retry[u->tx_nretry++] = idx;
+            } else {
+                u->tx_free[u->tx_nfree++] = idx;
+            }
+        } else if (cqe->res > 0) {
+            u->rx_state[idx] = TAP_URING_RX_READY;
+            u->rx_len[idx] = cqe->res;
+            u->rx_ready[(u->rx_ready_head + u->rx_ready_count++) %
+                        TAP_URING_RX_BUFS] = idx;
+        } else {
+            u->rx_state[idx] = TAP_URING_RX_FREE;
+            u->rx_empty++;
+        }
+        u->inflight--;
+        io_uring_cqe_seen(&u->ring, cqe);
+    }
+}
+
+/* Requests on the O_NONBLOCK fd mostly complete during the submission */
+static void tap_uring_submit(TAPState *s)
+{
+    int ret = io_uring_submit(&s->uring->ring);
+
+    if (ret < 0 && ret != -EAGAIN && ret != -EBUSY) {
+        error_report_once("tap: io_uring_submit failed: %s", strerror(-ret));
+    }
+    tap_uring_reap(s);
+}
+
+/* Wait for the fd to drain writes that found it full, or let the peer send */
+static void tap_uring_tx_kick(TAPState *s)
+{
+    TapUring *u = s->uring;
+
+    if (u->tx_nretry) {
+        tap_write_poll(s, true);
+    } else if (u->tx_blocked && u->tx_nfree) {
+        u->tx_blocked = false;
+        qemu_flush_queued_packets(&s->nc);
+    }
+}
+
+static void tap_uring_submit_bh(void *opaque)
+{
+    TAPState *s = opaque;
+
+    tap_uring_submit(s);
+    tap_uring_tx_kick(s);
+}
+
+static void tap_uring_tx_retry(TAPState *s)
+{
+    TapUring *u = s->uring;
+    struct io_uring_sqe *sqe;
+    unsigned i, n = u->tx_nretry;
+
+    for (i = 0; i < n; i++) {
+        unsigned idx = u->tx_retry[i];
+
+        sqe = io_uring_get_sqe(&u->ring);
+        if (!sqe) {
+            break;
+        }
+        io_uring_prep_write(sqe, s->fd, u->tx_buf[idx], u->tx_len[idx], 0);
+        io_uring_sqe_set_data(sqe, (void *)(uintptr_t)(idx | TAP_URING_TX));
+        u->inflight++;
+    }
+    memmove(u->tx_retry, u->tx_retry + i, (n - i) * sizeof(u->tx_retry[0]));
+    u->tx_nretry = n - i;
+
+    tap_uring_submit(s);
+    tap_uring_tx_kick(s);
+}
+
+/* Queue up to @max reads, returns how many were queued */
+static unsigned tap_uring_rx_refill(TAPState *s, unsigned max)
+{
+    TapUring *u = s->uring;
+    struct io_uring_sqe *sqe;
+    unsigned i, queued = 0;
+
+    for (i = 0; i < TAP_URING_RX_BUFS && queued < max; i++) {
+        if (u->rx_state[i] != TAP_URING_RX_FREE) {
+            continue;
+        }
+        sqe = io_uring_get_sqe(&u->ring);
+        if (!sqe) {
+            break;
+        }
+        io_uring_prep_read(sqe, s->fd, u->rx_buf[i], NET_BUFSIZE, 0);
+        io_uring_sqe_set_data(sqe, (void *)(uintptr_t)i);
+        u->rx_state[i] = TAP_URING_RX_INFLIGHT;
+        u->inflight++;
+        queued++;
+    }
+
+    return queued;
+}
+
+/* Hand completed reads to the peer */
+static void tap_uring_rx_deliver(TAPState *s)
+{
+    TapUring *u = s->uring;
+    int packets = 0;
+
+    while (u->rx_ready_count && s->read_poll && s->enabled) {
+        unsigned idx = u->rx_ready[u->rx_ready_head];
+        uint8_t *buf = u->rx_buf[idx];
+        int size = u->rx_len[idx];
+        uint8_t min_pkt[ETH_ZLEN];
+        size_t min_pktsz = sizeof(min_pkt);
+
+        u->rx_ready_head = (u->rx_ready_head + 1) % TAP_URING_RX_BUFS;
+        u->rx_ready_count--;
+        u->rx_state[idx] = TAP_URING_RX_FREE;
+
+        if (s->host_vnet_hdr_len && !s->using_vnet_hdr) {
+            buf  += s->host_vnet_hdr_len;
+            size -= s->host_vnet_hdr_len;
+        }
+
+        if (net_peer_needs_padding(&s->nc)) {
+            if (eth_pad_short_frame(min_pkt, &min_pktsz, buf, size)) {
+                buf = min_pkt;
+                size = min_pktsz;
+            }
+        }
+
+        /* A packet that the peer queues is copied, so the buffer is free */
+        size = qemu_send_packet_async(&s->nc, buf, size, tap_send_completed);
+        if (size == 0) {
+            tap_read_poll(s, false);
+            break;
+        }
+
+        /* Same limit as tap_send(), come back for the rest */
+        if (++packets >= 50) {
+            if (u->rx_ready_count) {
+                event_notifier_set(&u->notifier);
+            }
+            break;
+        }
+    }
+}
+
+/* The io_uring version of tap_send(), called when the fd is readable */
+static void tap_uring_send(TAPState *s)
+{
+    TapUring *u = s->uring;
+    unsigned queued;
+
+    /* Packets left over from the previous round go first */
+    tap_uring_rx_deliver(s);
+    if (u->rx_ready_count || !s->read_poll || !s->enabled) {
+        return;
+    }
+
+    queued = tap_uring_rx_refill(s, u->rx_batch);
+    if (!queued) {
+        return;
+    }
+    u->rx_empty = 0;
+    tap_uring_submit(s);
+
+    if (!u->rx_empty && queued == u->rx_batch) {
+        u->rx_batch = MIN(u->rx_batch * 2, TAP_URING_RX_BUFS);
+    } else if (u->rx_empty > queued / 2) {
+        u->rx_batch = MAX(u->rx_batch / 2, TAP_URING_RX_MIN_BATCH);
+    }
+
+    tap_uring_rx_deliver(s);
+}
+
+static void tap_uring_completion(EventNotifier *e)
+{
+    TapUring *u = container_of(e, TapUring, notifier);
+    TAPState *s = u->tap;
+
+    event_notifier_test_and_clear(e);
+    tap_uring_reap(s);
+    tap_uring_tx_kick(s);
+    tap_uring_rx_deliver(s);
+}
+
+static ssize_t tap_uring_write_packet(TAPState *s, const struct iovec *iov,
+                                      int iovcnt, size_t size)
+{
+    TapUring *u = s->uring;
+    struct io_uring_sqe *sqe = NULL;
+    unsigned idx;
+
+    if (!u->tx_nfree && !u->tx_nretry) {
+        tap_uring_submit(s);
+    }
+    /* Keep packets in order behind writes that wait for a retry */
+    if (u->tx_nfree && !u->tx_nretry) {
+        sqe = io_uring_get_sqe(&u->ring);
+    }
+    if (!sqe) {
+        /* The peer queues the packet until a write completes */
+        u->tx_blocked = true;
+        return 0;
+    }
+
+    idx = u->tx_free[--u->tx_nfree];
+    iov_to_buf(iov, iovcnt, 0, u->tx_buf[idx], size);
+    u->tx_len[idx] = size;
+    io_uring_prep_write(sqe, s->fd, u->tx_buf[idx], size, 0);
+    io_uring_sqe_set_data(sqe, (void *)(uintptr_t)(idx | TAP_URING_TX));
+    u->inflight++;
+
+    /* Submit all the packets of this burst together */
+    qemu_bh_schedule(u->submit_bh);
+    return size;
+}
+
+static bool tap_uring_init(TAPState *s, Error **errp)
+{
+    TapUring *u = g_new0(TapUring, 1);
+    unsigned i;
+    int ret;
+
+    ret = io_uring_queue_init(TAP_URING_RX_BUFS + TAP_URING_TX_BUFS,
+                              &u->ring, 0);
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "tap: failed to initialize io_uring");
+        g_free(u);
+        return false;
+    }
+
+    ret = event_notifier_init(&u->notifier, false);
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "tap: failed to create event notifier");
+        io_uring_queue_exit(&u->ring);
+        g_free(u);
+        return false;
+    }
+
+    ret = io_uring_register_eventfd(&u->ring,
+                                    event_notifier_get_fd(&u->notifier));
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "tap: failed to register io_uring eventfd");
+        event_notifier_cleanup(&u->notifier);
+        io_uring_queue_exit(&u->ring);
+        g_free(u);
+        return false;
+    }
+
+    u->tap = s;
+    u->rx_buf = g_malloc(TAP_URING_RX_BUFS * NET_BUFSIZE);
+    u->rx_batch = TAP_URING_RX_MIN_BATCH;
+    u->tx_buf = g_malloc(TAP_URING_TX_BUFS * NET_BUFSIZE);
+    for (i = 0; i < TAP_URING_TX_BUFS; i++) {
+        u->tx_free[u->tx_nfree++] = i;
+    }
+    u->submit_bh = qemu_bh_new(tap_uring_submit_bh, s);
+
+    s->uring = u;
+    event_notifier_set_handler(&u->notifier, tap_uring_completion);
+    tap_update_fd_handler(s);
+    return true;
+}
+
+static void tap_uring_cleanup(TAPState *s)
+{
+    TapUring *u = s->uring;
+    struct io_uring_cqe *cqe;
+
+    event_notifier_set_handler(&u->notifier, NULL);
+    qemu_bh_delete(u->submit_bh);
+
+    /*
+     * Nothing waits for packets on the O_NONBLOCK fd, so whatever is still
+     * in flight completes shortly; the buffers must not be freed before.
+     */
+    io_uring_submit(&u->ring);
+    while (u->inflight) {
+        if (io_uring_wait_cqe(&u->ring, &cqe) < 0) {
+            break;
+        }
+        tap_uring_reap(s);
+    }
+
+    io_uring_queue_exit(&u->ring);
+    event_notifier_cleanup(&u->notifier);
+    g_free(u->rx_buf);
+    g_free(u->tx_buf);
+    g_free(u);
+    s->uring = NULL;
+}
+#endif
 
 static void tap_update_fd_handler(TAPState *s)
 {
@@ -76,6 +454,12 @@ static void tap_update_fd_handler(TAPState *s)
                         s->read_poll && s->enabled ? tap_send : NULL,
                         s->write_poll && s->enabled ? tap_writable : NULL,
                         s);
+#ifdef CONFIG_LINUX_IO_URING
+    /* Packets that were already read don't make the fd readable again */
+    if (s->uring && s->uring->rx_ready_count && s->read_poll && s->enabled) {
+        event_notifier_set(&s->uring->notifier);
+    }
+#endif
 }
 
 static void tap_read_poll(TAPState *s, bool enable)
@@ -96,6 +480,13 @@ static void tap_writable(void *opaque)
 
     tap_write_poll(s, false);
 
+#ifdef CONFIG_LINUX_IO_URING
+    if (s->uring) {
+        tap_uring_tx_retry(s);
+        return;
+    }
+#endif
+
     qemu_flush_queued_packets(&s->nc);
 }
 
@@ -103,6 +494,22 @@ static ssize_t tap_write_packet(TAPState *s, const struct iovec *iov, int iovcnt
 {
     ssize_t len;
 
+#ifdef CONFIG_LINUX_IO_URING
+    if (s->uring) {
+        len = iov_size(iov, iovcnt);
+        if (len > NET_BUFSIZE) {
+            /*
+             * A direct writev() would overtake the packets still in the
+             * ring.  No valid frame is that large, drop it.
+             */
+            warn_report_once("tap: dropping %zd byte packet, larger than "
+                             "the io-uring transmit buffers", len);
+            return len;
+        }
+        return tap_uring_write_packet(s, iov, iovcnt, len);
+    }
+#endif
+
     do {
         len = writev(s->fd, iov, iovcnt);
     } while (len == -1 && errno == EINTR);
@@ -188,6 +595,13 @@ static void tap_send(void *opaque)
     int size;
     int packets = 0;
 
+#ifdef CONFIG_LINUX_IO_URING
+    if (s->uring) {
+        tap_uring_send(s);
+        return;
+    }
+#endif
+
     while (true) {
         uint8_t *buf = s->buf;
         uint8_t min_pkt[ETH_ZLEN];
@@ -336,6 +750,11 @@ static void tap_cleanup(NetClientState *nc)
 
     tap_read_poll(s, false);
     tap_write_poll(s, false);
+#ifdef CONFIG_LINUX_IO_URING
+    if (s->uring) {
+        tap_uring_cleanup(s);
+    }
+#endif
     close(s->fd);
     s->fd = -1;
 }
@@ -704,6 +1123,19 @@ static void net_init_tap_one(const NetdevTapOptions *tap, NetClientState *peer,
         }
     }
 
+#ifdef CONFIG_LINUX_IO_URING
+    if (tap->has_io_uring && tap->io_uring) {
+        if (tap->has_vhost ? tap->vhost :
+            vhostfdname || (tap->has_vhostforce && tap->vhostforce)) {
+            error_setg(errp, "io-uring=on is not valid with vhost");
+            return;
+        }
+        if (!tap_uring_init(s, errp)) {
+            return;
+        }
+    }
+#endif
+
     if (tap->has_vhost ? tap->vhost :
         vhostfdname || (tap->has_vhostforce && tap->vhostforce)) {
         VhostNetOptions options;
@@ -145,6 +145,7 @@ DEF("accel", HAS_ARG, QEMU_OPTION_accel,
     "                kvm-shadow-mem=size of KVM shadow MMU in bytes\n"
     "                split-wx=on|off (enable TCG split w^x mapping)\n"
     "                tb-size=n (TCG translation block cache size)\n"
+    "                trace-threshold=n (TCG TB executions before trace formation, default 0)\n"
     "                dirty-ring-size=n (KVM dirty ring GFN count, default 0)\n"
     "                thread=single|multi (enable multi-threaded TCG)\n", QEMU_ARCH_ALL)
 SRST
@@ -179,6 +180,14 @@ SRST
     ``tb-size=n``
         Controls the size (in MiB) of the TCG translation block cache.
 
+    ``trace-threshold=n``
+        Number of executions after which a TCG translation block is
+        translated again as a trace, that also contains the blocks its
+        branches lead to. Only targets that extend traces across
+        branches (currently AArch64 code) count executions; the option
+        has no effect on the others. Statistics are shown by ``info jit``.
+        The default is 0, which disables traces.
+
     ``thread=single|multi``
         Controls number of TCG threads. When the TCG is multi-threaded
         there will be one thread per vCPU therefore taking advantage of
@@ -2571,7 +2580,11 @@ DEF("netdev", HAS_ARG, QEMU_OPTION_netdev,
     "-netdev tap,id=str[,fd=h][,fds=x:y:...:z][,ifname=name][,script=file][,downscript=dfile]\n"
     "         [,br=bridge][,helper=helper][,sndbuf=nbytes][,vnet_hdr=on|off][,vhost=on|off]\n"
     "         [,vhostfd=h][,vhostfds=x:y:...:z][,vhostforce=on|off][,queues=n]\n"
-    "         [,poll-us=n]\n"
+    "         [,poll-us=n]"
+#ifdef CONFIG_LINUX_IO_URING
+    "[,io-uring=on|off]"
+#endif
+    "\n"
     "                configure a host TAP network backend with ID 'str'\n"
     "                connected to a bridge (default=" DEFAULT_BRIDGE_INTERFACE ")\n"
     "                use network scripts 'file' (default=" DEFAULT_NETWORK_SCRIPT ")\n"
@@ -2594,6 +2607,9 @@ DEF("netdev", HAS_ARG, QEMU_OPTION_netdev,
     "                use 'queues=n' to specify the number of queues to be created for multiqueue TAP\n"
     "                use 'poll-us=n' to specify the maximum number of microseconds that could be\n"
     "                spent on busy polling for vhost net\n"
+#ifdef CONFIG_LINUX_IO_URING
+    "                use io-uring=on to read and write packets in batches through io_uring\n"
+#endif
     "-netdev bridge,id=str[,br=bridge][,helper=helper]\n"
     "                configure a host TAP network backend with ID 'str' that is\n"
     "                connected to a bridge (default=" DEFAULT_BRIDGE_INTERFACE ")\n"
@@ -2648,6 +2664,15 @@ DEF("netdev", HAS_ARG, QEMU_OPTION_netdev,
     "                VALE port (created on the fly) called 'name' ('nmname' is name of the \n"
     "                netmap device, defaults to '/dev/netmap')\n"
 #endif
+#ifdef CONFIG_AF_XDP
+    "-netdev af-xdp,id=str,ifname=name[,mode=native|skb][,force-copy=on|off]\n"
+    "         [,queues=n][,start-queue=m]\n"
+    "                attach to the existing network interface 'name' with AF_XDP\n"
+    "                sockets, one for each of the 'n' queues starting at queue 'm'\n"
+    "                use 'mode' to choose how the XDP program is attached, native\n"
+    "                (driver) mode is tried first and then generic (skb) mode\n"
+    "                use 'force-copy=on' to disable zero-copy mode\n"
+#endif
 #ifdef CONFIG_POSIX
     "-netdev vhost-user,id=str,chardev=dev[,vhostforce=on|off]\n"
     "                configure a vhost-user network, backed by a chardev 'dev'\n"
@@ -2672,6 +2697,9 @@ DEF("nic", HAS_ARG, QEMU_OPTION_nic,
 #ifdef CONFIG_NETMAP
     "netmap|"
 #endif
+#ifdef CONFIG_AF_XDP
+    "af-xdp|"
+#endif
 #ifdef CONFIG_POSIX
     "vhost-user|"
 #endif
@@ -2701,7 +2729,7 @@ DEF("net", HAS_ARG, QEMU_OPTION_net,
     "                old way to initialize a host network interface\n"
     "                (use the -netdev option if possible instead)\n", QEMU_ARCH_ALL)
 SRST
-``-nic [tap|bridge|user|l2tpv3|vde|netmap|vhost-user|socket][,...][,mac=macaddr][,model=mn]``
+``-nic [tap|bridge|user|l2tpv3|vde|netmap|af-xdp|vhost-user|socket][,...][,mac=macaddr][,model=mn]``
     This option is a shortcut for configuring both the on-board
     (default) guest NIC hardware and the host network backend in one go.
     The host backend options are the same as with the corresponding
@@ -2916,6 +2944,13 @@ SRST
     ``fd``\ =h can be used to specify the handle of an already opened
     host TAP interface.
 
+    ``io-uring=on`` makes QEMU read and write packets through io_uring
+    instead of issuing one system call per packet. When the TAP device is
+    readable, a batch of reads is submitted at once, and writes are
+    submitted in batches. This
+    reduces the per-packet overhead when vhost is not used, and is not
+    valid together with vhost.
+
     Examples:
 
     .. parsed-literal::
@@ -3115,6 +3150,39 @@ SRST
         # launch QEMU instance
         |qemu_system| linux.img -nic vde,sock=/tmp/myswitch
 
+``-netdev af-xdp,id=id,ifname=name[,mode=native|skb][,force-copy=on|off][,queues=n][,start-queue=m]``
+    Configure AF_XDP backend to connect to a network interface 'name'
+    using AF_XDP sockets.  Packets are exchanged with the kernel through
+    a memory area (UMEM) shared with it, without system calls for each
+    packet.  This option is only available if QEMU has been compiled
+    with libxdp.
+
+    ``mode=native|skb`` selects how the default XDP program is attached
+    to the interface.  ``native`` needs support from the driver, while
+    ``skb`` (generic XDP) works with any interface.  By default native
+    mode is tried first.  In native mode the driver is asked for
+    zero-copy operation, which is used if available unless
+    ``force-copy=on`` is given.
+
+    ``queues=n`` creates one socket for each of 'n' queues of the
+    interface, starting at queue ``start-queue=m`` (0 by default).  Each
+    socket serves one queue pair of a multiqueue virtio-net device; the
+    interface's flow steering should be configured so that traffic only
+    goes to the queues in use.  QEMU needs CAP_NET_ADMIN and CAP_BPF (or
+    CAP_SYS_ADMIN) to attach the program and create the sockets.
+
+    Example (using a veth pair in generic mode):
+
+    .. parsed-literal::
+
+        # create a veth pair
+        ip link add veth0 type veth peer name veth1
+        ip link set veth0 up
+        ip link set veth1 up
+        # launch QEMU instance
+        |qemu_system| linux.img -device virtio-net-pci,netdev=n1 \\
+            -netdev af-xdp,id=n1,ifname=veth0,mode=skb
+
 ``-netdev vhost-user,chardev=id[,vhostforce=on|off][,queues=n]``
     Establish a vhost-user netdev, backed by a chardev id. The chardev
     should be a unix domain socket backed one. The vhost-user uses a
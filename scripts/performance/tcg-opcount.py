@@ -0,0 +1,149 @@
+#!/usr/bin/env python3
+
+#  Count the TCG ops emitted before and after the optimizer for a
+#  captured "-d op,op_opt" log, to measure how much code the optimizer
+#  removes from real guest code.  Given a second log of the same program
+#  captured with a QEMU built from a baseline tree, compare the optimized
+#  ops of both instead, to measure what a change to the optimizer adds.
+#
+#  Syntax:
+#  tcg-opcount.py [-h] [-n <top>] [--min-reduction <percent>]
+#                 [--baseline <log>] <log>
+#
+#  [-h] - Print the script arguments help message.
+#  [-n] - Number of opcodes with the largest change to print (default 10).
+#  [--min-reduction] - Fail if the op count is not reduced by at least
+#                      this percentage: by the optimizer, or compared
+#                      with the baseline if one is given.
+#  [--baseline] - Log captured the same way with the baseline QEMU.
+#
+#  Example of usage:
+#  qemu-x86_64 -d op,op_opt -D sha1.oplog ./sha1
+#  tcg-opcount.py sha1.oplog
+#  baseline/qemu-x86_64 -d op,op_opt -D sha1.base.oplog ./sha1
+#  tcg-opcount.py --baseline sha1.base.oplog sha1.oplog
+#
+#  Copyright (C) 2021  The QEMU Project Developers
+#
+#  This program is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 2 of the License, or
+#  (at your option) any later version.
+#
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+import argparse
+import collections
+import sys
+
+
+OP_BEFORE = "OP:"
+OP_AFTER = "OP after optimization and liveness analysis:"
+
+
+def count_ops(log):
+    """
+    Return a pair of Counters (before, after) mapping each opcode name to
+    the number of times it appears in the unoptimized and optimized dumps.
+    """
+    before = collections.Counter()
+    after = collections.Counter()
+    section = None
+
+    for line in log:
+        stripped = line.strip()
+        if stripped == OP_BEFORE:
+            section = before
+            continue
+        if stripped == OP_AFTER:
+            section = after
+            continue
+        if section is None:
+            continue
+        # Blank lines and guest instruction markers are not ops
+        if not stripped or stripped.startswith("----"):
+            continue
+        # Anything that does not start with an opcode name ends the dump
+        opcode = stripped.split()[0]
+        if not opcode.replace("_", "").isalnum():
+            section = None
+            continue
+        section[opcode] += 1
+
+    return before, after
+
+
+def print_table(columns, old, new, top):
+    """
+    Print the totals of the @old and @new Counters and the @top opcodes
+    whose count changed the most, returning the reduction in percent.
+    """
+    total_old = sum(old.values())
+    total_new = sum(new.values())
+
+    print("{:<24}{:>12}{:>12}{:>10}".format("", columns[0], columns[1],
+                                            "delta"))
+    print("{:<24}{:>12}{:>12}{:>10}".format("total", total_old, total_new,
+                                            total_new - total_old))
+
+    delta = {op: new[op] - old[op] for op in old.keys() | new.keys()}
+    changed = sorted((op for op in delta if delta[op]),
+                     key=lambda op: (delta[op], op))
+    for op in changed[:top]:
+        print("{:<24}{:>12}{:>12}{:>10}".format(op, old[op], new[op],
+                                                delta[op]))
+
+    return 100.0 * (total_old - total_new) / total_old
+
+
+def read_log(log):
+    before, after = count_ops(log)
+    if not before:
+        sys.exit("No \"{}\" sections found in {}; was the log "
+                 "captured with -d op,op_opt?".format(OP_BEFORE, log.name))
+    return before, after
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Count TCG ops before and after optimization")
+    parser.add_argument("log", type=argparse.FileType("r"),
+                        help="log produced with -d op,op_opt")
+    parser.add_argument("-n", type=int, default=10, dest="top",
+                        help="number of opcodes to list (default 10)")
+    parser.add_argument("--min-reduction", type=float, default=None,
+                        metavar="PERCENT",
+                        help="fail unless ops are reduced by this much")
+    parser.add_argument("--baseline", type=argparse.FileType("r"),
+                        metavar="LOG",
+                        help="compare with the optimized ops of this log")
+    args = parser.parse_args()
+
+    before, after = read_log(args.log)
+
+    if args.baseline:
+        base_before, base_after = read_log(args.baseline)
+        # Only the optimizer may differ for the comparison to be fair
+        if base_before != before:
+            print("Warning: the unoptimized ops differ from the baseline, "
+                  "the logs do not cover the same code", file=sys.stderr)
+        reduction = print_table(("baseline", "after"), base_after, after,
+                                args.top)
+        print("Reduction over baseline: {:.2f}%".format(reduction))
+    else:
+        reduction = print_table(("before", "after"), before, after, args.top)
+        print("Reduction: {:.2f}%".format(reduction))
+
+    if args.min_reduction is not None and reduction < args.min_reduction:
+        sys.exit("Op reduction {:.2f}% is below the required {:.2f}%"
+                 .format(reduction, args.min_reduction))
+
+
+if __name__ == "__main__":
+    main()
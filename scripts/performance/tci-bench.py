@@ -0,0 +1,91 @@
+#!/usr/bin/env python3
+
+#  Compare the speed of two QEMU builds that use the TCG interpreter, by
+#  running the same guest workload several times with each of them.
+#  It is meant to measure the threaded TCI dispatch against a build
+#  configured with --disable-tcg-interpreter-threaded.
+#
+#  Syntax:
+#  tci-bench.py [-h] [-r <runs>] -b <baseline qemu> -t <test qemu> -- \
+#               <target executable> [<target executable options>]
+#
+#  [-h] - Print the script arguments help message.
+#  [-r] - Number of runs for each build (default 5); the median is used.
+#  -b   - QEMU executable of the baseline build.
+#  -t   - QEMU executable of the build under test.
+#
+#  Example of usage:
+#  tci-bench.py -b switch/qemu-x86_64 -t threaded/qemu-x86_64 -- \
+#               tests/tcg/x86_64-linux-user/sha1
+#
+#  Copyright (C) 2021  The QEMU Project Developers
+#
+#  This program is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 2 of the License, or
+#  (at your option) any later version.
+#
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+import argparse
+import statistics
+import subprocess
+import sys
+import time
+
+
+def time_runs(qemu, command, runs):
+    """
+    Run the guest command under the given QEMU executable and return the
+    wall clock time of each run in seconds.
+    """
+    times = []
+    for _ in range(runs):
+        start = time.perf_counter()
+        result = subprocess.run([qemu] + command,
+                                stdout=subprocess.DEVNULL,
+                                stderr=subprocess.PIPE)
+        times.append(time.perf_counter() - start)
+        if result.returncode:
+            sys.exit("{} failed with exit code {}:\n{}".format(
+                qemu, result.returncode, result.stderr.decode()))
+    return times
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        usage="tci-bench.py [-h] [-r <runs>] -b <baseline qemu> "
+              "-t <test qemu> -- <target executable> "
+              "[<target executable options>]",
+        description="Compare two TCI builds on a guest workload")
+    parser.add_argument("-r", type=int, default=5, dest="runs",
+                        help="number of runs for each build (default 5)")
+    parser.add_argument("-b", required=True, dest="baseline",
+                        help="QEMU executable of the baseline build")
+    parser.add_argument("-t", required=True, dest="test",
+                        help="QEMU executable of the build under test")
+    parser.add_argument("command", type=str, nargs="+",
+                        help=argparse.SUPPRESS)
+    args = parser.parse_args()
+
+    # Warm up the page cache so that the first run is not penalized
+    time_runs(args.baseline, args.command, 1)
+
+    baseline = statistics.median(time_runs(args.baseline, args.command,
+                                           args.runs))
+    test = statistics.median(time_runs(args.test, args.command, args.runs))
+
+    print("{:<12}{:>12}".format("", "median (s)"))
+    print("{:<12}{:>12.3f}".format("baseline", baseline))
+    print("{:<12}{:>12.3f}".format("test", test))
+    print("Speedup: {:.2f}x".format(baseline / test))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,132 @@
+#!/usr/bin/env python3
+#
+# Compare aio=native and aio=io_uring request rates of two qemu-img binaries.
+#
+# The idea of the test comes from the registration of io_uring fixed files
+# in block/io_uring.c: run the same 'qemu-img bench' workloads with a
+# qemu-img built before and after a change to the io_uring engine, next to
+# aio=native as a reference.  qemu-img has no guest RAM, so fixed buffers
+# are not used; this measures the fixed file table only.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+
+import sys
+import os
+import subprocess
+import simplebench
+from results_to_text import results_to_text
+
+
+def bench_func(env, case):
+    """ Handle one "cell" of benchmarking table. """
+    return bench_aio(env['qemu_img'], env['aio'], env['image_name'],
+                     case['block_size'], case['depth'], case['write'])
+
+
+def bench_aio(qemu_img, aio, image_name, block_size, depth, write):
+    """Benchmark requests of one AIO engine
+
+    Runs 'qemu-img bench' with O_DIRECT on an existing raw image and returns
+    the time it took to complete the requests.
+
+    qemu_img   -- path to qemu_img executable file
+    aio        -- 'native' or 'io_uring'
+    image_name -- raw image to run the requests on
+    block_size -- size of each request
+    depth      -- number of requests in flight
+    write      -- True for write requests, False for reads
+
+    Returns {'seconds': float} on success and {'error': str} on failure.
+    Return value is compatible with simplebench lib.
+    """
+
+    count = 1024 * 1024 * 1024 // block_size
+    args = [qemu_img, 'bench', '-n', '-t', 'none', '-i', aio,
+            '-c', str(count), '-d', str(depth), '-s', str(block_size),
+            '-f', 'raw']
+    if write:
+        args.append('-w')
+    args.append(image_name)
+
+    try:
+        subp = subprocess.run(args, stdout=subprocess.PIPE,
+                              stderr=subprocess.STDOUT,
+                              universal_newlines=True)
+    except OSError as e:
+        return {'error': 'qemu_img bench failed: ' + str(e)}
+
+    ret = subp.stdout
+    if subp.returncode != 0 or 'seconds' not in ret:
+        return {'error': 'qemu_img bench failed: ' + ret}
+
+    ret_list = ret.split()
+    index = ret_list.index('seconds.')
+    return {'seconds': float(ret_list[index - 1])}
+
+
+if __name__ == '__main__':
+
+    if len(sys.argv) < 4:
+        program = os.path.basename(sys.argv[0])
+        print(f'USAGE: {program} <qemu-img without the change> '
+              '<qemu-img with the change> '
+              '<raw image of at least 1 GiB on the device to test>')
+        exit(1)
+
+    for qemu_img in sys.argv[1:3]:
+        if not os.path.isfile(qemu_img):
+            print(f'File not found: {qemu_img}')
+            sys.exit(1)
+
+    # Test-cases are "rows" in benchmark resulting table, 'id' is a caption
+    # for the row, other fields are handled by bench_func.
+    test_cases = []
+    for write in (False, True):
+        for block_size, depth in ((4096, 1), (4096, 32), (65536, 32)):
+            test_cases.append({
+                'id': '{} {}K qd{}'.format('write' if write else 'read',
+                                           block_size // 1024, depth),
+                'block_size': block_size,
+                'depth': depth,
+                'write': write
+            })
+
+    # Test-envs are "columns" in benchmark resulting table, 'id is a caption
+    # for the column, other fields are handled by bench_func.
+    test_envs = [
+        {
+            'id': 'native',
+            'qemu_img': sys.argv[1],
+            'aio': 'native',
+            'image_name': sys.argv[3]
+        },
+        {
+            'id': 'io_uring (before)',
+            'qemu_img': sys.argv[1],
+            'aio': 'io_uring',
+            'image_name': sys.argv[3]
+        },
+        {
+            'id': 'io_uring (after)',
+            'qemu_img': sys.argv[2],
+            'aio': 'io_uring',
+            'image_name': sys.argv[3]
+        },
+    ]
+
+    result = simplebench.bench(bench_func, test_envs, test_cases, count=3,
+                               initial_run=True)
+    print(results_to_text(result))
@@ -9,8 +9,10 @@
 #
 # For help see docs/devel/tracing.rst
 
+import heapq
 import struct
 import inspect
+import sys
 from tracetool import read_events, Event
 from tracetool.backend.simple import is_string
 
@@ -121,6 +123,47 @@ def read_trace_records(edict, idtoname, fobj):
 
             yield rec
 
+# A record is written late by at most the contents of the other threads'
+# ring buffers (64 KiB each, see trace/simple.c), i.e. a few thousand records
+# per tracing thread.  The file does not say how many threads traced, so
+# start with room for a couple of dozen busy ones and grow when that is
+# not enough.
+sort_lookahead = 1 << 16
+
+def sort_trace_records(records, lookahead=sort_lookahead):
+    """Yield trace records in timestamp order.
+
+    Each QEMU thread records events into its own buffer and the buffers are
+    merged when written out, so records that were being filled while the
+    buffers were merged end up later in the file than their timestamp says.
+    They are put back in order with a heap holding the next @lookahead
+    records, so traces of any size are processed in bounded memory.  Records
+    with the same timestamp keep the order in which they were written.
+
+    A record older than one already yielded means @lookahead was too small
+    for the number of threads; it is yielded out of order with a warning
+    and @lookahead is doubled for the rest of the trace.
+
+    Args:
+        records (iterable): record tuples from read_trace_records()
+        lookahead (int): number of records held back for reordering
+
+    """
+    heap = []
+    last = 0
+    for seq, rec in enumerate(records):
+        if rec[1] < last:
+            lookahead *= 2
+            sys.stderr.write('warning: trace record out of order by %d ns, '
+                             'reordering %d records from now on\n' %
+                             (last - rec[1], lookahead))
+        heapq.heappush(heap, (rec[1], seq, rec))
+        if len(heap) > lookahead:
+            last = heap[0][0]
+            yield heapq.heappop(heap)[2]
+    while heap:
+        yield heapq.heappop(heap)[2]
+
 class Analyzer(object):
     """A trace file analyzer which processes trace records.
 
@@ -210,7 +253,7 @@ def build_fn(analyzer, event):
 
     analyzer.begin()
     fn_cache = {}
-    for rec in read_trace_records(edict, idtoname, log):
+    for rec in sort_trace_records(read_trace_records(edict, idtoname, log)):
         event_num = rec[0]
         event = edict[event_num]
         if event_num not in fn_cache:
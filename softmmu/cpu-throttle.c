@@ -33,25 +33,33 @@
 /* vcpu throttling controls */
 static QEMUTimer *throttle_timer;
 static unsigned int throttle_percentage;
+/* Number of vCPUs with a throttle percentage of their own */
+static int vcpu_throttle_count;
 
 #define CPU_THROTTLE_PCT_MIN 1
 #define CPU_THROTTLE_PCT_MAX 99
 #define CPU_THROTTLE_TIMESLICE_NS 10000000
 
+static int cpu_throttle_get_vcpu_percentage(CPUState *cpu)
+{
+    return MAX(cpu_throttle_get_percentage(),
+               qatomic_read(&cpu->throttle_percentage));
+}
+
 static void cpu_throttle_thread(CPUState *cpu, run_on_cpu_data opaque)
 {
+    int64_t period_ns = opaque.host_ulong;
     double pct;
-    double throttle_ratio;
     int64_t sleeptime_ns, endtime_ns;
 
-    if (!cpu_throttle_get_percentage()) {
+    if (!cpu_throttle_get_vcpu_percentage(cpu)) {
+        qatomic_set(&cpu->throttle_thread_scheduled, 0);
         return;
     }
 
-    pct = (double)cpu_throttle_get_percentage() / 100;
-    throttle_ratio = pct / (1 - pct);
+    pct = (double)cpu_throttle_get_vcpu_percentage(cpu) / 100;
     /* Add 1ns to fix double's rounding error (like 0.9999999...) */
-    sleeptime_ns = (int64_t)(throttle_ratio * CPU_THROTTLE_TIMESLICE_NS + 1);
+    sleeptime_ns = (int64_t)(pct * period_ns + 1);
     endtime_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME) + sleeptime_ns;
     while (sleeptime_ns > 0 && !cpu->stop) {
         if (sleeptime_ns > SCALE_MS) {
@@ -67,25 +75,41 @@ static void cpu_throttle_thread(CPUState *cpu, run_on_cpu_data opaque)
     qatomic_set(&cpu->throttle_thread_scheduled, 0);
 }
 
+static bool cpu_throttle_any_active(void)
+{
+    return cpu_throttle_active() || qatomic_read(&vcpu_throttle_count);
+}
+
 static void cpu_throttle_timer_tick(void *opaque)
 {
     CPUState *cpu;
-    double pct;
+    int max_pct = 0;
+    int64_t period_ns;
 
     /* Stop the timer if needed */
-    if (!cpu_throttle_get_percentage()) {
+    if (!cpu_throttle_any_active()) {
         return;
     }
+
+    /*
+     * The most throttled vCPU runs for CPU_THROTTLE_TIMESLICE_NS in each
+     * period, every vCPU sleeps for its own percentage of the period.
+     */
+    CPU_FOREACH(cpu) {
+        max_pct = MAX(max_pct, cpu_throttle_get_vcpu_percentage(cpu));
+    }
+    period_ns = CPU_THROTTLE_TIMESLICE_NS / (1 - (double)max_pct / 100);
+
     CPU_FOREACH(cpu) {
-        if (!qatomic_xchg(&cpu->throttle_thread_scheduled, 1)) {
+        if (cpu_throttle_get_vcpu_percentage(cpu) &&
+            !qatomic_xchg(&cpu->throttle_thread_scheduled, 1)) {
             async_run_on_cpu(cpu, cpu_throttle_thread,
-                             RUN_ON_CPU_NULL);
+                             RUN_ON_CPU_HOST_ULONG(period_ns));
         }
     }
 
-    pct = (double)cpu_throttle_get_percentage() / 100;
     timer_mod(throttle_timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL_RT) +
-                                   CPU_THROTTLE_TIMESLICE_NS / (1 - pct));
+                              period_ns);
 }
 
 void cpu_throttle_set(int new_throttle_pct)
@@ -94,7 +118,7 @@ void cpu_throttle_set(int new_throttle_pct)
      * boolean to store whether throttle is already active or not,
      * before modifying throttle_percentage
      */
-    bool throttle_active = cpu_throttle_active();
+    bool throttle_active = cpu_throttle_any_active();
 
     /* Ensure throttle percentage is within valid range */
     new_throttle_pct = MIN(new_throttle_pct, CPU_THROTTLE_PCT_MAX);
@@ -107,6 +131,33 @@ void cpu_throttle_set(int new_throttle_pct)
     }
 }
 
+void cpu_throttle_set_vcpu(CPUState *cpu, int new_throttle_pct)
+{
+    bool throttle_active = cpu_throttle_any_active();
+    int old_throttle_pct = qatomic_read(&cpu->throttle_percentage);
+
+    if (new_throttle_pct) {
+        new_throttle_pct = MIN(new_throttle_pct, CPU_THROTTLE_PCT_MAX);
+        new_throttle_pct = MAX(new_throttle_pct, CPU_THROTTLE_PCT_MIN);
+    }
+
+    qatomic_set(&cpu->throttle_percentage, new_throttle_pct);
+    if (!old_throttle_pct && new_throttle_pct) {
+        qatomic_inc(&vcpu_throttle_count);
+    } else if (old_throttle_pct && !new_throttle_pct) {
+        qatomic_dec(&vcpu_throttle_count);
+    }
+
+    if (!throttle_active && new_throttle_pct) {
+        cpu_throttle_timer_tick(NULL);
+    }
+}
+
+int cpu_throttle_get_vcpu(CPUState *cpu)
+{
+    return qatomic_read(&cpu->throttle_percentage);
+}
+
 void cpu_throttle_stop(void)
 {
     qatomic_set(&throttle_percentage, 0);
@@ -0,0 +1,303 @@
+/*
+ * Per-vCPU dirty page rate limit
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qapi/qapi-commands-migration.h"
+#include "qemu/main-loop.h"
+#include "qemu/rcu.h"
+#include "qemu/thread.h"
+#include "hw/core/cpu.h"
+#include "hw/boards.h"
+#include "exec/memory.h"
+#include "exec/target_page.h"
+#include "sysemu/cpu-throttle.h"
+#include "sysemu/dirtylimit.h"
+#include "sysemu/kvm.h"
+#include "migration/misc.h"
+#include "migration/migration.h"
+#include "trace.h"
+
+/*
+ * The dirty ring of each vCPU is collected every DIRTYLIMIT_CALC_PERIOD_MS
+ * to compute its dirty page rate.  The throttle percentage of a vCPU is
+ * then scaled so that its rate would be its quota, assuming the vCPU
+ * dirties memory at the same speed while it runs.  A rate between
+ * DIRTYLIMIT_TOLERANCE_PCT of the quota and the quota leaves the
+ * throttle alone, so that it settles instead of oscillating.
+ */
+#define DIRTYLIMIT_CALC_PERIOD_MS   1000
+#define DIRTYLIMIT_TOLERANCE_PCT    90
+
+typedef struct VcpuDirtyLimitState {
+    /* dirty page rate limit in MB/s, 0 if the vCPU is not limited */
+    uint64_t quota;
+    /* dirty page rate in MB/s measured during the last period */
+    uint64_t current_rate;
+    /* CPUState::dirty_pages at the start of the period */
+    uint64_t last_pages;
+} VcpuDirtyLimitState;
+
+/* Protected by the BQL */
+static struct {
+    VcpuDirtyLimitState *states;
+    int max_cpus;
+    /* number of vCPUs with a quota */
+    int limited_nvcpu;
+    /* start of the current period */
+    int64_t last_time_ms;
+    bool thread_created;
+    /* wakes the thread when the first quota is set or the last cleared */
+    QemuCond cond;
+} dirtylimit_state;
+
+static VcpuDirtyLimitState *dirtylimit_vcpu_get_state(CPUState *cpu)
+{
+    if (cpu->cpu_index >= dirtylimit_state.max_cpus) {
+        return NULL;
+    }
+    return &dirtylimit_state.states[cpu->cpu_index];
+}
+
+static int dirtylimit_throttle_pct(VcpuDirtyLimitState *s, int pct)
+{
+    double running = 1 - (double)pct / 100;
+
+    if (s->current_rate > s->quota) {
+        running = running * s->quota / s->current_rate;
+    } else if (s->current_rate * 100 < s->quota * DIRTYLIMIT_TOLERANCE_PCT) {
+        running = s->current_rate ?
+                  MIN(1, running * s->quota / s->current_rate) : 1;
+    } else {
+        return pct;
+    }
+
+    return MIN(100 - (int)(running * 100), 99);
+}
+
+static void dirtylimit_adjust(void)
+{
+    int64_t now_ms = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
+    int64_t msec = now_ms - dirtylimit_state.last_time_ms;
+    CPUState *cpu;
+
+    if (msec <= 0) {
+        return;
+    }
+
+    /* Move what the rings hold to CPUState::dirty_pages */
+    memory_global_dirty_log_sync();
+
+    CPU_FOREACH(cpu) {
+        VcpuDirtyLimitState *s = dirtylimit_vcpu_get_state(cpu);
+        uint64_t pages;
+        int pct;
+
+        if (!s || !s->quota) {
+            continue;
+        }
+
+        /* A hotplugged vCPU can reuse the index of an unplugged one */
+        pages = cpu->dirty_pages >= s->last_pages ?
+                cpu->dirty_pages - s->last_pages : 0;
+
+        s->last_pages = cpu->dirty_pages;
+        s->current_rate = (pages * qemu_target_page_size() * 1000 /
+                           msec) >> 20;
+
+        pct = dirtylimit_throttle_pct(s, cpu_throttle_get_vcpu(cpu));
+        cpu_throttle_set_vcpu(cpu, pct);
+        trace_dirtylimit_adjust(cpu->cpu_index, s->quota, s->current_rate,
+                                pct);
+    }
+
+    dirtylimit_state.last_time_ms = now_ms;
+}
+
+static void *dirtylimit_thread(void *opaque)
+{
+    rcu_register_thread();
+
+    qemu_mutex_lock_iothread();
+    while (true) {
+        /* Park while no vCPU is limited */
+        while (!dirtylimit_state.limited_nvcpu) {
+            qemu_cond_wait_iothread(&dirtylimit_state.cond);
+        }
+
+        qemu_cond_timedwait_iothread(&dirtylimit_state.cond,
+                                     DIRTYLIMIT_CALC_PERIOD_MS);
+        if (dirtylimit_state.limited_nvcpu) {
+            dirtylimit_adjust();
+        }
+    }
+
+    return NULL;
+}
+
+static void dirtylimit_state_init(void)
+{
+    if (dirtylimit_state.states) {
+        return;
+    }
+
+    dirtylimit_state.max_cpus = current_machine->smp.max_cpus;
+    dirtylimit_state.states = g_new0(VcpuDirtyLimitState,
+                                     dirtylimit_state.max_cpus);
+}
+
+static void dirtylimit_start(void)
+{
+    memory_global_dirty_log_start(GLOBAL_DIRTY_LIMIT);
+    dirtylimit_state.last_time_ms = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
+
+    if (!dirtylimit_state.thread_created) {
+        QemuThread thread;
+
+        qemu_cond_init(&dirtylimit_state.cond);
+        qemu_thread_create(&thread, "dirtylimit", dirtylimit_thread, NULL,
+                           QEMU_THREAD_DETACHED);
+        dirtylimit_state.thread_created = true;
+    } else {
+        qemu_cond_signal(&dirtylimit_state.cond);
+    }
+}
+
+static void dirtylimit_stop(void)
+{
+    memory_global_dirty_log_stop(GLOBAL_DIRTY_LIMIT);
+    qemu_cond_signal(&dirtylimit_state.cond);
+}
+
+bool dirtylimit_vcpu_index_valid(int cpu_index)
+{
+    return cpu_index >= 0 && cpu_index < current_machine->smp.max_cpus &&
+           qemu_get_cpu(cpu_index);
+}
+
+void dirtylimit_set_vcpu(int cpu_index, uint64_t quota)
+{
+    CPUState *cpu = qemu_get_cpu(cpu_index);
+    VcpuDirtyLimitState *s;
+
+    dirtylimit_state_init();
+    s = &dirtylimit_state.states[cpu_index];
+
+    trace_dirtylimit_set_vcpu(cpu_index, quota);
+
+    if (quota) {
+        if (!s->quota) {
+            s->last_pages = cpu->dirty_pages;
+            s->current_rate = 0;
+            if (!dirtylimit_state.limited_nvcpu++) {
+                dirtylimit_start();
+            }
+        }
+        s->quota = quota;
+    } else if (s->quota) {
+        s->quota = 0;
+        s->current_rate = 0;
+        cpu_throttle_set_vcpu(cpu, 0);
+        if (!--dirtylimit_state.limited_nvcpu) {
+            dirtylimit_stop();
+        }
+    }
+}
+
+void dirtylimit_set_all(uint64_t quota)
+{
+    CPUState *cpu;
+
+    CPU_FOREACH(cpu) {
+        if (dirtylimit_vcpu_index_valid(cpu->cpu_index)) {
+            dirtylimit_set_vcpu(cpu->cpu_index, quota);
+        }
+    }
+}
+
+bool dirtylimit_in_service(void)
+{
+    return dirtylimit_state.limited_nvcpu > 0;
+}
+
+static bool dirtylimit_qmp_check(bool has_cpu_index, int64_t cpu_index,
+                                 Error **errp)
+{
+    if (!kvm_enabled() || !kvm_dirty_ring_enabled()) {
+        error_setg(errp, "dirty page limit requires KVM with accelerator "
+                   "property 'dirty-ring-size' set");
+        return false;
+    }
+
+    if (has_cpu_index && !dirtylimit_vcpu_index_valid(cpu_index)) {
+        error_setg(errp, "incorrect cpu index specified");
+        return false;
+    }
+
+    if (migrate_dirty_limit() && !migration_is_idle()) {
+        error_setg(errp, "dirty page limit is in use by migration");
+        return false;
+    }
+
+    return true;
+}
+
+void qmp_set_vcpu_dirty_limit(bool has_cpu_index, int64_t cpu_index,
+                              uint64_t dirty_rate, Error **errp)
+{
+    if (!dirtylimit_qmp_check(has_cpu_index, cpu_index, errp)) {
+        return;
+    }
+
+    if (has_cpu_index) {
+        dirtylimit_set_vcpu(cpu_index, dirty_rate);
+    } else {
+        dirtylimit_set_all(dirty_rate);
+    }
+}
+
+void qmp_cancel_vcpu_dirty_limit(bool has_cpu_index, int64_t cpu_index,
+                                 Error **errp)
+{
+    if (!dirtylimit_qmp_check(has_cpu_index, cpu_index, errp)) {
+        return;
+    }
+
+    if (has_cpu_index) {
+        dirtylimit_set_vcpu(cpu_index, 0);
+    } else {
+        dirtylimit_set_all(0);
+    }
+}
+
+DirtyLimitInfoList *qmp_query_vcpu_dirty_limit(Error **errp)
+{
+    DirtyLimitInfoList *head = NULL, **tail = &head;
+    CPUState *cpu;
+
+    if (!dirtylimit_in_service()) {
+        return NULL;
+    }
+
+    CPU_FOREACH(cpu) {
+        VcpuDirtyLimitState *s = dirtylimit_vcpu_get_state(cpu);
+        DirtyLimitInfo *info;
+
+        if (!s || !s->quota) {
+            continue;
+        }
+
+        info = g_new0(DirtyLimitInfo, 1);
+        info->cpu_index = cpu->cpu_index;
+        info->limit_rate = s->quota;
+        info->current_rate = s->current_rate;
+        info->throttle_percentage = cpu_throttle_get_vcpu(cpu);
+        QAPI_LIST_APPEND(tail, info);
+    }
+
+    return head;
+}
@@ -413,6 +413,57 @@ static inline void gen_goto_tb(DisasContext *s, int n, uint64_t dest)
     }
 }
 
+/*
+ * In a trace, continue the translation at @dest instead of ending the TB.
+ * Returns false if the branch must end the TB.
+ */
+static bool gen_trace_b(DisasContext *s, uint64_t dest)
+{
+    if (s->ss_active || s->base.singlestep_enabled) {
+        return false;
+    }
+    if (!translator_trace_follow(&s->base, dest)) {
+        return false;
+    }
+    s->base.pc_next = dest;
+    return true;
+}
+
+/*
+ * In a trace, continue the translation along the predicted path of a
+ * conditional branch whose condition, when true, branches to @label_match.
+ * Backward branches are predicted taken, as they usually close loops, and
+ * forward branches not taken.  The other path leaves the trace.
+ * Returns false if the branch must end the TB.
+ */
+static bool gen_trace_cond_b(DisasContext *s, TCGLabel *label_match,
+                             uint64_t dest)
+{
+    uint64_t next = s->base.pc_next;
+    TCGLabel *label_cont;
+
+    if (dest <= s->pc_curr) {
+        if (!gen_trace_b(s, dest)) {
+            return false;
+        }
+        gen_a64_set_pc_im(next);
+        tcg_gen_lookup_and_goto_ptr();
+        gen_set_label(label_match);
+    } else {
+        if (!gen_trace_b(s, next)) {
+            return false;
+        }
+        label_cont = gen_new_label();
+        tcg_gen_br(label_cont);
+        gen_set_label(label_match);
+        gen_a64_set_pc_im(dest);
+        tcg_gen_lookup_and_goto_ptr();
+        gen_set_label(label_cont);
+    }
+    s->base.trace_side_exits++;
+    return true;
+}
+
 static void init_tmp_a64_array(DisasContext *s)
 {
 #ifdef CONFIG_DEBUG_TCG
@@ -1314,7 +1365,9 @@ static void disas_uncond_b_imm(DisasContext *s, uint32_t insn)
 
     /* B Branch / BL Branch with link */
     reset_btype(s);
-    gen_goto_tb(s, 0, addr);
+    if (!gen_trace_b(s, addr)) {
+        gen_goto_tb(s, 0, addr);
+    }
 }
 
 /* Compare and branch (immediate)
@@ -1342,6 +1395,9 @@ static void disas_comp_b_imm(DisasContext *s, uint32_t insn)
     tcg_gen_brcondi_i64(op ? TCG_COND_NE : TCG_COND_EQ,
                         tcg_cmp, 0, label_match);
 
+    if (gen_trace_cond_b(s, label_match, addr)) {
+        return;
+    }
     gen_goto_tb(s, 0, s->base.pc_next);
     gen_set_label(label_match);
     gen_goto_tb(s, 1, addr);
@@ -1373,6 +1429,9 @@ static void disas_test_b_imm(DisasContext *s, uint32_t insn)
     tcg_gen_brcondi_i64(op ? TCG_COND_NE : TCG_COND_EQ,
                         tcg_cmp, 0, label_match);
     tcg_temp_free_i64(tcg_cmp);
+    if (gen_trace_cond_b(s, label_match, addr)) {
+        return;
+    }
     gen_goto_tb(s, 0, s->base.pc_next);
     gen_set_label(label_match);
     gen_goto_tb(s, 1, addr);
@@ -1401,10 +1460,13 @@ static void disas_cond_b_imm(DisasContext *s, uint32_t insn)
         /* genuinely conditional branches */
         TCGLabel *label_match = gen_new_label();
         arm_gen_test_cc(cond, label_match);
+        if (gen_trace_cond_b(s, label_match, addr)) {
+            return;
+        }
         gen_goto_tb(s, 0, s->base.pc_next);
         gen_set_label(label_match);
         gen_goto_tb(s, 1, addr);
-    } else {
+    } else if (!gen_trace_b(s, addr)) {
         /* 0xe and 0xf are both "always" conditions */
         gen_goto_tb(s, 0, addr);
     }
@@ -14961,4 +15023,5 @@ const TranslatorOps aarch64_translator_ops = {
     .translate_insn     = aarch64_tr_translate_insn,
     .tb_stop            = aarch64_tr_tb_stop,
     .disas_log          = aarch64_tr_disas_log,
+    .trace_follow       = true,
 };
@@ -2644,9 +2644,12 @@ static void gen_bnd_jmp(DisasContext *s)
 /* Generate an end of block. Trace exception is also generated if needed.
    If INHIBIT, set HF_INHIBIT_IRQ_MASK if it isn't already set.
    If RECHECK_TF, emit a rechecking helper for #DB, ignoring the state of
-   S->TF.  This is used by the syscall/sysret insns.  */
+   S->TF.  This is used by the syscall/sysret insns.
+   If JR, look up the next TB and jump to it; DEST is the new eip if
+   neither CS nor the hflags were changed, NULL otherwise.  */
 static void
-do_gen_eob_worker(DisasContext *s, bool inhibit, bool recheck_tf, bool jr)
+do_gen_eob_worker(DisasContext *s, bool inhibit, bool recheck_tf, bool jr,
+                  TCGv dest)
 {
     gen_update_cc_op(s);
 
@@ -2667,6 +2670,15 @@ do_gen_eob_worker(DisasContext *s, bool inhibit, bool recheck_tf, bool jr)
         tcg_gen_exit_tb(NULL, 0);
     } else if (s->flags & HF_TF_MASK) {
         gen_helper_single_step(cpu_env);
+    } else if (jr && dest &&
+               !(s->flags & (HF_INHIBIT_IRQ_MASK | HF_RF_MASK |
+                             HF_MPX_IU_MASK))) {
+        /* The TB flags are unchanged, the TB lookup can be inlined */
+        TCGv pc = tcg_temp_new();
+
+        tcg_gen_addi_tl(pc, dest, s->cs_base);
+        translator_lookup_and_goto_ptr(&s->base, pc);
+        tcg_temp_free(pc);
     } else if (jr) {
         tcg_gen_lookup_and_goto_ptr();
     } else {
@@ -2678,7 +2690,7 @@ do_gen_eob_worker(DisasContext *s, bool inhibit, bool recheck_tf, bool jr)
 static inline void
 gen_eob_worker(DisasContext *s, bool inhibit, bool recheck_tf)
 {
-    do_gen_eob_worker(s, inhibit, recheck_tf, false);
+    do_gen_eob_worker(s, inhibit, recheck_tf, false, NULL);
 }
 
 /* End of block.
@@ -2694,10 +2706,10 @@ static void gen_eob(DisasContext *s)
     gen_eob_worker(s, false, false);
 }
 
-/* Jump to register */
+/* Jump to register.  DEST is NULL after a far control transfer.  */
 static void gen_jr(DisasContext *s, TCGv dest)
 {
-    do_gen_eob_worker(s, false, false, true);
+    do_gen_eob_worker(s, false, false, true, dest);
 }
 
 /* generate a jump to eip. No segment change must happen before as a
@@ -5152,8 +5164,7 @@ static target_ulong disas_insn(DisasContext *s, CPUState *cpu)
                                       tcg_const_i32(dflag - 1),
                                       tcg_const_i32(s->pc - s->cs_base));
             }
-            tcg_gen_ld_tl(s->tmp4, cpu_env, offsetof(CPUX86State, eip));
-            gen_jr(s, s->tmp4);
+            gen_jr(s, NULL);
             break;
         case 4: /* jmp Ev */
             if (dflag == MO_16) {
@@ -5179,8 +5190,7 @@ static target_ulong disas_insn(DisasContext *s, CPUState *cpu)
                 gen_op_movl_seg_T0_vm(s, R_CS);
                 gen_op_jmp_v(s->T1);
             }
-            tcg_gen_ld_tl(s->tmp4, cpu_env, offsetof(CPUX86State, eip));
-            gen_jr(s, s->tmp4);
+            gen_jr(s, NULL);
             break;
         case 6: /* push Ev */
             gen_push_v(s, s->T0);
@@ -41,9 +41,30 @@ typedef struct TempOptInfo {
     TCGTemp *prev_copy;
     TCGTemp *next_copy;
     uint64_t val;
+    /* bits that may be set; the other ones are known to be zero */
     uint64_t mask;
+    /*
+     * The following describe the value in the width of the temp's type,
+     * i.e. the high bits of a 32-bit temp are left out.
+     */
+    /* bits known to be set */
+    uint64_t ones;
+    /* unsigned range of the value */
+    uint64_t umin;
+    uint64_t umax;
+    /* number of bits below the sign bit that are known to be copies of it */
+    int sign_copies;
 } TempOptInfo;
 
+/* What is known about an argument of an op, in the width of the op */
+typedef struct TempFacts {
+    uint64_t mask;
+    uint64_t ones;
+    uint64_t umin;
+    uint64_t umax;
+    int sign_copies;
+} TempFacts;
+
 static inline TempOptInfo *ts_info(TCGTemp *ts)
 {
     return ts->state_ptr;
@@ -82,6 +103,10 @@ static void reset_ts(TCGTemp *ts)
     ti->prev_copy = ts;
     ti->is_const = false;
     ti->mask = -1;
+    ti->ones = 0;
+    ti->umin = 0;
+    ti->umax = -1;
+    ti->sign_copies = 0;
 }
 
 static void reset_temp(TCGArg arg)
@@ -89,6 +114,41 @@ static void reset_temp(TCGArg arg)
     reset_ts(arg_temp(arg));
 }
 
+static inline uint64_t width_mask(bool is64)
+{
+    return is64 ? UINT64_MAX : UINT32_MAX;
+}
+
+/*
+ * Read what is known about ARG, as an input of an op that is 64-bit wide
+ * if IS64.  The known bits and the range also narrow each other down.
+ */
+static void arg_facts(TCGArg arg, bool is64, TempFacts *f)
+{
+    TempOptInfo *ti = arg_info(arg);
+    uint64_t w = width_mask(is64);
+    int width = is64 ? 64 : 32;
+    int known;
+
+    f->mask = ti->mask & w;
+    f->ones = ti->ones & f->mask;
+    f->umin = MAX(ti->umin, f->ones);
+    f->umax = MIN(ti->umax, f->mask);
+    if (f->umin > f->umax) {
+        /* Only possible in unreachable code; forget the range.  */
+        f->umin = f->ones;
+        f->umax = f->mask;
+    }
+    if (f->umax < w) {
+        f->mask &= f->umax ? MAKE_64BIT_MASK(0, 64 - clz64(f->umax)) : 0;
+    }
+
+    /* Leading bits that are all known zeros or all known ones.  */
+    known = clz64(f->mask << (64 - width));
+    known = MAX(known, clz64(~f->ones << (64 - width)));
+    f->sign_copies = MIN(MAX(ti->sign_copies, known - 1), width - 1);
+}
+
 /* Initialize and activate a temporary.  */
 static void init_ts_info(TCGTempSet *temps_used, TCGTemp *ts)
 {
@@ -108,6 +168,10 @@ static void init_ts_info(TCGTempSet *temps_used, TCGTemp *ts)
 
     ti->next_copy = ts;
     ti->prev_copy = ts;
+    ti->ones = 0;
+    ti->umin = 0;
+    ti->umax = -1;
+    ti->sign_copies = 0;
     if (ts->kind == TEMP_CONST) {
         ti->is_const = true;
         ti->val = ts->val;
@@ -116,6 +180,13 @@ static void init_ts_info(TCGTempSet *temps_used, TCGTemp *ts)
             /* High bits of a 32-bit quantity are garbage.  */
             ti->mask |= ~0xffffffffull;
         }
+        if (ts->type == TCG_TYPE_I32) {
+            ti->ones = ti->umin = ti->umax = (uint32_t)ts->val;
+            ti->sign_copies = clrsb32(ts->val);
+        } else if (ts->type == TCG_TYPE_I64) {
+            ti->ones = ti->umin = ti->umax = ts->val;
+            ti->sign_copies = clrsb64(ts->val);
+        }
     } else {
         ti->is_const = false;
         ti->mask = -1;
@@ -179,6 +250,25 @@ static bool args_are_copies(TCGArg arg1, TCGArg arg2)
     return ts_are_copies(arg_temp(arg1), arg_temp(arg2));
 }
 
+/* Make DST_TS, which was just reset, a copy of SRC_TS of the same type */
+static void ts_make_copy(TCGTemp *dst_ts, TCGTemp *src_ts)
+{
+    TempOptInfo *di = ts_info(dst_ts);
+    TempOptInfo *si = ts_info(src_ts);
+    TempOptInfo *ni = ts_info(si->next_copy);
+
+    di->next_copy = si->next_copy;
+    di->prev_copy = src_ts;
+    ni->prev_copy = dst_ts;
+    si->next_copy = dst_ts;
+    di->is_const = si->is_const;
+    di->val = si->val;
+    di->ones = si->ones;
+    di->umin = si->umin;
+    di->umax = si->umax;
+    di->sign_copies = si->sign_copies;
+}
+
 static void tcg_opt_gen_mov(TCGContext *s, TCGOp *op, TCGArg dst, TCGArg src)
 {
     TCGTemp *dst_ts = arg_temp(dst);
@@ -218,14 +308,15 @@ static void tcg_opt_gen_mov(TCGContext *s, TCGOp *op, TCGArg dst, TCGArg src)
     di->mask = mask;
 
     if (src_ts->type == dst_ts->type) {
-        TempOptInfo *ni = ts_info(si->next_copy);
-
-        di->next_copy = si->next_copy;
-        di->prev_copy = src_ts;
-        ni->prev_copy = dst_ts;
-        si->next_copy = dst_ts;
-        di->is_const = si->is_const;
-        di->val = si->val;
+        ts_make_copy(dst_ts, src_ts);
+    } else if (new_op == INDEX_op_mov_i32 && src_ts->type == TCG_TYPE_I64) {
+        /* The low half of a 64-bit temp, as used by tcg_gen_extrl_i64_i32 */
+        di->ones = (uint32_t)si->ones;
+        if (si->umax <= UINT32_MAX) {
+            di->umin = si->umin;
+            di->umax = si->umax;
+        }
+        di->sign_copies = MAX(si->sign_copies - 32, 0);
     }
 }
 
@@ -501,6 +592,59 @@ static bool do_constant_folding_cond_eq(TCGCond c)
     }
 }
 
+/* Return 2 if what is known about X and Y does not decide the condition */
+static TCGArg do_facts_folding_cond(bool is64, TCGArg x, TCGArg y, TCGCond c)
+{
+    uint64_t sign = 1ull << (is64 ? 63 : 31);
+    TempFacts a, b;
+
+    arg_facts(x, is64, &a);
+    arg_facts(y, is64, &b);
+
+    switch (c) {
+    case TCG_COND_EQ:
+    case TCG_COND_NE:
+        if (a.umax < b.umin || b.umax < a.umin ||
+            (a.ones & ~b.mask) || (b.ones & ~a.mask)) {
+            return c == TCG_COND_NE;
+        }
+        return 2;
+    case TCG_COND_LT:
+    case TCG_COND_GE:
+    case TCG_COND_LE:
+    case TCG_COND_GT:
+        /*
+         * Flipping the sign bit orders signed values like unsigned ones,
+         * and keeps a range that does not cross the sign boundary a range.
+         */
+        if ((a.umin < sign && a.umax >= sign) ||
+            (b.umin < sign && b.umax >= sign)) {
+            return 2;
+        }
+        a.umin ^= sign;
+        a.umax ^= sign;
+        b.umin ^= sign;
+        b.umax ^= sign;
+        c = tcg_unsigned_cond(c);
+        break;
+    default:
+        break;
+    }
+
+    switch (c) {
+    case TCG_COND_LTU:
+        return a.umax < b.umin ? 1 : a.umin >= b.umax ? 0 : 2;
+    case TCG_COND_GEU:
+        return a.umin >= b.umax ? 1 : a.umax < b.umin ? 0 : 2;
+    case TCG_COND_LEU:
+        return a.umax <= b.umin ? 1 : a.umin > b.umax ? 0 : 2;
+    case TCG_COND_GTU:
+        return a.umin > b.umax ? 1 : a.umax <= b.umin ? 0 : 2;
+    default:
+        return 2;
+    }
+}
+
 /* Return 2 if the condition can't be simplified, and the result
    of the condition (0 or 1) if it can */
 static TCGArg do_constant_folding_cond(TCGOpcode op, TCGArg x,
@@ -526,12 +670,35 @@ static TCGArg do_constant_folding_cond(TCGOpcode op, TCGArg x,
         case TCG_COND_GEU:
             return 1;
         default:
-            return 2;
+            break;
         }
     }
+    if (!(tcg_op_defs[op].flags & TCG_OPF_VECTOR)) {
+        return do_facts_folding_cond(tcg_op_defs[op].flags & TCG_OPF_64BIT,
+                                     x, y, c);
+    }
     return 2;
 }
 
+/*
+ * Known bits of the sum of A and B plus CARRY, where the M arguments are
+ * the bits that may be set and the O ones the bits known to be set.
+ * The carry into each bit is known where the sums of the smallest and
+ * of the largest possible inputs agree on it.
+ */
+static void add_known_bits(uint64_t am, uint64_t ao, uint64_t bm,
+                           uint64_t bo, int carry, uint64_t *pm, uint64_t *po)
+{
+    uint64_t sum_max = am + bm + carry;
+    uint64_t sum_min = ao + bo + carry;
+    uint64_t carry_zero = ~(sum_max ^ am ^ bm);
+    uint64_t carry_one = sum_min ^ ao ^ bo;
+    uint64_t known = (~am | ao) & (~bm | bo) & (carry_zero | carry_one);
+
+    *pm = sum_max | ~known;
+    *po = sum_min & known;
+}
+
 /* Return 2 if the condition can't be simplified, and the result
    of the condition (0 or 1) if it can */
 static TCGArg do_constant_folding_cond2(TCGArg *p1, TCGArg *p2, TCGCond c)
@@ -600,6 +767,83 @@ static bool swap_commutative2(TCGArg *p1, TCGArg *p2)
     return false;
 }
 
+/*
+ * Normal temps are dead at the end of a basic block, while the values of
+ * the other temps carry over to the next one.
+ */
+static void reset_normal_temps(TCGContext *s, TCGTempSet *temps_used)
+{
+    size_t i;
+
+    for (i = find_first_bit(temps_used->l, s->nb_temps); i < s->nb_temps;
+         i = find_next_bit(temps_used->l, s->nb_temps, i + 1)) {
+        if (s->temps[i].kind == TEMP_NORMAL) {
+            reset_ts(&s->temps[i]);
+        }
+    }
+}
+
+/*
+ * Record what the fall through path of brcond OP knows about its first
+ * argument: the branch was not taken.  Bounds checks of the same value
+ * often follow each other.
+ */
+static void brcond_fallthrough(TCGOp *op, bool is64)
+{
+    TCGTemp *ts = arg_temp(op->args[0]);
+    TempOptInfo *ti = ts_info(ts);
+    TCGCond cond = tcg_invert_cond(op->args[2]);
+    TempFacts a, b;
+
+    if (ts->kind == TEMP_NORMAL || temp_readonly(ts) || ti->is_const) {
+        return;
+    }
+    arg_facts(op->args[0], is64, &a);
+    arg_facts(op->args[1], is64, &b);
+
+    switch (cond) {
+    case TCG_COND_EQ:
+        if (arg_is_const(op->args[1]) && !ts_is_copy(ts)) {
+            ts_make_copy(ts, arg_temp(op->args[1]));
+            ti->mask = arg_info(op->args[1])->mask;
+        }
+        return;
+    case TCG_COND_NE:
+        if (b.umin != b.umax) {
+            return;
+        } else if (a.umin == b.umin) {
+            a.umin++;
+        } else if (a.umax == b.umin) {
+            a.umax--;
+        }
+        break;
+    case TCG_COND_LTU:
+        if (b.umax == 0) {
+            return;
+        }
+        a.umax = MIN(a.umax, b.umax - 1);
+        break;
+    case TCG_COND_LEU:
+        a.umax = MIN(a.umax, b.umax);
+        break;
+    case TCG_COND_GTU:
+        if (b.umin == width_mask(is64)) {
+            return;
+        }
+        a.umin = MAX(a.umin, b.umin + 1);
+        break;
+    case TCG_COND_GEU:
+        a.umin = MAX(a.umin, b.umin);
+        break;
+    default:
+        return;
+    }
+    if (a.umin <= a.umax) {
+        ti->umin = a.umin;
+        ti->umax = a.umax;
+    }
+}
+
 /* Propagate constants and copies, fold constant expressions. */
 void tcg_optimize(TCGContext *s)
 {
@@ -621,8 +865,10 @@ void tcg_optimize(TCGContext *s)
     }
 
     QTAILQ_FOREACH_SAFE(op, &s->ops, link, op_next) {
-        uint64_t mask, partmask, affected, tmp;
-        int nb_oargs, nb_iargs;
+        uint64_t mask, partmask, affected, tmp, ones, umin, umax;
+        int nb_oargs, nb_iargs, width, sign_copies;
+        TempFacts a, b;
+        bool is64;
         TCGOpcode opc = op->opc;
         const TCGOpDef *def = &tcg_op_defs[opc];
 
@@ -853,53 +1099,86 @@ void tcg_optimize(TCGContext *s)
             break;
         }
 
-        /* Simplify using known-zero bits. Currently only ops with a single
-           output argument is supported. */
+        /* Simplify using known bits and value ranges.  Currently only ops
+           with a single output argument are supported.  "mask" and "ones"
+           are the bits of the output that may be set and that are known
+           to be set, "umin" and "umax" its unsigned range.  */
+        is64 = def->flags & TCG_OPF_64BIT;
+        width = is64 ? 64 : 32;
         mask = -1;
+        ones = 0;
+        umin = 0;
+        umax = -1;
+        sign_copies = 0;
         affected = -1;
         switch (opc) {
         CASE_OP_32_64(ext8s):
-            if ((arg_info(op->args[1])->mask & 0x80) != 0) {
+            tmp = 8;
+            goto do_sext;
+        CASE_OP_32_64(ext16s):
+            tmp = 16;
+            goto do_sext;
+        case INDEX_op_ext32s_i64:
+            tmp = 32;
+        do_sext:
+            arg_facts(op->args[1], is64, &a);
+            if (a.sign_copies >= width - tmp) {
+                /* Already sign-extended.  */
+                affected = 0;
                 break;
             }
-            QEMU_FALLTHROUGH;
+            if (!(a.mask & (1ull << (tmp - 1)))) {
+                mask = MAKE_64BIT_MASK(0, tmp);
+                goto do_zext;
+            }
+            mask = sextract64(a.mask, 0, tmp);
+            ones = sextract64(a.ones, 0, tmp);
+            sign_copies = width - tmp;
+            break;
         CASE_OP_32_64(ext8u):
             mask = 0xff;
-            goto and_const;
-        CASE_OP_32_64(ext16s):
-            if ((arg_info(op->args[1])->mask & 0x8000) != 0) {
-                break;
-            }
-            QEMU_FALLTHROUGH;
+            goto do_zext;
         CASE_OP_32_64(ext16u):
             mask = 0xffff;
-            goto and_const;
-        case INDEX_op_ext32s_i64:
-            if ((arg_info(op->args[1])->mask & 0x80000000) != 0) {
-                break;
-            }
-            QEMU_FALLTHROUGH;
+            goto do_zext;
         case INDEX_op_ext32u_i64:
             mask = 0xffffffffU;
+        do_zext:
+            b.ones = mask;
+            b.umax = mask;
             goto and_const;
 
         CASE_OP_32_64(and):
+            arg_facts(op->args[2], is64, &b);
             mask = arg_info(op->args[2])->mask;
             if (arg_is_const(op->args[2])) {
         and_const:
-                affected = arg_info(op->args[1])->mask & ~mask;
+                arg_facts(op->args[1], is64, &a);
+                affected = a.mask & ~mask;
+            } else {
+                arg_facts(op->args[1], is64, &a);
             }
-            mask = arg_info(op->args[1])->mask & mask;
+            mask = a.mask & mask;
+            ones = a.ones & b.ones;
+            umax = MIN(a.umax, b.umax);
             break;
 
         case INDEX_op_ext_i32_i64:
-            if ((arg_info(op->args[1])->mask & 0x80000000) != 0) {
+            arg_facts(op->args[1], false, &a);
+            if (a.mask & 0x80000000) {
+                mask = (int32_t)a.mask;
+                ones = (int32_t)a.ones;
+                sign_copies = 32 + a.sign_copies;
                 break;
             }
             QEMU_FALLTHROUGH;
         case INDEX_op_extu_i32_i64:
             /* We do not compute affected as it is a size changing op.  */
-            mask = (uint32_t)arg_info(op->args[1])->mask;
+            arg_facts(op->args[1], false, &a);
+            mask = a.mask;
+            ones = a.ones;
+            umin = a.umin;
+            umax = a.umax;
             break;
 
         CASE_OP_32_64(andc):
@@ -907,22 +1186,39 @@ void tcg_optimize(TCGContext *s)
                op->args[2] is constant, we can't infer anything from it.  */
             if (arg_is_const(op->args[2])) {
                 mask = ~arg_info(op->args[2])->mask;
+                b.ones = mask;
+                b.umax = -1;
                 goto and_const;
             }
             /* But we certainly know nothing outside args[1] may be set. */
-            mask = arg_info(op->args[1])->mask;
+            arg_facts(op->args[1], is64, &a);
+            arg_facts(op->args[2], is64, &b);
+            mask = a.mask & ~b.ones;
+            ones = a.ones & ~b.mask;
+            umax = a.umax;
             break;
 
         case INDEX_op_sar_i32:
             if (arg_is_const(op->args[2])) {
                 tmp = arg_info(op->args[2])->val & 31;
+                arg_facts(op->args[1], false, &a);
                 mask = (int32_t)arg_info(op->args[1])->mask >> tmp;
+                ones = (int32_t)a.ones >> tmp;
+                goto do_sar;
             }
             break;
         case INDEX_op_sar_i64:
             if (arg_is_const(op->args[2])) {
                 tmp = arg_info(op->args[2])->val & 63;
+                arg_facts(op->args[1], true, &a);
                 mask = (int64_t)arg_info(op->args[1])->mask >> tmp;
+                ones = (int64_t)a.ones >> tmp;
+            do_sar:
+                sign_copies = MIN(a.sign_copies + tmp, width - 1);
+                if (!(a.umax >> (width - 1))) {
+                    umin = a.umin >> tmp;
+                    umax = a.umax >> tmp;
+                }
             }
             break;
 
@@ -930,26 +1226,52 @@ void tcg_optimize(TCGContext *s)
             if (arg_is_const(op->args[2])) {
                 tmp = arg_info(op->args[2])->val & 31;
                 mask = (uint32_t)arg_info(op->args[1])->mask >> tmp;
+                goto do_shr;
             }
             break;
         case INDEX_op_shr_i64:
             if (arg_is_const(op->args[2])) {
                 tmp = arg_info(op->args[2])->val & 63;
                 mask = (uint64_t)arg_info(op->args[1])->mask >> tmp;
+            do_shr:
+                arg_facts(op->args[1], is64, &a);
+                ones = a.ones >> tmp;
+                umin = a.umin >> tmp;
+                umax = a.umax >> tmp;
             }
             break;
 
         case INDEX_op_extrl_i64_i32:
             mask = (uint32_t)arg_info(op->args[1])->mask;
+            arg_facts(op->args[1], true, &a);
+            ones = (uint32_t)a.ones;
+            if (a.umax <= UINT32_MAX) {
+                umin = a.umin;
+                umax = a.umax;
+            }
+            sign_copies = MAX(a.sign_copies - 32, 0);
             break;
         case INDEX_op_extrh_i64_i32:
             mask = (uint64_t)arg_info(op->args[1])->mask >> 32;
+            arg_facts(op->args[1], true, &a);
+            ones = a.ones >> 32;
+            umin = a.umin >> 32;
+            umax = a.umax >> 32;
+            sign_copies = MIN(a.sign_copies, 31);
             break;
 
         CASE_OP_32_64(shl):
             if (arg_is_const(op->args[2])) {
                 tmp = arg_info(op->args[2])->val & (TCG_TARGET_REG_BITS - 1);
                 mask = arg_info(op->args[1])->mask << tmp;
+                if (tmp < width) {
+                    arg_facts(op->args[1], is64, &a);
+                    ones = a.ones << tmp;
+                    if (a.umax <= width_mask(is64) >> tmp) {
+                        umin = a.umin << tmp;
+                        umax = a.umax << tmp;
+                    }
+                }
             }
             break;
 
@@ -957,32 +1279,105 @@ void tcg_optimize(TCGContext *s)
             /* Set to 1 all bits to the left of the rightmost.  */
             mask = -(arg_info(op->args[1])->mask
                      & -arg_info(op->args[1])->mask);
+            /* 0 - a is 0 + ~a + 1 */
+            arg_facts(op->args[1], is64, &a);
+            add_known_bits(0, 0, ~a.ones, ~a.mask, 1, &tmp, &ones);
+            mask &= tmp;
+            break;
+
+        CASE_OP_32_64(add):
+            arg_facts(op->args[1], is64, &a);
+            arg_facts(op->args[2], is64, &b);
+            add_known_bits(a.mask, a.ones, b.mask, b.ones, 0, &mask, &ones);
+            if (a.umax <= width_mask(is64) - b.umax) {
+                umin = a.umin + b.umin;
+                umax = a.umax + b.umax;
+            }
+            break;
+        CASE_OP_32_64(sub):
+            arg_facts(op->args[1], is64, &a);
+            arg_facts(op->args[2], is64, &b);
+            /* a - b is a + ~b + 1 */
+            add_known_bits(a.mask, a.ones, ~b.ones, ~b.mask, 1, &mask, &ones);
+            if (a.umin >= b.umax) {
+                umin = a.umin - b.umax;
+                umax = a.umax - b.umin;
+            }
+            break;
+
+        CASE_OP_32_64(divu):
+            arg_facts(op->args[2], is64, &b);
+            if (b.umin) {
+                arg_facts(op->args[1], is64, &a);
+                umin = a.umin / b.umax;
+                umax = a.umax / b.umin;
+            }
+            break;
+        CASE_OP_32_64(remu):
+            arg_facts(op->args[2], is64, &b);
+            if (b.umin) {
+                arg_facts(op->args[1], is64, &a);
+                umax = MIN(a.umax, b.umax - 1);
+            }
             break;
 
         CASE_OP_32_64(deposit):
             mask = deposit64(arg_info(op->args[1])->mask,
                              op->args[3], op->args[4],
                              arg_info(op->args[2])->mask);
+            arg_facts(op->args[1], is64, &a);
+            arg_facts(op->args[2], is64, &b);
+            ones = deposit64(a.ones, op->args[3], op->args[4], b.ones);
             break;
 
         CASE_OP_32_64(extract):
             mask = extract64(arg_info(op->args[1])->mask,
                              op->args[2], op->args[3]);
+            arg_facts(op->args[1], is64, &a);
+            ones = extract64(a.ones, op->args[2], op->args[3]);
             if (op->args[2] == 0) {
                 affected = arg_info(op->args[1])->mask & ~mask;
+                umax = a.umax;
             }
             break;
         CASE_OP_32_64(sextract):
             mask = sextract64(arg_info(op->args[1])->mask,
                               op->args[2], op->args[3]);
-            if (op->args[2] == 0 && (tcg_target_long)mask >= 0) {
-                affected = arg_info(op->args[1])->mask & ~mask;
+            arg_facts(op->args[1], is64, &a);
+            ones = sextract64(a.ones, op->args[2], op->args[3]);
+            sign_copies = width - op->args[3];
+            if (op->args[2] == 0) {
+                if (a.sign_copies >= sign_copies) {
+                    /* Already sign-extended from that bit.  */
+                    affected = 0;
+                } else if ((tcg_target_long)mask >= 0) {
+                    affected = arg_info(op->args[1])->mask & ~mask;
+                }
             }
             break;
 
+        CASE_OP_32_64(not):
+            arg_facts(op->args[1], is64, &a);
+            mask = ~a.ones;
+            ones = ~a.mask;
+            sign_copies = a.sign_copies;
+            break;
+
         CASE_OP_32_64(or):
+            arg_facts(op->args[1], is64, &a);
+            arg_facts(op->args[2], is64, &b);
+            mask = arg_info(op->args[1])->mask | arg_info(op->args[2])->mask;
+            ones = a.ones | b.ones;
+            umin = MAX(a.umin, b.umin);
+            sign_copies = MIN(a.sign_copies, b.sign_copies);
+            break;
         CASE_OP_32_64(xor):
+            arg_facts(op->args[1], is64, &a);
+            arg_facts(op->args[2], is64, &b);
             mask = arg_info(op->args[1])->mask | arg_info(op->args[2])->mask;
+            mask &= ~(a.ones & b.ones);
+            ones = (a.ones & ~b.mask) | (b.ones & ~a.mask);
+            sign_copies = MIN(a.sign_copies, b.sign_copies);
             break;
 
         case INDEX_op_clz_i32:
@@ -1009,6 +1404,12 @@ void tcg_optimize(TCGContext *s)
 
         CASE_OP_32_64(movcond):
             mask = arg_info(op->args[3])->mask | arg_info(op->args[4])->mask;
+            arg_facts(op->args[3], is64, &a);
+            arg_facts(op->args[4], is64, &b);
+            ones = a.ones & b.ones;
+            umin = MIN(a.umin, b.umin);
+            umax = MAX(a.umax, b.umax);
+            sign_copies = MIN(a.sign_copies, b.sign_copies);
             break;
 
         CASE_OP_32_64(ld8u):
@@ -1020,6 +1421,15 @@ void tcg_optimize(TCGContext *s)
         case INDEX_op_ld32u_i64:
             mask = 0xffffffffu;
             break;
+        CASE_OP_32_64(ld8s):
+            sign_copies = width - 8;
+            break;
+        CASE_OP_32_64(ld16s):
+            sign_copies = width - 16;
+            break;
+        case INDEX_op_ld32s_i64:
+            sign_copies = 32;
+            break;
 
         CASE_OP_32_64(qemu_ld):
             {
@@ -1027,6 +1437,8 @@ void tcg_optimize(TCGContext *s)
                 MemOp mop = get_memop(oi);
                 if (!(mop & MO_SIGN)) {
                     mask = (2ULL << ((8 << (mop & MO_SIZE)) - 1)) - 1;
+                } else {
+                    sign_copies = MAX(width - (8 << (mop & MO_SIZE)), 0);
                 }
             }
             break;
@@ -1092,6 +1504,22 @@ void tcg_optimize(TCGContext *s)
             continue;
         }
 
+        ones &= partmask;
+        umin = MAX(umin, ones);
+        umax = MIN(umax, partmask);
+        if (umin > umax) {
+            /* Only possible in unreachable code.  */
+            ones = 0;
+            umin = 0;
+            umax = partmask;
+        }
+        if (umin == umax && nb_oargs == 1 && opc != INDEX_op_call &&
+            !(def->flags & (TCG_OPF_SIDE_EFFECTS | TCG_OPF_VECTOR))) {
+            tcg_opt_gen_movi(s, &temps_used, op, op->args[0],
+                             is64 ? umin : (int32_t)umin);
+            continue;
+        }
+
         /* Simplify expression for "op r, a, 0 => movi r, 0" cases */
         switch (opc) {
         CASE_OP_32_64_VEC(and):
@@ -1544,17 +1972,34 @@ void tcg_optimize(TCGContext *s)
                to compute the operation result) so no propagation is done.
                We trash everything if the operation is the end of a basic
                block, otherwise we only trash the output args.  "mask" is
-               the non-zero bits mask for the first output arg.  */
-            if (def->flags & TCG_OPF_BB_END) {
+               the non-zero bits mask for the first output arg.  The code
+               after a conditional branch is only reached from it, so there
+               we keep what we know and add the branch condition.  */
+            if (opc == INDEX_op_brcond_i32 || opc == INDEX_op_brcond_i64) {
+                reset_normal_temps(s, &temps_used);
+                brcond_fallthrough(op, is64);
+            } else if (opc == INDEX_op_brcond2_i32) {
+                reset_normal_temps(s, &temps_used);
+            } else if (def->flags & TCG_OPF_BB_END) {
                 memset(&temps_used, 0, sizeof(temps_used));
             } else {
         do_reset_output:
                 for (i = 0; i < nb_oargs; i++) {
                     reset_temp(op->args[i]);
-                    /* Save the corresponding known-zero bits mask for the
-                       first output argument (only one supported so far). */
+                    /* Save what is known about the first output argument
+                       (only one supported so far). */
                     if (i == 0) {
-                        arg_info(op->args[i])->mask = mask;
+                        TCGTemp *ts = arg_temp(op->args[i]);
+                        TempOptInfo *ti = ts_info(ts);
+
+                        ti->mask = mask;
+                        /* Calls have no width, their facts are unknown */
+                        if (ts->type == (is64 ? TCG_TYPE_I64 : TCG_TYPE_I32)) {
+                            ti->ones = ones;
+                            ti->umin = umin;
+                            ti->umax = umax;
+                            ti->sign_copies = sign_copies;
+                        }
                     }
                 }
             }
@@ -36,11 +36,24 @@ struct tcg_region_tree {
     /* padding to avoid false sharing is computed at run-time */
 };
 
+/* FIFO of region indices; it never holds more than region.n entries */
+struct tcg_region_queue {
+    size_t *idx;
+    size_t head;
+    size_t len;
+};
+
 /*
  * We divide code_gen_buffer into equally-sized "regions" that TCG threads
  * dynamically allocate from as demand dictates. Given appropriate region
  * sizing, this minimizes flushes even when some TCG threads generate a lot
  * more code than others.
+ *
+ * Regions that filled up are kept in the order they did so.  When few
+ * regions are left free, the oldest full one is evicted: its TBs are
+ * invalidated, and the region is handed out again once no vCPU can be
+ * running them anymore.  The whole buffer only has to be flushed when
+ * the free regions run out before evictions complete.
  */
 struct tcg_region_state {
     QemuMutex lock;
@@ -53,13 +66,43 @@ struct tcg_region_state {
     size_t stride; /* .size + guard size */
     size_t total_size; /* size of entire buffer, >= n * stride */
 
+    size_t evict_watermark; /* evict when fewer regions than this are free */
+
     /* fields protected by the lock */
-    size_t current; /* current region index */
+    struct tcg_region_queue free; /* regions not assigned to a context */
+    struct tcg_region_queue full; /* full regions, oldest first */
+    size_t *size_full; /* size of the code in each full region */
+    size_t n_evicting; /* regions between evict_begin and evict_end */
+    unsigned int generation; /* incremented by tcg_region_reset_all */
     size_t agg_size_full; /* aggregate size of full regions */
 };
 
 static struct tcg_region_state region;
 
+static void tcg_region_queue_init(struct tcg_region_queue *q)
+{
+    q->idx = g_new(size_t, region.n);
+    q->head = 0;
+    q->len = 0;
+}
+
+static void tcg_region_queue_push(struct tcg_region_queue *q, size_t idx)
+{
+    g_assert(q->len < region.n);
+    q->idx[(q->head + q->len++) % region.n] = idx;
+}
+
+static size_t tcg_region_queue_pop(struct tcg_region_queue *q)
+{
+    size_t idx;
+
+    g_assert(q->len);
+    idx = q->idx[q->head];
+    q->head = (q->head + 1) % region.n;
+    q->len--;
+    return idx;
+}
+
 /*
  * This is an array of struct tcg_region_tree's, with padding.
  * We use void * to simplify the computation of region_trees[i]; each
@@ -163,10 +206,23 @@ static void tcg_region_trees_init(void)
     }
 }
 
-static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
+/* @p must be in the rw view of code_gen_buffer */
+static size_t tcg_region_idx(const void *p)
 {
-    size_t region_idx;
+    ptrdiff_t offset;
+
+    if (p < region.start_aligned) {
+        return 0;
+    }
+    offset = p - region.start_aligned;
+    if (offset > region.stride * (region.n - 1)) {
+        return region.n - 1;
+    }
+    return offset / region.stride;
+}
 
+static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
+{
     /*
      * Like tcg_splitwx_to_rw, with no assert.  The pc may come from
      * a signal handler over which the caller has no control.
@@ -177,19 +233,7 @@ static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
             return NULL;
         }
     }
-
-    if (p < region.start_aligned) {
-        region_idx = 0;
-    } else {
-        ptrdiff_t offset = p - region.start_aligned;
-
-        if (offset > region.stride * (region.n - 1)) {
-            region_idx = region.n - 1;
-        } else {
-            region_idx = offset / region.stride;
-        }
-    }
-    return region_trees + region_idx * tree_size;
+    return region_trees + tcg_region_idx(p) * tree_size;
 }
 
 void tcg_tb_insert(TranslationBlock *tb)
@@ -283,17 +327,35 @@ size_t tcg_nb_tbs(void)
     return nb_tbs;
 }
 
+/*
+ * Call @func on the TBs of one region.  As with tcg_tb_foreach, @func
+ * is called with the region's tree locked.
+ */
+void tcg_region_tb_foreach(size_t region_idx, GTraverseFunc func,
+                           gpointer user_data)
+{
+    struct tcg_region_tree *rt = region_trees + region_idx * tree_size;
+
+    qemu_mutex_lock(&rt->lock);
+    g_tree_foreach(rt->tree, func, user_data);
+    qemu_mutex_unlock(&rt->lock);
+}
+
+/* Call with the region's tree locked */
+static void tcg_region_tree_reset(struct tcg_region_tree *rt)
+{
+    /* Increment the refcount first so that destroy acts as a reset */
+    g_tree_ref(rt->tree);
+    g_tree_destroy(rt->tree);
+}
+
 static void tcg_region_tree_reset_all(void)
 {
     size_t i;
 
     tcg_region_tree_lock_all();
     for (i = 0; i < region.n; i++) {
-        struct tcg_region_tree *rt = region_trees + i * tree_size;
-
-        /* Increment the refcount first so that destroy acts as a reset */
-        g_tree_ref(rt->tree);
-        g_tree_destroy(rt->tree);
+        tcg_region_tree_reset(region_trees + i * tree_size);
     }
     tcg_region_tree_unlock_all();
 }
@@ -331,11 +393,10 @@ static void tcg_region_assign(TCGContext *s, size_t curr_region)
 
 static bool tcg_region_alloc__locked(TCGContext *s)
 {
-    if (region.current == region.n) {
+    if (region.free.len == 0) {
         return true;
     }
-    tcg_region_assign(s, region.current);
-    region.current++;
+    tcg_region_assign(s, tcg_region_queue_pop(&region.free));
     return false;
 }
 
@@ -346,18 +407,77 @@ static bool tcg_region_alloc__locked(TCGContext *s)
 bool tcg_region_alloc(TCGContext *s)
 {
     bool err;
-    /* read the region size now; alloc__locked will overwrite it on success */
-    size_t size_full = s->code_gen_buffer_size;
+    /* read the region now; alloc__locked will overwrite it on success */
+    size_t idx_full = tcg_region_idx(s->code_gen_buffer);
+    size_t size_full = s->code_gen_buffer_size - TCG_HIGHWATER;
 
     qemu_mutex_lock(&region.lock);
     err = tcg_region_alloc__locked(s);
     if (!err) {
-        region.agg_size_full += size_full - TCG_HIGHWATER;
+        tcg_region_queue_push(&region.full, idx_full);
+        region.size_full[idx_full] = size_full;
+        region.agg_size_full += size_full;
     }
     qemu_mutex_unlock(&region.lock);
     return err;
 }
 
+/*
+ * If fewer than region.evict_watermark regions are free, take the oldest
+ * full region off the full list and return its index; otherwise return -1.
+ * The caller invalidates the TBs of the region, waits until no vCPU can be
+ * running them, then calls tcg_region_evict_end with *@gen.
+ */
+ssize_t tcg_region_evict_begin(unsigned int *gen)
+{
+    ssize_t idx = -1;
+
+    qemu_mutex_lock(&region.lock);
+    if (region.free.len + region.n_evicting < region.evict_watermark &&
+        region.full.len) {
+        idx = tcg_region_queue_pop(&region.full);
+        region.agg_size_full -= region.size_full[idx];
+        region.n_evicting++;
+        *gen = region.generation;
+    }
+    qemu_mutex_unlock(&region.lock);
+    return idx;
+}
+
+/*
+ * Forget the TBs of an evicted region and make it available again.
+ * Nothing is left to do if the code buffer was flushed in the meantime.
+ */
+void tcg_region_evict_end(size_t region_idx, unsigned int gen)
+{
+    struct tcg_region_tree *rt = region_trees + region_idx * tree_size;
+
+    qemu_mutex_lock(&region.lock);
+    if (gen == region.generation) {
+        qemu_mutex_lock(&rt->lock);
+        tcg_region_tree_reset(rt);
+        qemu_mutex_unlock(&rt->lock);
+
+        tcg_region_queue_push(&region.free, region_idx);
+        region.n_evicting--;
+    }
+    qemu_mutex_unlock(&region.lock);
+}
+
+static void tcg_region_free_all__locked(void)
+{
+    size_t i;
+
+    region.free.head = 0;
+    region.free.len = 0;
+    for (i = 0; i < region.n; i++) {
+        tcg_region_queue_push(&region.free, i);
+    }
+    region.full.len = 0;
+    region.n_evicting = 0;
+    region.agg_size_full = 0;
+}
+
 /*
  * Perform a context's first region allocation.
  * This function does _not_ increment region.agg_size_full.
@@ -382,8 +502,8 @@ void tcg_region_reset_all(void)
     unsigned int i;
 
     qemu_mutex_lock(&region.lock);
-    region.current = 0;
-    region.agg_size_full = 0;
+    tcg_region_free_all__locked();
+    region.generation++;
 
     for (i = 0; i < n_ctxs; i++) {
         TCGContext *s = qatomic_read(&tcg_ctxs[i]);
@@ -873,6 +993,11 @@ void tcg_region_init(size_t tb_size, int splitwx, unsigned max_cpus)
 
     /* init the region struct */
     qemu_mutex_init(&region.lock);
+    tcg_region_queue_init(&region.free);
+    tcg_region_queue_init(&region.full);
+    region.size_full = g_new0(size_t, region.n);
+    tcg_region_free_all__locked();
+    region.evict_watermark = DIV_ROUND_UP(region.n, 8);
 
     /*
      * Set guard pages in the rw buffer, as that's the one into which
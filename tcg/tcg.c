@@ -812,6 +812,7 @@ void tcg_func_start(TCGContext *s)
 
     s->nb_ops = 0;
     s->nb_labels = 0;
+    s->ir_host_ptr = false;
     s->current_frame_offset = s->frame_start;
 
 #ifdef CONFIG_DEBUG_TCG
@@ -2243,6 +2244,280 @@ TCGOp *tcg_op_insert_after(TCGContext *s, TCGOp *old_op, TCGOpcode opc)
     return new_op;
 }
 
+/*
+ * Saving and restoring the ops of a TB, as emitted by the front end and
+ * before any pass runs on them.  The format is private to one QEMU
+ * binary: temps are saved as indexes, helpers as indexes in all_helpers,
+ * and the pointer to the TB as an offset from it.
+ */
+
+typedef struct TCGIRHeader {
+    uint32_t nb_globals;
+    uint32_t nb_temps;
+    uint32_t nb_labels;
+    uint32_t nb_ops;
+} TCGIRHeader;
+
+typedef struct TCGIRTemp {
+    uint8_t base_type;
+    uint8_t type;
+    uint8_t kind;
+    uint8_t temp_allocated;
+    int64_t val;
+} TCGIRTemp;
+
+typedef struct TCGIROp {
+    uint8_t opc;
+    uint8_t param1;
+    uint8_t param2;
+    uint8_t nb_args;
+} TCGIROp;
+
+typedef struct TCGIRReader {
+    const uint8_t *p;
+    const uint8_t *end;
+} TCGIRReader;
+
+/* Index of the argument of @op that is a label, or -1 */
+static int tcg_op_label_arg(const TCGOp *op)
+{
+    const TCGOpDef *def = &tcg_op_defs[op->opc];
+
+    switch (op->opc) {
+    case INDEX_op_set_label:
+    case INDEX_op_br:
+        return 0;
+    case INDEX_op_brcond_i32:
+    case INDEX_op_brcond_i64:
+    case INDEX_op_brcond2_i32:
+        /* the condition comes first */
+        return def->nb_oargs + def->nb_iargs + 1;
+    default:
+        return -1;
+    }
+}
+
+static void tcg_op_nb_args(const TCGOp *op, int *nb_temps, int *nb_args)
+{
+    const TCGOpDef *def = &tcg_op_defs[op->opc];
+
+    if (op->opc == INDEX_op_call) {
+        *nb_temps = TCGOP_CALLO(op) + TCGOP_CALLI(op);
+    } else {
+        *nb_temps = def->nb_oargs + def->nb_iargs;
+    }
+    *nb_args = *nb_temps + def->nb_cargs;
+}
+
+bool tcg_ir_save(TCGContext *s, const TranslationBlock *tb, GByteArray *buf)
+{
+    uintptr_t tb_rx = (uintptr_t)tcg_splitwx_to_rx((void *)tb);
+    TCGIRHeader hdr = {
+        .nb_globals = s->nb_globals,
+        .nb_temps = s->nb_temps - s->nb_globals,
+        .nb_labels = s->nb_labels,
+        .nb_ops = 0,
+    };
+    size_t hdr_pos = buf->len;
+    TCGOp *op;
+    int i;
+
+    if (s->ir_host_ptr) {
+        return false;
+    }
+
+    g_byte_array_append(buf, (uint8_t *)&hdr, sizeof(hdr));
+
+    for (i = s->nb_globals; i < s->nb_temps; i++) {
+        TCGTemp *ts = &s->temps[i];
+        TCGIRTemp t = {
+            .base_type = ts->base_type,
+            .type = ts->type,
+            .kind = ts->kind,
+            .temp_allocated = ts->temp_allocated,
+            .val = ts->kind == TEMP_CONST ? ts->val : 0,
+        };
+
+        g_byte_array_append(buf, (uint8_t *)&t, sizeof(t));
+    }
+
+    QTAILQ_FOREACH(op, &s->ops, link) {
+        int nb_temps, nb_args, label = tcg_op_label_arg(op);
+        TCGIROp o = {
+            .opc = op->opc,
+            .param1 = op->param1,
+            .param2 = op->param2,
+        };
+
+        if (op->opc == INDEX_op_plugin_cb_start ||
+            op->opc == INDEX_op_plugin_cb_end) {
+            return false;
+        }
+
+        tcg_op_nb_args(op, &nb_temps, &nb_args);
+        o.nb_args = nb_args;
+        g_byte_array_append(buf, (uint8_t *)&o, sizeof(o));
+
+        for (i = 0; i < nb_args; i++) {
+            uint64_t arg = op->args[i];
+
+            if (i < nb_temps) {
+                if (op->args[i] != TCG_CALL_DUMMY_ARG) {
+                    arg = temp_idx(arg_temp(op->args[i])) + 1;
+                }
+            } else if (i == label) {
+                arg = arg_label(op->args[i])->id;
+            } else if (op->opc == INDEX_op_call && i == nb_temps) {
+                const TCGHelperInfo *info = tcg_call_info(op);
+
+                /* plugin callbacks use the info of a template helper */
+                if (tcg_call_func(op) != info->func) {
+                    return false;
+                }
+                arg = info - all_helpers;
+            } else if (op->opc == INDEX_op_call) {
+                /* the info pointer, rebuilt from the function */
+                arg = 0;
+            } else if (op->opc == INDEX_op_exit_tb && op->args[i]) {
+                tcg_debug_assert(op->args[i] - tb_rx <= TB_EXIT_REQUESTED);
+                arg = op->args[i] - tb_rx + 1;
+            }
+            g_byte_array_append(buf, (uint8_t *)&arg, sizeof(arg));
+        }
+        hdr.nb_ops++;
+    }
+
+    memcpy(buf->data + hdr_pos, &hdr, sizeof(hdr));
+    return true;
+}
+
+static const void *tcg_ir_read(TCGIRReader *r, size_t len)
+{
+    const void *p = r->p;
+
+    if ((size_t)(r->end - r->p) < len) {
+        return NULL;
+    }
+    r->p += len;
+    return p;
+}
+
+bool tcg_ir_restore(TCGContext *s, const TranslationBlock *tb,
+                    const void *data, size_t len)
+{
+    uintptr_t tb_rx = (uintptr_t)tcg_splitwx_to_rx((void *)tb);
+    TCGIRReader r = { data, (const uint8_t *)data + len };
+    const TCGIRHeader *hdr;
+    TCGLabel **labels;
+    bool high_half = false;
+    uint32_t i, j;
+
+    hdr = tcg_ir_read(&r, sizeof(*hdr));
+    if (!hdr || hdr->nb_globals != s->nb_globals ||
+        hdr->nb_temps > TCG_MAX_TEMPS - s->nb_globals) {
+        return false;
+    }
+
+    for (i = 0; i < hdr->nb_temps; i++) {
+        const TCGIRTemp *t = tcg_ir_read(&r, sizeof(*t));
+        TCGTemp *ts;
+
+        if (!t || t->base_type >= TCG_TYPE_COUNT ||
+            t->type >= TCG_TYPE_COUNT) {
+            return false;
+        }
+        ts = tcg_temp_alloc(s);
+        ts->base_type = t->base_type;
+        ts->type = t->type;
+        ts->kind = t->kind;
+        ts->temp_allocated = t->temp_allocated;
+        ts->val = t->val;
+
+        /*
+         * Passes look up constants by value, as in tcg_constant_internal().
+         * The high half of a 64-bit constant on a 32-bit host follows its
+         * low half and isn't in the table.
+         */
+        if (ts->kind == TEMP_CONST && !high_half) {
+            GHashTable *h = s->const_table[ts->base_type];
+
+            if (h == NULL) {
+                h = g_hash_table_new(g_int64_hash, g_int64_equal);
+                s->const_table[ts->base_type] = h;
+            }
+            g_hash_table_insert(h, &ts->val, ts);
+            high_half = ts->base_type != ts->type;
+        } else {
+            high_half = false;
+        }
+    }
+
+    labels = tcg_malloc(sizeof(TCGLabel *) * MAX(hdr->nb_labels, 1));
+    for (i = 0; i < hdr->nb_labels; i++) {
+        labels[i] = gen_new_label();
+    }
+
+    for (i = 0; i < hdr->nb_ops; i++) {
+        const TCGIROp *o = tcg_ir_read(&r, sizeof(*o));
+        int nb_temps, nb_args, label;
+        TCGOp *op;
+
+        if (!o || o->opc >= NB_OPS || o->nb_args > MAX_OPC_PARAM) {
+            return false;
+        }
+        op = tcg_emit_op(o->opc);
+        op->param1 = o->param1;
+        op->param2 = o->param2;
+        tcg_op_nb_args(op, &nb_temps, &nb_args);
+        if (nb_args != o->nb_args) {
+            return false;
+        }
+        label = tcg_op_label_arg(op);
+
+        for (j = 0; j < nb_args; j++) {
+            const uint64_t *a = tcg_ir_read(&r, sizeof(*a));
+            uint64_t arg;
+
+            if (!a) {
+                return false;
+            }
+            arg = *a;
+
+            if (j < nb_temps) {
+                if (arg != TCG_CALL_DUMMY_ARG) {
+                    if (arg > s->nb_temps) {
+                        return false;
+                    }
+                    arg = temp_arg(&s->temps[arg - 1]);
+                }
+            } else if (j == label) {
+                if (arg >= hdr->nb_labels) {
+                    return false;
+                }
+                if (op->opc == INDEX_op_set_label) {
+                    labels[arg]->present = 1;
+                } else {
+                    labels[arg]->refs++;
+                }
+                arg = label_arg(labels[arg]);
+            } else if (op->opc == INDEX_op_call && j == nb_temps) {
+                if (arg >= ARRAY_SIZE(all_helpers)) {
+                    return false;
+                }
+                op->args[j + 1] = (uintptr_t)&all_helpers[arg];
+                arg = (uintptr_t)all_helpers[arg].func;
+            } else if (op->opc == INDEX_op_call) {
+                continue;
+            } else if (op->opc == INDEX_op_exit_tb && arg) {
+                arg = tb_rx + arg - 1;
+            }
+            op->args[j] = arg;
+        }
+    }
+
+    return r.p == r.end;
+}
+
 /* Reachable analysis : remove unreachable code.  */
 static void reachable_code_pass(TCGContext *s)
 {
@@ -126,6 +126,16 @@ static void tci_args_rrs(uint32_t insn, TCGReg *r0, TCGReg *r1, int32_t *i2)
     *i2 = sextract32(insn, 16, 16);
 }
 
+/* The fused compare-and-branch keeps its label in the following word. */
+static void tci_args_rrcl(uint32_t insn, const uint32_t *tb_ptr,
+                          TCGReg *r0, TCGReg *r1, TCGCond *c2, void **l3)
+{
+    *r0 = extract32(insn, 8, 4);
+    *r1 = extract32(insn, 12, 4);
+    *c2 = extract32(insn, 16, 4);
+    *l3 = (int32_t)*tb_ptr + (void *)(tb_ptr + 1);
+}
+
 static void tci_args_rrbb(uint32_t insn, TCGReg *r0, TCGReg *r1,
                           uint8_t *i2, uint8_t *i3)
 {
@@ -438,15 +448,39 @@ static void tci_qemu_st(CPUArchState *env, target_ulong taddr, uint64_t val,
 #endif
 }
 
+#ifdef CONFIG_TCG_INTERPRETER_THREADED
+/*
+ * Threaded dispatch: each handler ends with its own indirect jump to the
+ * next handler, which the host predicts much better than the single
+ * shared jump of a switch.  The handler addresses are learned from the
+ * switch the first time each opcode executes, so there is no second list
+ * of implemented opcodes to keep in sync with the cases below.  Only the
+ * last case label of a group may learn, or the store would fall through.
+ */
+# define TCI_LABEL            TCI_LABEL_(glue(tci_handler_, __LINE__))
+# define TCI_LABEL_(L)        qatomic_set(&tci_dispatch[opc], &&L); L:
+# define TCI_NEXT()                                             \
+    do {                                                        \
+        insn = *tb_ptr++;                                       \
+        opc = extract32(insn, 0, 8);                            \
+        goto *qatomic_read(&tci_dispatch[opc]);                 \
+    } while (0)
+#else
+# define TCI_LABEL
+# define TCI_NEXT()           continue
+#endif
+
+#define CASE(x) \
+        case glue(INDEX_op_, x): TCI_LABEL
 #if TCG_TARGET_REG_BITS == 64
 # define CASE_32_64(x) \
         case glue(glue(INDEX_op_, x), _i64): \
-        case glue(glue(INDEX_op_, x), _i32):
+        case glue(glue(INDEX_op_, x), _i32): TCI_LABEL
 # define CASE_64(x) \
         case glue(glue(INDEX_op_, x), _i64):
 #else
 # define CASE_32_64(x) \
-        case glue(glue(INDEX_op_, x), _i32):
+        case glue(glue(INDEX_op_, x), _i32): TCI_LABEL
 # define CASE_64(x)
 #endif
 
@@ -464,6 +498,11 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
     uint64_t stack[(TCG_STATIC_CALL_ARGS_SIZE + TCG_STATIC_FRAME_SIZE)
                    / sizeof(uint64_t)];
     void *call_slots[TCG_STATIC_CALL_ARGS_SIZE / sizeof(uint64_t)];
+#ifdef CONFIG_TCG_INTERPRETER_THREADED
+    static void *tci_dispatch[NB_OPS] = {
+        [0 ... NB_OPS - 1] = &&tci_switch
+    };
+#endif
 
     regs[TCG_AREG0] = (tcg_target_ulong)env;
     regs[TCG_REG_CALL_STACK] = (uintptr_t)stack;
@@ -488,9 +527,13 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
 
         insn = *tb_ptr++;
         opc = extract32(insn, 0, 8);
+#ifdef CONFIG_TCG_INTERPRETER_THREADED
+        goto *qatomic_read(&tci_dispatch[opc]);
+    tci_switch:
+#endif
 
         switch (opc) {
-        case INDEX_op_call:
+        CASE(call)
             /*
              * Set up the ffi_avalue array once, delayed until now
              * because many TB's do not make any calls. In tcg_gen_callN,
@@ -537,51 +580,69 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
             default:
                 g_assert_not_reached();
             }
-            break;
+            TCI_NEXT();
 
-        case INDEX_op_br:
+        CASE(br)
             tci_args_l(insn, tb_ptr, &ptr);
             tb_ptr = ptr;
-            continue;
-        case INDEX_op_setcond_i32:
+            TCI_NEXT();
+        CASE(setcond_i32)
             tci_args_rrrc(insn, &r0, &r1, &r2, &condition);
             regs[r0] = tci_compare32(regs[r1], regs[r2], condition);
-            break;
-        case INDEX_op_movcond_i32:
+            TCI_NEXT();
+        CASE(movcond_i32)
             tci_args_rrrrrc(insn, &r0, &r1, &r2, &r3, &r4, &condition);
             tmp32 = tci_compare32(regs[r1], regs[r2], condition);
             regs[r0] = regs[tmp32 ? r3 : r4];
-            break;
+            TCI_NEXT();
 #if TCG_TARGET_REG_BITS == 32
-        case INDEX_op_setcond2_i32:
+        CASE(setcond2_i32)
             tci_args_rrrrrc(insn, &r0, &r1, &r2, &r3, &r4, &condition);
             T1 = tci_uint64(regs[r2], regs[r1]);
             T2 = tci_uint64(regs[r4], regs[r3]);
             regs[r0] = tci_compare64(T1, T2, condition);
-            break;
+            TCI_NEXT();
 #elif TCG_TARGET_REG_BITS == 64
-        case INDEX_op_setcond_i64:
+        CASE(setcond_i64)
             tci_args_rrrc(insn, &r0, &r1, &r2, &condition);
             regs[r0] = tci_compare64(regs[r1], regs[r2], condition);
-            break;
-        case INDEX_op_movcond_i64:
+            TCI_NEXT();
+        CASE(movcond_i64)
             tci_args_rrrrrc(insn, &r0, &r1, &r2, &r3, &r4, &condition);
             tmp32 = tci_compare64(regs[r1], regs[r2], condition);
             regs[r0] = regs[tmp32 ? r3 : r4];
-            break;
+            TCI_NEXT();
 #endif
         CASE_32_64(mov)
             tci_args_rr(insn, &r0, &r1);
             regs[r0] = regs[r1];
-            break;
-        case INDEX_op_tci_movi:
+            TCI_NEXT();
+        CASE(tci_movi)
             tci_args_ri(insn, &r0, &t1);
             regs[r0] = t1;
-            break;
-        case INDEX_op_tci_movl:
+            TCI_NEXT();
+        CASE(tci_movl)
             tci_args_rl(insn, tb_ptr, &r0, &ptr);
             regs[r0] = *(tcg_target_ulong *)ptr;
-            break;
+            TCI_NEXT();
+        CASE(tci_addi)
+            tci_args_rrs(insn, &r0, &r1, &ofs);
+            regs[r0] = regs[r1] + ofs;
+            TCI_NEXT();
+        CASE(tci_brcond_i32)
+            tci_args_rrcl(insn, tb_ptr++, &r0, &r1, &condition, &ptr);
+            if (tci_compare32(regs[r0], regs[r1], condition)) {
+                tb_ptr = ptr;
+            }
+            TCI_NEXT();
+#if TCG_TARGET_REG_BITS == 64
+        CASE(tci_brcond_i64)
+            tci_args_rrcl(insn, tb_ptr++, &r0, &r1, &condition, &ptr);
+            if (tci_compare64(regs[r0], regs[r1], condition)) {
+                tb_ptr = ptr;
+            }
+            TCI_NEXT();
+#endif
 
             /* Load/store operations (32 bit). */
 
@@ -589,441 +650,441 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
             tci_args_rrs(insn, &r0, &r1, &ofs);
             ptr = (void *)(regs[r1] + ofs);
             regs[r0] = *(uint8_t *)ptr;
-            break;
+            TCI_NEXT();
         CASE_32_64(ld8s)
             tci_args_rrs(insn, &r0, &r1, &ofs);
             ptr = (void *)(regs[r1] + ofs);
             regs[r0] = *(int8_t *)ptr;
-            break;
+            TCI_NEXT();
         CASE_32_64(ld16u)
             tci_args_rrs(insn, &r0, &r1, &ofs);
             ptr = (void *)(regs[r1] + ofs);
             regs[r0] = *(uint16_t *)ptr;
-            break;
+            TCI_NEXT();
         CASE_32_64(ld16s)
             tci_args_rrs(insn, &r0, &r1, &ofs);
             ptr = (void *)(regs[r1] + ofs);
             regs[r0] = *(int16_t *)ptr;
-            break;
-        case INDEX_op_ld_i32:
+            TCI_NEXT();
         CASE_64(ld32u)
+        CASE(ld_i32)
             tci_args_rrs(insn, &r0, &r1, &ofs);
             ptr = (void *)(regs[r1] + ofs);
             regs[r0] = *(uint32_t *)ptr;
-            break;
+            TCI_NEXT();
         CASE_32_64(st8)
             tci_args_rrs(insn, &r0, &r1, &ofs);
             ptr = (void *)(regs[r1] + ofs);
             *(uint8_t *)ptr = regs[r0];
-            break;
+            TCI_NEXT();
         CASE_32_64(st16)
             tci_args_rrs(insn, &r0, &r1, &ofs);
             ptr = (void *)(regs[r1] + ofs);
             *(uint16_t *)ptr = regs[r0];
-            break;
-        case INDEX_op_st_i32:
+            TCI_NEXT();
         CASE_64(st32)
+        CASE(st_i32)
             tci_args_rrs(insn, &r0, &r1, &ofs);
             ptr = (void *)(regs[r1] + ofs);
             *(uint32_t *)ptr = regs[r0];
-            break;
+            TCI_NEXT();
 
             /* Arithmetic operations (mixed 32/64 bit). */
 
         CASE_32_64(add)
             tci_args_rrr(insn, &r0, &r1, &r2);
             regs[r0] = regs[r1] + regs[r2];
-            break;
+            TCI_NEXT();
         CASE_32_64(sub)
             tci_args_rrr(insn, &r0, &r1, &r2);
             regs[r0] = regs[r1] - regs[r2];
-            break;
+            TCI_NEXT();
         CASE_32_64(mul)
             tci_args_rrr(insn, &r0, &r1, &r2);
             regs[r0] = regs[r1] * regs[r2];
-            break;
+            TCI_NEXT();
         CASE_32_64(and)
             tci_args_rrr(insn, &r0, &r1, &r2);
             regs[r0] = regs[r1] & regs[r2];
-            break;
+            TCI_NEXT();
         CASE_32_64(or)
             tci_args_rrr(insn, &r0, &r1, &r2);
             regs[r0] = regs[r1] | regs[r2];
-            break;
+            TCI_NEXT();
         CASE_32_64(xor)
             tci_args_rrr(insn, &r0, &r1, &r2);
             regs[r0] = regs[r1] ^ regs[r2];
-            break;
+            TCI_NEXT();
 #if TCG_TARGET_HAS_andc_i32 || TCG_TARGET_HAS_andc_i64
         CASE_32_64(andc)
             tci_args_rrr(insn, &r0, &r1, &r2);
             regs[r0] = regs[r1] & ~regs[r2];
-            break;
+            TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_orc_i32 || TCG_TARGET_HAS_orc_i64
         CASE_32_64(orc)
             tci_args_rrr(insn, &r0, &r1, &r2);
             regs[r0] = regs[r1] | ~regs[r2];
-            break;
+            TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_eqv_i32 || TCG_TARGET_HAS_eqv_i64
         CASE_32_64(eqv)
             tci_args_rrr(insn, &r0, &r1, &r2);
             regs[r0] = ~(regs[r1] ^ regs[r2]);
-            break;
+            TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_nand_i32 || TCG_TARGET_HAS_nand_i64
         CASE_32_64(nand)
             tci_args_rrr(insn, &r0, &r1, &r2);
             regs[r0] = ~(regs[r1] & regs[r2]);
-            break;
+            TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_nor_i32 || TCG_TARGET_HAS_nor_i64
         CASE_32_64(nor)
             tci_args_rrr(insn, &r0, &r1, &r2);
             regs[r0] = ~(regs[r1] | regs[r2]);
-            break;
+            TCI_NEXT();
 #endif
 
             /* Arithmetic operations (32 bit). */
 
-        case INDEX_op_div_i32:
+        CASE(div_i32)
             tci_args_rrr(insn, &r0, &r1, &r2);
             regs[r0] = (int32_t)regs[r1] / (int32_t)regs[r2];
-            break;
-        case INDEX_op_divu_i32:
+            TCI_NEXT();
+        CASE(divu_i32)
             tci_args_rrr(insn, &r0, &r1, &r2);
             regs[r0] = (uint32_t)regs[r1] / (uint32_t)regs[r2];
-            break;
-        case INDEX_op_rem_i32:
+            TCI_NEXT();
+        CASE(rem_i32)
             tci_args_rrr(insn, &r0, &r1, &r2);
             regs[r0] = (int32_t)regs[r1] % (int32_t)regs[r2];
-            break;
-        case INDEX_op_remu_i32:
+            TCI_NEXT();
+        CASE(remu_i32)
             tci_args_rrr(insn, &r0, &r1, &r2);
             regs[r0] = (uint32_t)regs[r1] % (uint32_t)regs[r2];
-            break;
+            TCI_NEXT();
 #if TCG_TARGET_HAS_clz_i32
-        case INDEX_op_clz_i32:
+        CASE(clz_i32)
             tci_args_rrr(insn, &r0, &r1, &r2);
             tmp32 = regs[r1];
             regs[r0] = tmp32 ? clz32(tmp32) : regs[r2];
-            break;
+            TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_ctz_i32
-        case INDEX_op_ctz_i32:
+        CASE(ctz_i32)
             tci_args_rrr(insn, &r0, &r1, &r2);
             tmp32 = regs[r1];
             regs[r0] = tmp32 ? ctz32(tmp32) : regs[r2];
-            break;
+            TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_ctpop_i32
-        case INDEX_op_ctpop_i32:
+        CASE(ctpop_i32)
             tci_args_rr(insn, &r0, &r1);
             regs[r0] = ctpop32(regs[r1]);
-            break;
+            TCI_NEXT();
 #endif
 
             /* Shift/rotate operations (32 bit). */
 
-        case INDEX_op_shl_i32:
+        CASE(shl_i32)
             tci_args_rrr(insn, &r0, &r1, &r2);
             regs[r0] = (uint32_t)regs[r1] << (regs[r2] & 31);
-            break;
-        case INDEX_op_shr_i32:
+            TCI_NEXT();
+        CASE(shr_i32)
             tci_args_rrr(insn, &r0, &r1, &r2);
             regs[r0] = (uint32_t)regs[r1] >> (regs[r2] & 31);
-            break;
-        case INDEX_op_sar_i32:
+            TCI_NEXT();
+        CASE(sar_i32)
             tci_args_rrr(insn, &r0, &r1, &r2);
             regs[r0] = (int32_t)regs[r1] >> (regs[r2] & 31);
-            break;
+            TCI_NEXT();
 #if TCG_TARGET_HAS_rot_i32
-        case INDEX_op_rotl_i32:
+        CASE(rotl_i32)
             tci_args_rrr(insn, &r0, &r1, &r2);
             regs[r0] = rol32(regs[r1], regs[r2] & 31);
-            break;
-        case INDEX_op_rotr_i32:
+            TCI_NEXT();
+        CASE(rotr_i32)
             tci_args_rrr(insn, &r0, &r1, &r2);
             regs[r0] = ror32(regs[r1], regs[r2] & 31);
-            break;
+            TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_deposit_i32
-        case INDEX_op_deposit_i32:
+        CASE(deposit_i32)
             tci_args_rrrbb(insn, &r0, &r1, &r2, &pos, &len);
             regs[r0] = deposit32(regs[r1], pos, len, regs[r2]);
-            break;
+            TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_extract_i32
-        case INDEX_op_extract_i32:
+        CASE(extract_i32)
             tci_args_rrbb(insn, &r0, &r1, &pos, &len);
             regs[r0] = extract32(regs[r1], pos, len);
-            break;
+            TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_sextract_i32
-        case INDEX_op_sextract_i32:
+        CASE(sextract_i32)
             tci_args_rrbb(insn, &r0, &r1, &pos, &len);
             regs[r0] = sextract32(regs[r1], pos, len);
-            break;
+            TCI_NEXT();
 #endif
-        case INDEX_op_brcond_i32:
+        CASE(brcond_i32)
             tci_args_rl(insn, tb_ptr, &r0, &ptr);
             if ((uint32_t)regs[r0]) {
                 tb_ptr = ptr;
             }
-            break;
+            TCI_NEXT();
 #if TCG_TARGET_REG_BITS == 32 || TCG_TARGET_HAS_add2_i32
-        case INDEX_op_add2_i32:
+        CASE(add2_i32)
             tci_args_rrrrrr(insn, &r0, &r1, &r2, &r3, &r4, &r5);
             T1 = tci_uint64(regs[r3], regs[r2]);
             T2 = tci_uint64(regs[r5], regs[r4]);
             tci_write_reg64(regs, r1, r0, T1 + T2);
-            break;
+            TCI_NEXT();
 #endif
 #if TCG_TARGET_REG_BITS == 32 || TCG_TARGET_HAS_sub2_i32
-        case INDEX_op_sub2_i32:
+        CASE(sub2_i32)
             tci_args_rrrrrr(insn, &r0, &r1, &r2, &r3, &r4, &r5);
             T1 = tci_uint64(regs[r3], regs[r2]);
             T2 = tci_uint64(regs[r5], regs[r4]);
             tci_write_reg64(regs, r1, r0, T1 - T2);
-            break;
+            TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_mulu2_i32
-        case INDEX_op_mulu2_i32:
+        CASE(mulu2_i32)
             tci_args_rrrr(insn, &r0, &r1, &r2, &r3);
             tmp64 = (uint64_t)(uint32_t)regs[r2] * (uint32_t)regs[r3];
             tci_write_reg64(regs, r1, r0, tmp64);
-            break;
+            TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_muls2_i32
-        case INDEX_op_muls2_i32:
+        CASE(muls2_i32)
             tci_args_rrrr(insn, &r0, &r1, &r2, &r3);
             tmp64 = (int64_t)(int32_t)regs[r2] * (int32_t)regs[r3];
             tci_write_reg64(regs, r1, r0, tmp64);
-            break;
+            TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_ext8s_i32 || TCG_TARGET_HAS_ext8s_i64
         CASE_32_64(ext8s)
             tci_args_rr(insn, &r0, &r1);
             regs[r0] = (int8_t)regs[r1];
-            break;
+            TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_ext16s_i32 || TCG_TARGET_HAS_ext16s_i64 || \
     TCG_TARGET_HAS_bswap16_i32 || TCG_TARGET_HAS_bswap16_i64
         CASE_32_64(ext16s)
             tci_args_rr(insn, &r0, &r1);
             regs[r0] = (int16_t)regs[r1];
-            break;
+            TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_ext8u_i32 || TCG_TARGET_HAS_ext8u_i64
         CASE_32_64(ext8u)
             tci_args_rr(insn, &r0, &r1);
             regs[r0] = (uint8_t)regs[r1];
-            break;
+            TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_ext16u_i32 || TCG_TARGET_HAS_ext16u_i64
         CASE_32_64(ext16u)
             tci_args_rr(insn, &r0, &r1);
             regs[r0] = (uint16_t)regs[r1];
-            break;
+            TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_bswap16_i32 || TCG_TARGET_HAS_bswap16_i64
         CASE_32_64(bswap16)
             tci_args_rr(insn, &r0, &r1);
             regs[r0] = bswap16(regs[r1]);
-            break;
+            TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_bswap32_i32 || TCG_TARGET_HAS_bswap32_i64
         CASE_32_64(bswap32)
             tci_args_rr(insn, &r0, &r1);
             regs[r0] = bswap32(regs[r1]);
-            break;
+            TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_not_i32 || TCG_TARGET_HAS_not_i64
         CASE_32_64(not)
             tci_args_rr(insn, &r0, &r1);
             regs[r0] = ~regs[r1];
-            break;
+            TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_neg_i32 || TCG_TARGET_HAS_neg_i64
         CASE_32_64(neg)
             tci_args_rr(insn, &r0, &r1);
             regs[r0] = -regs[r1];
-            break;
+            TCI_NEXT();
 #endif
 #if TCG_TARGET_REG_BITS == 64
             /* Load/store operations (64 bit). */
 
-        case INDEX_op_ld32s_i64:
+        CASE(ld32s_i64)
             tci_args_rrs(insn, &r0, &r1, &ofs);
             ptr = (void *)(regs[r1] + ofs);
             regs[r0] = *(int32_t *)ptr;
-            break;
-        case INDEX_op_ld_i64:
+            TCI_NEXT();
+        CASE(ld_i64)
             tci_args_rrs(insn, &r0, &r1, &ofs);
             ptr = (void *)(regs[r1] + ofs);
             regs[r0] = *(uint64_t *)ptr;
-            break;
-        case INDEX_op_st_i64:
+            TCI_NEXT();
+        CASE(st_i64)
             tci_args_rrs(insn, &r0, &r1, &ofs);
             ptr = (void *)(regs[r1] + ofs);
             *(uint64_t *)ptr = regs[r0];
-            break;
+            TCI_NEXT();
 
             /* Arithmetic operations (64 bit). */
 
-        case INDEX_op_div_i64:
+        CASE(div_i64)
             tci_args_rrr(insn, &r0, &r1, &r2);
             regs[r0] = (int64_t)regs[r1] / (int64_t)regs[r2];
-            break;
-        case INDEX_op_divu_i64:
+            TCI_NEXT();
+        CASE(divu_i64)
             tci_args_rrr(insn, &r0, &r1, &r2);
             regs[r0] = (uint64_t)regs[r1] / (uint64_t)regs[r2];
-            break;
-        case INDEX_op_rem_i64:
+            TCI_NEXT();
+        CASE(rem_i64)
             tci_args_rrr(insn, &r0, &r1, &r2);
             regs[r0] = (int64_t)regs[r1] % (int64_t)regs[r2];
-            break;
-        case INDEX_op_remu_i64:
+            TCI_NEXT();
+        CASE(remu_i64)
             tci_args_rrr(insn, &r0, &r1, &r2);
             regs[r0] = (uint64_t)regs[r1] % (uint64_t)regs[r2];
-            break;
+            TCI_NEXT();
 #if TCG_TARGET_HAS_clz_i64
-        case INDEX_op_clz_i64:
+        CASE(clz_i64)
             tci_args_rrr(insn, &r0, &r1, &r2);
             regs[r0] = regs[r1] ? clz64(regs[r1]) : regs[r2];
-            break;
+            TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_ctz_i64
-        case INDEX_op_ctz_i64:
+        CASE(ctz_i64)
             tci_args_rrr(insn, &r0, &r1, &r2);
             regs[r0] = regs[r1] ? ctz64(regs[r1]) : regs[r2];
-            break;
+            TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_ctpop_i64
-        case INDEX_op_ctpop_i64:
+        CASE(ctpop_i64)
             tci_args_rr(insn, &r0, &r1);
             regs[r0] = ctpop64(regs[r1]);
-            break;
+            TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_mulu2_i64
-        case INDEX_op_mulu2_i64:
+        CASE(mulu2_i64)
             tci_args_rrrr(insn, &r0, &r1, &r2, &r3);
             mulu64(&regs[r0], &regs[r1], regs[r2], regs[r3]);
-            break;
+            TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_muls2_i64
-        case INDEX_op_muls2_i64:
+        CASE(muls2_i64)
             tci_args_rrrr(insn, &r0, &r1, &r2, &r3);
             muls64(&regs[r0], &regs[r1], regs[r2], regs[r3]);
-            break;
+            TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_add2_i64
-        case INDEX_op_add2_i64:
+        CASE(add2_i64)
             tci_args_rrrrrr(insn, &r0, &r1, &r2, &r3, &r4, &r5);
             T1 = regs[r2] + regs[r4];
             T2 = regs[r3] + regs[r5] + (T1 < regs[r2]);
             regs[r0] = T1;
             regs[r1] = T2;
-            break;
+            TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_add2_i64
-        case INDEX_op_sub2_i64:
+        CASE(sub2_i64)
             tci_args_rrrrrr(insn, &r0, &r1, &r2, &r3, &r4, &r5);
             T1 = regs[r2] - regs[r4];
             T2 = regs[r3] - regs[r5] - (regs[r2] < regs[r4]);
             regs[r0] = T1;
             regs[r1] = T2;
-            break;
+            TCI_NEXT();
 #endif
 
             /* Shift/rotate operations (64 bit). */
 
-        case INDEX_op_shl_i64:
+        CASE(shl_i64)
             tci_args_rrr(insn, &r0, &r1, &r2);
             regs[r0] = regs[r1] << (regs[r2] & 63);
-            break;
-        case INDEX_op_shr_i64:
+            TCI_NEXT();
+        CASE(shr_i64)
             tci_args_rrr(insn, &r0, &r1, &r2);
             regs[r0] = regs[r1] >> (regs[r2] & 63);
-            break;
-        case INDEX_op_sar_i64:
+            TCI_NEXT();
+        CASE(sar_i64)
             tci_args_rrr(insn, &r0, &r1, &r2);
             regs[r0] = (int64_t)regs[r1] >> (regs[r2] & 63);
-            break;
+            TCI_NEXT();
 #if TCG_TARGET_HAS_rot_i64
-        case INDEX_op_rotl_i64:
+        CASE(rotl_i64)
             tci_args_rrr(insn, &r0, &r1, &r2);
             regs[r0] = rol64(regs[r1], regs[r2] & 63);
-            break;
-        case INDEX_op_rotr_i64:
+            TCI_NEXT();
+        CASE(rotr_i64)
             tci_args_rrr(insn, &r0, &r1, &r2);
             regs[r0] = ror64(regs[r1], regs[r2] & 63);
-            break;
+            TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_deposit_i64
-        case INDEX_op_deposit_i64:
+        CASE(deposit_i64)
             tci_args_rrrbb(insn, &r0, &r1, &r2, &pos, &len);
             regs[r0] = deposit64(regs[r1], pos, len, regs[r2]);
-            break;
+            TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_extract_i64
-        case INDEX_op_extract_i64:
+        CASE(extract_i64)
             tci_args_rrbb(insn, &r0, &r1, &pos, &len);
             regs[r0] = extract64(regs[r1], pos, len);
-            break;
+            TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_sextract_i64
-        case INDEX_op_sextract_i64:
+        CASE(sextract_i64)
             tci_args_rrbb(insn, &r0, &r1, &pos, &len);
             regs[r0] = sextract64(regs[r1], pos, len);
-            break;
+            TCI_NEXT();
 #endif
-        case INDEX_op_brcond_i64:
+        CASE(brcond_i64)
             tci_args_rl(insn, tb_ptr, &r0, &ptr);
             if (regs[r0]) {
                 tb_ptr = ptr;
             }
-            break;
+            TCI_NEXT();
         case INDEX_op_ext32s_i64:
-        case INDEX_op_ext_i32_i64:
+        CASE(ext_i32_i64)
             tci_args_rr(insn, &r0, &r1);
             regs[r0] = (int32_t)regs[r1];
-            break;
+            TCI_NEXT();
         case INDEX_op_ext32u_i64:
-        case INDEX_op_extu_i32_i64:
+        CASE(extu_i32_i64)
             tci_args_rr(insn, &r0, &r1);
             regs[r0] = (uint32_t)regs[r1];
-            break;
+            TCI_NEXT();
 #if TCG_TARGET_HAS_bswap64_i64
-        case INDEX_op_bswap64_i64:
+        CASE(bswap64_i64)
             tci_args_rr(insn, &r0, &r1);
             regs[r0] = bswap64(regs[r1]);
-            break;
+            TCI_NEXT();
 #endif
 #endif /* TCG_TARGET_REG_BITS == 64 */
 
             /* QEMU specific operations. */
 
-        case INDEX_op_exit_tb:
+        CASE(exit_tb)
             tci_args_l(insn, tb_ptr, &ptr);
             return (uintptr_t)ptr;
 
-        case INDEX_op_goto_tb:
+        CASE(goto_tb)
             tci_args_l(insn, tb_ptr, &ptr);
             tb_ptr = *(void **)ptr;
-            break;
+            TCI_NEXT();
 
-        case INDEX_op_goto_ptr:
+        CASE(goto_ptr)
             tci_args_r(insn, &r0);
             ptr = (void *)regs[r0];
             if (!ptr) {
                 return 0;
             }
             tb_ptr = ptr;
-            break;
+            TCI_NEXT();
 
-        case INDEX_op_qemu_ld_i32:
+        CASE(qemu_ld_i32)
             if (TARGET_LONG_BITS <= TCG_TARGET_REG_BITS) {
                 tci_args_rrm(insn, &r0, &r1, &oi);
                 taddr = regs[r1];
@@ -1033,9 +1094,9 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
             }
             tmp32 = tci_qemu_ld(env, taddr, oi, tb_ptr);
             regs[r0] = tmp32;
-            break;
+            TCI_NEXT();
 
-        case INDEX_op_qemu_ld_i64:
+        CASE(qemu_ld_i64)
             if (TCG_TARGET_REG_BITS == 64) {
                 tci_args_rrm(insn, &r0, &r1, &oi);
                 taddr = regs[r1];
@@ -1053,9 +1114,9 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
             } else {
                 regs[r0] = tmp64;
             }
-            break;
+            TCI_NEXT();
 
-        case INDEX_op_qemu_st_i32:
+        CASE(qemu_st_i32)
             if (TARGET_LONG_BITS <= TCG_TARGET_REG_BITS) {
                 tci_args_rrm(insn, &r0, &r1, &oi);
                 taddr = regs[r1];
@@ -1065,9 +1126,9 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
             }
             tmp32 = regs[r0];
             tci_qemu_st(env, taddr, tmp32, oi, tb_ptr);
-            break;
+            TCI_NEXT();
 
-        case INDEX_op_qemu_st_i64:
+        CASE(qemu_st_i64)
             if (TCG_TARGET_REG_BITS == 64) {
                 tci_args_rrm(insn, &r0, &r1, &oi);
                 taddr = regs[r1];
@@ -1084,12 +1145,12 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
                 tmp64 = tci_uint64(regs[r1], regs[r0]);
             }
             tci_qemu_st(env, taddr, tmp64, oi, tb_ptr);
-            break;
+            TCI_NEXT();
 
-        case INDEX_op_mb:
+        CASE(mb)
             /* Ensure ordering for all kinds */
             smp_mb();
-            break;
+            TCI_NEXT();
         default:
             g_assert_not_reached();
         }
@@ -1186,6 +1247,13 @@ int print_insn_tci(bfd_vma addr, disassemble_info *info)
                            op_name, str_r(r0), ptr);
         break;
 
+    case INDEX_op_tci_brcond_i32:
+    case INDEX_op_tci_brcond_i64:
+        tci_args_rrcl(insn, tb_ptr, &r0, &r1, &c, &ptr);
+        info->fprintf_func(info->stream, "%-12s  %s, %s, %s, %p",
+                           op_name, str_r(r0), str_r(r1), str_c(c), ptr);
+        return 2 * sizeof(insn);
+
     case INDEX_op_setcond_i32:
     case INDEX_op_setcond_i64:
         tci_args_rrrc(insn, &r0, &r1, &r2, &c);
@@ -1224,6 +1292,7 @@ int print_insn_tci(bfd_vma addr, disassemble_info *info)
     case INDEX_op_st32_i64:
     case INDEX_op_st_i32:
     case INDEX_op_st_i64:
+    case INDEX_op_tci_addi:
         tci_args_rrs(insn, &r0, &r1, &s2);
         info->fprintf_func(info->stream, "%-12s  %s, %s, %d",
                            op_name, str_r(r0), str_r(r1), s2);
@@ -0,0 +1,311 @@
+/*
+ * Multifd compression speed benchmark
+ *
+ * Compresses a guest memory image in multifd sized packets, the way the
+ * multifd compression methods do it on one channel, and reports the
+ * throughput of a single core and the compression ratio.
+ *
+ * The image is synthetic by default.  A raw dump of real guest memory
+ * can be used instead by pointing QEMU_BENCH_GUEST_MEMORY at it, e.g.
+ * the output of "dump-guest-memory -z" decompressed, or a file-backed
+ * memory-backend of a running guest.  Zero pages are left out of the
+ * image, as migration never hands them to the compression methods.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/cutils.h"
+#include "qemu/units.h"
+#include <zlib.h>
+#ifdef CONFIG_ZSTD
+#include <zstd.h>
+#endif
+#ifdef CONFIG_LZ4
+#include <lz4.h>
+#endif
+
+#define BENCH_PAGE_SIZE     4096
+/* Same as MULTIFD_PACKET_SIZE */
+#define BENCH_PACKET_SIZE   (512 * KiB)
+#define BENCH_IMAGE_SIZE    (64 * MiB)
+#define BENCH_ROUNDS        8
+
+typedef struct CompressOpts {
+    const char *name;
+    void *(*init)(int level);
+    size_t (*compress)(void *state, uint8_t *in, size_t in_len,
+                       uint8_t *out, size_t out_len);
+    void (*fini)(void *state);
+    int level;
+} CompressOpts;
+
+static uint8_t *image;
+static size_t image_size;
+
+static void fill_text_page(uint8_t *page)
+{
+    static const char *words[] = {
+        "the ", "of ", "kernel ", "memory ", "page ", "struct ", "return ",
+        "if ", "while ", "int ", "0x", "error ", "\n", "\t", "= ", "; ",
+    };
+    size_t pos = 0;
+
+    while (pos < BENCH_PAGE_SIZE) {
+        const char *w = words[g_test_rand_int_range(0, ARRAY_SIZE(words))];
+        size_t len = MIN(strlen(w), BENCH_PAGE_SIZE - pos);
+
+        memcpy(page + pos, w, len);
+        pos += len;
+    }
+}
+
+static void fill_struct_page(uint8_t *page)
+{
+    /* 64 byte objects: a couple of pointers, counters, flags, padding */
+    uint64_t base = 0xffff888000000000ULL +
+                    ((uint64_t)g_test_rand_int() << 12);
+    uint64_t *obj = (uint64_t *)page;
+    size_t i;
+
+    for (i = 0; i < BENCH_PAGE_SIZE / 64; i++, obj += 8) {
+        obj[0] = base + g_test_rand_int_range(0, 1 << 20) * 64;
+        obj[1] = base + g_test_rand_int_range(0, 1 << 20) * 64;
+        obj[2] = g_test_rand_int_range(0, 16);
+        obj[3] = g_test_rand_int_range(0, 4) << 8;
+        obj[4] = i;
+    }
+}
+
+static void fill_partial_page(uint8_t *page)
+{
+    size_t used = g_test_rand_int_range(64, BENCH_PAGE_SIZE / 2);
+
+    fill_struct_page(page);
+    memset(page + used, 0, BENCH_PAGE_SIZE - used);
+}
+
+static void fill_random_page(uint8_t *page)
+{
+    uint32_t *p = (uint32_t *)page;
+    size_t i;
+
+    for (i = 0; i < BENCH_PAGE_SIZE / sizeof(*p); i++) {
+        p[i] = g_test_rand_int();
+    }
+}
+
+static void image_synthetic(void)
+{
+    size_t i;
+
+    image_size = BENCH_IMAGE_SIZE;
+    image = g_malloc(image_size);
+
+    for (i = 0; i < image_size; i += BENCH_PAGE_SIZE) {
+        int kind = g_test_rand_int_range(0, 100);
+
+        if (kind < 30) {
+            fill_text_page(image + i);
+        } else if (kind < 60) {
+            fill_struct_page(image + i);
+        } else if (kind < 80) {
+            fill_partial_page(image + i);
+        } else {
+            /* already compressed or encrypted data */
+            fill_random_page(image + i);
+        }
+    }
+}
+
+static bool image_load(const char *path)
+{
+    g_autoptr(GError) err = NULL;
+    gchar *contents;
+    gsize len, i;
+
+    if (!g_file_get_contents(path, &contents, &len, &err)) {
+        g_test_message("cannot read %s: %s", path, err->message);
+        return false;
+    }
+
+    image = g_malloc(len);
+    image_size = 0;
+    for (i = 0; i + BENCH_PAGE_SIZE <= len; i += BENCH_PAGE_SIZE) {
+        if (!buffer_is_zero(contents + i, BENCH_PAGE_SIZE)) {
+            memcpy(image + image_size, contents + i, BENCH_PAGE_SIZE);
+            image_size += BENCH_PAGE_SIZE;
+        }
+    }
+    g_free(contents);
+
+    /* whole packets only */
+    image_size = QEMU_ALIGN_DOWN(image_size, BENCH_PACKET_SIZE);
+    if (!image_size) {
+        g_test_message("%s has less than one packet of non-zero pages", path);
+        g_free(image);
+        return false;
+    }
+    return true;
+}
+
+static void *zlib_init(int level)
+{
+    z_stream *zs = g_new0(z_stream, 1);
+
+    g_assert(deflateInit(zs, level) == Z_OK);
+    return zs;
+}
+
+static size_t zlib_compress(void *state, uint8_t *in, size_t in_len,
+                            uint8_t *out, size_t out_len)
+{
+    z_stream *zs = state;
+
+    zs->next_in = in;
+    zs->avail_in = in_len;
+    zs->next_out = out;
+    zs->avail_out = out_len;
+    g_assert(deflate(zs, Z_SYNC_FLUSH) == Z_OK);
+    g_assert(zs->avail_in == 0);
+    return out_len - zs->avail_out;
+}
+
+static void zlib_fini(void *state)
+{
+    deflateEnd(state);
+    g_free(state);
+}
+
+#ifdef CONFIG_ZSTD
+static void *zstd_init(int level)
+{
+    ZSTD_CStream *zcs = ZSTD_createCStream();
+
+    g_assert(!ZSTD_isError(ZSTD_initCStream(zcs, level)));
+    return zcs;
+}
+
+static size_t zstd_compress(void *state, uint8_t *in, size_t in_len,
+                            uint8_t *out, size_t out_len)
+{
+    ZSTD_inBuffer zin = { in, in_len, 0 };
+    ZSTD_outBuffer zout = { out, out_len, 0 };
+    size_t ret;
+
+    do {
+        ret = ZSTD_compressStream2(state, &zout, &zin, ZSTD_e_flush);
+        g_assert(!ZSTD_isError(ret));
+    } while (ret > 0);
+    return zout.pos;
+}
+
+static void zstd_fini(void *state)
+{
+    ZSTD_freeCStream(state);
+}
+#endif
+
+#ifdef CONFIG_LZ4
+typedef struct LZ4State {
+    LZ4_stream_t *stream;
+    uint8_t *buf;
+    char dict[64 * KiB];
+} LZ4State;
+
+static void *lz4_init(int level)
+{
+    LZ4State *s = g_new0(LZ4State, 1);
+
+    s->stream = LZ4_createStream();
+    s->buf = g_malloc(BENCH_PACKET_SIZE);
+    return s;
+}
+
+static size_t lz4_compress(void *state, uint8_t *in, size_t in_len,
+                           uint8_t *out, size_t out_len)
+{
+    LZ4State *s = state;
+    int ret;
+
+    /* multifd-lz4 copies the pages out of guest memory first */
+    memcpy(s->buf, in, in_len);
+    ret = LZ4_compress_fast_continue(s->stream, (char *)s->buf, (char *)out,
+                                     in_len, out_len, 1);
+    g_assert(ret > 0);
+    LZ4_saveDict(s->stream, s->dict, sizeof(s->dict));
+    return ret;
+}
+
+static void lz4_fini(void *state)
+{
+    LZ4State *s = state;
+
+    LZ4_freeStream(s->stream);
+    g_free(s->buf);
+    g_free(s);
+}
+#endif
+
+static void test_compress_speed(const void *opaque)
+{
+    const CompressOpts *opts = opaque;
+    size_t out_len = BENCH_PACKET_SIZE * 2;
+    uint8_t *out = g_malloc(out_len);
+    uint64_t in_total = 0, out_total = 0;
+    void *state = opts->init(opts->level);
+    size_t off;
+    int i;
+
+    g_test_timer_start();
+    for (i = 0; i < BENCH_ROUNDS; i++) {
+        for (off = 0; off < image_size; off += BENCH_PACKET_SIZE) {
+            out_total += opts->compress(state, image + off, BENCH_PACKET_SIZE,
+                                        out, out_len);
+            in_total += BENCH_PACKET_SIZE;
+        }
+    }
+    g_test_timer_elapsed();
+
+    g_test_message("compress(%s): %.2f GB/s per core, ratio %.2f",
+                   opts->name, in_total / g_test_timer_last() / GiB,
+                   (double)in_total / out_total);
+
+    opts->fini(state);
+    g_free(out);
+}
+
+int main(int argc, char **argv)
+{
+    static const CompressOpts opts[] = {
+        { "zlib-1", zlib_init, zlib_compress, zlib_fini, 1 },
+#ifdef CONFIG_ZSTD
+        { "zstd-1", zstd_init, zstd_compress, zstd_fini, 1 },
+        { "zstd-fast-5", zstd_init, zstd_compress, zstd_fini, -5 },
+#endif
+#ifdef CONFIG_LZ4
+        { "lz4", lz4_init, lz4_compress, lz4_fini, 0 },
+#endif
+    };
+    const char *path = getenv("QEMU_BENCH_GUEST_MEMORY");
+    char name[64];
+    int i, ret;
+
+    g_test_init(&argc, &argv, NULL);
+
+    if (!path || !image_load(path)) {
+        image_synthetic();
+    }
+
+    for (i = 0; i < ARRAY_SIZE(opts); i++) {
+        snprintf(name, sizeof(name), "/multifd/compress/%s", opts[i].name);
+        g_test_add_data_func(name, &opts[i], test_compress_speed);
+    }
+
+    ret = g_test_run();
+
+    g_free(image);
+    return ret;
+}
@@ -0,0 +1,171 @@
+/*
+ * Net queue benchmark
+ *
+ * Drives a NetQueue the way a backend drives the queue of a peer that
+ * applies backpressure, e.g. a virtio-net device whose receive ring
+ * holds a limited number of buffers: a burst of packets arrives, the
+ * peer takes what fits, the rest is queued, and the queue is flushed
+ * each time the peer has room again.  Reports packets per second for a
+ * single queue, and for a hub that fans every packet out to several
+ * blocked ports.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "net/net.h"
+#include "net/queue.h"
+#include "qemu/iov.h"
+
+#define BENCH_PACKETS       (4 * 1000 * 1000)
+/* Buffers the peer makes available each time it is refilled */
+#define BENCH_RING_SIZE     256
+#define BENCH_HUB_PORTS     4
+/* Packets that arrive while the peer is busy */
+#define BENCH_BURST         1024
+
+typedef struct BenchPeer {
+    NetQueue *queue;
+    unsigned budget;
+    uint64_t delivered;
+    uint64_t bytes;
+} BenchPeer;
+
+static NetClientState bench_sender;
+
+/* net/queue.c asks whether the sender may send; it always may here */
+int qemu_can_send_packet(NetClientState *nc)
+{
+    return 1;
+}
+
+static ssize_t bench_deliver(NetClientState *sender, unsigned flags,
+                             const struct iovec *iov, int iovcnt,
+                             void *opaque)
+{
+    BenchPeer *peer = opaque;
+    size_t size = iov_size(iov, iovcnt);
+
+    if (!peer->budget) {
+        return 0;
+    }
+    peer->budget--;
+    peer->delivered++;
+    peer->bytes += size;
+    return size;
+}
+
+static void bench_report(const char *name, size_t size, uint64_t packets)
+{
+    double elapsed = g_test_timer_elapsed();
+
+    g_test_message("%s, %zu byte packets: %.2f Mpps, %.2f Gbit/s",
+                   name, size, packets / elapsed / 1e6,
+                   packets * size * 8 / elapsed / 1e9);
+}
+
+static void test_queue_backpressure(const void *opaque)
+{
+    size_t size = GPOINTER_TO_SIZE(opaque);
+    uint8_t *buf = g_malloc0(size);
+    struct iovec iov = { .iov_base = buf, .iov_len = size };
+    BenchPeer peer = { 0 };
+    uint64_t sent = 0;
+
+    peer.queue = qemu_new_net_queue(bench_deliver, &peer);
+
+    g_test_timer_start();
+    while (sent < BENCH_PACKETS) {
+        unsigned burst;
+
+        /* A burst arrives, the peer takes what fits and the rest queues */
+        for (burst = 0; burst < BENCH_BURST; burst++) {
+            buf[0] = sent++;
+            qemu_net_queue_send_iov(peer.queue, &bench_sender, 0,
+                                    &iov, 1, NULL);
+        }
+
+        /* The peer makes room a ring at a time until the queue drains */
+        do {
+            peer.budget = BENCH_RING_SIZE;
+        } while (!qemu_net_queue_flush(peer.queue));
+    }
+    bench_report("queue", size, sent);
+
+    g_assert_cmpuint(peer.delivered, ==, sent);
+    g_assert_cmpuint(peer.bytes, ==, sent * size);
+
+    qemu_del_net_queue(peer.queue);
+    g_free(buf);
+}
+
+static void test_hub_fanout(const void *opaque)
+{
+    size_t size = GPOINTER_TO_SIZE(opaque);
+    uint8_t *buf = g_malloc0(size);
+    struct iovec iov = { .iov_base = buf, .iov_len = size };
+    BenchPeer peers[BENCH_HUB_PORTS] = { 0 };
+    uint64_t sent = 0;
+    int i;
+
+    for (i = 0; i < BENCH_HUB_PORTS; i++) {
+        peers[i].queue = qemu_new_net_queue(bench_deliver, &peers[i]);
+    }
+
+    g_test_timer_start();
+    while (sent < BENCH_PACKETS / BENCH_HUB_PORTS) {
+        unsigned burst;
+
+        /* Like net_hub_receive_iov() with all ports blocked */
+        for (burst = 0; burst < BENCH_RING_SIZE; burst++) {
+            NetPacketScope scope;
+
+            buf[0] = sent++;
+            qemu_net_packet_scope_begin(&scope, &iov, 1, NULL);
+            for (i = 0; i < BENCH_HUB_PORTS; i++) {
+                qemu_net_queue_send_iov(peers[i].queue, &bench_sender, 0,
+                                        &iov, 1, NULL);
+            }
+            qemu_net_packet_scope_end(&scope);
+        }
+
+        for (i = 0; i < BENCH_HUB_PORTS; i++) {
+            peers[i].budget = BENCH_RING_SIZE;
+            qemu_net_queue_flush(peers[i].queue);
+        }
+    }
+    bench_report("hub", size, sent * BENCH_HUB_PORTS);
+
+    for (i = 0; i < BENCH_HUB_PORTS; i++) {
+        g_assert_cmpuint(peers[i].delivered, ==, sent);
+        g_assert_cmpuint(peers[i].bytes, ==, sent * size);
+        qemu_del_net_queue(peers[i].queue);
+    }
+    g_free(buf);
+}
+
+int main(int argc, char **argv)
+{
+    static const size_t sizes[] = { 64, 1514, 65536 };
+    int i;
+
+    g_test_init(&argc, &argv, NULL);
+
+    for (i = 0; i < ARRAY_SIZE(sizes); i++) {
+        char *name;
+
+        name = g_strdup_printf("/net/queue/backpressure/%zu", sizes[i]);
+        g_test_add_data_func(name, GSIZE_TO_POINTER(sizes[i]),
+                             test_queue_backpressure);
+        g_free(name);
+
+        name = g_strdup_printf("/net/queue/hub/%zu", sizes[i]);
+        g_test_add_data_func(name, GSIZE_TO_POINTER(sizes[i]),
+                             test_hub_fanout);
+        g_free(name);
+    }
+
+    return g_test_run();
+}
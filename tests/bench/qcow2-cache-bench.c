@@ -0,0 +1,93 @@
+/*
+ * QCOW2 metadata cache lookup benchmark
+ *
+ * Measures the latency of the cache hit path (get + put of a table that is
+ * already cached) for increasing cache sizes. With an indexed cache the
+ * latency is expected to stay flat as the number of cached tables grows.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qemu/main-loop.h"
+#include "qemu/units.h"
+#include "block/block_int.h"
+#include "block/qcow2.h"
+
+#define TABLE_SIZE  4096
+#define ITERATIONS  (4 * 1024 * 1024)
+
+static char img_path[] = "/tmp/qcow2-cache-bench.XXXXXX";
+static BlockDriverState *bench_bs;
+
+static void test_cache_hit(const void *opaque)
+{
+    int num_tables = GPOINTER_TO_INT(opaque);
+    Qcow2Cache *c;
+    uint64_t *offsets;
+    void *table;
+    double elapsed;
+    int i, ret;
+
+    c = qcow2_cache_create(bench_bs, num_tables, TABLE_SIZE);
+    g_assert(c);
+
+    /* Populate the whole cache; the tables are never read from disk */
+    offsets = g_new(uint64_t, num_tables);
+    for (i = 0; i < num_tables; i++) {
+        offsets[i] = (uint64_t)(i + 1) * TABLE_SIZE;
+        ret = qcow2_cache_get_empty(bench_bs, c, offsets[i], &table);
+        g_assert(ret == 0);
+        qcow2_cache_put(c, &table);
+    }
+
+    g_test_timer_start();
+    for (i = 0; i < ITERATIONS; i++) {
+        uint64_t offset = offsets[g_test_rand_int_range(0, num_tables)];
+
+        ret = qcow2_cache_get_empty(bench_bs, c, offset, &table);
+        g_assert(ret == 0);
+        qcow2_cache_put(c, &table);
+    }
+    elapsed = g_test_timer_elapsed();
+
+    g_test_message("qcow2 cache hit: %d tables %.2f ns/lookup",
+                   num_tables, elapsed * 1e9 / ITERATIONS);
+
+    g_free(offsets);
+    qcow2_cache_destroy(c);
+}
+
+int main(int argc, char **argv)
+{
+    static const int sizes[] = { 16, 256, 4096, 65536 };
+    char name[64];
+    int fd;
+    int i;
+
+    g_test_init(&argc, &argv, NULL);
+    bdrv_init();
+    qemu_init_main_loop(&error_abort);
+
+    fd = mkstemp(img_path);
+    g_assert(fd >= 0);
+    close(fd);
+
+    bdrv_img_create(img_path, "qcow2", NULL, NULL, NULL, 1 * GiB,
+                    BDRV_O_RDWR, true, &error_abort);
+    bench_bs = bdrv_open(img_path, NULL, NULL, BDRV_O_RDWR, &error_abort);
+
+    for (i = 0; i < ARRAY_SIZE(sizes); i++) {
+        snprintf(name, sizeof(name), "/qcow2/cache/hit/tables-%d", sizes[i]);
+        g_test_add_data_func(name, GINT_TO_POINTER(sizes[i]), test_cache_hit);
+    }
+
+    i = g_test_run();
+
+    bdrv_unref(bench_bs);
+    unlink(img_path);
+    return i;
+}
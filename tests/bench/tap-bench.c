@@ -0,0 +1,323 @@
+/*
+ * TAP packet rate benchmark
+ *
+ * Compares the two ways the tap backend moves packets: one read() or
+ * writev() per packet, and batches of requests submitted through io_uring
+ * on the non-blocking fd, as with io-uring=on.  A thread transmits frames
+ * on the TAP interface through an AF_PACKET socket, which makes them
+ * readable on the TAP fd; frames written to the TAP fd are received and
+ * dropped by the host stack.  Reports packets per second.
+ *
+ * Needs CAP_NET_ADMIN to create the TAP interface, the tests are skipped
+ * otherwise.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/thread.h"
+#include <liburing.h>
+#include <net/if.h>
+#include <linux/if_tun.h>
+#include <linux/if_packet.h>
+#include <net/ethernet.h>
+#include <poll.h>
+
+#define BENCH_SECONDS       2
+#define BENCH_BUFSIZE       2048
+#define BENCH_BATCH         32
+#define BENCH_SEND_BURST    64
+
+typedef struct BenchTap {
+    int fd;
+    int pkt_fd;
+    char ifname[IFNAMSIZ];
+    size_t size;
+    bool stop;
+    QemuThread sender;
+} BenchTap;
+
+static bool bench_tap_open(BenchTap *t, size_t size)
+{
+    struct ifreq ifr = { 0 };
+    struct sockaddr_ll sll = { 0 };
+    int sock;
+
+    t->size = size;
+    t->fd = open("/dev/net/tun", O_RDWR | O_NONBLOCK);
+    if (t->fd < 0) {
+        return false;
+    }
+
+    ifr.ifr_flags = IFF_TAP | IFF_NO_PI;
+    pstrcpy(ifr.ifr_name, IFNAMSIZ, "qbench%d");
+    if (ioctl(t->fd, TUNSETIFF, &ifr) < 0) {
+        close(t->fd);
+        return false;
+    }
+    pstrcpy(t->ifname, IFNAMSIZ, ifr.ifr_name);
+
+    sock = socket(AF_INET, SOCK_DGRAM, 0);
+    g_assert(sock >= 0);
+    g_assert(ioctl(sock, SIOCGIFFLAGS, &ifr) == 0);
+    ifr.ifr_flags |= IFF_UP;
+    g_assert(ioctl(sock, SIOCSIFFLAGS, &ifr) == 0);
+    g_assert(ioctl(sock, SIOCGIFINDEX, &ifr) == 0);
+    close(sock);
+
+    t->pkt_fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+    g_assert(t->pkt_fd >= 0);
+    sll.sll_family = AF_PACKET;
+    sll.sll_protocol = htons(ETH_P_ALL);
+    sll.sll_ifindex = ifr.ifr_ifindex;
+    g_assert(bind(t->pkt_fd, (struct sockaddr *)&sll, sizeof(sll)) == 0);
+    return true;
+}
+
+static void bench_tap_close(BenchTap *t)
+{
+    close(t->pkt_fd);
+    close(t->fd);
+}
+
+/* A broadcast frame with a local ethertype, so the host ignores it */
+static void bench_fill_frame(uint8_t *buf, size_t size)
+{
+    memset(buf, 0, size);
+    memset(buf, 0xff, ETH_ALEN);
+    buf[ETH_ALEN] = 0x02;
+    buf[12] = 0x88;
+    buf[13] = 0xb5;
+}
+
+static void *bench_sender_thread(void *opaque)
+{
+    BenchTap *t = opaque;
+    uint8_t buf[BENCH_BUFSIZE];
+    struct iovec iov = { .iov_base = buf, .iov_len = t->size };
+    struct mmsghdr msgs[BENCH_SEND_BURST];
+    int i;
+
+    bench_fill_frame(buf, t->size);
+    memset(msgs, 0, sizeof(msgs));
+    for (i = 0; i < BENCH_SEND_BURST; i++) {
+        msgs[i].msg_hdr.msg_iov = &iov;
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    while (!qatomic_read(&t->stop)) {
+        sendmmsg(t->pkt_fd, msgs, BENCH_SEND_BURST, 0);
+    }
+    return NULL;
+}
+
+static void bench_sender_start(BenchTap *t)
+{
+    t->stop = false;
+    qemu_thread_create(&t->sender, "tap-bench-sender", bench_sender_thread,
+                       t, QEMU_THREAD_JOINABLE);
+}
+
+static void bench_sender_stop(BenchTap *t)
+{
+    qatomic_set(&t->stop, true);
+    qemu_thread_join(&t->sender);
+}
+
+static void bench_wait_fd(int fd, short events)
+{
+    struct pollfd pfd = { .fd = fd, .events = events };
+
+    poll(&pfd, 1, 100);
+}
+
+static void bench_report(const char *name, size_t size, uint64_t packets)
+{
+    double elapsed = g_test_timer_elapsed();
+
+    g_test_message("%s, %zu byte packets: %.3f Mpps", name, size,
+                   packets / elapsed / 1e6);
+}
+
+/* Like tap_send(): read until the fd is empty, then wait for it */
+static void test_rx_read(const void *opaque)
+{
+    size_t size = GPOINTER_TO_SIZE(opaque);
+    uint8_t buf[BENCH_BUFSIZE];
+    uint64_t packets = 0;
+    BenchTap t;
+
+    if (!bench_tap_open(&t, size)) {
+        g_test_skip("cannot create a TAP interface");
+        return;
+    }
+
+    bench_sender_start(&t);
+    g_test_timer_start();
+    while (g_test_timer_elapsed() < BENCH_SECONDS) {
+        if (read(t.fd, buf, sizeof(buf)) > 0) {
+            packets++;
+        } else {
+            bench_wait_fd(t.fd, POLLIN);
+        }
+    }
+    bench_report("read", size, packets);
+    bench_sender_stop(&t);
+    bench_tap_close(&t);
+}
+
+/* Like tap_uring_send(): a batch of reads per readable notification */
+static void test_rx_uring(const void *opaque)
+{
+    size_t size = GPOINTER_TO_SIZE(opaque);
+    uint8_t (*bufs)[BENCH_BUFSIZE] = g_malloc(BENCH_BATCH * BENCH_BUFSIZE);
+    struct io_uring ring;
+    struct io_uring_cqe *cqe;
+    uint64_t packets = 0;
+    BenchTap t;
+    int i;
+
+    if (!bench_tap_open(&t, size)) {
+        g_test_skip("cannot create a TAP interface");
+        g_free(bufs);
+        return;
+    }
+    g_assert(io_uring_queue_init(BENCH_BATCH, &ring, 0) == 0);
+
+    bench_sender_start(&t);
+    g_test_timer_start();
+    while (g_test_timer_elapsed() < BENCH_SECONDS) {
+        int empty = 0;
+
+        for (i = 0; i < BENCH_BATCH; i++) {
+            struct io_uring_sqe *sqe = io_uring_get_sqe(&ring);
+
+            io_uring_prep_read(sqe, t.fd, bufs[i], BENCH_BUFSIZE, 0);
+        }
+        io_uring_submit_and_wait(&ring, BENCH_BATCH);
+        for (i = 0; i < BENCH_BATCH; i++) {
+            g_assert(io_uring_peek_cqe(&ring, &cqe) == 0);
+            if (cqe->res > 0) {
+                packets++;
+            } else {
+                empty++;
+            }
+            io_uring_cqe_seen(&ring, cqe);
+        }
+        if (empty == BENCH_BATCH) {
+            bench_wait_fd(t.fd, POLLIN);
+        }
+    }
+    bench_report("io_uring read", size, packets);
+    bench_sender_stop(&t);
+
+    io_uring_queue_exit(&ring);
+    bench_tap_close(&t);
+    g_free(bufs);
+}
+
+/* Like tap_write_packet() without io-uring */
+static void test_tx_writev(const void *opaque)
+{
+    size_t size = GPOINTER_TO_SIZE(opaque);
+    uint8_t buf[BENCH_BUFSIZE];
+    struct iovec iov = { .iov_base = buf, .iov_len = size };
+    uint64_t packets = 0;
+    BenchTap t;
+
+    if (!bench_tap_open(&t, size)) {
+        g_test_skip("cannot create a TAP interface");
+        return;
+    }
+
+    bench_fill_frame(buf, size);
+    g_test_timer_start();
+    while (g_test_timer_elapsed() < BENCH_SECONDS) {
+        if (writev(t.fd, &iov, 1) > 0) {
+            packets++;
+        } else {
+            bench_wait_fd(t.fd, POLLOUT);
+        }
+    }
+    bench_report("writev", size, packets);
+    bench_tap_close(&t);
+}
+
+/* Like tap_uring_write_packet(): a burst of writes per submission */
+static void test_tx_uring(const void *opaque)
+{
+    size_t size = GPOINTER_TO_SIZE(opaque);
+    uint8_t buf[BENCH_BUFSIZE];
+    struct io_uring ring;
+    struct io_uring_cqe *cqe;
+    uint64_t packets = 0;
+    BenchTap t;
+    int i;
+
+    if (!bench_tap_open(&t, size)) {
+        g_test_skip("cannot create a TAP interface");
+        return;
+    }
+    g_assert(io_uring_queue_init(BENCH_BATCH, &ring, 0) == 0);
+
+    bench_fill_frame(buf, size);
+    g_test_timer_start();
+    while (g_test_timer_elapsed() < BENCH_SECONDS) {
+        int failed = 0;
+
+        for (i = 0; i < BENCH_BATCH; i++) {
+            struct io_uring_sqe *sqe = io_uring_get_sqe(&ring);
+
+            io_uring_prep_write(sqe, t.fd, buf, size, 0);
+        }
+        io_uring_submit_and_wait(&ring, BENCH_BATCH);
+        for (i = 0; i < BENCH_BATCH; i++) {
+            g_assert(io_uring_peek_cqe(&ring, &cqe) == 0);
+            if (cqe->res > 0) {
+                packets++;
+            } else {
+                failed++;
+            }
+            io_uring_cqe_seen(&ring, cqe);
+        }
+        if (failed) {
+            bench_wait_fd(t.fd, POLLOUT);
+        }
+    }
+    bench_report("io_uring write", size, packets);
+
+    io_uring_queue_exit(&ring);
+    bench_tap_close(&t);
+}
+
+int main(int argc, char **argv)
+{
+    static const size_t sizes[] = { 64, 1514 };
+    int i;
+
+    g_test_init(&argc, &argv, NULL);
+
+    for (i = 0; i < ARRAY_SIZE(sizes); i++) {
+        char *name;
+
+        name = g_strdup_printf("/net/tap/rx/read/%zu", sizes[i]);
+        g_test_add_data_func(name, GSIZE_TO_POINTER(sizes[i]), test_rx_read);
+        g_free(name);
+
+        name = g_strdup_printf("/net/tap/rx/io_uring/%zu", sizes[i]);
+        g_test_add_data_func(name, GSIZE_TO_POINTER(sizes[i]), test_rx_uring);
+        g_free(name);
+
+        name = g_strdup_printf("/net/tap/tx/writev/%zu", sizes[i]);
+        g_test_add_data_func(name, GSIZE_TO_POINTER(sizes[i]), test_tx_writev);
+        g_free(name);
+
+        name = g_strdup_printf("/net/tap/tx/io_uring/%zu", sizes[i]);
+        g_test_add_data_func(name, GSIZE_TO_POINTER(sizes[i]), test_tx_uring);
+        g_free(name);
+    }
+
+    return g_test_run();
+}
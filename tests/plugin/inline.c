@@ -0,0 +1,200 @@
+/*
+ * Copyright (C) 2021, The QEMU Project Developers
+ *
+ * Check that per-vCPU inline operations and conditional callbacks agree
+ * with the equivalent regular callbacks.
+ *
+ * License: GNU GPL, version 2 or later.
+ *   See the COPYING file in the top-level directory.
+ */
+#include <inttypes.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib.h>
+
+#include <qemu-plugin.h>
+
+QEMU_PLUGIN_EXPORT int qemu_plugin_version = QEMU_PLUGIN_VERSION;
+
+#define COND_PERIOD 100
+
+typedef struct {
+    uint64_t count_tb;
+    uint64_t count_tb_inline;
+    uint64_t count_insn;
+    uint64_t count_insn_inline;
+    uint64_t count_mem;
+    uint64_t count_mem_inline;
+    uint64_t tb_cond_track;
+    uint64_t tb_cond_trigger;
+    uint64_t insn_mark;
+} CPUCount;
+
+static struct qemu_plugin_scoreboard *counts;
+static qemu_plugin_u64 count_tb;
+static qemu_plugin_u64 count_tb_inline;
+static qemu_plugin_u64 count_insn;
+static qemu_plugin_u64 count_insn_inline;
+static qemu_plugin_u64 count_mem;
+static qemu_plugin_u64 count_mem_inline;
+static qemu_plugin_u64 tb_cond_track;
+static qemu_plugin_u64 tb_cond_trigger;
+static qemu_plugin_u64 insn_mark;
+
+/* legacy inline ops on a global counter, only exact with one vCPU */
+static uint64_t global_count_tb_inline;
+
+static void stats_insn(GString *report)
+{
+    const uint64_t expected = qemu_plugin_u64_sum(count_insn);
+    const uint64_t per_vcpu = qemu_plugin_u64_sum(count_insn_inline);
+    int i;
+
+    g_string_append_printf(report, "insn: %" PRIu64 "\n", expected);
+    g_string_append_printf(report, "insn: %" PRIu64 " (per vcpu)\n", per_vcpu);
+    g_assert(expected > 0);
+    g_assert(per_vcpu == expected);
+    for (i = 0; i < qemu_plugin_num_vcpus(); ++i) {
+        uint64_t mark = qemu_plugin_u64_get(insn_mark, i);
+
+        /* every insn stores 1 and then adds 1 */
+        g_assert(mark == (qemu_plugin_u64_get(count_insn, i) ? 2 : 0));
+    }
+}
+
+static void stats_tb(GString *report)
+{
+    const uint64_t expected = qemu_plugin_u64_sum(count_tb);
+    const uint64_t per_vcpu = qemu_plugin_u64_sum(count_tb_inline);
+    int i;
+
+    g_string_append_printf(report, "tb: %" PRIu64 "\n", expected);
+    g_string_append_printf(report, "tb: %" PRIu64 " (per vcpu)\n", per_vcpu);
+    g_assert(expected > 0);
+    g_assert(per_vcpu == expected);
+    if (qemu_plugin_num_vcpus() == 1) {
+        g_string_append_printf(report, "tb: %" PRIu64 " (global)\n",
+                               global_count_tb_inline);
+        g_assert(global_count_tb_inline == expected);
+    }
+    for (i = 0; i < qemu_plugin_num_vcpus(); ++i) {
+        uint64_t trigger = qemu_plugin_u64_get(tb_cond_trigger, i);
+
+        g_assert(trigger == qemu_plugin_u64_get(count_tb, i) / COND_PERIOD);
+    }
+}
+
+static void stats_mem(GString *report)
+{
+    const uint64_t expected = qemu_plugin_u64_sum(count_mem);
+    const uint64_t per_vcpu = qemu_plugin_u64_sum(count_mem_inline);
+
+    g_string_append_printf(report, "mem: %" PRIu64 "\n", expected);
+    g_string_append_printf(report, "mem: %" PRIu64 " (per vcpu)\n", per_vcpu);
+    g_assert(per_vcpu == expected);
+}
+
+static void plugin_exit(qemu_plugin_id_t id, void *udata)
+{
+    g_autoptr(GString) report = g_string_new("");
+
+    stats_tb(report);
+    stats_insn(report);
+    stats_mem(report);
+    qemu_plugin_outs(report->str);
+    qemu_plugin_scoreboard_free(counts);
+}
+
+static void vcpu_tb_exec(unsigned int cpu_index, void *udata)
+{
+    qemu_plugin_u64_add(count_tb, cpu_index, 1);
+}
+
+static void vcpu_tb_cond_exec(unsigned int cpu_index, void *udata)
+{
+    g_assert(qemu_plugin_u64_get(tb_cond_track, cpu_index) == COND_PERIOD);
+    qemu_plugin_u64_set(tb_cond_track, cpu_index, 0);
+    qemu_plugin_u64_add(tb_cond_trigger, cpu_index, 1);
+}
+
+static void vcpu_insn_exec(unsigned int cpu_index, void *udata)
+{
+    qemu_plugin_u64_add(count_insn, cpu_index, 1);
+}
+
+static void vcpu_mem_access(unsigned int cpu_index, qemu_plugin_meminfo_t info,
+                            uint64_t vaddr, void *userdata)
+{
+    qemu_plugin_u64_add(count_mem, cpu_index, 1);
+}
+
+static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
+{
+    size_t n = qemu_plugin_tb_n_insns(tb);
+    size_t i;
+
+    qemu_plugin_register_vcpu_tb_exec_cb(tb, vcpu_tb_exec,
+                                         QEMU_PLUGIN_CB_NO_REGS, NULL);
+    qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu(
+        tb, QEMU_PLUGIN_INLINE_ADD_U64, count_tb_inline, 1);
+    qemu_plugin_register_vcpu_tb_exec_inline(
+        tb, QEMU_PLUGIN_INLINE_ADD_U64, &global_count_tb_inline, 1);
+
+    qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu(
+        tb, QEMU_PLUGIN_INLINE_ADD_U64, tb_cond_track, 1);
+    qemu_plugin_register_vcpu_tb_exec_cond_cb(
+        tb, vcpu_tb_cond_exec, QEMU_PLUGIN_CB_NO_REGS,
+        QEMU_PLUGIN_COND_EQ, tb_cond_track, COND_PERIOD, NULL);
+
+    for (i = 0; i < n; i++) {
+        struct qemu_plugin_insn *insn = qemu_plugin_tb_get_insn(tb, i);
+
+        qemu_plugin_register_vcpu_insn_exec_cb(insn, vcpu_insn_exec,
+                                               QEMU_PLUGIN_CB_NO_REGS, NULL);
+        qemu_plugin_register_vcpu_insn_exec_inline_per_vcpu(
+            insn, QEMU_PLUGIN_INLINE_ADD_U64, count_insn_inline, 1);
+        qemu_plugin_register_vcpu_insn_exec_inline_per_vcpu(
+            insn, QEMU_PLUGIN_INLINE_STORE_U64, insn_mark, 1);
+        qemu_plugin_register_vcpu_insn_exec_inline_per_vcpu(
+            insn, QEMU_PLUGIN_INLINE_ADD_U64, insn_mark, 1);
+
+        qemu_plugin_register_vcpu_mem_cb(insn, vcpu_mem_access,
+                                         QEMU_PLUGIN_CB_NO_REGS,
+                                         QEMU_PLUGIN_MEM_RW, NULL);
+        qemu_plugin_register_vcpu_mem_inline_per_vcpu(
+            insn, QEMU_PLUGIN_MEM_RW, QEMU_PLUGIN_INLINE_ADD_U64,
+            count_mem_inline, 1);
+    }
+}
+
+QEMU_PLUGIN_EXPORT
+int qemu_plugin_install(qemu_plugin_id_t id, const qemu_info_t *info,
+                        int argc, char **argv)
+{
+    counts = qemu_plugin_scoreboard_new(sizeof(CPUCount));
+    count_tb = qemu_plugin_scoreboard_u64_in_struct(
+        counts, CPUCount, count_tb);
+    count_tb_inline = qemu_plugin_scoreboard_u64_in_struct(
+        counts, CPUCount, count_tb_inline);
+    count_insn = qemu_plugin_scoreboard_u64_in_struct(
+        counts, CPUCount, count_insn);
+    count_insn_inline = qemu_plugin_scoreboard_u64_in_struct(
+        counts, CPUCount, count_insn_inline);
+    count_mem = qemu_plugin_scoreboard_u64_in_struct(
+        counts, CPUCount, count_mem);
+    count_mem_inline = qemu_plugin_scoreboard_u64_in_struct(
+        counts, CPUCount, count_mem_inline);
+    tb_cond_track = qemu_plugin_scoreboard_u64_in_struct(
+        counts, CPUCount, tb_cond_track);
+    tb_cond_trigger = qemu_plugin_scoreboard_u64_in_struct(
+        counts, CPUCount, tb_cond_trigger);
+    insn_mark = qemu_plugin_scoreboard_u64_in_struct(
+        counts, CPUCount, insn_mark);
+
+    qemu_plugin_register_vcpu_tb_trans_cb(id, vcpu_tb_trans);
+    qemu_plugin_register_atexit_cb(id, plugin_exit, NULL);
+
+    return 0;
+}
@@ -0,0 +1,137 @@
+/*
+ * QTest testcase for the af-xdp network backend
+ *
+ * Attach -netdev af-xdp in skb mode to one end of a veth pair, send a
+ * frame into the other end and check that filter-mirror sees the backend
+ * pass it on.  Creating the veth pair needs CAP_NET_ADMIN and the ip
+ * command, the test is skipped without them.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * later.  See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu-common.h"
+#include "libqos/libqtest.h"
+#include "qapi/qmp/qdict.h"
+#include "qemu/sockets.h"
+#include <net/if.h>
+#include <linux/if_packet.h>
+#include <net/ethernet.h>
+
+static bool veth_run(const char *fmt, ...) G_GNUC_PRINTF(1, 2);
+
+static bool veth_run(const char *fmt, ...)
+{
+    g_autofree char *cmd = NULL;
+    int status;
+    va_list ap;
+
+    va_start(ap, fmt);
+    cmd = g_strdup_vprintf(fmt, ap);
+    va_end(ap);
+
+    return g_spawn_command_line_sync(cmd, NULL, NULL, &status, NULL) &&
+           g_spawn_check_exit_status(status, NULL);
+}
+
+static bool veth_create(const char *name, const char *peer)
+{
+    if (!veth_run("ip link add %s type veth peer name %s", name, peer)) {
+        return false;
+    }
+    if (!veth_run("ip link set %s up", name) ||
+        !veth_run("ip link set %s up", peer)) {
+        veth_run("ip link del %s", name);
+        return false;
+    }
+    return true;
+}
+
+/* A raw socket that sends frames out of @ifname */
+static int packet_socket(const char *ifname)
+{
+    struct sockaddr_ll sll = {
+        .sll_family = AF_PACKET,
+        .sll_protocol = htons(ETH_P_ALL),
+        .sll_ifindex = if_nametoindex(ifname),
+    };
+    int fd;
+
+    g_assert_cmpint(sll.sll_ifindex, !=, 0);
+    fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+    g_assert_cmpint(fd, >=, 0);
+    g_assert_cmpint(bind(fd, (struct sockaddr *)&sll, sizeof(sll)), ==, 0);
+    return fd;
+}
+
+static void test_af_xdp_skb(void)
+{
+    g_autofree char *ifname = g_strdup_printf("qxdp%d", getpid());
+    g_autofree char *peer = g_strdup_printf("qxdpp%d", getpid());
+    uint8_t frame[ETH_ZLEN] = { 0 };
+    uint8_t *recv_buf;
+    int recv_sock[2];
+    uint32_t len;
+    QTestState *qts;
+    int pkt_fd;
+    ssize_t ret;
+
+    if (geteuid() != 0) {
+        g_test_skip("creating a veth pair needs root");
+        return;
+    }
+    if (!veth_create(ifname, peer)) {
+        g_test_skip("cannot create a veth pair");
+        return;
+    }
+
+    ret = socketpair(PF_UNIX, SOCK_STREAM, 0, recv_sock);
+    g_assert_cmpint(ret, !=, -1);
+
+    qts = qtest_initf(
+        "-netdev af-xdp,id=qtest-bn0,ifname=%s,mode=skb "
+        "-device e1000,netdev=qtest-bn0,id=qtest-e0 "
+        "-chardev socket,id=mirror0,fd=%d "
+        "-object filter-mirror,id=qtest-f0,netdev=qtest-bn0,queue=tx,"
+        "outdev=mirror0 ",
+        ifname, recv_sock[1]);
+    qobject_unref(qtest_qmp(qts, "{ 'execute' : 'query-status'}"));
+
+    /* A broadcast frame with a local ethertype, so the host ignores it */
+    memset(frame, 0xff, ETH_ALEN);
+    frame[ETH_ALEN] = 0x02;
+    frame[12] = 0x88;
+    frame[13] = 0xb5;
+    pstrcpy((char *)frame + ETH_HLEN, ETH_ZLEN - ETH_HLEN, "af-xdp qtest");
+
+    pkt_fd = packet_socket(peer);
+    ret = send(pkt_fd, frame, sizeof(frame), 0);
+    g_assert_cmpint(ret, ==, sizeof(frame));
+
+    ret = qemu_recv(recv_sock[0], &len, sizeof(len), 0);
+    g_assert_cmpint(ret, ==, sizeof(len));
+    len = ntohl(len);
+    g_assert_cmpint(len, ==, sizeof(frame));
+
+    recv_buf = g_malloc(len);
+    ret = qemu_recv(recv_sock[0], recv_buf, len, 0);
+    g_assert_cmpint(ret, ==, len);
+    g_assert(memcmp(recv_buf, frame, len) == 0);
+
+    g_free(recv_buf);
+    close(pkt_fd);
+    close(recv_sock[0]);
+    close(recv_sock[1]);
+    qtest_quit(qts);
+    veth_run("ip link del %s", ifname);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    qtest_add_func("/netdev/af-xdp/skb", test_af_xdp_skb);
+
+    return g_test_run();
+}
@@ -0,0 +1,139 @@
+/*
+ * QTest testcase for the per-vCPU dirty page rate limit commands
+ *
+ * set-vcpu-dirty-limit, cancel-vcpu-dirty-limit and
+ * query-vcpu-dirty-limit need KVM with a dirty ring, the test is skipped
+ * when the host does not support it.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * later.  See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "libqos/libqtest.h"
+#include "qapi/qmp/qdict.h"
+#include "qapi/qmp/qlist.h"
+
+/* So far the dirty ring is only supported on x86_64 */
+#if defined(__linux__) && defined(HOST_X86_64)
+#include "linux/kvm.h"
+#endif
+
+static bool kvm_dirty_ring_supported(void)
+{
+#if defined(__linux__) && defined(HOST_X86_64)
+    int ret, kvm_fd = open("/dev/kvm", O_RDONLY);
+
+    if (kvm_fd < 0) {
+        return false;
+    }
+
+    ret = ioctl(kvm_fd, KVM_CHECK_EXTENSION, KVM_CAP_DIRTY_LOG_RING);
+    close(kvm_fd);
+
+    /* We test with 4096 slots */
+    return ret >= 4096;
+#else
+    return false;
+#endif
+}
+
+/*
+ * Check that query-vcpu-dirty-limit lists the vCPUs of @limits, indexed
+ * by cpu-index with 0 for the vCPUs that are not limited.
+ */
+static void check_limits(QTestState *qts, const uint64_t *limits, int n)
+{
+    QDict *rsp = qtest_qmp(qts, "{ 'execute': 'query-vcpu-dirty-limit' }");
+    QList *list = qdict_get_qlist(rsp, "return");
+    const QListEntry *entry;
+    int i, found = 0;
+
+    g_assert(list);
+    QLIST_FOREACH_ENTRY(list, entry) {
+        QDict *info = qobject_to(QDict, qlist_entry_obj(entry));
+        int64_t cpu = qdict_get_int(info, "cpu-index");
+
+        g_assert_cmpint(cpu, >=, 0);
+        g_assert_cmpint(cpu, <, n);
+        g_assert_cmpuint(qdict_get_int(info, "limit-rate"), ==, limits[cpu]);
+        g_assert(qdict_haskey(info, "current-rate"));
+        g_assert(qdict_haskey(info, "throttle-percentage"));
+        found++;
+    }
+
+    for (i = 0; i < n; i++) {
+        if (limits[i]) {
+            found--;
+        }
+    }
+    g_assert_cmpint(found, ==, 0);
+    qobject_unref(rsp);
+}
+
+static void test_vcpu_dirty_limit(void)
+{
+    uint64_t limits[2] = { 0, 0 };
+    QTestState *qts;
+    QDict *rsp;
+
+    if (!kvm_dirty_ring_supported()) {
+        g_test_skip("KVM dirty ring not supported");
+        return;
+    }
+
+    qts = qtest_init("-accel kvm,dirty-ring-size=4096 -smp 2");
+
+    check_limits(qts, limits, 2);
+
+    /* One vCPU */
+    qtest_qmp_assert_success(qts, "{ 'execute': 'set-vcpu-dirty-limit',"
+                             "  'arguments': { 'cpu-index': 1,"
+                             "                 'dirty-rate': 200 } }");
+    limits[1] = 200;
+    check_limits(qts, limits, 2);
+
+    /* All of them, which updates the existing limit */
+    qtest_qmp_assert_success(qts, "{ 'execute': 'set-vcpu-dirty-limit',"
+                             "  'arguments': { 'dirty-rate': 100 } }");
+    limits[0] = limits[1] = 100;
+    check_limits(qts, limits, 2);
+
+    qtest_qmp_assert_success(qts, "{ 'execute': 'cancel-vcpu-dirty-limit',"
+                             "  'arguments': { 'cpu-index': 0 } }");
+    limits[0] = 0;
+    check_limits(qts, limits, 2);
+
+    qtest_qmp_assert_success(qts, "{ 'execute': 'cancel-vcpu-dirty-limit' }");
+    limits[1] = 0;
+    check_limits(qts, limits, 2);
+
+    /* Limits can be set again after everything was cancelled */
+    qtest_qmp_assert_success(qts, "{ 'execute': 'set-vcpu-dirty-limit',"
+                             "  'arguments': { 'cpu-index': 0,"
+                             "                 'dirty-rate': 50 } }");
+    limits[0] = 50;
+    check_limits(qts, limits, 2);
+
+    rsp = qtest_qmp(qts, "{ 'execute': 'set-vcpu-dirty-limit',"
+                    "  'arguments': { 'cpu-index': 2, 'dirty-rate': 50 } }");
+    g_assert(qdict_haskey(rsp, "error"));
+    qobject_unref(rsp);
+
+    rsp = qtest_qmp(qts, "{ 'execute': 'cancel-vcpu-dirty-limit',"
+                    "  'arguments': { 'cpu-index': -1 } }");
+    g_assert(qdict_haskey(rsp, "error"));
+    qobject_unref(rsp);
+    check_limits(qts, limits, 2);
+
+    qtest_quit(qts);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    qtest_add_func("/dirtylimit/vcpu", test_vcpu_dirty_limit);
+
+    return g_test_run();
+}
@@ -13,6 +13,9 @@
 #include "libqos/libqtest.h"
 #include "libqos/qgraph.h"
 #include "libqos/pci.h"
+#include "libqos/malloc.h"
+#include "qapi/qmp/qdict.h"
+#include "qapi/qmp/qlist.h"
 #include "include/block/nvme.h"
 
 typedef struct QNvme QNvme;
@@ -142,6 +145,217 @@ static void nvmetest_pmr_reg_test(void *obj, void *data, QGuestAllocator *alloc)
     qpci_iounmap(pdev, pmr_bar);
 }
 
+#define NVMETEST_QUEUE_SIZE 8
+#define NVMETEST_TIMEOUT_US (5 * G_USEC_PER_SEC)
+
+typedef struct NvmeTestQueue {
+    uint64_t addr;
+    uint16_t idx;       /* tail of an SQ, head of a CQ */
+    uint16_t phase;
+} NvmeTestQueue;
+
+typedef struct NvmeTest {
+    QPCIDevice *pdev;
+    QTestState *qts;
+    QPCIBar bar;
+    NvmeTestQueue asq, acq;
+} NvmeTest;
+
+static void nvmetest_submit(NvmeTest *t, NvmeTestQueue *sq, NvmeCmd *cmd)
+{
+    cmd->cid = cpu_to_le16(sq->idx);
+    qtest_memwrite(t->qts, sq->addr + sq->idx * sizeof(*cmd), cmd,
+                   sizeof(*cmd));
+    sq->idx = (sq->idx + 1) % NVMETEST_QUEUE_SIZE;
+}
+
+/* Wait for the next completion queue entry and return its status field */
+static uint16_t nvmetest_complete(NvmeTest *t, NvmeTestQueue *cq)
+{
+    uint64_t addr = cq->addr + cq->idx * sizeof(NvmeCqe);
+    gint64 end_time = g_get_monotonic_time() + NVMETEST_TIMEOUT_US;
+    NvmeCqe cqe;
+
+    for (;;) {
+        qtest_memread(t->qts, addr, &cqe, sizeof(cqe));
+        if ((le16_to_cpu(cqe.status) & 1) == cq->phase) {
+            break;
+        }
+        g_assert(g_get_monotonic_time() < end_time);
+        qtest_clock_step(t->qts, 1000);
+    }
+
+    cq->idx = (cq->idx + 1) % NVMETEST_QUEUE_SIZE;
+    if (!cq->idx) {
+        cq->phase ^= 1;
+    }
+
+    return le16_to_cpu(cqe.status) >> 1;
+}
+
+static uint16_t nvmetest_admin(NvmeTest *t, NvmeCmd *cmd)
+{
+    uint16_t status;
+
+    nvmetest_submit(t, &t->asq, cmd);
+    qpci_io_writel(t->pdev, t->bar, 0x1000, t->asq.idx);
+    status = nvmetest_complete(t, &t->acq);
+    qpci_io_writel(t->pdev, t->bar, 0x1004, t->acq.idx);
+
+    return status;
+}
+
+/* Whether the host has to write the doorbell register, as Linux decides it */
+static bool nvmetest_need_event(uint16_t event_idx, uint16_t new_idx,
+                                uint16_t old_idx)
+{
+    return (uint16_t)(new_idx - event_idx - 1) < (uint16_t)(new_idx - old_idx);
+}
+
+static void nvmetest_read(NvmeTest *t, NvmeTestQueue *sq, uint64_t buf)
+{
+    NvmeCmd cmd = {
+        .opcode = NVME_CMD_READ,
+        .nsid = cpu_to_le32(1),
+        .dptr.prp1 = cpu_to_le64(buf),
+    };
+
+    nvmetest_submit(t, sq, &cmd);
+}
+
+/* Shadow doorbells and EventIdx entries are little endian */
+static void nvmetest_dbbuf_writel(NvmeTest *t, uint64_t addr, uint32_t val)
+{
+    val = cpu_to_le32(val);
+    qtest_memwrite(t->qts, addr, &val, sizeof(val));
+}
+
+static uint32_t nvmetest_dbbuf_readl(NvmeTest *t, uint64_t addr)
+{
+    uint32_t val;
+
+    qtest_memread(t->qts, addr, &val, sizeof(val));
+    return le32_to_cpu(val);
+}
+
+static int64_t nvmetest_dbbuf_stat(QDict *stats, const char *name)
+{
+    g_assert(qdict_haskey(stats, name));
+    return qdict_get_int(stats, name);
+}
+
+static void nvmetest_dbbuf_test(void *obj, void *data, QGuestAllocator *alloc)
+{
+    QNvme *nvme = obj;
+    NvmeTest t = { .pdev = &nvme->dev, .qts = nvme->dev.bus->qts };
+    NvmeTestQueue sq = { 0 }, cq = { .phase = 1 };
+    /* Shadow doorbell and EventIdx slots of I/O queue pair 1 */
+    uint64_t dbs, eis, sq_db, sq_ei, cq_db, cq_ei, buf;
+    uint32_t cc = 0;
+    NvmeCmd cmd;
+    QDict *resp, *stats;
+    QList *list;
+
+    /* The controller only suppresses head doorbells with MSI-X */
+    qpci_device_enable(t.pdev);
+    qpci_msix_enable(t.pdev);
+    t.bar = t.pdev->msix_table_bar;
+
+    t.asq.addr = guest_alloc(alloc, 4096);
+    t.acq.addr = guest_alloc(alloc, 4096);
+    t.acq.phase = 1;
+    sq.addr = guest_alloc(alloc, 4096);
+    cq.addr = guest_alloc(alloc, 4096);
+    dbs = guest_alloc(alloc, 4096);
+    eis = guest_alloc(alloc, 4096);
+    buf = guest_alloc(alloc, 4096);
+    qtest_memset(t.qts, t.acq.addr, 0, 4096);
+    qtest_memset(t.qts, cq.addr, 0, 4096);
+
+    sq_db = dbs + (1 << 3);
+    sq_ei = eis + (1 << 3);
+    cq_db = sq_db + (1 << 2);
+    cq_ei = sq_ei + (1 << 2);
+
+    qpci_io_writel(t.pdev, t.bar, NVME_REG_AQA,
+                   (NVMETEST_QUEUE_SIZE - 1) << 16 | (NVMETEST_QUEUE_SIZE - 1));
+    qpci_io_writel(t.pdev, t.bar, NVME_REG_ASQ, t.asq.addr);
+    qpci_io_writel(t.pdev, t.bar, NVME_REG_ASQ + 4, t.asq.addr >> 32);
+    qpci_io_writel(t.pdev, t.bar, NVME_REG_ACQ, t.acq.addr);
+    qpci_io_writel(t.pdev, t.bar, NVME_REG_ACQ + 4, t.acq.addr >> 32);
+    NVME_SET_CC_EN(cc, 1);
+    NVME_SET_CC_IOSQES(cc, 6);
+    NVME_SET_CC_IOCQES(cc, 4);
+    qpci_io_writel(t.pdev, t.bar, NVME_REG_CC, cc);
+    g_assert(qpci_io_readl(t.pdev, t.bar, NVME_REG_CSTS) & NVME_CSTS_READY);
+
+    cmd = (NvmeCmd) {
+        .opcode = NVME_ADM_CMD_DBBUF_CONFIG,
+        .dptr.prp1 = cpu_to_le64(dbs),
+        .dptr.prp2 = cpu_to_le64(eis),
+    };
+    g_assert_cmphex(nvmetest_admin(&t, &cmd), ==, NVME_SUCCESS);
+
+    /* I/O queue pair 1: interrupts on vector 0, physically contiguous */
+    cmd = (NvmeCmd) {
+        .opcode = NVME_ADM_CMD_CREATE_CQ,
+        .dptr.prp1 = cpu_to_le64(cq.addr),
+        .cdw10 = cpu_to_le32((NVMETEST_QUEUE_SIZE - 1) << 16 | 1),
+        .cdw11 = cpu_to_le32(0x3),
+    };
+    g_assert_cmphex(nvmetest_admin(&t, &cmd), ==, NVME_SUCCESS);
+
+    cmd = (NvmeCmd) {
+        .opcode = NVME_ADM_CMD_CREATE_SQ,
+        .dptr.prp1 = cpu_to_le64(sq.addr),
+        .cdw10 = cpu_to_le32((NVMETEST_QUEUE_SIZE - 1) << 16 | 1),
+        .cdw11 = cpu_to_le32(1 << 16 | 0x1),
+    };
+    g_assert_cmphex(nvmetest_admin(&t, &cmd), ==, NVME_SUCCESS);
+
+    /* The first submission on an idle queue has to ring the doorbell */
+    nvmetest_read(&t, &sq, buf);
+    nvmetest_dbbuf_writel(&t, sq_db, sq.idx);
+    g_assert(nvmetest_need_event(nvmetest_dbbuf_readl(&t, sq_ei), sq.idx, 0));
+    qpci_io_writel(t.pdev, t.bar, 0x1008, sq.idx);
+
+    /* The next one, before the queue was processed, only updates the shadow */
+    nvmetest_read(&t, &sq, buf);
+    nvmetest_dbbuf_writel(&t, sq_db, sq.idx);
+    g_assert(!nvmetest_need_event(nvmetest_dbbuf_readl(&t, sq_ei), sq.idx, 1));
+
+    g_assert_cmphex(nvmetest_complete(&t, &cq), ==, NVME_SUCCESS);
+    g_assert_cmphex(nvmetest_complete(&t, &cq), ==, NVME_SUCCESS);
+
+    /* With MSI-X, consuming completions does not need a head doorbell */
+    nvmetest_dbbuf_writel(&t, cq_db, cq.idx);
+    g_assert(!nvmetest_need_event(nvmetest_dbbuf_readl(&t, cq_ei), cq.idx, 0));
+
+    /* The queue is idle again, so the next submission rings the doorbell */
+    nvmetest_read(&t, &sq, buf);
+    nvmetest_dbbuf_writel(&t, sq_db, sq.idx);
+    g_assert(nvmetest_need_event(nvmetest_dbbuf_readl(&t, sq_ei), sq.idx, 2));
+    qpci_io_writel(t.pdev, t.bar, 0x1008, sq.idx);
+    g_assert_cmphex(nvmetest_complete(&t, &cq), ==, NVME_SUCCESS);
+
+    resp = qtest_qmp(t.qts, "{ 'execute': 'qom-get', 'arguments': {"
+                     " 'path': '/machine/peripheral/nvme0',"
+                     " 'property': 'x-dbbuf-stats' } }");
+    g_assert(qdict_haskey(resp, "return"));
+    list = qdict_get_qlist(resp, "return");
+    g_assert_cmpint(qlist_size(list), ==, 1);
+    stats = qobject_to(QDict, qlist_peek(list));
+
+    g_assert_cmpint(nvmetest_dbbuf_stat(stats, "qid"), ==, 1);
+    g_assert_cmpint(nvmetest_dbbuf_stat(stats, "sq-doorbells"), ==, 2);
+    g_assert_cmpint(nvmetest_dbbuf_stat(stats, "sq-exits-avoided"), ==, 1);
+    g_assert_cmpint(nvmetest_dbbuf_stat(stats, "cq-doorbells"), ==, 0);
+    g_assert_cmpint(nvmetest_dbbuf_stat(stats, "cq-exits-avoided"), ==, 1);
+    qobject_unref(resp);
+
+    qpci_msix_disable(t.pdev);
+}
+
 static void nvme_register_nodes(void)
 {
     QOSGraphEdgeOptions opts = {
@@ -168,6 +382,11 @@ static void nvme_register_nodes(void)
     });
 
     qos_add_test("reg-read", "nvme", nvmetest_reg_read_test, NULL);
+
+    qos_add_test("dbbuf", "nvme", nvmetest_dbbuf_test,
+                 &(QOSGraphTestOptions) {
+        .edge.extra_device_opts = "id=nvme0"
+    });
 }
 
 libqos_init(nvme_register_nodes);
@@ -0,0 +1,47 @@
+/*
+ * Hot loop test
+ *
+ * Count the Collatz steps of the first numbers: a loop with conditional
+ * branches that runs often enough to be retranslated as traces when a
+ * trace-threshold is set.  The result must not depend on it.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <inttypes.h>
+#include <minilib.h>
+
+#define LAST_NUMBER     20000
+#define EXPECTED_STEPS  1834634
+
+static uint64_t collatz_steps(uint64_t n)
+{
+    uint64_t steps = 0;
+
+    while (n != 1) {
+        if (n & 1) {
+            n = 3 * n + 1;
+        } else {
+            n >>= 1;
+        }
+        steps++;
+    }
+    return steps;
+}
+
+int main()
+{
+    uint64_t n, steps = 0;
+
+    for (n = 1; n <= LAST_NUMBER; n++) {
+        steps += collatz_steps(n);
+    }
+
+    if (steps != EXPECTED_STEPS) {
+        ml_printf("FAIL: %lu steps, expected %lu\n", steps,
+                  (uint64_t)EXPECTED_STEPS);
+        return 1;
+    }
+    ml_printf("PASS: %lu steps\n", steps);
+    return 0;
+}
@@ -0,0 +1,455 @@
+/*
+ * Vector operation correctness and throughput
+ *
+ * Each operation is checked against a scalar reference on random
+ * inputs and then timed in a tight loop.  The operations are chosen
+ * to exercise the TCG generic vector ops that hosts may implement
+ * natively (64-bit abs, min/max and multiply, 64-bit arithmetic
+ * shifts, 16-bit variable shifts, bit select, not and orc, and the
+ * rotates by immediate of SHA3 XAR/RAX1 and SVE2 XAR).
+ *
+ * Copyright (c) 2021 The QEMU Project Developers
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define ITERATIONS  1000
+#define TIME_LOOPS  (1 << 20)
+
+/* Large enough for the maximum SVE vector length of 2048 bits */
+#define MAX_LANES   32
+
+typedef struct {
+    uint64_t v[MAX_LANES];
+} Vec;
+
+typedef void OpFn(Vec *d, const Vec *a, const Vec *b, const Vec *c);
+typedef uint64_t RefFn(uint64_t a, uint64_t b, uint64_t c);
+typedef void LoopFn(unsigned n);
+
+typedef struct {
+    const char *name;
+    unsigned esize;     /* element size in bits */
+    OpFn *op;
+    RefFn *ref;
+    LoopFn *loop;
+} VecOp;
+
+static unsigned lanes64 = 2;
+static int failures;
+
+/* 128-bit AdvSIMD ops: v0 = a, v1 = b, v2 = c; the result is in v0. */
+#define NEON_OP(NAME, INSN)                                             \
+    static void op_##NAME(Vec *d, const Vec *a, const Vec *b,           \
+                          const Vec *c)                                 \
+    {                                                                   \
+        asm volatile("ldr q0, [%1]\n\t"                                 \
+                     "ldr q1, [%2]\n\t"                                 \
+                     "ldr q2, [%3]\n\t"                                 \
+                     INSN "\n\t"                                        \
+                     "str q0, [%0]"                                     \
+                     : : "r"(d), "r"(a), "r"(b), "r"(c)                 \
+                     : "v0", "v1", "v2", "memory");                     \
+    }                                                                   \
+    static void loop_##NAME(unsigned n)                                 \
+    {                                                                   \
+        asm volatile("movi v0.16b, #0x5a\n\t"                           \
+                     "movi v1.16b, #3\n\t"                              \
+                     "movi v2.16b, #0xc3\n"                             \
+                     "1:\t" INSN "\n\t"                                 \
+                     "subs %w0, %w0, #1\n\t"                            \
+                     "b.ne 1b"                                          \
+                     : "+r"(n) : : "v0", "v1", "v2", "cc");             \
+    }
+
+NEON_OP(abs_d, "abs v0.2d, v0.2d")
+NEON_OP(sshr_d, "sshr v0.2d, v0.2d, #13")
+NEON_OP(sshl_d, "sshl v0.2d, v0.2d, v1.2d")
+NEON_OP(ushl_h, "ushl v0.8h, v0.8h, v1.8h")
+NEON_OP(sshl_h, "sshl v0.8h, v0.8h, v1.8h")
+NEON_OP(bsl, "bsl v0.16b, v1.16b, v2.16b")
+NEON_OP(mvn, "mvn v0.16b, v1.16b")
+NEON_OP(orn, "orn v0.16b, v0.16b, v1.16b")
+NEON_OP(cmhi_d, "cmhi v0.2d, v0.2d, v1.2d")
+NEON_OP(cmgt_d, "cmgt v0.2d, v0.2d, v1.2d")
+
+static uint64_t ref_abs_d(uint64_t a, uint64_t b, uint64_t c)
+{
+    return (int64_t)a < 0 ? -a : a;
+}
+
+static uint64_t ref_sshr_d(uint64_t a, uint64_t b, uint64_t c)
+{
+    return (int64_t)a >> 13;
+}
+
+static uint64_t ref_sshl_d(uint64_t a, uint64_t b, uint64_t c)
+{
+    int8_t sh = b;
+
+    if (sh >= 64) {
+        return 0;
+    } else if (sh >= 0) {
+        return a << sh;
+    } else if (sh > -64) {
+        return (int64_t)a >> -sh;
+    }
+    return (int64_t)a >> 63;
+}
+
+/* Apply a 16-bit lane function to the four lanes of a 64-bit value */
+static uint64_t map16(uint64_t a, uint64_t b,
+                      uint16_t (*fn)(uint16_t, uint16_t))
+{
+    uint64_t r = 0;
+    int i;
+
+    for (i = 0; i < 64; i += 16) {
+        r |= (uint64_t)fn(a >> i, b >> i) << i;
+    }
+    return r;
+}
+
+static uint16_t ushl16(uint16_t a, uint16_t b)
+{
+    int8_t sh = b;
+
+    if (sh >= 16 || sh <= -16) {
+        return 0;
+    }
+    return sh >= 0 ? a << sh : a >> -sh;
+}
+
+static uint16_t sshl16(uint16_t a, uint16_t b)
+{
+    int8_t sh = b;
+
+    if (sh >= 16) {
+        return 0;
+    } else if (sh >= 0) {
+        return a << sh;
+    }
+    return (int16_t)a >> (sh > -16 ? -sh : 15);
+}
+
+static uint64_t ref_ushl_h(uint64_t a, uint64_t b, uint64_t c)
+{
+    return map16(a, b, ushl16);
+}
+
+static uint64_t ref_sshl_h(uint64_t a, uint64_t b, uint64_t c)
+{
+    return map16(a, b, sshl16);
+}
+
+static uint64_t ref_bsl(uint64_t a, uint64_t b, uint64_t c)
+{
+    return (a & b) | (~a & c);
+}
+
+static uint64_t ref_mvn(uint64_t a, uint64_t b, uint64_t c)
+{
+    return ~b;
+}
+
+static uint64_t ref_orn(uint64_t a, uint64_t b, uint64_t c)
+{
+    return a | ~b;
+}
+
+static uint64_t ref_cmhi_d(uint64_t a, uint64_t b, uint64_t c)
+{
+    return a > b ? -1ull : 0;
+}
+
+static uint64_t ref_cmgt_d(uint64_t a, uint64_t b, uint64_t c)
+{
+    return (int64_t)a > (int64_t)b ? -1ull : 0;
+}
+
+#if defined(__ARM_FEATURE_SHA3) || defined(__ARM_FEATURE_SVE2)
+/* Rotate each ESIZE-bit lane of a 64-bit value right by 1 .. ESIZE-1 */
+static uint64_t ror_lanes(uint64_t x, unsigned esize, unsigned sh)
+{
+    uint64_t mask = esize == 64 ? -1ull : (1ull << esize) - 1;
+    uint64_t r = 0;
+    unsigned i;
+
+    for (i = 0; i < 64; i += esize) {
+        uint64_t e = (x >> i) & mask;
+
+        r |= (((e >> sh) | (e << (esize - sh))) & mask) << i;
+    }
+    return r;
+}
+#endif
+
+#ifdef __ARM_FEATURE_SHA3
+NEON_OP(xar_d, "xar v0.2d, v0.2d, v1.2d, #17")
+NEON_OP(rax1, "rax1 v0.2d, v0.2d, v1.2d")
+
+static uint64_t ref_xar_d(uint64_t a, uint64_t b, uint64_t c)
+{
+    return ror_lanes(a ^ b, 64, 17);
+}
+
+static uint64_t ref_rax1(uint64_t a, uint64_t b, uint64_t c)
+{
+    return a ^ ror_lanes(b, 64, 63);
+}
+#endif
+
+#ifdef __ARM_FEATURE_SVE
+/*
+ * Unpredicated SVE ops with an immediate operand, over the whole vector
+ * length: z0 = a, the result is in z0.
+ */
+#define SVE_OP(NAME, INSN)                                              \
+    static void op_##NAME(Vec *d, const Vec *a, const Vec *b,           \
+                          const Vec *c)                                 \
+    {                                                                   \
+        asm volatile("ptrue p0.d\n\t"                                   \
+                     "ld1d { z0.d }, p0/z, [%1]\n\t"                    \
+                     INSN "\n\t"                                        \
+                     "st1d { z0.d }, p0, [%0]"                          \
+                     : : "r"(d), "r"(a)                                 \
+                     : "z0", "p0", "memory");                           \
+    }                                                                   \
+    static void loop_##NAME(unsigned n)                                 \
+    {                                                                   \
+        asm volatile("index z0.d, #1, #7\n"                             \
+                     "1:\t" INSN "\n\t"                                 \
+                     "subs %w0, %w0, #1\n\t"                            \
+                     "b.ne 1b"                                          \
+                     : "+r"(n) : : "z0", "cc");                         \
+    }
+
+SVE_OP(mul_d, "mul z0.d, z0.d, #-3")
+SVE_OP(smax_d, "smax z0.d, z0.d, #-5")
+SVE_OP(smin_d, "smin z0.d, z0.d, #100")
+SVE_OP(umax_d, "umax z0.d, z0.d, #200")
+SVE_OP(umin_d, "umin z0.d, z0.d, #17")
+SVE_OP(asr_d, "asr z0.d, z0.d, #40")
+
+static uint64_t ref_mul_d(uint64_t a, uint64_t b, uint64_t c)
+{
+    return a * -3ull;
+}
+
+static uint64_t ref_smax_d(uint64_t a, uint64_t b, uint64_t c)
+{
+    return (int64_t)a > -5 ? a : -5ull;
+}
+
+static uint64_t ref_smin_d(uint64_t a, uint64_t b, uint64_t c)
+{
+    return (int64_t)a < 100 ? a : 100;
+}
+
+static uint64_t ref_umax_d(uint64_t a, uint64_t b, uint64_t c)
+{
+    return a > 200 ? a : 200;
+}
+
+static uint64_t ref_umin_d(uint64_t a, uint64_t b, uint64_t c)
+{
+    return a < 17 ? a : 17;
+}
+
+static uint64_t ref_asr_d(uint64_t a, uint64_t b, uint64_t c)
+{
+    return (int64_t)a >> 40;
+}
+#endif
+
+#ifdef __ARM_FEATURE_SVE2
+/* Unpredicated SVE2 ops with two vector operands: z0 = a, z1 = b */
+#define SVE2_OP(NAME, INSN)                                             \
+    static void op_##NAME(Vec *d, const Vec *a, const Vec *b,           \
+                          const Vec *c)                                 \
+    {                                                                   \
+        asm volatile("ptrue p0.d\n\t"                                   \
+                     "ld1d { z0.d }, p0/z, [%1]\n\t"                    \
+                     "ld1d { z1.d }, p0/z, [%2]\n\t"                    \
+                     INSN "\n\t"                                        \
+                     "st1d { z0.d }, p0, [%0]"                          \
+                     : : "r"(d), "r"(a), "r"(b)                         \
+                     : "z0", "z1", "p0", "memory");                     \
+    }                                                                   \
+    static void loop_##NAME(unsigned n)                                 \
+    {                                                                   \
+        asm volatile("index z0.d, #1, #7\n\t"                           \
+                     "index z1.d, #3, #-5\n"                            \
+                     "1:\t" INSN "\n\t"                                 \
+                     "subs %w0, %w0, #1\n\t"                            \
+                     "b.ne 1b"                                          \
+                     : "+r"(n) : : "z0", "z1", "cc");                   \
+    }
+
+SVE2_OP(xar_b, "xar z0.b, z0.b, z1.b, #3")
+SVE2_OP(xar_h, "xar z0.h, z0.h, z1.h, #5")
+SVE2_OP(xar_s, "xar z0.s, z0.s, z1.s, #11")
+SVE2_OP(xar_sd, "xar z0.d, z0.d, z1.d, #40")
+
+static uint64_t ref_xar_b(uint64_t a, uint64_t b, uint64_t c)
+{
+    return ror_lanes(a ^ b, 8, 3);
+}
+
+static uint64_t ref_xar_h(uint64_t a, uint64_t b, uint64_t c)
+{
+    return ror_lanes(a ^ b, 16, 5);
+}
+
+static uint64_t ref_xar_s(uint64_t a, uint64_t b, uint64_t c)
+{
+    return ror_lanes(a ^ b, 32, 11);
+}
+
+static uint64_t ref_xar_sd(uint64_t a, uint64_t b, uint64_t c)
+{
+    return ror_lanes(a ^ b, 64, 40);
+}
+#endif
+
+#define OP(NAME, ESIZE) { #NAME, ESIZE, op_##NAME, ref_##NAME, loop_##NAME }
+
+static const VecOp neon_ops[] = {
+    OP(abs_d, 64),
+    OP(sshr_d, 64),
+    OP(sshl_d, 64),
+    OP(ushl_h, 16),
+    OP(sshl_h, 16),
+    OP(bsl, 8),
+    OP(mvn, 8),
+    OP(orn, 8),
+    OP(cmhi_d, 64),
+    OP(cmgt_d, 64),
+#ifdef __ARM_FEATURE_SHA3
+    OP(xar_d, 64),
+    OP(rax1, 64),
+#endif
+};
+
+#ifdef __ARM_FEATURE_SVE
+static const VecOp sve_ops[] = {
+    OP(mul_d, 64),
+    OP(smax_d, 64),
+    OP(smin_d, 64),
+    OP(umax_d, 64),
+    OP(umin_d, 64),
+    OP(asr_d, 64),
+#ifdef __ARM_FEATURE_SVE2
+    OP(xar_b, 8),
+    OP(xar_h, 16),
+    OP(xar_s, 32),
+    OP(xar_sd, 64),
+#endif
+};
+#endif
+
+static uint64_t rand64(void)
+{
+    uint64_t r = 0;
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        r = (r << 16) ^ (random() & 0xffff);
+    }
+    /* Bias towards small magnitudes, which are interesting for shifts */
+    switch (random() & 3) {
+    case 0:
+        return (int64_t)(int8_t)r;
+    case 1:
+        return r & 0x00ff00ff00ff00ffull;
+    default:
+        return r;
+    }
+}
+
+static void check_op(const VecOp *op, unsigned lanes)
+{
+    Vec a, b, c, d;
+    unsigned i, j;
+
+    for (i = 0; i < ITERATIONS; i++) {
+        for (j = 0; j < lanes; j++) {
+            a.v[j] = rand64();
+            b.v[j] = rand64();
+            c.v[j] = rand64();
+        }
+        memset(&d, 0, sizeof(d));
+        op->op(&d, &a, &b, &c);
+
+        for (j = 0; j < lanes; j++) {
+            uint64_t expect = op->ref(a.v[j], b.v[j], c.v[j]);
+
+            if (d.v[j] != expect) {
+                printf("FAIL %s lane %u: a=%016llx b=%016llx c=%016llx "
+                       "got %016llx expected %016llx\n", op->name, j,
+                       (unsigned long long)a.v[j],
+                       (unsigned long long)b.v[j],
+                       (unsigned long long)c.v[j],
+                       (unsigned long long)d.v[j],
+                       (unsigned long long)expect);
+                failures++;
+                return;
+            }
+        }
+    }
+}
+
+static void time_op(const VecOp *op, unsigned lanes)
+{
+    struct timespec t0, t1;
+    double ns;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    op->loop(TIME_LOOPS);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    ns = (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec);
+    printf("%-8s %2u-bit x %2u: %6.2f ns/insn\n", op->name, op->esize,
+           lanes * 64 / op->esize, ns / TIME_LOOPS);
+}
+
+static void run_ops(const VecOp *ops, size_t n, unsigned lanes)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        check_op(&ops[i], lanes);
+        time_op(&ops[i], lanes);
+    }
+}
+
+int main(void)
+{
+    srandom(1);
+
+    run_ops(neon_ops, sizeof(neon_ops) / sizeof(neon_ops[0]), lanes64);
+
+#ifdef __ARM_FEATURE_SVE
+    {
+        uint64_t cntd;
+
+        asm("cntd %0" : "=r"(cntd));
+        lanes64 = cntd;
+    }
+    run_ops(sve_ops, sizeof(sve_ops) / sizeof(sve_ops[0]), lanes64);
+#endif
+
+    if (failures) {
+        printf("%d operations FAILED\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("PASS\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,86 @@
+#!/usr/bin/env python3
+#
+# Run a linux-user test binary several times with a translation cache
+#
+# The first run fills the cache.  The second must give the same output
+# and restore translations from the cache.  The binary is then modified,
+# which must discard its cache file: the third run must still give the
+# same output without any hit, and the fourth must hit again.
+#
+# This work is licensed under the terms of the GNU GPL, version 2 or later.
+# See the COPYING file in the top-level directory.
+#
+# SPDX-License-Identifier: GPL-2.0-or-later
+
+import argparse
+import os
+import re
+import shlex
+import shutil
+import subprocess
+import sys
+from tempfile import TemporaryDirectory
+
+
+STATS_RE = re.compile(r"tb cache: (\d+) lookups, (\d+) hits")
+
+
+def get_args():
+    parser = argparse.ArgumentParser(description="A tb-cache test runner")
+    parser.add_argument("--qemu", help="Qemu binary for test",
+                        required=True)
+    parser.add_argument("--qargs", help="Qemu arguments for test",
+                        default="")
+    parser.add_argument("--binary", help="Binary to run",
+                        required=True)
+    return parser.parse_args()
+
+
+def run(args, cache_dir, binary):
+    """Run @binary once, returning its output and the number of hits"""
+    cmd = ([args.qemu] + shlex.split(args.qargs) +
+           ["-tb-cache", cache_dir, "-tb-cache-stats", binary])
+    result = subprocess.run(cmd, stdout=subprocess.PIPE,
+                            stderr=subprocess.PIPE, universal_newlines=True)
+    if result.returncode != 0:
+        sys.exit("{} failed with {}:\n{}".format(" ".join(cmd),
+                                                 result.returncode,
+                                                 result.stderr))
+    stats = STATS_RE.search(result.stderr)
+    if not stats:
+        sys.exit("no tb cache statistics in:\n{}".format(result.stderr))
+    print("{}: {} lookups, {} hits".format(os.path.basename(binary),
+                                           stats.group(1), stats.group(2)))
+    return result.stdout, int(stats.group(2))
+
+
+def check(cond, msg):
+    if not cond:
+        sys.exit("FAIL: " + msg)
+
+
+if __name__ == '__main__':
+    args = get_args()
+
+    with TemporaryDirectory() as tmpdir:
+        cache_dir = os.path.join(tmpdir, "cache")
+        # A copy that can be modified, the cache is per mapped file
+        binary = os.path.join(tmpdir, os.path.basename(args.binary))
+        shutil.copy2(args.binary, binary)
+
+        ref, _ = run(args, cache_dir, binary)
+        out, hits = run(args, cache_dir, binary)
+        check(out == ref, "output differs when restoring from the cache")
+        check(hits > 0, "nothing was restored from the cache")
+
+        # Trailing bytes are not loaded but change the file
+        with open(binary, "ab") as f:
+            f.write(b"\0" * 16)
+
+        out, hits = run(args, cache_dir, binary)
+        check(out == ref, "output differs after modifying the binary")
+        check(hits == 0, "stale translations were restored")
+
+        out, hits = run(args, cache_dir, binary)
+        check(out == ref, "output differs with the rebuilt cache")
+        check(hits > 0, "the cache was not rebuilt")
@@ -0,0 +1,96 @@
+/*
+ * Vector rotate by element (vrlb, vrlh, vrlw, vrld)
+ *
+ * These map onto the TCG rotlv vector op.  Each is checked against a
+ * scalar reference on random inputs.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define ITERATIONS  1000
+
+typedef union {
+    __int128 q;
+    uint8_t b[16];
+    uint16_t h[8];
+    uint32_t w[4];
+    uint64_t d[2];
+} Vr;
+
+#define VRL(INSN, D, A, B) \
+    asm(INSN " %0,%1,%2" : "=v"((D).q) : "v"((A).q), "v"((B).q))
+
+static uint64_t rol(uint64_t x, unsigned esize, unsigned sh)
+{
+    uint64_t mask = esize == 64 ? -1ull : (1ull << esize) - 1;
+
+    sh &= esize - 1;
+    x &= mask;
+    return sh ? ((x << sh) | (x >> (esize - sh))) & mask : x;
+}
+
+static uint64_t rand64(void)
+{
+    uint64_t r = 0;
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        r = (r << 16) ^ (random() & 0xffff);
+    }
+    return r;
+}
+
+static int check(const char *insn, unsigned esize, unsigned i,
+                 uint64_t a, uint64_t b, uint64_t got)
+{
+    uint64_t expect = rol(a, esize, b);
+
+    if (got != expect) {
+        printf("FAIL %s lane %u: a=%llx b=%llx got %llx expected %llx\n",
+               insn, i, (unsigned long long)a, (unsigned long long)b,
+               (unsigned long long)got, (unsigned long long)expect);
+        return 1;
+    }
+    return 0;
+}
+
+int main(void)
+{
+    Vr a, b, d;
+    int failures = 0;
+    unsigned n, i;
+
+    srandom(1);
+    for (n = 0; n < ITERATIONS; n++) {
+        a.d[0] = rand64();
+        a.d[1] = rand64();
+        b.d[0] = rand64();
+        b.d[1] = rand64();
+
+        VRL("vrlb", d, a, b);
+        for (i = 0; i < 16; i++) {
+            failures += check("vrlb", 8, i, a.b[i], b.b[i], d.b[i]);
+        }
+        VRL("vrlh", d, a, b);
+        for (i = 0; i < 8; i++) {
+            failures += check("vrlh", 16, i, a.h[i], b.h[i], d.h[i]);
+        }
+        VRL("vrlw", d, a, b);
+        for (i = 0; i < 4; i++) {
+            failures += check("vrlw", 32, i, a.w[i], b.w[i], d.w[i]);
+        }
+        VRL("vrld", d, a, b);
+        for (i = 0; i < 2; i++) {
+            failures += check("vrld", 64, i, a.d[i], b.d[i], d.d[i]);
+        }
+        if (failures) {
+            return EXIT_FAILURE;
+        }
+    }
+    printf("PASS\n");
+    return EXIT_SUCCESS;
+}
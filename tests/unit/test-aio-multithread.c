@@ -193,6 +193,94 @@ static void test_multi_co_schedule_10(void)
     test_multi_co_schedule(10);
 }
 
+/* aio_notify coalescing.  */
+
+#define NUM_NOTIFIERS 4
+
+static uint64_t count_wakeups;
+
+static void wakeup_bh_cb(void *opaque)
+{
+    qatomic_set(&count_wakeups, qatomic_read(&count_wakeups) + 1);
+}
+
+/*
+ * Hammer one AioContext with qemu_bh_schedule() from several threads.  Every
+ * call ends in aio_notify(), but most of them should be coalesced instead of
+ * writing to the EventNotifier.
+ */
+static void *notifier_thread(void *opaque)
+{
+    QEMUBH *bh = opaque;
+
+    while (!qatomic_mb_read(&now_stopping)) {
+        qemu_bh_schedule(bh);
+    }
+    return NULL;
+}
+
+static void test_multi_notify(int seconds)
+{
+    QemuThread notifiers[NUM_NOTIFIERS];
+    QEMUBH *bhs[NUM_NOTIFIERS];
+    uint64_t events, coalesced, wakeups;
+    int i;
+
+    count_wakeups = 0;
+    now_stopping = false;
+
+    create_aio_contexts();
+    events = stat64_get(&ctx[0]->notify_events);
+    coalesced = stat64_get(&ctx[0]->notify_coalesced);
+
+    for (i = 0; i < NUM_NOTIFIERS; i++) {
+        bhs[i] = aio_bh_new(ctx[0], wakeup_bh_cb, NULL);
+        qemu_thread_create(&notifiers[i], "notifier", notifier_thread, bhs[i],
+                           QEMU_THREAD_JOINABLE);
+    }
+
+    g_usleep(seconds * 1000000);
+
+    qatomic_mb_set(&now_stopping, true);
+    for (i = 0; i < NUM_NOTIFIERS; i++) {
+        qemu_thread_join(&notifiers[i]);
+    }
+
+    /* Let the iothread run the BHs scheduled last */
+    ctx_run(0, wakeup_bh_cb, NULL);
+    wakeups = qatomic_read(&count_wakeups);
+    events = stat64_get(&ctx[0]->notify_events) - events;
+    coalesced = stat64_get(&ctx[0]->notify_coalesced) - coalesced;
+
+    for (i = 0; i < NUM_NOTIFIERS; i++) {
+        qemu_bh_delete(bhs[i]);
+    }
+    join_aio_contexts();
+
+    /*
+     * An eventfd write needs a clear ctx->notified, and the iothread only
+     * clears it before running the BHs that were scheduled, so every write
+     * is followed by at least one wakeup.  Each notifier thread schedules
+     * its BH again as soon as it runs, so with several of them some
+     * notifications must find ctx->notified still set and be coalesced.
+     */
+    g_assert_cmpint(events, <=, wakeups);
+    g_assert_cmpint(coalesced, >, 0);
+    g_test_message("wakeups %" PRIu64 "/s, eventfd writes %" PRIu64 "/s, "
+                   "coalesced notifications %" PRIu64 "/s",
+                   wakeups / seconds, events / seconds, coalesced / seconds);
+}
+
+static void test_multi_notify_1(void)
+{
+    test_multi_notify(1);
+}
+
+static void test_multi_notify_10(void)
+{
+    test_multi_notify(10);
+}
+
 /* CoMutex thread-safety.  */
 
 static uint32_t atomic_counter;
@@ -441,6 +529,7 @@ int main(int argc, char **argv)
     g_test_add_func("/aio/multi/lifecycle", test_lifecycle);
     if (g_test_quick()) {
         g_test_add_func("/aio/multi/schedule", test_multi_co_schedule_1);
+        g_test_add_func("/aio/multi/notify", test_multi_notify_1);
         g_test_add_func("/aio/multi/mutex/contended", test_multi_co_mutex_1);
         g_test_add_func("/aio/multi/mutex/handoff", test_multi_co_mutex_2_3);
 #ifdef CONFIG_LINUX
@@ -449,6 +538,7 @@ int main(int argc, char **argv)
         g_test_add_func("/aio/multi/mutex/pthread", test_multi_mutex_1);
     } else {
         g_test_add_func("/aio/multi/schedule", test_multi_co_schedule_10);
+        g_test_add_func("/aio/multi/notify", test_multi_notify_10);
         g_test_add_func("/aio/multi/mutex/contended", test_multi_co_mutex_10);
         g_test_add_func("/aio/multi/mutex/handoff", test_multi_co_mutex_2_30);
 #ifdef CONFIG_LINUX
@@ -451,6 +451,70 @@ static void test_lifecycle(void)
     g_assert(done); /* expect done to be true (second time) */
 }
 
+/*
+ * Check that a pool sized for the workload makes coroutine creation reuse
+ * stacks, including stacks whose memory was released with
+ * qemu_coroutine_trim().
+ */
+
+#define POOL_TEST_COROUTINES 256
+
+static void coroutine_fn dirty_stack_and_yield(void *opaque)
+{
+    char buf[64 * 1024];
+    int *count = opaque;
+
+    memset(buf, 0x5a, sizeof(buf));
+    qemu_coroutine_yield();
+    g_assert_cmpint(buf[sizeof(buf) - 1], ==, 0x5a);
+    (*count)++;
+}
+
+static void run_pool_test_coroutines(Coroutine **cos, int *count)
+{
+    int i;
+
+    for (i = 0; i < POOL_TEST_COROUTINES; i++) {
+        cos[i] = qemu_coroutine_create(dirty_stack_and_yield, count);
+        qemu_coroutine_enter(cos[i]);
+    }
+    for (i = 0; i < POOL_TEST_COROUTINES; i++) {
+        qemu_coroutine_enter(cos[i]);
+    }
+}
+
+static void test_pool_size(void)
+{
+    Coroutine *cos[POOL_TEST_COROUTINES];
+    CoroutinePoolStats before, after;
+    int count = 0;
+    int i;
+
+    qemu_coroutine_inc_pool_size(POOL_TEST_COROUTINES);
+
+    run_pool_test_coroutines(cos, &count);
+    g_assert_cmpint(count, ==, POOL_TEST_COROUTINES);
+
+    /* All of them are in the pool now */
+    for (i = 0; i < POOL_TEST_COROUTINES; i++) {
+        qemu_coroutine_trim(cos[i]);
+    }
+
+    qemu_coroutine_get_pool_stats(&before);
+    run_pool_test_coroutines(cos, &count);
+    qemu_coroutine_get_pool_stats(&after);
+
+    g_assert_cmpint(count, ==, 2 * POOL_TEST_COROUTINES);
+    g_assert_cmpint(after.allocated, ==, before.allocated);
+
+    /* Shrinking the pool frees the excess and trims the rest */
+    before = after;
+    qemu_coroutine_dec_pool_size(POOL_TEST_COROUTINES);
+    qemu_coroutine_get_pool_stats(&after);
+
+    g_assert_cmpint(after.freed, >, before.freed);
+    g_assert_cmpint(after.trimmed, >, before.trimmed);
+}
 
 #define RECORD_SIZE 10 /* Leave some room for expansion */
 struct coroutine_position {
@@ -652,6 +716,9 @@ int main(int argc, char **argv)
     }
 
     g_test_add_func("/basic/lifecycle", test_lifecycle);
+    if (CONFIG_COROUTINE_POOL) {
+        g_test_add_func("/basic/pool-size", test_pool_size);
+    }
     g_test_add_func("/basic/yield", test_yield);
     g_test_add_func("/basic/nesting", test_nesting);
     g_test_add_func("/basic/self", test_self);
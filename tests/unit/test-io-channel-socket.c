@@ -444,6 +444,7 @@ static void test_io_channel_unix_fd_pass(void)
                             G_N_ELEMENTS(iosend),
                             fdsend,
                             G_N_ELEMENTS(fdsend),
+                            0,
                             &error_abort);
 
     qio_channel_readv_full(dst,
@@ -552,6 +553,68 @@ static void test_io_channel_ipv4_fd(void)
 }
 
 
+static void test_io_channel_ipv4_zero_copy(void)
+{
+    SocketAddress *listen_addr = g_new0(SocketAddress, 1);
+    SocketAddress *connect_addr = g_new0(SocketAddress, 1);
+    QIOChannel *src, *dst, *srv;
+    char bufsend[4096], bufrecv[4096];
+    struct iovec iosend[4];
+    size_t i;
+
+    listen_addr->type = SOCKET_ADDRESS_TYPE_INET;
+    listen_addr->u.inet = (InetSocketAddress) {
+        .host = g_strdup("127.0.0.1"),
+        .port = NULL, /* Auto-select */
+    };
+
+    connect_addr->type = SOCKET_ADDRESS_TYPE_INET;
+    connect_addr->u.inet = (InetSocketAddress) {
+        .host = g_strdup("127.0.0.1"),
+        .port = NULL, /* Filled in later */
+    };
+
+    test_io_channel_setup_sync(listen_addr, connect_addr, &srv, &src, &dst);
+
+    if (!qio_channel_has_feature(src, QIO_CHANNEL_FEATURE_WRITE_ZERO_COPY)) {
+        g_test_skip("MSG_ZEROCOPY not supported by the host");
+        goto cleanup;
+    }
+
+    for (i = 0; i < sizeof(bufsend); i++) {
+        bufsend[i] = i;
+    }
+    for (i = 0; i < G_N_ELEMENTS(iosend); i++) {
+        iosend[i].iov_base = bufsend;
+        iosend[i].iov_len = sizeof(bufsend);
+    }
+
+    g_assert_cmpint(qio_channel_writev_full_all(src, iosend,
+                                                G_N_ELEMENTS(iosend),
+                                                NULL, 0,
+                                                QIO_CHANNEL_WRITE_FLAG_ZERO_COPY,
+                                                &error_abort), ==, 0);
+
+    for (i = 0; i < G_N_ELEMENTS(iosend); i++) {
+        g_assert_cmpint(qio_channel_read_all(dst, bufrecv, sizeof(bufrecv),
+                                             &error_abort), ==, 0);
+        g_assert(memcmp(bufsend, bufrecv, sizeof(bufrecv)) == 0);
+    }
+
+    /* Loopback has no NIC to do the copy, so the kernel may copy itself */
+    g_assert_cmpint(qio_channel_flush(src, &error_abort), >=, 0);
+    g_assert_cmpint(QIO_CHANNEL_SOCKET(src)->zero_copy_sent, ==,
+                    QIO_CHANNEL_SOCKET(src)->zero_copy_queued);
+
+ cleanup:
+    object_unref(OBJECT(src));
+    object_unref(OBJECT(dst));
+    object_unref(OBJECT(srv));
+    qapi_free_SocketAddress(listen_addr);
+    qapi_free_SocketAddress(connect_addr);
+}
+
+
 int main(int argc, char **argv)
 {
     bool has_ipv4, has_ipv6;
@@ -579,6 +642,8 @@ int main(int argc, char **argv)
                         test_io_channel_ipv4_async);
         g_test_add_func("/io/channel/socket/ipv4-fd",
                         test_io_channel_ipv4_fd);
+        g_test_add_func("/io/channel/socket/ipv4-zero-copy",
+                        test_io_channel_ipv4_zero_copy);
     }
     if (has_ipv6) {
         g_test_add_func("/io/channel/socket/ipv6-sync",
@@ -30,12 +30,25 @@
 /** Records were dropped event ID */
 #define DROPPED_EVENT_ID (~(uint64_t)0 - 1)
 
-/** Trace record is valid */
-#define TRACE_RECORD_VALID ((uint64_t)1 << 63)
-
 /*
- * Trace records are written out by a dedicated thread.  The thread waits for
- * records to become available, writes them out, and then waits again.
+ * Each thread that emits trace events gets its own ring buffer, so that
+ * recording an event needs no atomic read-modify-write and threads do not
+ * contend with each other.  A ring has a single producer, the thread that
+ * owns it, and a single consumer, the writeout thread:
+ *
+ * - the producer fills a record at @head and then publishes it by moving
+ *   @head forward with release semantics;
+ * - the consumer writes out records between @tail and @head, and then
+ *   releases the space by moving @tail forward.
+ *
+ * @head and @tail are free-running and only reduced modulo the buffer size
+ * when accessing @buf.  Rings are never unlinked while their thread is
+ * alive; once the thread exits, the writeout thread drains and frees it.
+ *
+ * Within a round the writeout thread merges the rings by timestamp.  A
+ * record that was still being filled when a round started is written in
+ * the next one, so the file is only mostly sorted; simpletrace.py sorts
+ * the records again with a bounded lookahead when reading them.
  */
 static GMutex trace_lock;
 static GCond trace_available_cond;
@@ -45,14 +58,28 @@ static bool trace_available;
 static bool trace_writeout_enabled;
 
 enum {
-    TRACE_BUF_LEN = 4096 * 64,
-    TRACE_BUF_FLUSH_THRESHOLD = TRACE_BUF_LEN / 4,
+    TRACE_THREAD_BUF_LEN = 4096 * 16,
+    TRACE_THREAD_BUF_FLUSH_THRESHOLD = TRACE_THREAD_BUF_LEN / 4,
 };
 
-uint8_t trace_buf[TRACE_BUF_LEN];
-static volatile gint trace_idx;
-static unsigned int writeout_idx;
-static volatile gint dropped_events;
+QEMU_BUILD_BUG_ON(TRACE_THREAD_BUF_LEN & (TRACE_THREAD_BUF_LEN - 1));
+
+typedef struct TraceThreadBuffer {
+    unsigned int head;
+    unsigned int tail;
+    unsigned int dropped;
+    /* head at the start of the writeout round, see write_trace_records() */
+    unsigned int round_head;
+    bool busy;      /* a record is being filled, guards against reentrancy */
+    bool orphaned;  /* the owner thread has exited */
+    struct TraceThreadBuffer *next;
+    uint8_t buf[TRACE_THREAD_BUF_LEN];
+} TraceThreadBuffer;
+
+static void trace_thread_buffer_orphan(gpointer opaque);
+
+static GPrivate trace_thread_buffer = G_PRIVATE_INIT(trace_thread_buffer_orphan);
+static TraceThreadBuffer *trace_buffers;
 static uint32_t trace_pid;
 static FILE *trace_fp;
 static char *trace_file_name;
@@ -76,53 +103,79 @@ typedef struct {
 } TraceLogHeader;
 
 
-static void read_from_buffer(unsigned int idx, void *dataptr, size_t size);
-static unsigned int write_to_buffer(unsigned int idx, void *dataptr, size_t size);
+static void read_from_buffer(TraceThreadBuffer *tb, unsigned int idx,
+                             void *dataptr, size_t size)
+{
+    unsigned int off = idx % TRACE_THREAD_BUF_LEN;
+    size_t first = MIN(size, TRACE_THREAD_BUF_LEN - off);
+
+    memcpy(dataptr, &tb->buf[off], first);
+    memcpy((uint8_t *)dataptr + first, &tb->buf[0], size - first);
+}
 
-static void clear_buffer_range(unsigned int idx, size_t len)
+static unsigned int write_to_buffer(TraceThreadBuffer *tb, unsigned int idx,
+                                    const void *dataptr, size_t size)
 {
-    uint32_t num = 0;
-    while (num < len) {
-        if (idx >= TRACE_BUF_LEN) {
-            idx = idx % TRACE_BUF_LEN;
-        }
-        trace_buf[idx++] = 0;
-        num++;
-    }
+    unsigned int off = idx % TRACE_THREAD_BUF_LEN;
+    size_t first = MIN(size, TRACE_THREAD_BUF_LEN - off);
+
+    memcpy(&tb->buf[off], dataptr, first);
+    memcpy(&tb->buf[0], (const uint8_t *)dataptr + first, size - first);
+    return idx + size; /* most callers wants to know where to write next */
 }
+
 /**
- * Read a trace record from the trace buffer
- *
- * @idx         Trace buffer index
- * @record      Trace record to fill
+ * Write out a record from a thread buffer
  *
- * Returns false if the record is not valid.
+ * @tb          Thread buffer
+ * @idx         Index of the record, which must be complete
+ * @length      Length of the record
  */
-static bool get_trace_record(unsigned int idx, TraceRecord **recordptr)
+static void write_trace_record(TraceThreadBuffer *tb, unsigned int idx,
+                               uint32_t length)
 {
-    uint64_t event_flag = 0;
-    TraceRecord record;
-    /* read the event flag to see if its a valid record */
-    read_from_buffer(idx, &record, sizeof(event_flag));
+    unsigned int off = idx % TRACE_THREAD_BUF_LEN;
+    size_t first = MIN(length, TRACE_THREAD_BUF_LEN - off);
+    uint64_t type = TRACE_RECORD_TYPE_EVENT;
+    size_t unused __attribute__ ((unused));
 
-    if (!(record.event & TRACE_RECORD_VALID)) {
-        return false;
+    unused = fwrite(&type, sizeof(type), 1, trace_fp);
+    unused = fwrite(&tb->buf[off], first, 1, trace_fp);
+    if (length > first) {
+        unused = fwrite(&tb->buf[0], length - first, 1, trace_fp);
     }
+}
 
-    smp_rmb(); /* read memory barrier before accessing record */
-    /* read the record header to know record length */
-    read_from_buffer(idx, &record, sizeof(TraceRecord));
-    *recordptr = malloc(record.length); /* don't use g_malloc, can deadlock when traced */
-    /* make a copy of record to avoid being overwritten */
-    read_from_buffer(idx, *recordptr, record.length);
-    smp_rmb(); /* memory barrier before clearing valid flag */
-    (*recordptr)->event &= ~TRACE_RECORD_VALID;
-    /* clear the trace buffer range for consumed record otherwise any byte
-     * with its MSB set may be considered as a valid event id when the writer
-     * thread crosses this range of buffer again.
-     */
-    clear_buffer_range(idx, record.length);
-    return true;
+/* Called by glib when a thread that has emitted trace events exits */
+static void trace_thread_buffer_orphan(gpointer opaque)
+{
+    TraceThreadBuffer *tb = opaque;
+
+    qatomic_store_release(&tb->orphaned, true);
+}
+
+static TraceThreadBuffer *trace_thread_buffer_get(void)
+{
+    TraceThreadBuffer *tb = g_private_get(&trace_thread_buffer);
+    TraceThreadBuffer *old;
+
+    if (likely(tb)) {
+        return tb;
+    }
+
+    /* don't use g_malloc, can deadlock when traced */
+    tb = calloc(1, sizeof(*tb));
+    if (!tb) {
+        return NULL;
+    }
+    g_private_set(&trace_thread_buffer, tb);
+
+    /* Only ever push at the head, the writeout thread never unlinks it */
+    do {
+        old = qatomic_read(&trace_buffers);
+        tb->next = old;
+    } while (qatomic_cmpxchg(&trace_buffers, old, tb) != old);
+    return tb;
 }
 
 /**
@@ -154,43 +207,96 @@ static void wait_for_trace_records_available(void)
     g_mutex_unlock(&trace_lock);
 }
 
-static gpointer writeout_thread(gpointer opaque)
+static void write_dropped_record(unsigned int dropped_count)
 {
-    TraceRecord *recordptr;
     union {
         TraceRecord rec;
         uint8_t bytes[sizeof(TraceRecord) + sizeof(uint64_t)];
     } dropped;
-    unsigned int idx = 0;
-    int dropped_count;
-    size_t unused __attribute__ ((unused));
     uint64_t type = TRACE_RECORD_TYPE_EVENT;
+    size_t unused __attribute__ ((unused));
 
-    for (;;) {
-        wait_for_trace_records_available();
+    dropped.rec.event = DROPPED_EVENT_ID;
+    dropped.rec.timestamp_ns = get_clock();
+    dropped.rec.length = sizeof(TraceRecord) + sizeof(uint64_t);
+    dropped.rec.pid = trace_pid;
+    dropped.rec.arguments[0] = dropped_count;
+    unused = fwrite(&type, sizeof(type), 1, trace_fp);
+    unused = fwrite(&dropped.rec, dropped.rec.length, 1, trace_fp);
+}
 
-        if (g_atomic_int_get(&dropped_events)) {
-            dropped.rec.event = DROPPED_EVENT_ID;
-            dropped.rec.timestamp_ns = get_clock();
-            dropped.rec.length = sizeof(TraceRecord) + sizeof(uint64_t);
-            dropped.rec.pid = trace_pid;
-            do {
-                dropped_count = g_atomic_int_get(&dropped_events);
-            } while (!g_atomic_int_compare_and_exchange(&dropped_events,
-                                                        dropped_count, 0));
-            dropped.rec.arguments[0] = dropped_count;
-            unused = fwrite(&type, sizeof(type), 1, trace_fp);
-            unused = fwrite(&dropped.rec, dropped.rec.length, 1, trace_fp);
+/*
+ * Write out the records that were complete when the round started, merging
+ * the thread buffers by timestamp.  The number of threads that trace is
+ * small, so a linear scan for the oldest record is good enough.
+ */
+static void write_trace_records(void)
+{
+    TraceThreadBuffer *first, *tb, *oldest;
+    TraceRecord record, oldest_record;
+    unsigned int dropped_count = 0;
+
+    /* Buffers of new threads are pushed in front, they wait for next round */
+    first = qatomic_read(&trace_buffers);
+    for (tb = first; tb; tb = tb->next) {
+        dropped_count += qatomic_xchg(&tb->dropped, 0);
+        tb->round_head = qatomic_load_acquire(&tb->head);
+    }
+    if (dropped_count) {
+        write_dropped_record(dropped_count);
+    }
+
+    for (;;) {
+        oldest = NULL;
+        for (tb = first; tb; tb = tb->next) {
+            unsigned int tail = tb->tail;
+
+            if (tail == tb->round_head) {
+                continue;
+            }
+            read_from_buffer(tb, tail, &record, sizeof(record));
+            if (!oldest || record.timestamp_ns < oldest_record.timestamp_ns) {
+                oldest = tb;
+                oldest_record = record;
+            }
+        }
+        if (!oldest) {
+            break;
         }
+        write_trace_record(oldest, oldest->tail, oldest_record.length);
+        qatomic_store_release(&oldest->tail,
+                              oldest->tail + oldest_record.length);
+    }
+}
 
-        while (get_trace_record(idx, &recordptr)) {
-            unused = fwrite(&type, sizeof(type), 1, trace_fp);
-            unused = fwrite(recordptr, recordptr->length, 1, trace_fp);
-            writeout_idx += recordptr->length;
-            free(recordptr); /* don't use g_free, can deadlock when traced */
-            idx = writeout_idx % TRACE_BUF_LEN;
+/* Free the buffers of exited threads, once they have been written out */
+static void reap_trace_buffers(void)
+{
+    TraceThreadBuffer *prev = qatomic_read(&trace_buffers);
+    TraceThreadBuffer *tb;
+
+    /* Threads may push concurrently, so the list head stays */
+    if (!prev) {
+        return;
+    }
+    while ((tb = prev->next) != NULL) {
+        if (qatomic_load_acquire(&tb->orphaned) &&
+            tb->tail == qatomic_read(&tb->head) &&
+            !qatomic_read(&tb->dropped)) {
+            prev->next = tb->next;
+            free(tb); /* don't use g_free, can deadlock when traced */
+        } else {
+            prev = tb;
         }
+    }
+}
 
+static gpointer writeout_thread(gpointer opaque)
+{
+    for (;;) {
+        wait_for_trace_records_available();
+        write_trace_records();
+        reap_trace_buffers();
         fflush(trace_fp);
     }
     return NULL;
@@ -198,84 +304,69 @@ static gpointer writeout_thread(gpointer opaque)
 
 void trace_record_write_u64(TraceBufferRecord *rec, uint64_t val)
 {
-    rec->rec_off = write_to_buffer(rec->rec_off, &val, sizeof(uint64_t));
+    rec->rec_off = write_to_buffer(rec->tbuf, rec->rec_off,
+                                   &val, sizeof(uint64_t));
 }
 
 void trace_record_write_str(TraceBufferRecord *rec, const char *s, uint32_t slen)
 {
     /* Write string length first */
-    rec->rec_off = write_to_buffer(rec->rec_off, &slen, sizeof(slen));
+    rec->rec_off = write_to_buffer(rec->tbuf, rec->rec_off,
+                                   &slen, sizeof(slen));
     /* Write actual string now */
-    rec->rec_off = write_to_buffer(rec->rec_off, (void*)s, slen);
+    rec->rec_off = write_to_buffer(rec->tbuf, rec->rec_off, s, slen);
 }
 
 int trace_record_start(TraceBufferRecord *rec, uint32_t event, size_t datasize)
 {
-    unsigned int idx, rec_off, old_idx, new_idx;
-    uint32_t rec_len = sizeof(TraceRecord) + datasize;
-    uint64_t event_u64 = event;
-    uint64_t timestamp_ns = get_clock();
-
-    do {
-        old_idx = g_atomic_int_get(&trace_idx);
-        smp_rmb();
-        new_idx = old_idx + rec_len;
-
-        if (new_idx - writeout_idx > TRACE_BUF_LEN) {
-            /* Trace Buffer Full, Event dropped ! */
-            g_atomic_int_inc(&dropped_events);
-            return -ENOSPC;
-        }
-    } while (!g_atomic_int_compare_and_exchange(&trace_idx, old_idx, new_idx));
-
-    idx = old_idx % TRACE_BUF_LEN;
+    TraceThreadBuffer *tb = trace_thread_buffer_get();
+    TraceRecord record = {
+        .event = event,
+        .timestamp_ns = get_clock(),
+        .length = sizeof(TraceRecord) + datasize,
+        .pid = trace_pid,
+    };
+    unsigned int head;
+
+    if (unlikely(!tb)) {
+        return -ENOMEM;
+    }
 
-    rec_off = idx;
-    rec_off = write_to_buffer(rec_off, &event_u64, sizeof(event_u64));
-    rec_off = write_to_buffer(rec_off, &timestamp_ns, sizeof(timestamp_ns));
-    rec_off = write_to_buffer(rec_off, &rec_len, sizeof(rec_len));
-    rec_off = write_to_buffer(rec_off, &trace_pid, sizeof(trace_pid));
+    /* An event from a signal handler that interrupted this thread's tracing */
+    if (unlikely(tb->busy)) {
+        qatomic_inc(&tb->dropped);
+        return -EBUSY;
+    }
+    tb->busy = true;
+    barrier();
+
+    head = tb->head;
+    if (head + record.length - qatomic_load_acquire(&tb->tail) >
+        TRACE_THREAD_BUF_LEN) {
+        /* Trace Buffer Full, Event dropped ! */
+        qatomic_inc(&tb->dropped);
+        barrier();
+        tb->busy = false;
+        return -ENOSPC;
+    }
 
-    rec->tbuf_idx = idx;
-    rec->rec_off  = (idx + sizeof(TraceRecord)) % TRACE_BUF_LEN;
+    rec->tbuf = tb;
+    rec->tbuf_idx = head;
+    rec->rec_off = write_to_buffer(tb, head, &record, sizeof(record));
     return 0;
 }
 
-static void read_from_buffer(unsigned int idx, void *dataptr, size_t size)
+void trace_record_finish(TraceBufferRecord *rec)
 {
-    uint8_t *data_ptr = dataptr;
-    uint32_t x = 0;
-    while (x < size) {
-        if (idx >= TRACE_BUF_LEN) {
-            idx = idx % TRACE_BUF_LEN;
-        }
-        data_ptr[x++] = trace_buf[idx++];
-    }
-}
+    TraceThreadBuffer *tb = rec->tbuf;
 
-static unsigned int write_to_buffer(unsigned int idx, void *dataptr, size_t size)
-{
-    uint8_t *data_ptr = dataptr;
-    uint32_t x = 0;
-    while (x < size) {
-        if (idx >= TRACE_BUF_LEN) {
-            idx = idx % TRACE_BUF_LEN;
-        }
-        trace_buf[idx++] = data_ptr[x++];
-    }
-    return idx; /* most callers wants to know where to write next */
-}
+    /* publish the record to the writeout thread */
+    qatomic_store_release(&tb->head, rec->rec_off);
+    barrier();
+    tb->busy = false;
 
-void trace_record_finish(TraceBufferRecord *rec)
-{
-    TraceRecord record;
-    read_from_buffer(rec->tbuf_idx, &record, sizeof(TraceRecord));
-    smp_wmb(); /* write barrier before marking as valid */
-    record.event |= TRACE_RECORD_VALID;
-    write_to_buffer(rec->tbuf_idx, &record, sizeof(TraceRecord));
-
-    if (((unsigned int)g_atomic_int_get(&trace_idx) - writeout_idx)
-        > TRACE_BUF_FLUSH_THRESHOLD) {
+    if (rec->rec_off - qatomic_read(&tb->tail) >
+        TRACE_THREAD_BUF_FLUSH_THRESHOLD) {
         flush_trace_file(false);
     }
 }
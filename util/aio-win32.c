@@ -385,7 +385,9 @@ bool aio_poll(AioContext *ctx, bool blocking)
         HANDLE event;
         int ret;
 
-        timeout = blocking && !have_select_revents
+        /* Don't block if aio_notify() was called, see aio_notify() */
+        timeout = blocking && !have_select_revents &&
+                  !qatomic_read(&ctx->notified)
             ? qemu_timeout_ns_to_ms(aio_compute_timeout(ctx)) : 0;
         ret = WaitForMultipleObjects(count, events, FALSE, timeout);
         if (blocking) {
@@ -266,7 +266,8 @@ aio_ctx_prepare(GSource *source, gint    *timeout)
     /* We assume there is no timeout already supplied */
     *timeout = qemu_timeout_ns_to_ms(aio_compute_timeout(ctx));
 
-    if (aio_prepare(ctx)) {
+    /* Don't block if aio_notify() was called, see aio_notify() */
+    if (aio_prepare(ctx) || qatomic_read(&ctx->notified)) {
         *timeout = 0;
     }
 
@@ -418,7 +419,8 @@ LuringState *aio_setup_linux_io_uring(AioContext *ctx, Error **errp)
         return ctx->linux_io_uring;
     }
 
-    ctx->linux_io_uring = luring_init(errp);
+    ctx->linux_io_uring = luring_init(ctx->uring_sqpoll,
+                                      ctx->uring_fixed_buffers, errp);
     if (!ctx->linux_io_uring) {
         return NULL;
     }
@@ -434,21 +436,51 @@ LuringState *aio_get_linux_io_uring(AioContext *ctx)
 }
 #endif
 
+void aio_context_set_io_uring_params(AioContext *ctx, bool sqpoll,
+                                     bool fixed_buffers, Error **errp)
+{
+#ifdef CONFIG_LINUX_IO_URING
+    if (ctx->linux_io_uring &&
+        (sqpoll != ctx->uring_sqpoll ||
+         fixed_buffers != ctx->uring_fixed_buffers)) {
+        error_setg(errp, "io_uring parameters cannot be changed while the "
+                   "io_uring engine is in use");
+        return;
+    }
+#else
+    if (sqpoll || fixed_buffers) {
+        error_setg(errp, "io_uring is not supported in this build");
+        return;
+    }
+#endif
+
+    ctx->uring_sqpoll = sqpoll;
+    ctx->uring_fixed_buffers = fixed_buffers;
+}
+
 void aio_notify(AioContext *ctx)
 {
     /*
-     * Write e.g. bh->flags before writing ctx->notified.  Pairs with smp_mb in
-     * aio_notify_accept.
+     * Write e.g. bh->flags before writing ctx->notified, and write
+     * ctx->notified before reading ctx->notify_me.  The implicit memory
+     * barrier pairs with smp_mb in aio_notify_accept, and with smp_mb in
+     * aio_ctx_prepare or aio_poll.
      */
-    smp_wmb();
-    qatomic_set(&ctx->notified, true);
+    if (qatomic_xchg(&ctx->notified, true)) {
+        /*
+         * Somebody else notified ctx since the last aio_notify_accept.  The
+         * event loop does not block while ctx->notified is set, and it
+         * looks at bottom halves etc. only after clearing it, so it will
+         * see whatever the caller did before aio_notify.  Coalesce this
+         * notification with the earlier one and skip the system call.
+         */
+        stat64_add(&ctx->notify_coalesced, 1);
+        trace_aio_notify_coalesced(ctx);
+        return;
+    }
 
-    /*
-     * Write ctx->notified before reading ctx->notify_me.  Pairs
-     * with smp_mb in aio_ctx_prepare or aio_poll.
-     */
-    smp_mb();
     if (qatomic_read(&ctx->notify_me)) {
+        stat64_add(&ctx->notify_events, 1);
         event_notifier_set(&ctx->notifier);
     }
 }
@@ -556,6 +588,12 @@ AioContext *aio_context_new(Error **errp)
 
     ctx->aio_max_batch = 0;
 
+    ctx->uring_sqpoll = false;
+    ctx->uring_fixed_buffers = false;
+
+    stat64_init(&ctx->notify_events, 0);
+    stat64_init(&ctx->notify_coalesced, 0);
+
     return ctx;
 fail:
     g_source_destroy(&ctx->source);
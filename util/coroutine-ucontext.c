@@ -52,6 +52,9 @@ typedef struct {
 #endif
     sigjmp_buf env;
 
+    /* Lowest stack address still in use after the coroutine terminated */
+    void *terminate_sp;
+
 #ifdef CONFIG_TSAN
     void *tsan_co_fiber;
     void *tsan_caller_fiber;
@@ -280,6 +283,37 @@ void qemu_coroutine_delete(Coroutine *co_)
     g_free(co);
 }
 
+void qemu_coroutine_trim(Coroutine *co_)
+{
+#if !defined(CONFIG_DEBUG_STACK_USAGE) && \
+    !defined(HOST_IA64) && !defined(HOST_HPPA)
+    CoroutineUContext *co = DO_UPCAST(CoroutineUContext, base, co_);
+    uintptr_t pagesz = qemu_real_host_page_size;
+    uintptr_t stack = (uintptr_t)co->stack;
+    uintptr_t sp = (uintptr_t)co->terminate_sp;
+    uintptr_t start, end;
+
+    /*
+     * terminate_sp is not on the coroutine stack if the compiler placed the
+     * local variable elsewhere, e.g. on an ASAN fake stack; don't guess then.
+     */
+    if (sp <= stack || sp >= stack + co->stack_size) {
+        return;
+    }
+
+    /*
+     * The stack grows down.  Keep the guard page at the bottom as well as the
+     * frames of coroutine_trampoline() and qemu_coroutine_switch() at the top,
+     * plus one page of slack for the red zone.
+     */
+    start = stack + pagesz;
+    end = QEMU_ALIGN_DOWN(sp, pagesz) - pagesz;
+    if (end > start) {
+        qemu_madvise((void *)start, end - start, QEMU_MADV_DONTNEED);
+    }
+#endif
+}
+
 /* This function is marked noinline to prevent GCC from inlining it
  * into coroutine_trampoline(). If we allow it to do that then it
  * hoists the code to get the address of the TLS variable "current"
@@ -299,6 +333,10 @@ qemu_coroutine_switch(Coroutine *from_, Coroutine *to_,
 
     current = to_;
 
+    if (action == COROUTINE_TERMINATE) {
+        from->terminate_sp = &ret;
+    }
+
     ret = sigsetjmp(from->env, 0);
     if (ret == 0) {
         start_switch_fiber_asan(action, &fake_stack_save, to->stack,
@@ -18,28 +18,56 @@
 #include "qemu/atomic.h"
 #include "qemu/coroutine.h"
 #include "qemu/coroutine_int.h"
+#include "qemu/stats64.h"
 #include "block/aio.h"
 
 enum {
-    POOL_BATCH_SIZE = 64,
+    POOL_MIN_BATCH_SIZE = 64,
 };
 
 /** Free list to speed up creation */
 static QSLIST_HEAD(, Coroutine) release_pool = QSLIST_HEAD_INITIALIZER(pool);
+static unsigned int pool_batch_size = POOL_MIN_BATCH_SIZE;
 static unsigned int release_pool_size;
 static __thread QSLIST_HEAD(, Coroutine) alloc_pool = QSLIST_HEAD_INITIALIZER(pool);
 static __thread unsigned int alloc_pool_size;
 static __thread Notifier coroutine_pool_cleanup_notifier;
 
+/* Pool statistics, only updated on the slow paths */
+static Stat64 pool_allocated;
+static Stat64 pool_freed;
+static Stat64 pool_trimmed;
+
+/*
+ * Put a coroutine that is not expected to be reused soon in the release pool
+ * if there is room, or free it.  Its stack is idle, so give the memory back;
+ * it is faulted in again, local to the NUMA node of the thread that reuses
+ * the coroutine.
+ */
+static void coroutine_release_idle(Coroutine *co)
+{
+    if (qatomic_read(&release_pool_size) < qatomic_read(&pool_batch_size) * 2) {
+        qemu_coroutine_trim(co);
+        stat64_add(&pool_trimmed, 1);
+        QSLIST_INSERT_HEAD_ATOMIC(&release_pool, co, pool_next);
+        qatomic_inc(&release_pool_size);
+    } else {
+        stat64_add(&pool_freed, 1);
+        qemu_coroutine_delete(co);
+    }
+}
+
 static void coroutine_pool_cleanup(Notifier *n, void *value)
 {
     Coroutine *co;
     Coroutine *tmp;
 
+    /* Hand the coroutines of the exiting thread over to other threads */
     QSLIST_FOREACH_SAFE(co, &alloc_pool, pool_next, tmp) {
         QSLIST_REMOVE_HEAD(&alloc_pool, pool_next);
-        qemu_coroutine_delete(co);
+        coroutine_release_idle(co);
     }
+    alloc_pool_size = 0;
 }
 
 Coroutine *qemu_coroutine_create(CoroutineEntry *entry, void *opaque)
@@ -49,7 +77,7 @@ Coroutine *qemu_coroutine_create(CoroutineEntry *entry, void *opaque)
     if (CONFIG_COROUTINE_POOL) {
         co = QSLIST_FIRST(&alloc_pool);
         if (!co) {
-            if (release_pool_size > POOL_BATCH_SIZE) {
+            if (release_pool_size > POOL_MIN_BATCH_SIZE) {
                 /* Slow path; a good place to register the destructor, too.  */
                 if (!coroutine_pool_cleanup_notifier.notify) {
                     coroutine_pool_cleanup_notifier.notify = coroutine_pool_cleanup;
@@ -72,6 +100,8 @@ Coroutine *qemu_coroutine_create(CoroutineEntry *entry, void *opaque)
     }
 
     if (!co) {
+        trace_qemu_coroutine_new(alloc_pool_size, release_pool_size);
+        stat64_add(&pool_allocated, 1);
         co = qemu_coroutine_new();
     }
 
@@ -86,16 +116,19 @@ static void coroutine_delete(Coroutine *co)
     co->caller = NULL;
 
     if (CONFIG_COROUTINE_POOL) {
-        if (release_pool_size < POOL_BATCH_SIZE * 2) {
+        unsigned int batch_size = qatomic_read(&pool_batch_size);
+
+        if (release_pool_size < batch_size * 2) {
             QSLIST_INSERT_HEAD_ATOMIC(&release_pool, co, pool_next);
             qatomic_inc(&release_pool_size);
             return;
         }
-        if (alloc_pool_size < POOL_BATCH_SIZE) {
+        if (alloc_pool_size < batch_size) {
             QSLIST_INSERT_HEAD(&alloc_pool, co, pool_next);
             alloc_pool_size++;
             return;
         }
+        stat64_add(&pool_freed, 1);
     }
 
     qemu_coroutine_delete(co);
@@ -198,6 +231,41 @@ bool qemu_coroutine_entered(Coroutine *co)
     return co->caller;
 }
 
+void qemu_coroutine_inc_pool_size(unsigned int additional_pool_size)
+{
+    qatomic_add(&pool_batch_size, additional_pool_size);
+}
+
+void qemu_coroutine_dec_pool_size(unsigned int removing_pool_size)
+{
+    QSLIST_HEAD(, Coroutine) idle = QSLIST_HEAD_INITIALIZER(idle);
+    Coroutine *co;
+    Coroutine *tmp;
+
+    qatomic_sub(&pool_batch_size, removing_pool_size);
+
+    /*
+     * The workload the release pool was sized for has gone away, so shrink
+     * the release pool to the new limit and trim the stacks that are kept.
+     * Coroutines are only ever taken from the release pool as a whole, so
+     * it can be emptied and refilled while other threads use it.
+     */
+    qatomic_xchg(&release_pool_size, 0);
+    QSLIST_MOVE_ATOMIC(&idle, &release_pool);
+    QSLIST_FOREACH_SAFE(co, &idle, pool_next, tmp) {
+        QSLIST_REMOVE_HEAD(&idle, pool_next);
+        coroutine_release_idle(co);
+    }
+}
+
+void qemu_coroutine_get_pool_stats(CoroutinePoolStats *stats)
+{
+    stats->batch_size = qatomic_read(&pool_batch_size);
+    stats->allocated = stat64_get(&pool_allocated);
+    stats->freed = stat64_get(&pool_freed);
+    stats->trimmed = stat64_get(&pool_trimmed);
+}
+
 AioContext *coroutine_fn qemu_coroutine_get_aio_context(Coroutine *co)
 {
     return co->ctx;